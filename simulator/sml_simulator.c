@@ -20,6 +20,7 @@
 #include <sml_ann.h>
 #include <sml_fuzzy.h>
 #include <sml_naive.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -877,6 +878,53 @@ print_results(Context *ctx)
     printf("===============================\n");
 }
 
+static void
+print_stats(Context *ctx)
+{
+    static const char *timer_names[SML_STATS_TIMER_COUNT] = {
+        [SML_STATS_TIMER_READ_STATE] = "read_state_cb",
+        [SML_STATS_TIMER_MEMBERSHIP] = "membership",
+        [SML_STATS_TIMER_PREDICT] = "predict",
+        [SML_STATS_TIMER_OBSERVATION_HIT] = "observation hit",
+        [SML_STATS_TIMER_RULE_REBUILD] = "rule rebuild",
+        [SML_STATS_TIMER_ANN_TRAINING] = "ann training",
+        [SML_STATS_TIMER_SAVE] = "save",
+        [SML_STATS_TIMER_LOAD] = "load",
+    };
+    struct sml_stats stats;
+    int i, j;
+
+    if (!sml_get_stats(ctx->sml, &stats)) {
+        fprintf(stderr, "Failed to get sml stats\n");
+        return;
+    }
+
+    printf("===============================\n");
+    printf("Stats\n");
+    printf("Rules: %" PRIu32 "\n", stats.rules);
+    printf("Observation groups: %" PRIu32 "\n", stats.observation_groups);
+    printf("Trained ANNs: %" PRIu32 "\n", stats.trained_anns);
+    printf("Cache hits: %" PRIu64 " evictions: %" PRIu64 "\n",
+        stats.cache_hits, stats.cache_evictions);
+    printf("Timers (in us):\n");
+    for (i = 0; i < SML_STATS_TIMER_COUNT; i++) {
+        struct sml_stats_timer_data *timer = &stats.timers[i];
+
+        if (!timer->count)
+            continue;
+        printf("\t%s: count %" PRIu64 " avg %.2f max %" PRIu64 "\n",
+            timer_names[i], timer->count,
+            timer->total_usec / (double)timer->count, timer->max_usec);
+        printf("\t\thistogram:");
+        for (j = 0; j < SML_STATS_HISTOGRAM_BUCKETS; j++) {
+            if (timer->histogram[j])
+                printf(" <%u:%" PRIu64, 1u << j, timer->histogram[j]);
+        }
+        printf("\n");
+    }
+    printf("===============================\n");
+}
+
 static Variable *
 add_input(Context *ctx, const char *name, float min, float max)
 {
@@ -1320,8 +1368,10 @@ main(int argc, char *argv[])
             sml_ann_use_pseudorehearsal_strategy(ctx.sml, atoi(argv[8]) != 0);
     }
 
-    if (ctx.debug)
+    if (ctx.debug) {
         print_scenario(&ctx);
+        sml_set_stats_enabled(ctx.sml, true);
+    }
 
     ctx.max_iteration_duration = -1;
     total_tic = clock();
@@ -1345,6 +1395,8 @@ main(int argc, char *argv[])
         sml_print_debug(ctx.sml, true);
     }
     print_results(&ctx);
+    if (ctx.debug)
+        print_stats(&ctx);
 
     sml_free(ctx.sml);
 
@@ -26,19 +26,37 @@
 extern "C" {
 #endif
 struct sml_cache;
+struct sml_cache_node;
 typedef void (*sml_cache_element_free_cb)(void *element, void *data);
-struct sml_cache *sml_cache_new(uint16_t max_elements, sml_cache_element_free_cb free_cb, void *free_cb_data);
+struct sml_cache *sml_cache_new(uint32_t max_elements, sml_cache_element_free_cb free_cb, void *free_cb_data);
 bool sml_cache_put(struct sml_cache *cache, void *data);
 struct sol_ptr_vector *sml_cache_get_elements(struct sml_cache *cache);
 bool sml_cache_hit(struct sml_cache *cache, void *data);
 bool sml_cache_remove(struct sml_cache *cache, void *data);
-uint16_t sml_cache_get_size(struct sml_cache *cache);
+bool sml_cache_steal(struct sml_cache *cache, void *data);
+uint32_t sml_cache_get_size(struct sml_cache *cache);
 void sml_cache_free(struct sml_cache *cache);
 void sml_cache_clear(struct sml_cache *cache);
 unsigned int sml_cache_get_total_elements_inserted(struct sml_cache *cache);
-bool sml_cache_set_max_size(struct sml_cache *cache, uint16_t max_elements);
-bool sml_cache_remove_by_id(struct sml_cache *cache, uint16_t elem);
-void *sml_cache_get_element(struct sml_cache *cache, uint16_t elem);
+uint64_t sml_cache_get_hits(struct sml_cache *cache);
+uint64_t sml_cache_get_evictions(struct sml_cache *cache);
+bool sml_cache_set_max_size(struct sml_cache *cache, uint32_t max_elements);
+bool sml_cache_remove_by_id(struct sml_cache *cache, uint32_t elem);
+void *sml_cache_get_element(struct sml_cache *cache, uint32_t elem);
+
+struct sml_cache_node *sml_cache_get_first(struct sml_cache *cache);
+struct sml_cache_node *sml_cache_node_get_next(struct sml_cache_node *node);
+void *sml_cache_node_get_data(struct sml_cache_node *node);
+
+/*
+ * Iterates from the least to the most recently used element. It is safe to
+ * remove the current element while iterating.
+ */
+#define SML_CACHE_FOREACH_SAFE(cache, node, next, data) \
+    for (node = sml_cache_get_first(cache); \
+        node && (next = sml_cache_node_get_next(node), \
+        data = sml_cache_node_get_data(node), true); \
+        node = next)
 
 #ifdef __cplusplus
 }
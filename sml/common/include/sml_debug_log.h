@@ -0,0 +1,79 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sml.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary debug log. A file starts with a header followed by records. Each
+ * record is an opcode byte followed by a fixed payload in host byte order:
+ *
+ * START: (none). Written each time the file is opened, resets variable ids.
+ * VARIABLE, NEW_INPUT, NEW_OUTPUT: uint16_t id, uint8_t name_len, name
+ * SET_VALUE: uint16_t id, float value
+ * SET_ENABLED: uint16_t id, uint8_t enabled
+ * REMOVE_VARIABLE: uint16_t id
+ * SET_RANGE: uint16_t id, float min, float max
+ * LEARN_DISABLED: uint8_t disabled
+ * PROCESS, PREDICT, ERASE_KNOWLEDGE, READ_STATE, OUTPUT_STATE_CHANGED: (none)
+ *
+ * Variables are referred by ids. A VARIABLE record binds an id to the name
+ * of a variable that existed before it was first used in the log.
+ */
+enum sml_debug_log_op {
+    SML_DEBUG_LOG_OP_START = 1,
+    SML_DEBUG_LOG_OP_VARIABLE,
+    SML_DEBUG_LOG_OP_NEW_INPUT,
+    SML_DEBUG_LOG_OP_NEW_OUTPUT,
+    SML_DEBUG_LOG_OP_SET_VALUE,
+    SML_DEBUG_LOG_OP_SET_ENABLED,
+    SML_DEBUG_LOG_OP_REMOVE_VARIABLE,
+    SML_DEBUG_LOG_OP_SET_RANGE,
+    SML_DEBUG_LOG_OP_LEARN_DISABLED,
+    SML_DEBUG_LOG_OP_PROCESS,
+    SML_DEBUG_LOG_OP_PREDICT,
+    SML_DEBUG_LOG_OP_ERASE_KNOWLEDGE,
+    SML_DEBUG_LOG_OP_READ_STATE,
+    SML_DEBUG_LOG_OP_OUTPUT_STATE_CHANGED
+};
+
+struct sml_debug_log;
+
+struct sml_debug_log *sml_debug_log_open(struct sml_object *sml, const char *path);
+void sml_debug_log_close(struct sml_debug_log *log);
+void sml_debug_log_flush(struct sml_debug_log *log);
+void sml_debug_log_op(struct sml_debug_log *log, enum sml_debug_log_op op);
+void sml_debug_log_op_bool(struct sml_debug_log *log, enum sml_debug_log_op op, bool value);
+void sml_debug_log_variable_new(struct sml_debug_log *log, enum sml_debug_log_op op, struct sml_variable *var, const char *name);
+void sml_debug_log_variable_op(struct sml_debug_log *log, enum sml_debug_log_op op, struct sml_variable *var, const void *payload, size_t payload_len);
+
+bool sml_debug_log_is_binary(FILE *f);
+bool sml_debug_log_replay(struct sml_object *sml, FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
@@ -29,9 +29,12 @@
 extern "C" {
 #endif
 struct sml_engine;
+struct sml_debug_log;
+struct sml_variable_index;
 typedef bool (*sml_engine_load_file)(struct sml_engine *engine, const char *filename);
 typedef void (*sml_engine_free)(struct sml_engine *engine);
 typedef int (*sml_engine_process)(struct sml_engine *engine);
+typedef int (*sml_engine_process_batch)(struct sml_engine *engine, const float *inputs, const float *outputs, size_t rows, size_t stride);
 typedef bool (*sml_engine_predict)(struct sml_engine *engine);
 typedef bool (*sml_engine_save)(struct sml_engine *engine, const char *path);
 typedef bool (*sml_engine_load)(struct sml_engine *engine, const char *path);
@@ -49,19 +52,26 @@ typedef bool (*sml_engine_variable_is_enabled)(struct sml_variable *variable);
 typedef bool (*sml_engine_remove_variable)(struct sml_engine *engine, struct sml_variable *variable);
 typedef uint16_t (*sml_engine_variables_list_get_length)(struct sml_variables_list *list);
 typedef struct sml_variable *(*sml_engine_variables_list_index)(struct sml_variables_list *list, unsigned int index);
+typedef int (*sml_engine_variables_list_set_values)(struct sml_engine *engine, struct sml_variables_list *list, const float *values);
+typedef int (*sml_engine_variables_list_get_values)(struct sml_engine *engine, struct sml_variables_list *list, float *values);
+typedef int (*sml_engine_variables_list_bind_values)(struct sml_engine *engine, struct sml_variables_list *list, float *values);
 typedef bool (*sml_engine_variable_set_range)(struct sml_engine *engine, struct sml_variable *sml_variable, float min, float max);
 typedef bool (*sml_engine_variable_get_range)(struct sml_variable *sml_variable, float *min, float *max);
 typedef void (*sml_engine_print_debug)(struct sml_engine *engine, bool full);
 typedef bool (*sml_engine_erase_knowledge)(struct sml_engine *engine);
+typedef void (*sml_engine_get_stats)(struct sml_engine *engine, struct sml_stats *stats);
 
 int sml_call_read_state_cb(struct sml_engine *engine);
 void sml_call_output_state_changed_cb(struct sml_engine *engine, struct sml_variables_list *changed);
+uint64_t sml_stats_now(void);
+void sml_stats_record(struct sml_engine *engine, enum sml_stats_timer timer, uint64_t usec);
 
 struct sml_engine {
     /* General API */
     sml_engine_load_file load_file;
     sml_engine_free free;
     sml_engine_process process;
+    sml_engine_process_batch process_batch;
     sml_engine_predict predict;
     sml_engine_save save;
     sml_engine_load load;
@@ -82,13 +92,17 @@ struct sml_engine {
     sml_engine_remove_variable remove_variable;
     sml_engine_variables_list_get_length variables_list_get_length;
     sml_engine_variables_list_index variables_list_index;
+    sml_engine_variables_list_set_values variables_list_set_values;
+    sml_engine_variables_list_get_values variables_list_get_values;
+    sml_engine_variables_list_bind_values variables_list_bind_values;
     sml_engine_variable_set_range variable_set_range;
     sml_engine_variable_get_range variable_get_range;
 
     /* Debug API */
     sml_engine_print_debug print_debug;
+    sml_engine_get_stats get_stats;
 #ifdef Debug
-    FILE *debug_file;
+    struct sml_debug_log *debug_log;
 #endif
 
     uint32_t magic_number;
@@ -101,8 +115,34 @@ struct sml_engine {
     uint16_t stabilization_hits;
     uint16_t hits;
     unsigned int obs_max_size;
+    bool stats_enabled;
+    struct sml_stats stats;
+
+    /* Name lookups. The index is rebuilt from the variable lists on the
+       first lookup after it is invalidated. */
+    struct sml_variable_index *variable_index;
+    bool variable_index_valid;
+    bool variable_change_pending;
 };
 
+/* Timers are started and stopped inline, so a disabled collection costs
+   only a branch. A start of 0 means the timer was not started. */
+static inline uint64_t
+sml_stats_timer_start(struct sml_engine *engine)
+{
+    if (!engine->stats_enabled)
+        return 0;
+    return sml_stats_now();
+}
+
+static inline void
+sml_stats_timer_stop(struct sml_engine *engine, enum sml_stats_timer timer,
+    uint64_t start)
+{
+    if (start)
+        sml_stats_record(engine, timer, sml_stats_now() - start);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,42 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <sml.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * Maps variable names to variables. Inputs and outputs live in separate
+ * namespaces, as engines do not forbid an input and an output sharing
+ * the same name.
+ */
+struct sml_variable_index;
+struct sml_variable_index *sml_variable_index_new(void);
+void sml_variable_index_free(struct sml_variable_index *index);
+void sml_variable_index_clear(struct sml_variable_index *index);
+bool sml_variable_index_add(struct sml_variable_index *index, const char *name, bool output, struct sml_variable *var);
+bool sml_variable_index_remove(struct sml_variable_index *index, const char *name, bool output);
+struct sml_variable *sml_variable_index_get(struct sml_variable_index *index, const char *name, bool output);
+
+#ifdef __cplusplus
+}
+#endif
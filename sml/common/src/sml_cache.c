@@ -18,17 +18,43 @@
 
 #include "sml_cache.h"
 #include <config.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sml_log.h>
 
+#define MIN_BUCKETS (16)
+
+/*
+ * Elements are kept in a doubly-linked list ordered from the least
+ * recently used (head) to the most recently used (tail). A hash table keyed
+ * by the element pointer maps elements to their nodes, so hit and remove
+ * do not need to scan the list.
+ */
+struct sml_cache_node {
+    struct sml_cache_node *prev;
+    struct sml_cache_node *next;
+    struct sml_cache_node *bucket_next;
+    void *data;
+};
+
 struct sml_cache {
 #ifdef Debug
     unsigned int total;
 #endif
-    uint16_t max_elements;
+    uint32_t max_elements;
+    uint32_t count;
+    struct sml_cache_node *head;
+    struct sml_cache_node *tail;
+    struct sml_cache_node **buckets;
+    uint32_t buckets_size;
+    /* Snapshot returned by sml_cache_get_elements(), rebuilt on demand */
     struct sol_ptr_vector elements;
+    bool elements_dirty;
     sml_cache_element_free_cb free_cb;
     void *free_cb_data;
+    uint64_t hits;
+    uint64_t evictions;
 };
 
 unsigned int
@@ -43,44 +69,161 @@ sml_cache_get_total_elements_inserted(struct sml_cache *cache)
 #endif
 }
 
+uint64_t
+sml_cache_get_hits(struct sml_cache *cache)
+{
+    return cache->hits;
+}
+
+uint64_t
+sml_cache_get_evictions(struct sml_cache *cache)
+{
+    return cache->evictions;
+}
+
+static inline uint32_t
+_sml_cache_bucket(struct sml_cache *cache, void *data)
+{
+    uintptr_t key = (uintptr_t)data;
+
+    /* Pointers are aligned, mix the higher bits into the lower ones */
+    key ^= key >> 16;
+    key *= 0x45d9f3b;
+    key ^= key >> 16;
+    return key & (cache->buckets_size - 1);
+}
+
+static struct sml_cache_node *
+_sml_cache_find_node(struct sml_cache *cache, void *data)
+{
+    struct sml_cache_node *node;
+
+    if (!cache->buckets)
+        return NULL;
+
+    for (node = cache->buckets[_sml_cache_bucket(cache, data)]; node;
+        node = node->bucket_next) {
+        if (node->data == data)
+            return node;
+    }
+    return NULL;
+}
+
 static bool
-_sml_cache_find_index_by_data(struct sol_ptr_vector *elements, void *data,
-    uint16_t *idx)
+_sml_cache_buckets_grow_if_needed(struct sml_cache *cache)
 {
-    uint16_t i;
-    void *v;
+    struct sml_cache_node **buckets, *node;
+    uint32_t size, i;
 
-    SOL_PTR_VECTOR_FOREACH_IDX (elements, v, i) {
-        if (v == data) {
-            *idx = i;
-            return true;
+    if (cache->buckets && cache->count < cache->buckets_size)
+        return true;
+
+    size = cache->buckets_size ? cache->buckets_size * 2 : MIN_BUCKETS;
+    buckets = calloc(size, sizeof(struct sml_cache_node *));
+    if (!buckets) {
+        sml_critical("Could not alloc the cache index");
+        return false;
+    }
+
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->buckets_size = size;
+    for (node = cache->head; node; node = node->next) {
+        i = _sml_cache_bucket(cache, node->data);
+        node->bucket_next = buckets[i];
+        buckets[i] = node;
+    }
+    return true;
+}
+
+static void
+_sml_cache_bucket_unlink(struct sml_cache *cache, struct sml_cache_node *node)
+{
+    struct sml_cache_node **itr;
+
+    for (itr = &cache->buckets[_sml_cache_bucket(cache, node->data)]; *itr;
+        itr = &(*itr)->bucket_next) {
+        if (*itr == node) {
+            *itr = node->bucket_next;
+            return;
         }
     }
-    return false;
 }
 
-bool
-sml_cache_set_max_size(struct sml_cache *cache, uint16_t max_elements)
+static void
+_sml_cache_list_unlink(struct sml_cache *cache, struct sml_cache_node *node)
+{
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        cache->head = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    else
+        cache->tail = node->prev;
+    node->prev = node->next = NULL;
+}
+
+static void
+_sml_cache_list_append(struct sml_cache *cache, struct sml_cache_node *node)
+{
+    node->prev = cache->tail;
+    node->next = NULL;
+    if (cache->tail)
+        cache->tail->next = node;
+    else
+        cache->head = node;
+    cache->tail = node;
+}
+
+static void *
+_sml_cache_node_del(struct sml_cache *cache, struct sml_cache_node *node)
+{
+    void *data = node->data;
+
+    _sml_cache_bucket_unlink(cache, node);
+    _sml_cache_list_unlink(cache, node);
+    free(node);
+    cache->count--;
+    cache->elements_dirty = true;
+    return data;
+}
+
+static struct sml_cache_node *
+_sml_cache_node_get(struct sml_cache *cache, uint32_t elem)
 {
-    void *to_del;
+    struct sml_cache_node *node;
 
+    if (elem >= cache->count)
+        return NULL;
+
+    if (elem < cache->count / 2) {
+        for (node = cache->head; elem; elem--)
+            node = node->next;
+    } else {
+        for (node = cache->tail, elem = cache->count - elem - 1; elem; elem--)
+            node = node->prev;
+    }
+    return node;
+}
+
+bool
+sml_cache_set_max_size(struct sml_cache *cache, uint32_t max_elements)
+{
     if (!max_elements || cache->max_elements == max_elements)
         return true;
 
     cache->max_elements = max_elements;
-    while (sol_ptr_vector_get_len(&cache->elements) > max_elements) {
-        to_del = sol_ptr_vector_steal(&cache->elements, 0);
-        if (!to_del) {
-            sml_critical("Could not remove an element from the cache!");
-            return false;
-        }
-        cache->free_cb(to_del, cache->free_cb_data);
+    while (cache->count > max_elements) {
+        cache->free_cb(_sml_cache_node_del(cache, cache->head),
+            cache->free_cb_data);
+        cache->evictions++;
     }
     return true;
 }
 
 struct sml_cache *
-sml_cache_new(uint16_t max_elements, sml_cache_element_free_cb free_cb,
+sml_cache_new(uint32_t max_elements, sml_cache_element_free_cb free_cb,
     void *free_cb_data)
 {
     struct sml_cache *cache;
@@ -100,22 +243,34 @@ sml_cache_new(uint16_t max_elements, sml_cache_element_free_cb free_cb,
 bool
 sml_cache_put(struct sml_cache *cache, void *data)
 {
-    uint16_t count = sol_ptr_vector_get_len(&cache->elements);
-    void *to_del;
+    struct sml_cache_node *node;
+    uint32_t i;
 
-    if (cache->max_elements && count == cache->max_elements) {
-        to_del = sol_ptr_vector_steal(&cache->elements, 0);
-        if (!to_del) {
-            sml_critical("Could not remove the oldest element in the cache");
-            return false;
-        }
-        cache->free_cb(to_del, cache->free_cb_data);
+    if (cache->max_elements && cache->count == cache->max_elements) {
+        cache->free_cb(_sml_cache_node_del(cache, cache->head),
+            cache->free_cb_data);
+        cache->evictions++;
     }
 
-    if (sol_ptr_vector_append(&cache->elements, data)) {
+    if (!_sml_cache_buckets_grow_if_needed(cache))
+        return false;
+
+    node = calloc(1, sizeof(struct sml_cache_node));
+    if (!node) {
         sml_critical("Could not add element to the cache");
         return false;
     }
+
+    node->data = data;
+    i = _sml_cache_bucket(cache, data);
+    node->bucket_next = cache->buckets[i];
+    cache->buckets[i] = node;
+    _sml_cache_list_append(cache, node);
+    cache->count++;
+
+    if (!cache->elements_dirty &&
+        sol_ptr_vector_append(&cache->elements, data))
+        cache->elements_dirty = true;
 #ifdef Debug
     cache->total++;
 #endif
@@ -125,15 +280,17 @@ sml_cache_put(struct sml_cache *cache, void *data)
 bool
 sml_cache_hit(struct sml_cache *cache, void *data)
 {
-    uint16_t i;
+    struct sml_cache_node *node;
 
-    if (!_sml_cache_find_index_by_data(&cache->elements, data, &i))
+    node = _sml_cache_find_node(cache, data);
+    if (!node)
         return false;
 
-    if (sol_ptr_vector_del(&cache->elements, i) ||
-        sol_ptr_vector_append(&cache->elements, data)) {
-        sml_critical("Could not relocate the element in the cache");
-        return false;
+    cache->hits++;
+    if (node != cache->tail) {
+        _sml_cache_list_unlink(cache, node);
+        _sml_cache_list_append(cache, node);
+        cache->elements_dirty = true;
     }
     return true;
 }
@@ -141,64 +298,134 @@ sml_cache_hit(struct sml_cache *cache, void *data)
 bool
 sml_cache_remove(struct sml_cache *cache, void *data)
 {
-    uint16_t i;
+    if (!sml_cache_steal(cache, data))
+        return false;
+
+    cache->free_cb(data, cache->free_cb_data);
+    return true;
+}
+
+bool
+sml_cache_steal(struct sml_cache *cache, void *data)
+{
+    struct sml_cache_node *node;
 
-    if (!_sml_cache_find_index_by_data(&cache->elements, data, &i)) {
+    node = _sml_cache_find_node(cache, data);
+    if (!node) {
         sml_critical("Could not find the index for data: %p", data);
         return false;
     }
 
-    sol_ptr_vector_del(&cache->elements, i);
-    cache->free_cb(data, cache->free_cb_data);
+    _sml_cache_node_del(cache, node);
     return true;
 }
 
 struct sol_ptr_vector *
 sml_cache_get_elements(struct sml_cache *cache)
 {
+    struct sml_cache_node *node;
+
+    if (!cache->elements_dirty)
+        return &cache->elements;
+
+    if (cache->count > UINT16_MAX)
+        sml_warning("Cache has %" PRIu32 " elements, only the %d most "
+            "recently used are listed", cache->count, UINT16_MAX);
+
+    sol_ptr_vector_clear(&cache->elements);
+    for (node = _sml_cache_node_get(cache,
+        cache->count > UINT16_MAX ? cache->count - UINT16_MAX : 0);
+        node; node = node->next) {
+        if (sol_ptr_vector_append(&cache->elements, node->data)) {
+            sml_critical("Could not list the cache elements");
+            sol_ptr_vector_clear(&cache->elements);
+            return &cache->elements;
+        }
+    }
+    cache->elements_dirty = false;
     return &cache->elements;
 }
 
-uint16_t
+uint32_t
 sml_cache_get_size(struct sml_cache *cache)
 {
-    return sol_ptr_vector_get_len(&cache->elements);
+    return cache->count;
 }
 
 void
 sml_cache_free(struct sml_cache *cache)
 {
     sml_cache_clear(cache);
+    free(cache->buckets);
     free(cache);
 }
 
 void
 sml_cache_clear(struct sml_cache *cache)
 {
-    uint16_t i;
-    void *v;
+    struct sml_cache_node *node, *next;
 
-    SOL_PTR_VECTOR_FOREACH_IDX (&cache->elements, v, i)
-        cache->free_cb(v, cache->free_cb_data);
+    for (node = cache->head; node; node = next) {
+        next = node->next;
+        cache->free_cb(node->data, cache->free_cb_data);
+        free(node);
+    }
+    cache->head = cache->tail = NULL;
+    cache->count = 0;
+    if (cache->buckets)
+        memset(cache->buckets, 0,
+            cache->buckets_size * sizeof(struct sml_cache_node *));
     sol_ptr_vector_clear(&cache->elements);
+    cache->elements_dirty = false;
 }
 
 bool
-sml_cache_remove_by_id(struct sml_cache *cache, uint16_t elem)
+sml_cache_remove_by_id(struct sml_cache *cache, uint32_t elem)
 {
-    void *to_del;
+    struct sml_cache_node *node;
+    bool dirty = cache->elements_dirty;
+    void *data;
 
-    to_del = sol_ptr_vector_steal(&cache->elements, elem);
-    if (!to_del) {
+    node = _sml_cache_node_get(cache, elem);
+    if (!node) {
         sml_critical("Could not remove the oldest element in the cache");
         return false;
     }
-    cache->free_cb(to_del, cache->free_cb_data);
+
+    data = _sml_cache_node_del(cache, node);
+    /* Keep the listed elements in sync, callers may be iterating on them */
+    if (!dirty && cache->count < UINT16_MAX &&
+        !sol_ptr_vector_del(&cache->elements, elem))
+        cache->elements_dirty = false;
+    cache->free_cb(data, cache->free_cb_data);
     return true;
 }
 
 void *
-sml_cache_get_element(struct sml_cache *cache, uint16_t elem)
+sml_cache_get_element(struct sml_cache *cache, uint32_t elem)
+{
+    struct sml_cache_node *node;
+
+    node = _sml_cache_node_get(cache, elem);
+    if (!node)
+        return NULL;
+    return node->data;
+}
+
+struct sml_cache_node *
+sml_cache_get_first(struct sml_cache *cache)
+{
+    return cache->head;
+}
+
+struct sml_cache_node *
+sml_cache_node_get_next(struct sml_cache_node *node)
+{
+    return node->next;
+}
+
+void *
+sml_cache_node_get_data(struct sml_cache_node *node)
 {
-    return sol_ptr_vector_get(&cache->elements, elem);
+    return node->data;
 }
@@ -0,0 +1,544 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sml_debug_log.h"
+#include "sml_util.h"
+#include <config.h>
+#include <macros.h>
+#include <sml_log.h>
+#include <sol-vector.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAGIC "SMLD"
+#define VERSION (1)
+#define BYTE_ORDER_MARK (0x0102)
+#define BUFFER_SIZE (64 * 1024)
+#define MIN_BUCKETS (16)
+#define NO_ID (UINT16_MAX)
+
+struct sml_debug_log_header {
+    char magic[4];
+    uint8_t version;
+    uint8_t float_size;
+    uint16_t byte_order_mark;
+};
+
+/* Records are kept in memory and only written when the buffer is full,
+   the log is closed or it is explicitly flushed. */
+struct sml_debug_log {
+    FILE *f;
+    struct sml_object *sml;
+    /* Index is the variable id. Removed variables are set to NULL. */
+    struct sol_ptr_vector vars;
+    /* Hash table keyed by the variable pointer, chained through
+       next_ids. Ids are never reused, so removed variables are left in
+       their chains and never match. */
+    uint16_t *buckets;
+    uint16_t *next_ids;
+    uint32_t buckets_size;
+    size_t len;
+    uint8_t buf[BUFFER_SIZE];
+};
+
+struct sml_debug_log_reader {
+    FILE *f;
+    size_t pos;
+    size_t len;
+    uint8_t buf[BUFFER_SIZE];
+};
+
+static void
+_header_init(struct sml_debug_log_header *header)
+{
+    memcpy(header->magic, MAGIC, sizeof(header->magic));
+    header->version = VERSION;
+    header->float_size = sizeof(float);
+    header->byte_order_mark = BYTE_ORDER_MARK;
+}
+
+void
+sml_debug_log_flush(struct sml_debug_log *log)
+{
+    if (!log->len)
+        return;
+
+    if (fwrite(log->buf, 1, log->len, log->f) < log->len)
+        sml_warning("Could not write %zu bytes to the debug log", log->len);
+    fflush(log->f);
+    log->len = 0;
+}
+
+static void
+_write(struct sml_debug_log *log, const void *data, size_t len)
+{
+    if (log->len + len > sizeof(log->buf))
+        sml_debug_log_flush(log);
+    memcpy(log->buf + log->len, data, len);
+    log->len += len;
+}
+
+static void
+_write_u8(struct sml_debug_log *log, uint8_t value)
+{
+    _write(log, &value, sizeof(value));
+}
+
+/* The reader rejects longer names */
+static bool
+_variable_name_is_valid(const char *name)
+{
+    if (strlen(name) <= SML_VARIABLE_NAME_MAX_LEN)
+        return true;
+    sml_warning("Variable name %s is too long, not logging it", name);
+    return false;
+}
+
+static void
+_write_variable(struct sml_debug_log *log, enum sml_debug_log_op op,
+    uint16_t id, const char *name)
+{
+    uint8_t name_len = strlen(name);
+
+    _write_u8(log, op);
+    _write(log, &id, sizeof(id));
+    _write_u8(log, name_len);
+    _write(log, name, name_len);
+}
+
+static inline uint32_t
+_variable_bucket(uint32_t buckets_size, struct sml_variable *var)
+{
+    uintptr_t key = (uintptr_t)var;
+
+    /* Pointers are aligned, mix the higher bits into the lower ones */
+    key ^= key >> 16;
+    key *= 0x45d9f3b;
+    key ^= key >> 16;
+    return key & (buckets_size - 1);
+}
+
+static bool
+_buckets_grow_if_needed(struct sml_debug_log *log, uint16_t len)
+{
+    uint16_t *buckets, *next_ids, id;
+    uint32_t size, i;
+
+    if (len < log->buckets_size)
+        return true;
+
+    size = log->buckets_size ? log->buckets_size * 2 : MIN_BUCKETS;
+    next_ids = realloc(log->next_ids, sizeof(uint16_t) * size);
+    if (!next_ids) {
+        sml_critical("Could not grow the debug log variables index");
+        return false;
+    }
+    log->next_ids = next_ids;
+
+    buckets = malloc(sizeof(uint16_t) * size);
+    if (!buckets) {
+        sml_critical("Could not grow the debug log variables index");
+        return false;
+    }
+    for (i = 0; i < size; i++)
+        buckets[i] = NO_ID;
+    for (id = 0; id < len; id++) {
+        i = _variable_bucket(size, sol_ptr_vector_get(&log->vars, id));
+        next_ids[id] = buckets[i];
+        buckets[i] = id;
+    }
+    free(log->buckets);
+    log->buckets = buckets;
+    log->buckets_size = size;
+    return true;
+}
+
+static int
+_variable_id_add(struct sml_debug_log *log, struct sml_variable *var)
+{
+    uint16_t id = sol_ptr_vector_get_len(&log->vars);
+    uint32_t i;
+
+    if (id == NO_ID) {
+        sml_warning("Too many variables in the debug log");
+        return -1;
+    }
+    if (!_buckets_grow_if_needed(log, id))
+        return -1;
+    if (sol_ptr_vector_append(&log->vars, var))
+        return -1;
+
+    i = _variable_bucket(log->buckets_size, var);
+    log->next_ids[id] = log->buckets[i];
+    log->buckets[i] = id;
+    return id;
+}
+
+static int
+_variable_id_get(struct sml_debug_log *log, struct sml_variable *var)
+{
+    char name[SML_VARIABLE_NAME_MAX_LEN + 1];
+    uint16_t i;
+    int id;
+
+    if (log->buckets) {
+        for (i = log->buckets[_variable_bucket(log->buckets_size, var)];
+            i != NO_ID; i = log->next_ids[i]) {
+            if (sol_ptr_vector_get(&log->vars, i) == var)
+                return i;
+        }
+    }
+
+    //Variable was created before the log was opened
+    if (sml_variable_get_name(log->sml, var, name, sizeof(name)) ||
+        !_variable_name_is_valid(name))
+        return -1;
+    id = _variable_id_add(log, var);
+    if (id >= 0)
+        _write_variable(log, SML_DEBUG_LOG_OP_VARIABLE, id, name);
+    return id;
+}
+
+/* Text logs of previous versions, or binary logs of other platforms, can
+   not be appended to. They are kept aside and a new log is started. */
+static FILE *
+_debug_log_replace(const char *path)
+{
+    char old_path[SML_PATH_MAX];
+    FILE *f;
+
+    if (snprintf(old_path, sizeof(old_path), "%s.old", path) >=
+        (int)sizeof(old_path) || rename(path, old_path)) {
+        sml_critical("%s is not a debug log of this platform and could not" \
+            " be moved", path);
+        return NULL;
+    }
+    sml_warning("%s is not a debug log of this platform, moved to %s", path,
+        old_path);
+
+    f = fopen(path, "a+b");
+    if (!f)
+        sml_critical("Could not open the debug log %s", path);
+    return f;
+}
+
+struct sml_debug_log *
+sml_debug_log_open(struct sml_object *sml, const char *path)
+{
+    struct sml_debug_log_header header, expected;
+    struct sml_debug_log *log;
+
+    log = malloc(sizeof(struct sml_debug_log));
+    if (!log) {
+        sml_critical("Could not alloc the debug log");
+        return NULL;
+    }
+
+    log->f = fopen(path, "a+b");
+    if (!log->f) {
+        sml_critical("Could not open the debug log %s", path);
+        goto error_open;
+    }
+
+    _header_init(&expected);
+    if (fseek(log->f, 0, SEEK_END) || ftell(log->f) < 0)
+        goto error;
+    if (ftell(log->f) > 0) {
+        rewind(log->f);
+        if (fread(&header, sizeof(header), 1, log->f) < 1 ||
+            memcmp(&header, &expected, sizeof(header))) {
+            fclose(log->f);
+            log->f = _debug_log_replace(path);
+            if (!log->f)
+                goto error_open;
+        }
+    }
+    if (fseek(log->f, 0, SEEK_END) || ftell(log->f) < 0)
+        goto error;
+    if (ftell(log->f) == 0 &&
+        fwrite(&expected, sizeof(expected), 1, log->f) < 1)
+        goto error;
+
+    log->sml = sml;
+    log->len = 0;
+    log->buckets = NULL;
+    log->next_ids = NULL;
+    log->buckets_size = 0;
+    sol_ptr_vector_init(&log->vars);
+    _write_u8(log, SML_DEBUG_LOG_OP_START);
+    return log;
+
+error:
+    fclose(log->f);
+error_open:
+    free(log);
+    return NULL;
+}
+
+void
+sml_debug_log_close(struct sml_debug_log *log)
+{
+    sml_debug_log_flush(log);
+    fclose(log->f);
+    sol_ptr_vector_clear(&log->vars);
+    free(log->buckets);
+    free(log->next_ids);
+    free(log);
+}
+
+void
+sml_debug_log_op(struct sml_debug_log *log, enum sml_debug_log_op op)
+{
+    _write_u8(log, op);
+}
+
+void
+sml_debug_log_op_bool(struct sml_debug_log *log, enum sml_debug_log_op op,
+    bool value)
+{
+    _write_u8(log, op);
+    _write_u8(log, value);
+}
+
+void
+sml_debug_log_variable_new(struct sml_debug_log *log,
+    enum sml_debug_log_op op, struct sml_variable *var, const char *name)
+{
+    int id;
+
+    if (!var || !_variable_name_is_valid(name))
+        return;
+
+    id = _variable_id_add(log, var);
+    if (id >= 0)
+        _write_variable(log, op, id, name);
+}
+
+void
+sml_debug_log_variable_op(struct sml_debug_log *log, enum sml_debug_log_op op,
+    struct sml_variable *var, const void *payload, size_t payload_len)
+{
+    uint16_t id;
+    int r;
+
+    r = _variable_id_get(log, var);
+    if (r < 0)
+        return;
+
+    id = r;
+    _write_u8(log, op);
+    _write(log, &id, sizeof(id));
+    if (payload_len)
+        _write(log, payload, payload_len);
+
+    if (op == SML_DEBUG_LOG_OP_REMOVE_VARIABLE)
+        sol_ptr_vector_set(&log->vars, id, NULL);
+}
+
+bool
+sml_debug_log_is_binary(FILE *f)
+{
+    struct sml_debug_log_header header, expected;
+
+    _header_init(&expected);
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        !memcmp(&header, &expected, sizeof(header)))
+        return true;
+
+    rewind(f);
+    return false;
+}
+
+static bool
+_read(struct sml_debug_log_reader *reader, void *data, size_t len)
+{
+    size_t n;
+    uint8_t *dst = data;
+
+    while (len) {
+        if (reader->pos == reader->len) {
+            reader->len = fread(reader->buf, 1, sizeof(reader->buf),
+                reader->f);
+            reader->pos = 0;
+            if (!reader->len)
+                return false;
+        }
+        n = reader->len - reader->pos;
+        if (n > len)
+            n = len;
+        memcpy(dst, reader->buf + reader->pos, n);
+        reader->pos += n;
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool
+_read_variable(struct sml_debug_log_reader *reader, uint16_t *id, char *name)
+{
+    uint8_t name_len;
+
+    if (!_read(reader, id, sizeof(*id)) ||
+        !_read(reader, &name_len, sizeof(name_len)) ||
+        name_len > SML_VARIABLE_NAME_MAX_LEN ||
+        !_read(reader, name, name_len))
+        return false;
+    name[name_len] = '\0';
+    return true;
+}
+
+static bool
+_variable_set(struct sol_ptr_vector *vars, uint16_t id,
+    struct sml_variable *var)
+{
+    while (sol_ptr_vector_get_len(vars) <= id)
+        if (sol_ptr_vector_append(vars, NULL))
+            return false;
+    return sol_ptr_vector_set(vars, id, var) == 0;
+}
+
+static struct sml_variable *
+_variable_get(struct sol_ptr_vector *vars, uint16_t id)
+{
+    if (id >= sol_ptr_vector_get_len(vars))
+        return NULL;
+    return sol_ptr_vector_get_no_check(vars, id);
+}
+
+/* The reader must be positioned after the header. */
+bool
+sml_debug_log_replay(struct sml_object *sml, FILE *f)
+{
+    struct sml_debug_log_reader *reader;
+    struct sol_ptr_vector vars = SOL_PTR_VECTOR_INIT;
+    char name[SML_VARIABLE_NAME_MAX_LEN + 1];
+    struct sml_variable *var;
+    uint8_t op, u8_val;
+    float values[2];
+    uint16_t id;
+    bool r = false;
+
+    reader = malloc(sizeof(struct sml_debug_log_reader));
+    if (!reader) {
+        sml_critical("Could not alloc the debug log reader");
+        return false;
+    }
+    reader->f = f;
+    reader->pos = reader->len = 0;
+
+    while (_read(reader, &op, sizeof(op))) {
+        switch (op) {
+        case SML_DEBUG_LOG_OP_START:
+            sol_ptr_vector_clear(&vars);
+            break;
+        case SML_DEBUG_LOG_OP_VARIABLE:
+            if (!_read_variable(reader, &id, name))
+                goto truncated;
+            var = sml_get_input(sml, name);
+            if (!var)
+                var = sml_get_output(sml, name);
+            if (!_variable_set(&vars, id, var))
+                goto exit;
+            break;
+        case SML_DEBUG_LOG_OP_NEW_INPUT:
+        case SML_DEBUG_LOG_OP_NEW_OUTPUT:
+            if (!_read_variable(reader, &id, name))
+                goto truncated;
+            if (op == SML_DEBUG_LOG_OP_NEW_INPUT)
+                var = sml_new_input(sml, name);
+            else
+                var = sml_new_output(sml, name);
+            if (!var) {
+                sml_error("Could not create the variable %s", name);
+                goto exit;
+            }
+            if (!_variable_set(&vars, id, var))
+                goto exit;
+            break;
+        case SML_DEBUG_LOG_OP_SET_VALUE:
+            if (!_read(reader, &id, sizeof(id)) ||
+                !_read(reader, values, sizeof(float)))
+                goto truncated;
+            var = _variable_get(&vars, id);
+            if (var)
+                sml_variable_set_value(sml, var, values[0]);
+            break;
+        case SML_DEBUG_LOG_OP_SET_ENABLED:
+            if (!_read(reader, &id, sizeof(id)) ||
+                !_read(reader, &u8_val, sizeof(u8_val)))
+                goto truncated;
+            var = _variable_get(&vars, id);
+            if (var)
+                sml_variable_set_enabled(sml, var, !!u8_val);
+            break;
+        case SML_DEBUG_LOG_OP_REMOVE_VARIABLE:
+            if (!_read(reader, &id, sizeof(id)))
+                goto truncated;
+            var = _variable_get(&vars, id);
+            if (var) {
+                sml_remove_variable(sml, var);
+                sol_ptr_vector_set(&vars, id, NULL);
+            }
+            break;
+        case SML_DEBUG_LOG_OP_SET_RANGE:
+            if (!_read(reader, &id, sizeof(id)) ||
+                !_read(reader, values, sizeof(values)))
+                goto truncated;
+            var = _variable_get(&vars, id);
+            if (var)
+                sml_variable_set_range(sml, var, values[0], values[1]);
+            break;
+        case SML_DEBUG_LOG_OP_LEARN_DISABLED:
+            if (!_read(reader, &u8_val, sizeof(u8_val)))
+                goto truncated;
+            sml_set_learn_disabled(sml, !!u8_val);
+            break;
+        case SML_DEBUG_LOG_OP_PROCESS:
+            if (sml_process(sml)) {
+                sml_error("Could not execute process");
+                goto exit;
+            }
+            break;
+        case SML_DEBUG_LOG_OP_PREDICT:
+            sml_predict(sml);
+            break;
+        case SML_DEBUG_LOG_OP_ERASE_KNOWLEDGE:
+            sml_erase_knowledge(sml);
+            break;
+        case SML_DEBUG_LOG_OP_READ_STATE:
+        case SML_DEBUG_LOG_OP_OUTPUT_STATE_CHANGED:
+            break;
+        default:
+            sml_error("Unknown debug log opcode %d", op);
+            goto exit;
+        }
+    }
+
+    r = true;
+    goto exit;
+
+truncated:
+    sml_warning("Debug log ends in the middle of a record");
+    r = true;
+exit:
+    sol_ptr_vector_clear(&vars);
+    free(reader);
+    return r;
+}
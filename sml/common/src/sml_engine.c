@@ -21,6 +21,7 @@
 #include <sml_log.h>
 #include <macros.h>
 #include <sml_engine.h>
+#include <sml_variable_index.h>
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
@@ -28,36 +29,46 @@
 #include <errno.h>
 #include <config.h>
 #include <stdarg.h>
+#include <time.h>
+#ifdef Debug
+#include <sml_debug_log.h>
+#endif
 
 #define LINE_SIZE (256)
 #define STR_FORMAT(WIDTH) "%" #WIDTH "s"
 #define STR_FMT(W) STR_FORMAT(W)
 
 #ifdef Debug
-#define SML_LOG_DEBUG_DATA(engine, ...)                     \
+#define SML_LOG_DEBUG_DATA(engine, op)                      \
     do {                                                    \
-        if (engine->debug_file) {                           \
-            fprintf(engine->debug_file, __VA_ARGS__);       \
-            fflush(engine->debug_file);                     \
-        }                                                   \
+        if (engine->debug_log)                              \
+            sml_debug_log_op(engine->debug_log, op);        \
     } while (0)
 
-#define SML_LOG_DEBUG_DATA_VAR(engine, prefix, fmt, var, ...)                 \
-    do {                                                                      \
-        if (engine->debug_file)                                               \
-            sml_log_debug_data_var(engine, prefix, fmt, var, ## __VA_ARGS__); \
+#define SML_LOG_DEBUG_DATA_BOOL(engine, op, value)                  \
+    do {                                                            \
+        if (engine->debug_log)                                      \
+            sml_debug_log_op_bool(engine->debug_log, op, value);    \
     } while (0)
 
-#define SML_LOG_DEBUG_DATA_LIST(engine, prefix, list, ...)                   \
+#define SML_LOG_DEBUG_DATA_NEW_VAR(engine, op, var, name)                    \
     do {                                                                     \
-        if (engine->debug_file)                                              \
-            sml_log_debug_data_list(engine, prefix, list, ## __VA_ARGS__);   \
+        if (engine->debug_log)                                               \
+            sml_debug_log_variable_new(engine->debug_log, op, var, name);    \
+    } while (0)
+
+#define SML_LOG_DEBUG_DATA_VAR(engine, op, var, payload, payload_len)         \
+    do {                                                                      \
+        if (engine->debug_log)                                                \
+            sml_debug_log_variable_op(engine->debug_log, op, var, payload,    \
+                payload_len);                                                 \
     } while (0)
 
 #else
 #define SML_LOG_DEBUG_DATA(...)
+#define SML_LOG_DEBUG_DATA_BOOL(...)
+#define SML_LOG_DEBUG_DATA_NEW_VAR(...)
 #define SML_LOG_DEBUG_DATA_VAR(...)
-#define SML_LOG_DEBUG_DATA_LIST(...)
 #endif
 
 static bool
@@ -110,45 +121,122 @@ _default_load_fll_file(struct sml_object *engine, const char *filename)
     return true;
 }
 
-#ifdef Debug
-void
-sml_log_debug_data_var(struct sml_engine *engine, const char *prefix,
-    const char *fmt, struct sml_variable *var, ...)
+/*
+ * The variable index is a complete map of the engine variables while
+ * variable_index_valid is set. Engines may create or destroy variables on
+ * their own (loading files, deferred additions and removals), so every path
+ * that may do it just invalidates the index and the next lookup rebuilds it.
+ */
+static bool
+_variable_index_add_list(struct sml_engine *engine,
+    struct sml_variables_list *list, bool output)
 {
-    int r;
-    va_list args;
-    char name[SML_VARIABLE_NAME_MAX_LEN + 1];
+    struct sml_variable *var;
+    char name[SML_VARIABLE_NAME_MAX_LEN];
+    uint16_t i, len;
 
-    va_start(args, var);
-    r = sml_variable_get_name((struct sml_object *)engine, var, name,
-        sizeof(name));
-    if (r == 0) {
-        fprintf(engine->debug_file, "%s %s ", prefix, name);
-        vfprintf(engine->debug_file, fmt, args);
-        fflush(engine->debug_file);
+    if (!list)
+        return true;
+
+    len = engine->variables_list_get_length(list);
+    for (i = 0; i < len; i++) {
+        var = engine->variables_list_index(list, i);
+        if (!var || engine->get_name(var, name, sizeof(name)))
+            return false;
+        if (!sml_variable_index_add(engine->variable_index, name, output, var))
+            return false;
     }
-    va_end(args);
+    return true;
 }
 
-void
-sml_log_debug_data_list(struct sml_engine *engine, const char *prefix,
-    struct sml_variables_list *list)
+static bool
+_variable_index_update(struct sml_engine *engine)
 {
-    int r;
-    uint16_t len, i;
-    struct sml_variable *var;
-    char name[SML_VARIABLE_NAME_MAX_LEN + 1];
+    if (engine->variable_index_valid)
+        return true;
+
+    if (!engine->get_input_list || !engine->get_output_list ||
+        !engine->variables_list_get_length || !engine->variables_list_index ||
+        !engine->get_name)
+        return false;
 
-    SML_VARIABLES_LIST_FOREACH((struct sml_object *)engine, list, len, var, i) {
-        r = sml_variable_get_name((struct sml_object *)engine, var, name,
-            sizeof(name));
-        if (r == 0)
-            fprintf(engine->debug_file, "%s %s %f\n", prefix, name,
-                sml_variable_get_value((struct sml_object *)engine, var));
+    if (!engine->variable_index) {
+        engine->variable_index = sml_variable_index_new();
+        if (!engine->variable_index)
+            return false;
+    } else
+        sml_variable_index_clear(engine->variable_index);
+
+    if (!_variable_index_add_list(engine, engine->get_input_list(engine),
+        false) ||
+        !_variable_index_add_list(engine, engine->get_output_list(engine),
+        true)) {
+        sml_variable_index_clear(engine->variable_index);
+        return false;
     }
-    fflush(engine->debug_file);
+
+    engine->variable_index_valid = true;
+    return true;
+}
+
+/*
+ * Engines like ANN keep new variables out of the input/output lists until the
+ * next process call, so only index the variable if the lists already have it.
+ * Otherwise the index is rebuilt once the engine moved it.
+ */
+static void
+_variable_index_add(struct sml_engine *engine, const char *name, bool output,
+    struct sml_variable *var)
+{
+    struct sml_variables_list *list;
+    uint16_t len;
+
+    /* Can't tell if the lists have it, rebuild after the next process call */
+    if (!engine->variable_index_valid) {
+        engine->variable_change_pending = true;
+        return;
+    }
+
+    list = output ? engine->get_output_list(engine) :
+        engine->get_input_list(engine);
+    len = list ? engine->variables_list_get_length(list) : 0;
+    if (!len || engine->variables_list_index(list, len - 1) != var) {
+        engine->variable_change_pending = true;
+        engine->variable_index_valid = false;
+        return;
+    }
+    if (!sml_variable_index_add(engine->variable_index, name, output, var))
+        engine->variable_index_valid = false;
+}
+
+static void
+_variable_index_remove(struct sml_engine *engine, struct sml_variable *var)
+{
+    char name[SML_VARIABLE_NAME_MAX_LEN];
+
+    /* Engines may only drop the variable on the next process call */
+    engine->variable_change_pending = true;
+    if (!engine->variable_index_valid)
+        return;
+
+    if (!engine->get_name || engine->get_name(var, name, sizeof(name))) {
+        engine->variable_index_valid = false;
+        return;
+    }
+    if (sml_variable_index_get(engine->variable_index, name, false) == var)
+        sml_variable_index_remove(engine->variable_index, name, false);
+    else if (sml_variable_index_get(engine->variable_index, name, true) == var)
+        sml_variable_index_remove(engine->variable_index, name, true);
+}
+
+static void
+_variable_index_handle_changes(struct sml_engine *engine)
+{
+    if (!engine->variable_change_pending)
+        return;
+    engine->variable_change_pending = false;
+    engine->variable_index_valid = false;
 }
-#endif
 
 API_EXPORT bool
 sml_load_fll_file(struct sml_object *sml, const char *filename)
@@ -156,6 +244,7 @@ sml_load_fll_file(struct sml_object *sml, const char *filename)
     ON_NULL_RETURN_VAL(sml, false);
     ON_NULL_RETURN_VAL(filename, false);
     struct sml_engine *engine = (struct sml_engine *)sml;
+    engine->variable_index_valid = false;
     if (!engine->load_file) {
         return _default_load_fll_file(sml, filename);
     }
@@ -173,9 +262,10 @@ sml_free(struct sml_object *sml)
         return;
     }
 #ifdef Debug
-    if (engine->debug_file)
-        fclose(engine->debug_file);
+    if (engine->debug_log)
+        sml_debug_log_close(engine->debug_log);
 #endif
+    sml_variable_index_free(engine->variable_index);
     engine->free(engine);
 }
 
@@ -220,21 +310,27 @@ sml_set_debug_log_file(struct sml_object *sml, const char *str)
     ON_NULL_RETURN_VAL(sml, false);
     struct sml_engine *engine = (struct sml_engine *)sml;
 
-    if (engine->debug_file)
-        fclose(engine->debug_file);
+    if (engine->debug_log) {
+        sml_debug_log_close(engine->debug_log);
+        engine->debug_log = NULL;
+    }
 
-    if (!str || str[0] == 0) {
-        engine->debug_file = NULL;
+    if (!str || str[0] == 0)
         return true;
-    }
 
-    engine->debug_file = fopen(str, "a");
-    return engine->debug_file != NULL;
+    engine->debug_log = sml_debug_log_open(sml, str);
+    return engine->debug_log != NULL;
 #else
     return false;
 #endif
 }
 
+static bool
+empty_read_state_cb(struct sml_object *sml, void *data)
+{
+    return true;
+}
+
 #ifdef Debug
 struct sml_variable *
 variable_find_by_name(struct sml_object *sml, const char *name)
@@ -248,51 +344,28 @@ variable_find_by_name(struct sml_object *sml, const char *name)
     return sml_get_output(sml, name);
 }
 
-static bool
-empty_read_state_cb(struct sml_object *sml, void *data)
-{
-    return true;
-}
-
 static void
 empty_output_state_changed_cb(struct sml_object *sml,
     struct sml_variables_list *changed, void *data)
 {
 }
 
-#endif
-
-API_EXPORT bool
-sml_load_debug_log_file(struct sml_object *sml, const char *str)
+/* Debug logs written by older versions have one call per line */
+static bool
+_load_debug_log_text(struct sml_object *sml, FILE *file)
 {
-#ifdef Debug
-    ON_NULL_RETURN_VAL(sml, false);
-    ON_NULL_RETURN_VAL(str, false);
-    FILE *file;
     char line[LINE_SIZE];
     char name[SML_VARIABLE_NAME_MAX_LEN + 1];
     int int_val, ret;
     float float_val, float_val2;
     struct sml_variable *var;
-    struct sml_engine *engine = (struct sml_engine *)sml;
-    sml_read_state_cb read_state_cb;
-    sml_change_cb output_state_changed_cb;
-    bool r;
 
-    file = fopen(str, "r");
-    ON_NULL_RETURN_VAL(file, false);
-
-    read_state_cb = engine->read_state_cb;
-    output_state_changed_cb = engine->output_state_changed_cb;
-    engine->read_state_cb = empty_read_state_cb;
-    engine->output_state_changed_cb = empty_output_state_changed_cb;
-    r = false;
     while (fgets(line, LINE_SIZE, file)) {
         ret = strncmp(line, "sml_process", 11);
         if (ret == 0) {
             if (sml_process(sml)) {
                 sml_error("Could not execute process");
-                goto exit;
+                return false;
             }
             continue;
         }
@@ -310,7 +383,7 @@ sml_load_debug_log_file(struct sml_object *sml, const char *str)
         if (ret > 0) {
             if (!sml_new_input(sml, name)) {
                 sml_error("Could not create the input %s", name);
-                goto exit;
+                return false;
             }
             continue;
         }
@@ -318,7 +391,7 @@ sml_load_debug_log_file(struct sml_object *sml, const char *str)
         if (ret > 0) {
             if (!sml_new_output(sml, name)) {
                 sml_error("Could not create the output %s", name);
-                goto exit;
+                return false;
             }
             continue;
         }
@@ -359,8 +432,33 @@ sml_load_debug_log_file(struct sml_object *sml, const char *str)
             continue;
         }
     }
-    r = true;
-exit:
+    return true;
+}
+#endif
+
+API_EXPORT bool
+sml_load_debug_log_file(struct sml_object *sml, const char *str)
+{
+#ifdef Debug
+    ON_NULL_RETURN_VAL(sml, false);
+    ON_NULL_RETURN_VAL(str, false);
+    FILE *file;
+    struct sml_engine *engine = (struct sml_engine *)sml;
+    sml_read_state_cb read_state_cb;
+    sml_change_cb output_state_changed_cb;
+    bool r;
+
+    file = fopen(str, "rb");
+    ON_NULL_RETURN_VAL(file, false);
+
+    read_state_cb = engine->read_state_cb;
+    output_state_changed_cb = engine->output_state_changed_cb;
+    engine->read_state_cb = empty_read_state_cb;
+    engine->output_state_changed_cb = empty_output_state_changed_cb;
+    if (sml_debug_log_is_binary(file))
+        r = sml_debug_log_replay(sml, file);
+    else
+        r = _load_debug_log_text(sml, file);
     fclose(file);
     engine->read_state_cb = read_state_cb;
     engine->output_state_changed_cb = output_state_changed_cb;
@@ -377,7 +475,7 @@ sml_set_learn_disabled(struct sml_object *sml, bool disable)
     ON_NULL_RETURN_VAL(sml, false);
     struct sml_engine *engine = (struct sml_engine *)sml;
     engine->learn_disabled = disable;
-    SML_LOG_DEBUG_DATA(engine, "sml_set_learn_disabled %d\n", !!disable);
+    SML_LOG_DEBUG_DATA_BOOL(engine, SML_DEBUG_LOG_OP_LEARN_DISABLED, disable);
     return true;
 }
 
@@ -394,7 +492,96 @@ sml_process(struct sml_object *sml)
         return -EINVAL;
     }
     r = engine->process(engine);
-    SML_LOG_DEBUG_DATA(engine, "sml_process\n");
+    _variable_index_handle_changes(engine);
+    SML_LOG_DEBUG_DATA(engine, SML_DEBUG_LOG_OP_PROCESS);
+    return r;
+}
+
+/* Slow path, used if the engine has no batch implementation or the debug
+   log is enabled, as it must be possible to replay the log line by line. */
+static int
+_process_batch_rows(struct sml_object *sml, const float *inputs,
+    const float *outputs, size_t rows, size_t stride)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+    struct sml_variables_list *input_list, *output_list;
+    struct sml_variable *var;
+    sml_read_state_cb read_state_cb;
+    size_t row, in_stride, out_stride;
+    uint16_t i, len, in_len, out_len;
+    int r = 0;
+
+    input_list = sml_get_input_list(sml);
+    output_list = sml_get_output_list(sml);
+    in_stride = stride ? stride :
+        sml_variables_list_get_length(sml, input_list);
+    out_stride = stride ? stride :
+        sml_variables_list_get_length(sml, output_list);
+
+    read_state_cb = engine->read_state_cb;
+    engine->read_state_cb = empty_read_state_cb;
+    for (row = 0; row < rows; row++) {
+        /* Variables may be added or removed by sml_process() */
+        input_list = sml_get_input_list(sml);
+        output_list = sml_get_output_list(sml);
+        in_len = sml_variables_list_get_length(sml, input_list);
+        out_len = outputs ? sml_variables_list_get_length(sml, output_list) :
+            0;
+        if (stride ? in_len > stride || out_len > stride :
+            in_len != in_stride || (outputs && out_len != out_stride)) {
+            sml_warning("Variables changed while processing a batch");
+            r = -EINVAL;
+            break;
+        }
+        SML_VARIABLES_LIST_FOREACH(sml, input_list, len, var, i)
+            sml_variable_set_value(sml, var, inputs[row * in_stride + i]);
+        if (outputs) {
+            SML_VARIABLES_LIST_FOREACH(sml, output_list, len, var, i)
+                sml_variable_set_value(sml, var,
+                    outputs[row * out_stride + i]);
+        }
+        if ((r = sml_process(sml)))
+            break;
+    }
+    engine->read_state_cb = read_state_cb;
+    return r;
+}
+
+API_EXPORT int
+sml_process_batch(struct sml_object *sml, const float *inputs,
+    const float *outputs, size_t rows, size_t stride)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+    uint16_t in_len, out_len;
+    int r;
+
+    ON_NULL_RETURN_VAL(sml, -EINVAL);
+    ON_NULL_RETURN_VAL(inputs, -EINVAL);
+    if (!engine->process) {
+        sml_critical("Unexpected error. Implementation of function "
+            "sml_process is mandatory for engines.");
+        return -EINVAL;
+    }
+
+    in_len = sml_variables_list_get_length(sml, sml_get_input_list(sml));
+    out_len = sml_variables_list_get_length(sml, sml_get_output_list(sml));
+    if (stride && (stride < in_len || (outputs && stride < out_len))) {
+        sml_warning("Invalid stride %zu. Inputs: %d Outputs: %d", stride,
+            in_len, out_len);
+        return -EINVAL;
+    }
+
+    if (!rows)
+        return 0;
+
+#ifdef Debug
+    if (engine->debug_log)
+        return _process_batch_rows(sml, inputs, outputs, rows, stride);
+#endif
+    if (!engine->process_batch)
+        return _process_batch_rows(sml, inputs, outputs, rows, stride);
+    r = engine->process_batch(engine, inputs, outputs, rows, stride);
+    _variable_index_handle_changes(engine);
     return r;
 }
 
@@ -409,7 +596,7 @@ sml_predict(struct sml_object *sml)
             "sml_predict is mandatory for engines.");
         return false;
     }
-    SML_LOG_DEBUG_DATA(engine, "sml_predict\n");
+    SML_LOG_DEBUG_DATA(engine, SML_DEBUG_LOG_OP_PREDICT);
     return engine->predict(engine);
 }
 
@@ -417,30 +604,43 @@ API_EXPORT bool
 sml_save(struct sml_object *sml, const char *path)
 {
     struct sml_engine *engine = (struct sml_engine *)sml;
+    uint64_t start;
+    bool r;
 
     ON_NULL_RETURN_VAL(sml, false);
     ON_NULL_RETURN_VAL(path, false);
+
     if (!engine->save) {
         sml_critical("Unexpected error. Implementation of function "
             "sml_save is mandatory for engines.");
         return false;
     }
-    return engine->save(engine, path);
+    start = sml_stats_timer_start(engine);
+    r = engine->save(engine, path);
+    sml_stats_timer_stop(engine, SML_STATS_TIMER_SAVE, start);
+    return r;
 }
 
 API_EXPORT bool
 sml_load(struct sml_object *sml, const char *path)
 {
     struct sml_engine *engine = (struct sml_engine *)sml;
+    uint64_t start;
+    bool r;
 
     ON_NULL_RETURN_VAL(sml, false);
     ON_NULL_RETURN_VAL(path, false);
+
     if (!engine->load) {
         sml_critical("Unexpected error. Implementation of function "
             "sml_load is mandatory for engines.");
         return false;
     }
-    return engine->load(engine, path);
+    engine->variable_index_valid = false;
+    start = sml_stats_timer_start(engine);
+    r = engine->load(engine, path);
+    sml_stats_timer_stop(engine, SML_STATS_TIMER_LOAD, start);
+    return r;
 }
 
 API_EXPORT bool
@@ -448,7 +648,7 @@ sml_erase_knowledge(struct sml_object *sml)
 {
     struct sml_engine *engine = (struct sml_engine *)sml;
 
-    SML_LOG_DEBUG_DATA(engine, "sml_erase_knowledge\n");
+    SML_LOG_DEBUG_DATA(engine, SML_DEBUG_LOG_OP_ERASE_KNOWLEDGE);
     ON_NULL_RETURN_VAL(sml, false);
     if (!engine->erase_knowledge) {
         sml_critical("Unexpected error. Implementation of function "
@@ -490,6 +690,7 @@ API_EXPORT struct sml_variable *
 sml_new_input(struct sml_object *sml, const char *name)
 {
     struct sml_engine *engine = (struct sml_engine *)sml;
+    struct sml_variable *var;
     size_t name_len;
 
     ON_NULL_RETURN_VAL(sml, NULL);
@@ -508,14 +709,18 @@ sml_new_input(struct sml_object *sml, const char *name)
         return NULL;
     }
 
-    SML_LOG_DEBUG_DATA(engine, "sml_new_input %s\n", name);
-    return engine->new_input(engine, name);
+    var = engine->new_input(engine, name);
+    if (var)
+        _variable_index_add(engine, name, false, var);
+    SML_LOG_DEBUG_DATA_NEW_VAR(engine, SML_DEBUG_LOG_OP_NEW_INPUT, var, name);
+    return var;
 }
 
 API_EXPORT struct sml_variable *
 sml_new_output(struct sml_object *sml, const char *name)
 {
     struct sml_engine *engine = (struct sml_engine *)sml;
+    struct sml_variable *var;
     size_t name_len;
 
     ON_NULL_RETURN_VAL(sml, NULL);
@@ -534,8 +739,11 @@ sml_new_output(struct sml_object *sml, const char *name)
         return NULL;
     }
 
-    SML_LOG_DEBUG_DATA(engine, "sml_new_output %s\n", name);
-    return engine->new_output(engine, name);
+    var = engine->new_output(engine, name);
+    if (var)
+        _variable_index_add(engine, name, true, var);
+    SML_LOG_DEBUG_DATA_NEW_VAR(engine, SML_DEBUG_LOG_OP_NEW_OUTPUT, var, name);
+    return var;
 }
 
 API_EXPORT struct sml_variable *
@@ -550,6 +758,8 @@ sml_get_input(struct sml_object *sml, const char *name)
             "sml_get_input is mandatory for engines.");
         return NULL;
     }
+    if (_variable_index_update(engine))
+        return sml_variable_index_get(engine->variable_index, name, false);
     return engine->get_input(engine, name);
 }
 
@@ -565,6 +775,8 @@ sml_get_output(struct sml_object *sml, const char *name)
             "sml_get_output is mandatory for engines.");
         return NULL;
     }
+    if (_variable_index_update(engine))
+        return sml_variable_index_get(engine->variable_index, name, true);
     return engine->get_output(engine, name);
 }
 
@@ -582,8 +794,8 @@ sml_variable_set_value(struct sml_object *sml,
         return false;
     }
 
-    SML_LOG_DEBUG_DATA_VAR(engine, "sml_variable_set_value", "%f\n",
-        sml_variable, value);
+    SML_LOG_DEBUG_DATA_VAR(engine, SML_DEBUG_LOG_OP_SET_VALUE, sml_variable,
+        &value, sizeof(value));
     return engine->set_value(sml_variable, value);
 }
 
@@ -638,8 +850,8 @@ sml_variable_set_enabled(struct sml_object *sml,
         return -EINVAL;
     }
 
-    SML_LOG_DEBUG_DATA_VAR(engine, "sml_variable_set_enabled", "%d\n",
-        sml_variable, !!enabled);
+    SML_LOG_DEBUG_DATA_VAR(engine, SML_DEBUG_LOG_OP_SET_ENABLED, sml_variable,
+        &(uint8_t){ enabled }, sizeof(uint8_t));
     return engine->variable_set_enabled(engine,
         sml_variable, enabled);
 }
@@ -672,8 +884,14 @@ sml_remove_variable(struct sml_object *sml, struct sml_variable *sml_variable)
             "sml_remove_variable is mandatory for engines.");
         return false;
     }
-    SML_LOG_DEBUG_DATA_VAR(engine, "sml_remove_variable", "", sml_variable);
-    return engine->remove_variable(engine, sml_variable);
+    SML_LOG_DEBUG_DATA_VAR(engine, SML_DEBUG_LOG_OP_REMOVE_VARIABLE,
+        sml_variable, NULL, 0);
+    _variable_index_remove(engine, sml_variable);
+    if (!engine->remove_variable(engine, sml_variable)) {
+        engine->variable_index_valid = false;
+        return false;
+    }
+    return true;
 }
 
 API_EXPORT uint16_t
@@ -726,6 +944,89 @@ sml_variables_list_index(struct sml_object *sml,
     return engine->variables_list_index(list, index);
 }
 
+static bool
+_variables_list_check_count(struct sml_object *sml,
+    struct sml_variables_list *list, uint16_t count)
+{
+    uint16_t len = sml_variables_list_get_length(sml, list);
+
+    if (count != len) {
+        sml_warning("Expected %d values for the list, got %d", len, count);
+        return false;
+    }
+    return true;
+}
+
+API_EXPORT int
+sml_variables_list_set_values(struct sml_object *sml,
+    struct sml_variables_list *list, const float *values, uint16_t count)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+    struct sml_variable *var;
+    uint16_t i, len;
+
+    ON_NULL_RETURN_VAL(sml, -EINVAL);
+    ON_NULL_RETURN_VAL(list, -EINVAL);
+    ON_NULL_RETURN_VAL(values, -EINVAL);
+    if (!_variables_list_check_count(sml, list, count))
+        return -EINVAL;
+
+#ifdef Debug
+    /* Go through sml_variable_set_value() so every value is logged */
+    if (engine->debug_log) {
+        SML_VARIABLES_LIST_FOREACH(sml, list, len, var, i)
+            sml_variable_set_value(sml, var, values[i]);
+        return 0;
+    }
+#endif
+    if (engine->variables_list_set_values)
+        return engine->variables_list_set_values(engine, list, values);
+
+    SML_VARIABLES_LIST_FOREACH(sml, list, len, var, i)
+        engine->set_value(var, values[i]);
+    return 0;
+}
+
+API_EXPORT int
+sml_variables_list_get_values(struct sml_object *sml,
+    struct sml_variables_list *list, float *values, uint16_t count)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+    struct sml_variable *var;
+    uint16_t i, len;
+
+    ON_NULL_RETURN_VAL(sml, -EINVAL);
+    ON_NULL_RETURN_VAL(list, -EINVAL);
+    ON_NULL_RETURN_VAL(values, -EINVAL);
+    if (!_variables_list_check_count(sml, list, count))
+        return -EINVAL;
+
+    if (engine->variables_list_get_values)
+        return engine->variables_list_get_values(engine, list, values);
+
+    SML_VARIABLES_LIST_FOREACH(sml, list, len, var, i)
+        values[i] = engine->get_value(var);
+    return 0;
+}
+
+API_EXPORT int
+sml_variables_list_bind_values(struct sml_object *sml,
+    struct sml_variables_list *list, float *values, uint16_t count)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+
+    ON_NULL_RETURN_VAL(sml, -EINVAL);
+    ON_NULL_RETURN_VAL(list, -EINVAL);
+    if (values && !_variables_list_check_count(sml, list, count))
+        return -EINVAL;
+
+    if (!engine->variables_list_bind_values) {
+        sml_warning("This engine does not support binding variable values");
+        return -ENOTSUP;
+    }
+    return engine->variables_list_bind_values(engine, list, values);
+}
+
 API_EXPORT bool
 sml_variable_set_range(struct sml_object *sml,
     struct sml_variable *sml_variable, float min, float max)
@@ -747,8 +1048,8 @@ sml_variable_set_range(struct sml_object *sml,
     if (isnan(max) && !sml_variable_get_range(sml, sml_variable, NULL, &max))
         return false;
 
-    SML_LOG_DEBUG_DATA_VAR(engine, "sml_variable_set_range", "%f %f\n",
-        sml_variable, min, max);
+    SML_LOG_DEBUG_DATA_VAR(engine, SML_DEBUG_LOG_OP_SET_RANGE, sml_variable,
+        ((float[]){ min, max }), 2 * sizeof(float));
 
     if (max < min) {
         sml_warning("Max value (%f) is lower than min value (%f). Inverting.",
@@ -796,23 +1097,87 @@ sml_set_max_memory_for_observations(struct sml_object *sml,
     return true;
 }
 
+API_EXPORT bool
+sml_set_stats_enabled(struct sml_object *sml, bool enabled)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+
+    ON_NULL_RETURN_VAL(sml, false);
+    engine->stats_enabled = enabled;
+    return true;
+}
+
+API_EXPORT bool
+sml_get_stats(struct sml_object *sml, struct sml_stats *stats)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+
+    ON_NULL_RETURN_VAL(sml, false);
+    ON_NULL_RETURN_VAL(stats, false);
+
+    *stats = engine->stats;
+    if (engine->get_stats)
+        engine->get_stats(engine, stats);
+    return true;
+}
+
+API_EXPORT bool
+sml_reset_stats(struct sml_object *sml)
+{
+    struct sml_engine *engine = (struct sml_engine *)sml;
+
+    ON_NULL_RETURN_VAL(sml, false);
+    memset(&engine->stats, 0, sizeof(engine->stats));
+    return true;
+}
+
+uint64_t
+sml_stats_now(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+sml_stats_record(struct sml_engine *engine, enum sml_stats_timer timer,
+    uint64_t usec)
+{
+    struct sml_stats_timer_data *data = &engine->stats.timers[timer];
+    unsigned int bucket;
+
+    bucket = usec ? 64 - __builtin_clzll(usec) : 0;
+    if (bucket >= SML_STATS_HISTOGRAM_BUCKETS)
+        bucket = SML_STATS_HISTOGRAM_BUCKETS - 1;
+
+    data->count++;
+    data->total_usec += usec;
+    if (usec > data->max_usec)
+        data->max_usec = usec;
+    data->histogram[bucket]++;
+}
+
 int
 sml_call_read_state_cb(struct sml_engine *engine)
 {
+    bool r;
+    uint64_t start;
+
     if (!engine->read_state_cb) {
         sml_critical("It's required to set a read_state_cb to read");
         return -EINVAL;
     }
 
-    if (!engine->read_state_cb((struct sml_object *)engine,
-        engine->read_state_cb_data))
+    start = sml_stats_timer_start(engine);
+    r = engine->read_state_cb((struct sml_object *)engine,
+        engine->read_state_cb_data);
+    sml_stats_timer_stop(engine, SML_STATS_TIMER_READ_STATE, start);
+    if (!r)
         return -EAGAIN;
 
-    SML_LOG_DEBUG_DATA(engine, "sml_call_read_state_cb\n");
-    SML_LOG_DEBUG_DATA_LIST(engine, "sml_call_read_state_cb input",
-        sml_get_input_list((struct sml_object *)engine));
-    SML_LOG_DEBUG_DATA_LIST(engine, "sml_call_read_state_cb output",
-        sml_get_output_list((struct sml_object *)engine));
+    SML_LOG_DEBUG_DATA(engine, SML_DEBUG_LOG_OP_READ_STATE);
     return 0;
 }
 
@@ -828,8 +1193,5 @@ sml_call_output_state_changed_cb(struct sml_engine *engine,
     engine->output_state_changed_cb((struct sml_object *)engine, changed,
         engine->output_state_changed_cb_data);
 
-    SML_LOG_DEBUG_DATA(engine, "sml_call_output_state_changed_cb\n");
-    if (changed)
-        SML_LOG_DEBUG_DATA_LIST(engine,
-            "sml_call_output_state_changed_cb changed", changed);
+    SML_LOG_DEBUG_DATA(engine, SML_DEBUG_LOG_OP_OUTPUT_STATE_CHANGED);
 }
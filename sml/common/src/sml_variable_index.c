@@ -0,0 +1,210 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sml_variable_index.h"
+#include <config.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sml_log.h>
+
+#define MIN_BUCKETS (16)
+
+struct sml_variable_index_node {
+    struct sml_variable_index_node *next;
+    struct sml_variable *var;
+    uint32_t hash;
+    bool output;
+    char name[];
+};
+
+struct sml_variable_index {
+    struct sml_variable_index_node **buckets;
+    uint32_t buckets_size;
+    uint32_t count;
+};
+
+/* FNV-1a. The output flag is folded in so inputs and outputs with the same
+   name do not share a chain. */
+static uint32_t
+_hash(const char *name, bool output)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    if (output)
+        hash = ~hash;
+    return hash;
+}
+
+static struct sml_variable_index_node **
+_find_node(struct sml_variable_index *index, const char *name, bool output,
+    uint32_t hash)
+{
+    struct sml_variable_index_node **itr;
+
+    for (itr = &index->buckets[hash & (index->buckets_size - 1)]; *itr;
+        itr = &(*itr)->next) {
+        if ((*itr)->hash == hash && (*itr)->output == output &&
+            !strcmp((*itr)->name, name))
+            return itr;
+    }
+    return NULL;
+}
+
+static bool
+_buckets_grow_if_needed(struct sml_variable_index *index)
+{
+    struct sml_variable_index_node **buckets, *node, *next;
+    uint32_t size, i;
+
+    if (index->count < index->buckets_size)
+        return true;
+
+    size = index->buckets_size * 2;
+    buckets = calloc(size, sizeof(struct sml_variable_index_node *));
+    if (!buckets) {
+        sml_critical("Could not grow the variable index");
+        return false;
+    }
+
+    for (i = 0; i < index->buckets_size; i++) {
+        for (node = index->buckets[i]; node; node = next) {
+            next = node->next;
+            node->next = buckets[node->hash & (size - 1)];
+            buckets[node->hash & (size - 1)] = node;
+        }
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->buckets_size = size;
+    return true;
+}
+
+struct sml_variable_index *
+sml_variable_index_new(void)
+{
+    struct sml_variable_index *index;
+
+    index = calloc(1, sizeof(struct sml_variable_index));
+    if (!index) {
+        sml_critical("Could not create the variable index");
+        return NULL;
+    }
+
+    index->buckets = calloc(MIN_BUCKETS,
+        sizeof(struct sml_variable_index_node *));
+    if (!index->buckets) {
+        sml_critical("Could not create the variable index");
+        free(index);
+        return NULL;
+    }
+    index->buckets_size = MIN_BUCKETS;
+    return index;
+}
+
+void
+sml_variable_index_clear(struct sml_variable_index *index)
+{
+    struct sml_variable_index_node *node, *next;
+    uint32_t i;
+
+    for (i = 0; i < index->buckets_size; i++) {
+        for (node = index->buckets[i]; node; node = next) {
+            next = node->next;
+            free(node);
+        }
+        index->buckets[i] = NULL;
+    }
+    index->count = 0;
+}
+
+void
+sml_variable_index_free(struct sml_variable_index *index)
+{
+    if (!index)
+        return;
+    sml_variable_index_clear(index);
+    free(index->buckets);
+    free(index);
+}
+
+bool
+sml_variable_index_add(struct sml_variable_index *index, const char *name,
+    bool output, struct sml_variable *var)
+{
+    struct sml_variable_index_node **itr, *node;
+    uint32_t hash = _hash(name, output);
+    size_t len;
+
+    itr = _find_node(index, name, output, hash);
+    if (itr) {
+        (*itr)->var = var;
+        return true;
+    }
+
+    if (!_buckets_grow_if_needed(index))
+        return false;
+
+    len = strlen(name) + 1;
+    node = malloc(sizeof(struct sml_variable_index_node) + len);
+    if (!node) {
+        sml_critical("Could not add %s to the variable index", name);
+        return false;
+    }
+    node->var = var;
+    node->hash = hash;
+    node->output = output;
+    memcpy(node->name, name, len);
+
+    itr = &index->buckets[hash & (index->buckets_size - 1)];
+    node->next = *itr;
+    *itr = node;
+    index->count++;
+    return true;
+}
+
+bool
+sml_variable_index_remove(struct sml_variable_index *index, const char *name,
+    bool output)
+{
+    struct sml_variable_index_node **itr, *node;
+
+    itr = _find_node(index, name, output, _hash(name, output));
+    if (!itr)
+        return false;
+
+    node = *itr;
+    *itr = node->next;
+    free(node);
+    index->count--;
+    return true;
+}
+
+struct sml_variable *
+sml_variable_index_get(struct sml_variable_index *index, const char *name,
+    bool output)
+{
+    struct sml_variable_index_node **itr;
+
+    itr = _find_node(index, name, output, _hash(name, output));
+    return itr ? (*itr)->var : NULL;
+}
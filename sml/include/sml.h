@@ -300,6 +300,36 @@ bool sml_set_learn_disabled(struct sml_object *sml, bool disable);
  */
 int sml_process(struct sml_object *sml);
 
+/**
+ * @brief Process a batch of observations stored in memory
+ *
+ * This function has the same effect of calling ::sml_process once for each row,
+ * with a ::sml_read_state_cb that sets the row values to the variables,
+ * but ::sml_read_state_cb is not called and variables are set
+ * directly by the engine. It's useful to feed SML with historical data.
+ *
+ * Each row of inputs has one value for each variable of
+ * ::sml_get_input_list, in the same order. The same is valid for outputs and
+ * ::sml_get_output_list.
+ *
+ * @remarks ::sml_change_cb is called as it would be by ::sml_process.
+ * @remarks If variables are added or removed while the batch is processed,
+ * like from ::sml_change_cb, and the rows no longer fit the stride, the
+ * remaining rows are not processed and @c -EINVAL is returned.
+ *
+ * @param sml The ::sml_object object.
+ * @param inputs The input values, a matrix with rows lines.
+ * @param outputs The output values, a matrix with rows lines. If @c NULL, output values are
+ * not changed.
+ * @param rows The number of observations.
+ * @param stride The number of floats between the beginning of two consecutive rows.
+ * If @c 0, rows are considered to be packed.
+ * @return ::0 on success
+ * @return A negative value on failure.
+ * @see ::sml_process
+ */
+int sml_process_batch(struct sml_object *sml, const float *inputs, const float *outputs, size_t rows, size_t stride);
+
 /**
  * @brief Make a prediction based on the most recent observations.
  *
@@ -400,6 +430,13 @@ void sml_print_debug(struct sml_object *sml, bool full);
  * execution of sml for debug purposes. Methods that configure the sml are not
  * logged.
  *
+ * Data is written in a compact binary format and kept in memory until the
+ * buffer is full, so it is only guaranteed to be in the file after the debug
+ * file is changed or the engine is freed. If the file already exists, new data
+ * is appended to it. Files that can not be appended to, like the text logs
+ * written by previous versions of sml or logs of other platforms, are renamed
+ * to the same path with the @c .old suffix and a new log is started.
+ *
  * To use this feature, sml must be compiled with build type set to Debug.
  *
  * @param sml The ::sml_object object.
@@ -416,7 +453,8 @@ bool sml_set_debug_log_file(struct sml_object *sml, const char *str);
  * @brief Load to current engine the debug data logged to a file
  *
  * Load all data logged in file set by ::sml_set_debug_log_file to current
- * engine. Used for debug purposes.
+ * engine. Used for debug purposes. Text logs written by previous versions of
+ * sml are also supported.
  *
  * To use this feature, sml must be compiled with build type set to Debug.
  *
@@ -441,6 +479,97 @@ bool sml_load_debug_log_file(struct sml_object *sml, const char *str);
  */
 bool sml_set_max_memory_for_observations(struct sml_object *sml, unsigned int max_size);
 
+/**
+ * @enum sml_stats_timer
+ * @brief Operations which have their duration measured by ::sml_get_stats.
+ */
+enum sml_stats_timer {
+    SML_STATS_TIMER_READ_STATE, /**< Calls to ::sml_read_state_cb */
+    SML_STATS_TIMER_MEMBERSHIP, /**< Computation of the membership values of the variables. Fuzzy only. */
+    SML_STATS_TIMER_PREDICT, /**< Prediction of output values */
+    SML_STATS_TIMER_OBSERVATION_HIT, /**< Storage of a new observation, including rule updates */
+    SML_STATS_TIMER_RULE_REBUILD, /**< Updates of the rule base. Fuzzy only. */
+    SML_STATS_TIMER_ANN_TRAINING, /**< Training of a neural network. ANN only. */
+    SML_STATS_TIMER_SAVE, /**< Calls to ::sml_save */
+    SML_STATS_TIMER_LOAD, /**< Calls to ::sml_load */
+    SML_STATS_TIMER_COUNT /**< Number of timers, not a valid timer */
+};
+
+/**
+ * @brief Number of buckets of the latency histograms.
+ */
+#define SML_STATS_HISTOGRAM_BUCKETS (24)
+
+/**
+ * @struct sml_stats_timer_data
+ * @brief Latency data of one ::sml_stats_timer.
+ *
+ * Histogram bucket 0 counts operations that took less than 1 microsecond.
+ * Bucket @c i counts operations that took from 2^(i-1) to 2^i - 1
+ * microseconds. The last bucket also counts all slower operations.
+ */
+struct sml_stats_timer_data {
+    uint64_t count; /**< Number of measured operations */
+    uint64_t total_usec; /**< Sum of all durations in microseconds */
+    uint64_t max_usec; /**< Longest duration in microseconds */
+    uint64_t histogram[SML_STATS_HISTOGRAM_BUCKETS]; /**< Durations histogram */
+};
+
+/**
+ * @struct sml_stats
+ * @brief Statistics of a ::sml_object.
+ *
+ * @see ::sml_get_stats
+ */
+struct sml_stats {
+    struct sml_stats_timer_data timers[SML_STATS_TIMER_COUNT]; /**< Latency of each ::sml_stats_timer */
+    uint32_t rules; /**< Number of fuzzy rules */
+    uint32_t observation_groups; /**< Number of fuzzy observation groups */
+    uint32_t trained_anns; /**< Number of trained neural networks */
+    uint64_t cache_hits; /**< Number of times an element in the engine cache was reused */
+    uint64_t cache_evictions; /**< Number of elements removed from the engine cache to make room for new ones */
+};
+
+/**
+ * @brief Enable or disable the collection of statistics.
+ *
+ * Timers are only updated while collection is enabled. It's disabled by
+ * default and costs almost nothing while disabled.
+ *
+ * @param sml The ::sml_object object.
+ * @param enabled @c true to enable, @c false to disable.
+ * @return @c true on success.
+ * @return @c false on failure.
+ * @see ::sml_get_stats
+ */
+bool sml_set_stats_enabled(struct sml_object *sml, bool enabled);
+
+/**
+ * @brief Get the statistics of the engine.
+ *
+ * Counters of rules, observation groups and trained networks are the
+ * current values. Cache counters are accumulated since the engine creation,
+ * even if collection of statistics is disabled.
+ *
+ * @param sml The ::sml_object object.
+ * @param stats Where the statistics are written to.
+ * @return @c true on success.
+ * @return @c false on failure.
+ * @see ::sml_set_stats_enabled
+ * @see ::sml_reset_stats
+ */
+bool sml_get_stats(struct sml_object *sml, struct sml_stats *stats);
+
+/**
+ * @brief Clear all timers of the statistics.
+ *
+ * @param sml The ::sml_object object.
+ * @return @c true on success.
+ * @return @c false on failure.
+ * @see ::sml_get_stats
+ */
+bool sml_reset_stats(struct sml_object *sml);
+
 /**
  * @}
  */
@@ -619,6 +748,59 @@ struct sml_variable *sml_variables_list_index(struct sml_object *sml, struct sml
  */
 bool sml_variables_list_contains(struct sml_object *sml, struct sml_variables_list *list, struct sml_variable *var);
 
+/**
+ * @brief Set the values of all variables in a ::sml_variables_list
+ *
+ * Equivalent to calling ::sml_variable_set_value for each variable
+ * of the list, in order, but done by the engine in a single call.
+ *
+ * @param sml The ::sml_object object.
+ * @param list The ::sml_variables_list.
+ * @param values The values, one for each variable of the list.
+ * @param count Number of elements in @c values. Must be the list length.
+ * @return @c 0 on success.
+ * @return @c -EINVAL on invalid parameters.
+ */
+int sml_variables_list_set_values(struct sml_object *sml, struct sml_variables_list *list, const float *values, uint16_t count);
+
+/**
+ * @brief Get the values of all variables in a ::sml_variables_list
+ *
+ * @param sml The ::sml_object object.
+ * @param list The ::sml_variables_list.
+ * @param values Where the values are written, one for each variable of
+ * the list.
+ * @param count Number of elements in @c values. Must be the list length.
+ * @return @c 0 on success.
+ * @return @c -EINVAL on invalid parameters.
+ */
+int sml_variables_list_get_values(struct sml_object *sml, struct sml_variables_list *list, float *values, uint16_t count);
+
+/**
+ * @brief Use a caller provided buffer to store the variables values
+ *
+ * After this call, the value of the i-th variable of the list is kept
+ * in @c values[i]. Writing to the buffer is the same as setting the variable
+ * value and engine updates, like predicted outputs, are visible in it
+ * without further calls. The current values are copied to the buffer.
+ *
+ * The buffer must stay valid until it is unbound. It is unbound, and the
+ * values copied back to the engine, when @c NULL is given, when a variable
+ * is added to or removed from the list or when the engine is freed.
+ *
+ * @remarks Values written directly to the buffer are not recorded by the
+ * debug log.
+ *
+ * @param sml The ::sml_object object.
+ * @param list The ::sml_variables_list.
+ * @param values The buffer, or @c NULL to unbind the current one.
+ * @param count Number of elements in @c values. Must be the list length.
+ * @return @c 0 on success.
+ * @return @c -EINVAL on invalid parameters.
+ * @return @c -ENOTSUP if the engine keeps values in its own storage.
+ */
+int sml_variables_list_bind_values(struct sml_object *sml, struct sml_variables_list *list, float *values, uint16_t count);
+
 /**
  * @brief Set variable range.
  *
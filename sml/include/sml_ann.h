@@ -157,6 +157,17 @@ enum sml_ann_activation_function {
     SML_ANN_ACTIVATION_FUNCTION_SIN_SYMMETRIC     /**< Sinus function. Defined for -1 <= y <= 1 */
 };     /**< The neuron activation functions */
 
+/**
+ * @enum sml_ann_quantization
+ * @brief Precision of the weights used to predict with trained neural networks.
+ * @see ::sml_ann_set_quantization
+ */
+enum sml_ann_quantization {
+    SML_ANN_QUANTIZATION_NONE,     /**< Predict with float weights. */
+    SML_ANN_QUANTIZATION_INT16,     /**< Predict with 16 bits integer weights. */
+    SML_ANN_QUANTIZATION_INT8     /**< Predict with 8 bits integer weights. */
+};     /**< The weights precision of the predictions */
+
 /**
  * @brief Creates a SML neural networks engine.
  *
@@ -341,6 +352,212 @@ bool sml_ann_set_initial_required_observations(struct sml_object *sml, unsigned
  * @return @c false on failure.
  */
 bool sml_ann_use_pseudorehearsal_strategy(struct sml_object *sml, bool use_pseudorehearsal);
+
+/**
+ * @brief Set the warm start mode
+ *
+ * By default the weights of a neural network are randomized before each
+ * training, including retrainings of a network that was already trained
+ * or that needs more observations to be trained. With warm start, such
+ * retrainings start from the current weights, so they usually reach the
+ * desired error in fewer epochs. New networks are always randomized.
+ *
+ * @remark The default value for warm start is @c false.
+ *
+ * @param sml The ::sml_object object.
+ * @param warm_start @c true to enable, @c false to disable
+ * @return @c true on success.
+ * @return @c false on failure.
+ */
+bool sml_ann_set_warm_start(struct sml_object *sml, bool warm_start);
+
+/**
+ * @brief Set a time budget for each call of the neural network training
+ *
+ * By default a training runs until the desired error, the maximum number of
+ * epochs or the maximum number of neurons is reached, blocking ::sml_process
+ * for as long as it takes. With a time budget, the training stops after
+ * @c budget_ms milliseconds and continues in the next calls of ::sml_process,
+ * so the work is spread over several calls. The training also stops once the
+ * training error is no longer improving. The budget also applies to the
+ * retraining of a trained neural network with the observations that are
+ * inside its confidence intervals.
+ *
+ * While a neural network training is not finished, new observations are not
+ * stored. A neural network that is retrained keeps being used for predictions.
+ *
+ * @remark The default value is @c 0, that disables the time budget.
+ * @remark It has no effect on trainings running in background, see
+ * ::sml_ann_set_async_training
+ *
+ * @param sml The ::sml_object object.
+ * @param budget_ms Maximum time of each training call in milliseconds.
+ * @return @c true on success.
+ * @return @c false on failure.
+ */
+bool sml_ann_set_training_time_budget(struct sml_object *sml, unsigned int budget_ms);
+
+/**
+ * @brief Set the number of neural networks trained in parallel
+ *
+ * Each training trains @c variants neural networks, each one in its own
+ * thread, and keeps the one with the smallest error. New neural networks
+ * differ in their random weights, number of candidate groups and activation
+ * function candidates, while retrainings start from copies of the trained
+ * neural network. Training several variants makes it more likely to reach
+ * the desired error without waiting for more observations.
+ *
+ * @remark The default value is @c 1.
+ * @remark Variants are not used while a training time budget is set, see
+ * ::sml_ann_set_training_time_budget
+ *
+ * @param sml The ::sml_object object.
+ * @param variants Number of neural networks trained in each training.
+ * @return @c true on success.
+ * @return @c false on failure.
+ */
+bool sml_ann_set_training_variants(struct sml_object *sml, unsigned int variants);
+
+/**
+ * @brief Set the number of threads used by each training epoch
+ *
+ * Retraining a neural network with a batch algorithm, like
+ * ::SML_ANN_TRAINING_ALGORITHM_RPROP, goes through all observations in each
+ * epoch. With more than one thread, the observations are split between the
+ * threads and their results are merged in a fixed order, so the trained
+ * neural network does not depend on the thread scheduling. The cascade
+ * training of new neural networks is not split.
+ *
+ * @remark The default value is @c 1.
+ * @remark More than one thread requires FANN built with parallel training
+ * support.
+ *
+ * @param sml The ::sml_object object.
+ * @param threads Number of threads used by each training epoch.
+ * @return @c true on success.
+ * @return @c false on failure.
+ */
+bool sml_ann_set_training_threads(struct sml_object *sml, unsigned int threads);
+
+/**
+ * @brief Set the weights precision used to predict
+ *
+ * After each training, the neural network weights are converted to integers
+ * and the predictions are done with integer dot products, which are faster.
+ * The neuron values are kept as fixed point numbers in the [-8, 8] range, so
+ * networks with linear neurons producing values outside it lose accuracy.
+ *
+ * The float neural network is still kept to be trained again, so the memory
+ * used only decreases by the float compiled form of the network, which is
+ * dropped while the quantized weights are used. 16 bits weights are scaled
+ * down further when needed, so each neuron sums fit in 32 bits integers.
+ *
+ * The accuracy loss is measured as the increase of the mean square error
+ * over the training observations. If it is above max_error, the float
+ * weights keep being used for that neural network.
+ *
+ * The quantized weights are saved by ::sml_save and restored by
+ * ::sml_load. Networks loaded without them are predicted with float
+ * weights until they are trained again.
+ *
+ * @remark The default value is ::SML_ANN_QUANTIZATION_NONE.
+ *
+ * @param sml The ::sml_object object.
+ * @param quantization The weights precision.
+ * @param max_error Largest mean square error increase accepted.
+ * @return @c true on success.
+ * @return @c false on failure.
+ * @see ::sml_ann_get_quantization_error
+ */
+bool sml_ann_set_quantization(struct sml_object *sml, enum sml_ann_quantization quantization, float max_error);
+
+/**
+ * @brief Get the accuracy loss of the quantized neural networks
+ *
+ * @param sml The ::sml_object object.
+ * @return The largest mean square error increase measured when the neural
+ * networks were quantized, including the ones kept with float weights.
+ * @return @c NAN if no neural network was quantized.
+ * @see ::sml_ann_set_quantization
+ */
+float sml_ann_get_quantization_error(struct sml_object *sml);
+
+/**
+ * @brief Called when a neural network training running in background finishes.
+ *
+ * It's called from ::sml_process, in the same thread, so no locking is required.
+ *
+ * @param sml The ::sml_object object.
+ * @param trained @c true if the neural network is trained and will be used for predictions,
+ * @c false if the training failed or more observations are required.
+ * @param data User defined data.
+ * @see ::sml_ann_set_training_finished_callback
+ */
+typedef void (*sml_ann_training_finished_cb)(struct sml_object *sml, bool trained, void *data);
+
+/**
+ * @brief Set the asynchronous training mode
+ *
+ * Training a neural network may take several seconds and by default it's done
+ * inside ::sml_process, blocking the caller. If asynchronous training is enabled,
+ * the collected observations are copied and the neural network is trained in a
+ * background thread, so ::sml_process never waits for the training.
+ *
+ * While the training is running, predictions keep using the last trained
+ * neural networks and new observations keep being stored, up to the number of
+ * observations required to train. The new neural network is published in the
+ * first call of ::sml_process after its training is finished, and the
+ * observations stored meanwhile are used by the next training.
+ *
+ * @remark The default value is @c false.
+ * @remark It must be set before the first call of ::sml_process.
+ *
+ * @param sml The ::sml_object object.
+ * @param async_training @c true to enable, @c false to disable
+ * @return @c true on success.
+ * @return @c false on failure.
+ *
+ * @see ::sml_ann_set_training_finished_callback
+ */
+bool sml_ann_set_async_training(struct sml_object *sml, bool async_training);
+
+/**
+ * @brief Register a callback to be called when a background training finishes.
+ *
+ * @remarks If training_finished_cb is null previous callback will be unset.
+ *
+ * @param sml The ::sml_object object.
+ * @param training_finished_cb A ::sml_ann_training_finished_cb.
+ * @param data User data to ::sml_ann_training_finished_cb.
+ * @return @c true on success.
+ * @return @c false on failure.
+ *
+ * @see ::sml_ann_set_async_training
+ */
+bool sml_ann_set_training_finished_callback(struct sml_object *sml, sml_ann_training_finished_cb training_finished_cb, void *data);
+
+/**
+ * @brief Predict the outputs of many input rows at once.
+ *
+ * Each row is routed to the neural network that would be chosen by
+ * ::sml_predict for those input values, then the rows of each network are
+ * run back to back. The current values of the variables are not changed,
+ * and missing input values (@c NAN) are handled as in ::sml_predict.
+ *
+ * @param sml The ::sml_object object.
+ * @param inputs Row-major input values, one column per input variable,
+ * in the order of the input variables list.
+ * @param outputs Row-major buffer that receives the predicted values,
+ * one column per output variable, in the order of the output variables list.
+ * @param rows The number of rows in @c inputs and @c outputs.
+ * @return @c 0 on success.
+ * @return @c -EINVAL on invalid parameters.
+ * @return @c -ENOENT if there is no trained neural network.
+ * @return @c -ENOMEM on memory allocation failure.
+ *
+ * @see ::sml_predict
+ */
+int sml_ann_predict_batch(struct sml_object *sml, const float *inputs, float *outputs, unsigned int rows);
 /**
  * @}
  */
@@ -27,11 +27,14 @@
 #include <sol-vector.h>
 #include <sml_log.h>
 #include <float.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include "sml_ann_bridge.h"
+#include "sml_ann_ci_index.h"
 #include "sml_util.h"
 #include <sys/stat.h>
+#include <pthread.h>
 #include <config.h>
 
 #define DEFAULT_EPOCHS (300)
@@ -47,6 +50,8 @@
 #define ANN_PSEUDOREHEARSAL_PREFIX "pseudo_rehearsal_ann"
 #define CFG_FILE_PREFIX "ann_cfg_"
 #define CFG_FILE_EXTENSION "cfg"
+#define QUANTIZED_FILE_EXTENSION "qnet"
+#define PACKED_FILE ANN_FILE_PREFIX "models.pack"
 #define ANN_MAGIC (0xa22)
 #define EXPAND_FACTOR (3)
 
@@ -57,6 +62,24 @@ struct sml_ann_engine {
     struct sml_variables_list *outputs;
     bool first_run;
     bool use_pseudorehearsal;
+    /* Retrain networks from their current weights */
+    bool warm_start;
+    /* Trainings inside sml_process stop after this many milliseconds and
+       resume_ann is trained again in the next calls */
+    unsigned int training_time_budget;
+    struct sml_ann_bridge *resume_ann;
+    unsigned int resume_observations;
+    /* Observations kept once resume_ann is done, 0 keeps all of them */
+    unsigned int resume_length;
+    /* Cached network retrained in the next calls, on its own observations */
+    struct sml_ann_bridge *retrain_ann;
+    /* Networks trained in parallel in each training, the best one is kept */
+    unsigned int training_variants;
+    /* Threads sharing each epoch of batch trainings */
+    unsigned int training_threads;
+    /* Weight bits of the predictions, 0 predicts with float weights */
+    unsigned int quantization_bits;
+    float quantization_max_error;
 
     unsigned int required_observations;
     unsigned int train_epochs;
@@ -66,13 +89,171 @@ struct sml_ann_engine {
 
     enum sml_ann_training_algorithm train_algorithm;
 
-    struct sol_ptr_vector pending_add;
+    /* Owns the variables created while networks exist */
+    struct sml_variables_list *pending_add;
     struct sol_ptr_vector pending_remove;
     struct sol_vector activation_functions;
 
     struct sml_cache *anns_cache;
+    /* Mapped file the cached networks were loaded from. Their kernels use
+       it, so it is kept until the networks are loaded again. */
+    struct sml_ann_bridge_file *packed_file;
+    /* Index over the confidence intervals of the trained networks in the
+       cache, rebuilt on first use after the cache changes */
+    struct sml_ann_ci_index *ci_index;
+    bool ci_index_valid;
+    /* The last untrained network of the cache when the index was built */
+    struct sml_ann_bridge *ci_index_untrained;
+    /* Current input values, then the lower and upper limits scratch */
+    float *ci_point;
+
+    bool async_training;
+    struct sml_ann_training_job *training_job;
+    /* Observations stored since the training job started. The job trains
+       on copies, so they are kept once it is collected. */
+    unsigned int job_observations;
+    /* Cached networks are waiting for the job or retrain_ann to finish to
+       be retrained */
+    bool retrain_pending;
+    /* Only used by async training. Networks are published in the cache
+       after they are trained, the last untrained one is kept here. */
+    struct sml_ann_bridge *untrained_ann;
+    sml_ann_training_finished_cb training_finished_cb;
+    void *training_finished_cb_data;
 };
 
+/* Everything the training thread touches is owned by the job. The main
+   thread only reads the results after done is set. If the engine does not
+   need the result anymore, the job is abandoned and freed by the thread. */
+struct sml_ann_training_job {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    bool done;
+    bool abandoned;
+    int error;
+
+    struct sml_ann_bridge *iann;
+    /* iann is a copy of a cached network, retrained on its own
+       observations. The cached one is only touched by the main thread and
+       is set to NULL if it is freed meanwhile. */
+    bool retrain;
+    struct sml_ann_bridge *retrained;
+    struct sml_variables_list *inputs;
+    struct sml_variables_list *outputs;
+    unsigned int observations;
+    unsigned int required_observations_suggestion;
+    unsigned int max_neurons;
+    float train_error;
+    bool use_pseudorehearsal;
+    bool warm_start;
+    struct sml_ann_bridge **variants;
+    unsigned int variants_len;
+    /* Training duration, only measured if stats are enabled */
+    bool measure_time;
+    uint64_t train_usec;
+};
+
+static void
+_sml_ann_bridge_configure(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann)
+{
+    sml_ann_bridge_set_training_threads(iann, ann_engine->training_threads);
+    sml_ann_bridge_set_quantization(iann, ann_engine->quantization_bits,
+        ann_engine->quantization_max_error);
+}
+
+static bool
+_sml_ann_cache_put(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann)
+{
+    ann_engine->ci_index_valid = false;
+    _sml_ann_bridge_configure(ann_engine, iann);
+    return sml_cache_put(ann_engine->anns_cache, iann);
+}
+
+static int
+_sml_ann_ci_index_update(struct sml_ann_engine *ann_engine)
+{
+    struct sml_cache_node *node;
+    struct sml_ann_bridge *iann;
+    uint16_t dimensions;
+    float *lower, *upper, *point;
+    int r;
+
+    dimensions = sml_ann_variables_list_get_length(ann_engine->inputs);
+    if (ann_engine->ci_index_valid &&
+        sml_ann_ci_index_get_dimensions(ann_engine->ci_index) == dimensions)
+        return 0;
+
+    if (!ann_engine->ci_index ||
+        sml_ann_ci_index_get_dimensions(ann_engine->ci_index) != dimensions) {
+        sml_ann_ci_index_free(ann_engine->ci_index);
+        ann_engine->ci_index = sml_ann_ci_index_new(dimensions);
+        if (!ann_engine->ci_index)
+            return -ENOMEM;
+        point = realloc(ann_engine->ci_point,
+            sizeof(float) * (dimensions ? dimensions * 3 : 1));
+        if (!point) {
+            sml_critical("Could not alloc the confidence interval scratch");
+            sml_ann_ci_index_free(ann_engine->ci_index);
+            ann_engine->ci_index = NULL;
+            return -ENOMEM;
+        }
+        ann_engine->ci_point = point;
+    } else
+        sml_ann_ci_index_clear(ann_engine->ci_index);
+
+    lower = ann_engine->ci_point + dimensions;
+    upper = lower + dimensions;
+    ann_engine->ci_index_untrained = NULL;
+    for (node = sml_cache_get_first(ann_engine->anns_cache); node;
+        node = sml_cache_node_get_next(node)) {
+        iann = sml_cache_node_get_data(node);
+        if (!sml_ann_bridge_is_trained(iann)) {
+            ann_engine->ci_index_untrained = iann;
+            continue;
+        }
+        if (!sml_ann_bridge_get_confidence_intervals(iann, lower, upper,
+            dimensions)) {
+            sml_warning("Confidence intervals of ANN:%p do not match the" \
+                " inputs, ignoring it", iann);
+            continue;
+        }
+        if ((r = sml_ann_ci_index_add(ann_engine->ci_index, iann, lower,
+                upper, sml_ann_bridge_get_confidence_interval_sum(iann))))
+            goto err_exit;
+    }
+
+    if ((r = sml_ann_ci_index_build(ann_engine->ci_index)))
+        goto err_exit;
+    ann_engine->ci_index_valid = true;
+    return 0;
+
+err_exit:
+    sml_ann_ci_index_clear(ann_engine->ci_index);
+    return r;
+}
+
+/* The current input values, with the range minimum for missing ones. Only
+   valid after _sml_ann_ci_index_update() succeeds. */
+static const float *
+_sml_ann_ci_index_point(struct sml_ann_engine *ann_engine)
+{
+    struct sml_variable *var;
+    float *point = ann_engine->ci_point;
+    uint16_t i, len;
+
+    len = sml_ann_variables_list_get_length(ann_engine->inputs);
+    sml_ann_variables_list_get_values(ann_engine->inputs, point);
+    for (i = 0; i < len; i++) {
+        if (isnan(point[i])) {
+            var = sml_ann_variables_list_index(ann_engine->inputs, i);
+            sml_ann_variable_get_range(var, &point[i], NULL);
+        }
+    }
+    return point;
+}
+
 //FIXME: Is this a good approuch?
 static struct sml_variables_list *
 _sml_ann_output_has_significant_changes(struct sml_variables_list *outputs)
@@ -80,7 +261,7 @@ _sml_ann_output_has_significant_changes(struct sml_variables_list *outputs)
     uint16_t i, size;
     struct sml_variable *var;
     float neural_value, read_value;
-    struct sml_variables_list *changed = sml_ann_variable_list_new();
+    struct sml_variables_list *changed = sml_ann_variable_list_new_view();
 
     if (!changed) {
         sml_critical("Could not alloc the output changed list !");
@@ -97,7 +278,7 @@ _sml_ann_output_has_significant_changes(struct sml_variables_list *outputs)
         if (isnan(read_value) ||
             fabs(read_value - neural_value) >= MIN_TRESHOLD) {
             if (sml_ann_variable_list_add_variable(changed, var)) {
-                sml_ann_variable_list_free(changed, false);
+                sml_ann_variable_list_free(changed);
                 sml_critical("Could not add a variable to the changed list!");
                 return NULL;
             }
@@ -114,36 +295,25 @@ static bool
 _sml_ann_variable_list_has_significant_changes(
     struct sml_variables_list *inputs)
 {
-
-    uint16_t i, size;
-    struct sml_variable *var;
-    float last, stable;
-
-    size = sml_ann_variables_list_get_length(inputs);
-    for (i = 0; i < size; i++) {
-        var = sml_ann_variables_list_index(inputs, i);
-        last = sml_ann_variable_get_value(var);
-        stable = sml_ann_variable_get_last_stable_value(var);
-
-        if (!isnan(stable) && !isnan(last)) {
-            if (fabs(last - stable) >= MIN_TRESHOLD)
-                return true;
-        } else if (!(isnan(stable) && isnan(last)))
-            return true;
-    }
-    return false;
+    return sml_ann_variables_list_has_changes_since_stable(inputs,
+        MIN_TRESHOLD);
 }
 
 static unsigned int
 _sml_ann_get_observations_length(struct sml_ann_engine *ann_engine)
 {
-    struct sml_variable *var;
-
-    var = sml_ann_variables_list_index(ann_engine->inputs, 0);
+    return sml_ann_variables_list_get_observations_length(ann_engine->inputs);
+}
 
-    if (!var)
-        return 0;
-    return sml_ann_variable_get_observations_length(var);
+/* Rows kept for a window of required observations */
+static unsigned int
+_sml_ann_observations_capacity(struct sml_ann_engine *ann_engine,
+    unsigned int required_observations)
+{
+    /* Pseudo-rehearsal adds generated observations when retraining */
+    if (ann_engine->use_pseudorehearsal)
+        return required_observations * EXPAND_FACTOR;
+    return required_observations;
 }
 
 static bool
@@ -159,40 +329,200 @@ _sml_ann_can_alloc_memory_for_observations(unsigned int total_variables,
     return final_size <= max_memory_size;
 }
 
+/* Makes room for the required observations in every list. The storage
+   only grows, a smaller window just drops the newest observations. */
 static int
-_sml_ann_train(struct sml_ann_engine *ann_engine, struct sml_ann_bridge *iann,
-    unsigned int observations_size)
+_sml_ann_reserve_observations(struct sml_ann_engine *ann_engine)
 {
+    struct sml_variables_list *lists[] = { ann_engine->inputs,
+                                           ann_engine->outputs,
+                                           ann_engine->pending_add };
+    unsigned int i, capacity;
     int error;
-    unsigned int required_observations_suggestion;
-    bool retrain, can_realloc;
-    uint16_t in_size, out_size, pending_size, i;
-    struct sml_variable *var;
 
-    error = sml_ann_bridge_train(iann, ann_engine->inputs, ann_engine->outputs,
+    capacity = _sml_ann_observations_capacity(ann_engine,
+        ann_engine->required_observations);
+
+    for (i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        if ((error = sml_ann_variables_list_reserve_observations(lists[i],
+                capacity)))
+            return error;
+        sml_ann_variables_list_keep_last_observations(lists[i],
+            ann_engine->required_observations);
+    }
+    return 0;
+}
+
+static struct sml_ann_bridge *
+_sml_ann_variant_create(struct sml_ann_engine *ann_engine, unsigned int n)
+{
+    struct sol_vector functions;
+    struct sml_ann_bridge *iann;
+    enum sml_ann_activation_function *func, *dst;
+    unsigned int candidate_groups;
+    uint16_t i, skip;
+
+    /* Variants use less candidate groups and, if there are several
+       activation function candidates, leave one of them out */
+    candidate_groups = ann_engine->candidate_groups * n /
+        ann_engine->training_variants;
+    if (!candidate_groups)
+        candidate_groups = 1;
+
+    sol_vector_init(&functions, sizeof(enum sml_ann_activation_function));
+    if (ann_engine->activation_functions.len > 1) {
+        skip = (n - 1) % ann_engine->activation_functions.len;
+        SOL_VECTOR_FOREACH_IDX (&ann_engine->activation_functions, func, i) {
+            if (i == skip)
+                continue;
+            dst = sol_vector_append(&functions);
+            if (!dst) {
+                sol_vector_clear(&functions);
+                return NULL;
+            }
+            *dst = *func;
+        }
+    }
+
+    iann = sml_ann_bridge_new(
+        sml_ann_variables_list_get_length(ann_engine->inputs),
+        sml_ann_variables_list_get_length(ann_engine->outputs),
+        candidate_groups,
+        ann_engine->train_epochs,
+        ann_engine->train_algorithm,
+        functions.len ? &functions : &ann_engine->activation_functions,
+        NULL);
+    sol_vector_clear(&functions);
+    return iann;
+}
+
+static void
+_sml_ann_variants_free(struct sml_ann_bridge **variants, unsigned int len)
+{
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+        sml_ann_bridge_free(variants[i]);
+    free(variants);
+}
+
+static struct sml_ann_bridge **
+_sml_ann_variants_new(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann, unsigned int *len)
+{
+    struct sml_ann_bridge **variants;
+    unsigned int i, count;
+
+    *len = 0;
+    if (ann_engine->training_variants <= 1)
+        return NULL;
+
+    count = ann_engine->training_variants - 1;
+    variants = calloc(count, sizeof(struct sml_ann_bridge *));
+    if (!variants) {
+        sml_warning("Could not alloc the training variants");
+        return NULL;
+    }
+
+    /* Retrainings of a trained network start from copies of it */
+    for (i = 0; i < count; i++) {
+        if (sml_ann_bridge_is_trained(iann))
+            variants[i] = sml_ann_bridge_copy(iann);
+        else
+            variants[i] = _sml_ann_variant_create(ann_engine, i + 1);
+        if (!variants[i]) {
+            sml_warning("Could not create the training variant %u", i + 1);
+            break;
+        }
+        _sml_ann_bridge_configure(ann_engine, variants[i]);
+    }
+
+    if (!i) {
+        free(variants);
+        return NULL;
+    }
+    *len = i;
+    return variants;
+}
+
+static int
+_sml_ann_bridge_train(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann, struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs, unsigned int observations_size,
+    unsigned int *required_observations_suggestion, unsigned int time_budget)
+{
+    struct sml_ann_bridge **variants = NULL;
+    unsigned int variants_len = 0;
+    int error;
+
+    _sml_ann_bridge_configure(ann_engine, iann);
+    /* Variants are not trained in slices */
+    if (!time_budget)
+        variants = _sml_ann_variants_new(ann_engine, iann, &variants_len);
+
+    if (variants) {
+        error = sml_ann_bridge_train_variants(iann, variants, variants_len,
+            inputs, outputs,
+            ann_engine->train_error,
+            observations_size,
+            ann_engine->max_neurons,
+            required_observations_suggestion,
+            ann_engine->use_pseudorehearsal,
+            ann_engine->warm_start);
+        _sml_ann_variants_free(variants, variants_len);
+        return error;
+    }
+
+    return sml_ann_bridge_train(iann, inputs, outputs,
         ann_engine->train_error,
         observations_size,
         ann_engine->max_neurons,
-        &required_observations_suggestion,
-        ann_engine->use_pseudorehearsal);
-    if (error)
-        return error;
+        required_observations_suggestion,
+        ann_engine->use_pseudorehearsal,
+        ann_engine->warm_start,
+        time_budget);
+}
+
+static int
+_sml_ann_train_suspend(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann, unsigned int observations_size)
+{
+    sml_debug("Training of ANN:%p will continue in the next process",
+        iann);
+    ann_engine->resume_ann = iann;
+    ann_engine->resume_observations = observations_size;
+    ann_engine->resume_length = 0;
+    return -EINPROGRESS;
+}
+
+/* inputs and outputs hold the observations iann was trained with */
+static int
+_sml_ann_train_finish(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann, struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs,
+    unsigned int required_observations_suggestion)
+{
+    int error = 0;
+    bool retrain, can_realloc;
+    uint16_t in_size, out_size, pending_size;
 
     can_realloc = true;
     retrain = false;
     if (required_observations_suggestion > ann_engine->required_observations) {
         in_size = sml_ann_variables_list_get_length(ann_engine->inputs);
         out_size = sml_ann_variables_list_get_length(ann_engine->outputs);
-        pending_size = sol_ptr_vector_get_len(&ann_engine->pending_add);
+        pending_size = sml_ann_variables_list_get_length(
+            ann_engine->pending_add);
         if (!_sml_ann_can_alloc_memory_for_observations(
             in_size + out_size + pending_size,
-            required_observations_suggestion,
+            _sml_ann_observations_capacity(ann_engine,
+            required_observations_suggestion),
             ann_engine->engine.obs_max_size)) {
             sml_warning("Can not alloc more memory for observations,"   \
                 "obs_max_size has been reached."       \
                 "Considering the network trained");
             can_realloc = false;
-            error = sml_ann_bridge_consider_trained(iann, ann_engine->inputs,
+            error = sml_ann_bridge_consider_trained(iann, inputs,
                 ann_engine->required_observations,
                 ann_engine->use_pseudorehearsal);
         }
@@ -206,31 +536,100 @@ _sml_ann_train(struct sml_ann_engine *ann_engine, struct sml_ann_bridge *iann,
         if (can_realloc) {
             ann_engine->required_observations =
                 required_observations_suggestion;
-            if ((error = sml_ann_variables_list_realloc_observations_array(
-                    ann_engine->inputs, ann_engine->required_observations)))
-                return error;
-            if ((error = sml_ann_variables_list_realloc_observations_array(
-                    ann_engine->outputs, ann_engine->required_observations)))
+            if ((error = _sml_ann_reserve_observations(ann_engine)))
                 return error;
-            SOL_PTR_VECTOR_FOREACH_IDX (&ann_engine->pending_add, var, i) {
-                if ((error = sml_ann_variable_realloc_observation_array(
-                        var, ann_engine->required_observations)))
-                    return error;
-            }
         }
+        /* Background trainings are finished here, in a single call */
         if (retrain) {
-            error = sml_ann_bridge_train(iann, ann_engine->inputs,
-                ann_engine->outputs,
-                ann_engine->train_error,
-                ann_engine->required_observations,
-                ann_engine->max_neurons,
-                NULL,
-                ann_engine->use_pseudorehearsal);
+            error = _sml_ann_bridge_train(ann_engine, iann, inputs, outputs,
+                ann_engine->required_observations, NULL,
+                ann_engine->async_training ? 0 :
+                ann_engine->training_time_budget);
+            if (error == -EINPROGRESS)
+                return _sml_ann_train_suspend(ann_engine, iann,
+                    ann_engine->required_observations);
         }
     }
     return error;
 }
 
+static int
+_sml_ann_train(struct sml_ann_engine *ann_engine, struct sml_ann_bridge *iann,
+    unsigned int observations_size)
+{
+    int error;
+    uint64_t start;
+    unsigned int required_observations_suggestion;
+
+    start = sml_stats_timer_start(&ann_engine->engine);
+    error = _sml_ann_bridge_train(ann_engine, iann, ann_engine->inputs,
+        ann_engine->outputs, observations_size,
+        &required_observations_suggestion, ann_engine->training_time_budget);
+    sml_stats_timer_stop(&ann_engine->engine, SML_STATS_TIMER_ANN_TRAINING,
+        start);
+    /* The network may be in the cache and have become trained */
+    ann_engine->ci_index_valid = false;
+    if (error == -EINPROGRESS)
+        return _sml_ann_train_suspend(ann_engine, iann, observations_size);
+    if (error)
+        return error;
+
+    return _sml_ann_train_finish(ann_engine, iann, ann_engine->inputs,
+        ann_engine->outputs, required_observations_suggestion);
+}
+
+static void
+_sml_ann_keep_last_observations(struct sml_ann_engine *ann_engine,
+    unsigned int length)
+{
+    sml_ann_variables_list_keep_last_observations(ann_engine->inputs, length);
+    sml_ann_variables_list_keep_last_observations(ann_engine->outputs, length);
+}
+
+static void
+_sml_ann_set_observations_length(struct sml_ann_engine *ann_engine,
+    unsigned int length)
+{
+    sml_ann_variables_list_set_observations_length(ann_engine->inputs,
+        length);
+    sml_ann_variables_list_set_observations_length(ann_engine->outputs,
+        length);
+}
+
+static int
+_sml_ann_train_resume(struct sml_ann_engine *ann_engine)
+{
+    struct sml_ann_bridge *iann = ann_engine->resume_ann;
+    unsigned int length = ann_engine->resume_length;
+    int error;
+
+    if (!iann)
+        return 0;
+
+    ann_engine->resume_ann = NULL;
+    error = _sml_ann_train(ann_engine, iann,
+        ann_engine->resume_observations);
+    if (error == -EINPROGRESS) {
+        ann_engine->resume_length = length;
+        return 0;
+    }
+
+    if (length)
+        _sml_ann_set_observations_length(ann_engine, length);
+    if (error) {
+        if (!ann_engine->use_pseudorehearsal)
+            sml_cache_remove(ann_engine->anns_cache, iann);
+        return error;
+    }
+
+    if (sml_ann_bridge_is_trained(iann)) {
+        sml_debug("ANN is trained, reseting variable observations.");
+        sml_ann_variables_list_reset_observations(ann_engine->inputs, false);
+        sml_ann_variables_list_reset_observations(ann_engine->outputs, false);
+    }
+    return 0;
+}
+
 static bool
 _sml_ann_remove_variable_from_sml(struct sml_ann_engine *ann_engine,
     struct sml_variable *var_to_remove, bool input)
@@ -291,6 +690,13 @@ _sml_ann_remove_variable_from_lists(struct sml_ann_engine *ann_engine,
     return true;
 }
 
+static bool
+_sml_ann_has_networks(struct sml_ann_engine *ann_engine)
+{
+    return sml_cache_get_size(ann_engine->anns_cache) ||
+           ann_engine->untrained_ann || ann_engine->training_job;
+}
+
 static struct sml_variable *
 _sml_ann_add_variable(struct sml_ann_engine *ann_engine, const char *name,
     bool input)
@@ -299,46 +705,384 @@ _sml_ann_add_variable(struct sml_ann_engine *ann_engine, const char *name,
     struct sml_variables_list *list;
     unsigned int total;
 
-    if (input)
+    if (_sml_ann_has_networks(ann_engine))
+        list = ann_engine->pending_add;
+    else if (input)
         list = ann_engine->inputs;
     else
         list = ann_engine->outputs;
 
-    var = sml_ann_variable_new(name, input);
-
-    if (!var)
-        return NULL;
-
     total = sml_ann_variables_list_get_length(ann_engine->inputs) +
         sml_ann_variables_list_get_length(ann_engine->outputs) +
-        sol_ptr_vector_get_len(&ann_engine->pending_add) + 1;
+        sml_ann_variables_list_get_length(ann_engine->pending_add) + 1;
     if (!_sml_ann_can_alloc_memory_for_observations(total,
-        ann_engine->required_observations,
-        ann_engine->engine.obs_max_size) ||
-        sml_ann_variable_realloc_observation_array(var,
-        ann_engine->required_observations)) {
+        _sml_ann_observations_capacity(ann_engine,
+        ann_engine->required_observations),
+        ann_engine->engine.obs_max_size)) {
         sml_critical("Could not alloc the observation array!");
-        goto err_exit;
+        return NULL;
     }
-    sml_ann_variable_set_observations_array_index(var,
-        _sml_ann_get_observations_length(ann_engine));
 
-    if (!sml_cache_get_size(ann_engine->anns_cache) &&
-        sml_ann_variable_list_add_variable(list, var)) {
+    var = sml_ann_variables_list_new_variable(list, name, input);
+    if (!var) {
         sml_critical("Could not add the variable to the list");
-        goto err_exit;
-    } else if (sml_cache_get_size(ann_engine->anns_cache) &&
-        sol_ptr_vector_append(&ann_engine->pending_add, var)) {
-        sml_critical("Could not add the variable to the add pending list");
-        goto err_exit;
+        return NULL;
+    }
+
+    if (list == ann_engine->pending_add) {
+        if (sml_ann_variables_list_reserve_observations(list,
+            sml_ann_variables_list_get_observations_capacity(
+            ann_engine->inputs))) {
+            sml_critical("Could not alloc the observation array!");
+            sml_ann_variable_list_remove(list,
+                sml_ann_variables_list_get_length(list) - 1);
+            return NULL;
+        }
+        sml_ann_variables_list_set_observations_length(list,
+            _sml_ann_get_observations_length(ann_engine));
     }
 
     return var;
-err_exit:
-    sml_ann_variable_free(var);
+}
+
+static struct sml_ann_bridge *
+_sml_ann_bridge_create(struct sml_ann_engine *ann_engine, int *error_code)
+{
+    sml_debug("Creating a new ANN!");
+    return sml_ann_bridge_new(
+        sml_ann_variables_list_get_length(ann_engine->inputs),
+        sml_ann_variables_list_get_length(ann_engine->outputs),
+        ann_engine->candidate_groups,
+        ann_engine->train_epochs,
+        ann_engine->train_algorithm,
+        &ann_engine->activation_functions, error_code);
+}
+
+static int
+_sml_ann_fill_pseudo_observations(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs, struct sml_variables_list *outputs,
+    unsigned int observations_size, unsigned int total_size)
+{
+    int r;
+    unsigned int i, j, diff;
+
+    diff = total_size - observations_size;
+
+    if ((r = sml_ann_variables_list_reserve_observations(
+            inputs, total_size))) {
+        sml_debug("Could not expand the input array");
+        return r;
+    }
+
+    if ((r = sml_ann_variables_list_reserve_observations(
+            outputs, total_size))) {
+        sml_debug("Could not expand the output array");
+        return r;
+    }
+
+    //Generate inputs
+    sml_ann_variables_list_fill_with_random_values(inputs, diff);
+
+    //Predict the outputs
+    for (i = 0, j = observations_size; i < diff; i++, j++)
+        sml_ann_bridge_predict_output_by_index(iann, inputs, outputs, j);
+
+    return 0;
+}
+
+static void
+_sml_ann_training_job_free(struct sml_ann_training_job *job)
+{
+    if (job->iann)
+        sml_ann_bridge_free(job->iann);
+    _sml_ann_variants_free(job->variants, job->variants_len);
+    if (job->inputs)
+        sml_ann_variable_list_free(job->inputs);
+    if (job->outputs)
+        sml_ann_variable_list_free(job->outputs);
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
+
+static void *
+_sml_ann_training_job_run(void *data)
+{
+    struct sml_ann_training_job *job = data;
+    unsigned int observations = job->observations;
+    uint64_t start = 0;
+    bool abandoned;
+
+    if (job->measure_time)
+        start = sml_stats_now();
+
+    if (job->retrain) {
+        job->error = sml_ann_bridge_retrain(job->iann, 0);
+        goto end;
+    }
+
+    job->required_observations_suggestion = job->observations;
+    if (job->use_pseudorehearsal && sml_ann_bridge_is_trained(job->iann)) {
+        if (sml_ann_bridge_get_error(job->iann, job->inputs, job->outputs,
+            observations) <= job->train_error) {
+            sml_debug("Not retraining the ANN. Error is good enought");
+            goto end;
+        }
+        observations *= EXPAND_FACTOR;
+        if ((job->error = _sml_ann_fill_pseudo_observations(job->iann,
+                job->inputs, job->outputs, job->observations, observations)))
+            goto end;
+    }
+
+    if (job->variants)
+        job->error = sml_ann_bridge_train_variants(job->iann, job->variants,
+            job->variants_len, job->inputs, job->outputs,
+            job->train_error,
+            observations,
+            job->max_neurons,
+            &job->required_observations_suggestion,
+            job->use_pseudorehearsal,
+            job->warm_start);
+    else
+        job->error = sml_ann_bridge_train(job->iann, job->inputs,
+            job->outputs,
+            job->train_error,
+            observations,
+            job->max_neurons,
+            &job->required_observations_suggestion,
+            job->use_pseudorehearsal,
+            job->warm_start, 0);
+
+end:
+    if (start)
+        job->train_usec = sml_stats_now() - start;
+    pthread_mutex_lock(&job->lock);
+    job->done = true;
+    abandoned = job->abandoned;
+    pthread_mutex_unlock(&job->lock);
+
+    if (abandoned) {
+        sml_debug("Training job was abandoned, discarding the ANN");
+        _sml_ann_training_job_free(job);
+    }
     return NULL;
 }
 
+static int
+_sml_ann_training_job_start(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann, unsigned int observations)
+{
+    struct sml_ann_training_job *job;
+    int r;
+
+    job = calloc(1, sizeof(struct sml_ann_training_job));
+    if (!job) {
+        sml_critical("Could not alloc the training job");
+        return -ENOMEM;
+    }
+
+    job->inputs = sml_ann_variable_list_dup(ann_engine->inputs, observations);
+    if (!job->inputs) {
+        sml_critical("Could not copy the input observations");
+        r = -ENOMEM;
+        goto err_inputs;
+    }
+
+    job->outputs = sml_ann_variable_list_dup(ann_engine->outputs,
+        observations);
+    if (!job->outputs) {
+        sml_critical("Could not copy the output observations");
+        r = -ENOMEM;
+        goto err_outputs;
+    }
+
+    if ((r = pthread_mutex_init(&job->lock, NULL))) {
+        sml_critical("Could not create the training job lock");
+        r = -r;
+        goto err_lock;
+    }
+
+    job->iann = iann;
+    job->observations = observations;
+    job->max_neurons = ann_engine->max_neurons;
+    job->train_error = ann_engine->train_error;
+    job->measure_time = ann_engine->engine.stats_enabled;
+    job->use_pseudorehearsal = ann_engine->use_pseudorehearsal;
+    job->warm_start = ann_engine->warm_start;
+    _sml_ann_bridge_configure(ann_engine, iann);
+    job->variants = _sml_ann_variants_new(ann_engine, iann,
+        &job->variants_len);
+
+    if ((r = pthread_create(&job->thread, NULL, _sml_ann_training_job_run,
+            job))) {
+        sml_critical("Could not create the training thread");
+        r = -r;
+        goto err_thread;
+    }
+    pthread_detach(job->thread);
+
+    sml_debug("Training ANN:%p in background with %d observations", iann,
+        observations);
+    ann_engine->training_job = job;
+    ann_engine->job_observations = 0;
+    return 0;
+
+err_thread:
+    _sml_ann_variants_free(job->variants, job->variants_len);
+    pthread_mutex_destroy(&job->lock);
+err_lock:
+    sml_ann_variable_list_free(job->outputs);
+err_outputs:
+    sml_ann_variable_list_free(job->inputs);
+err_inputs:
+    free(job);
+    return r;
+}
+
+static void
+_sml_ann_training_job_abandon(struct sml_ann_engine *ann_engine)
+{
+    struct sml_ann_training_job *job = ann_engine->training_job;
+    bool done;
+
+    if (!job)
+        return;
+
+    ann_engine->training_job = NULL;
+    pthread_mutex_lock(&job->lock);
+    done = job->done;
+    if (!done)
+        job->abandoned = true;
+    pthread_mutex_unlock(&job->lock);
+
+    if (done)
+        _sml_ann_training_job_free(job);
+}
+
+static void
+_sml_ann_discard_training(struct sml_ann_engine *ann_engine)
+{
+    _sml_ann_training_job_abandon(ann_engine);
+    ann_engine->resume_ann = NULL;
+    if (ann_engine->untrained_ann) {
+        sml_ann_bridge_free(ann_engine->untrained_ann);
+        ann_engine->untrained_ann = NULL;
+    }
+}
+
+static int
+_sml_ann_train_async(struct sml_ann_engine *ann_engine)
+{
+    struct sml_ann_bridge *iann;
+    int r;
+
+    if (ann_engine->untrained_ann) {
+        iann = ann_engine->untrained_ann;
+        ann_engine->untrained_ann = NULL;
+        sml_debug("Trying to train a previous created ANN.");
+    } else if (ann_engine->use_pseudorehearsal &&
+        sml_cache_get_size(ann_engine->anns_cache)) {
+        /* Train a copy, the published ANN is still used to predict */
+        iann = sml_ann_bridge_copy(
+            sml_cache_get_element(ann_engine->anns_cache, 0));
+        if (!iann)
+            return -ENOMEM;
+    } else {
+        iann = _sml_ann_bridge_create(ann_engine, &r);
+        if (!iann)
+            return r;
+    }
+
+    if ((r = _sml_ann_training_job_start(ann_engine, iann,
+            ann_engine->required_observations))) {
+        if (sml_ann_bridge_is_trained(iann))
+            sml_ann_bridge_free(iann);
+        else
+            ann_engine->untrained_ann = iann;
+    }
+    return r;
+}
+
+static int
+_sml_ann_training_job_collect(struct sml_ann_engine *ann_engine)
+{
+    struct sml_ann_training_job *job = ann_engine->training_job;
+    struct sml_ann_bridge *iann;
+    unsigned int required_observations_suggestion;
+    bool done, trained = false;
+    int error;
+
+    if (!job)
+        return 0;
+
+    pthread_mutex_lock(&job->lock);
+    done = job->done;
+    pthread_mutex_unlock(&job->lock);
+    if (!done)
+        return 0;
+
+    ann_engine->training_job = NULL;
+    iann = job->iann;
+    job->iann = NULL;
+    error = job->error;
+    required_observations_suggestion = job->required_observations_suggestion;
+    if (job->measure_time)
+        sml_stats_record(&ann_engine->engine, SML_STATS_TIMER_ANN_TRAINING,
+            job->train_usec);
+
+    if (job->retrain) {
+        trained = !error && job->retrained;
+        if (trained) {
+            sml_debug("Publishing the retrained weights of ANN:%p",
+                job->retrained);
+            sml_ann_bridge_take_weights(job->retrained, iann);
+        } else
+            sml_ann_bridge_free(iann);
+        _sml_ann_training_job_free(job);
+        goto end;
+    }
+
+    if (!error)
+        error = _sml_ann_train_finish(ann_engine, iann, job->inputs,
+            job->outputs, required_observations_suggestion);
+    _sml_ann_training_job_free(job);
+    if (error) {
+        sml_critical("Could not train the neural network");
+        sml_ann_bridge_free(iann);
+        _sml_ann_keep_last_observations(ann_engine,
+            ann_engine->job_observations);
+        goto end;
+    }
+
+    trained = sml_ann_bridge_is_trained(iann);
+    if (!trained) {
+        sml_debug("ANN is not trained yet, waiting for more observations.");
+        ann_engine->untrained_ann = iann;
+        goto end;
+    }
+
+    /* Pseudorehearsal only keeps the most recent network */
+    if (ann_engine->use_pseudorehearsal)
+        sml_cache_clear(ann_engine->anns_cache);
+
+    if (!_sml_ann_cache_put(ann_engine, iann)) {
+        sml_critical("Could not add the trained ANN to the cache");
+        sml_ann_bridge_free(iann);
+        error = -ENOMEM;
+        trained = false;
+        goto end;
+    }
+
+    sml_debug("ANN is trained, keeping the observations stored while it" \
+        " was trained.");
+    _sml_ann_keep_last_observations(ann_engine, ann_engine->job_observations);
+
+end:
+    if (ann_engine->training_finished_cb)
+        ann_engine->training_finished_cb((struct sml_object *)ann_engine,
+            trained, ann_engine->training_finished_cb_data);
+    return error;
+}
+
 static struct sml_ann_bridge *
 _sml_ann_new(struct sml_ann_engine *ann_engine, int *error_code)
 {
@@ -349,19 +1093,13 @@ _sml_ann_new(struct sml_ann_engine *ann_engine, int *error_code)
         return sml_cache_get_element(ann_engine->anns_cache, 0);
     }
 
-    sml_debug("Creating a new ANN!");
-    struct sml_ann_bridge *iann = sml_ann_bridge_new(
-        sml_ann_variables_list_get_length(ann_engine->inputs),
-        sml_ann_variables_list_get_length(ann_engine->outputs),
-        ann_engine->candidate_groups,
-        ann_engine->train_epochs,
-        ann_engine->train_algorithm,
-        &ann_engine->activation_functions, error_code);
+    struct sml_ann_bridge *iann = _sml_ann_bridge_create(ann_engine,
+        error_code);
 
     if (!iann)
         return NULL;
 
-    if (!sml_cache_put(ann_engine->anns_cache, iann)) {
+    if (!_sml_ann_cache_put(ann_engine, iann)) {
         sml_ann_bridge_free(iann);
         if (error_code)
             *error_code = -ENOMEM;
@@ -381,7 +1119,7 @@ _sml_ann_change_ann_layout_if_needed(struct sml_ann_engine *ann_engine)
     bool changed = false;
     int error;
 
-    if (!sol_ptr_vector_get_len(&ann_engine->pending_add) &&
+    if (!sml_ann_variables_list_get_length(ann_engine->pending_add) &&
         !sol_ptr_vector_get_len(&ann_engine->pending_remove))
         return 0;
 
@@ -389,7 +1127,7 @@ _sml_ann_change_ann_layout_if_needed(struct sml_ann_engine *ann_engine)
     outputs = sml_ann_variables_list_get_length(ann_engine->outputs);
 
     /* Check the new number of inputs/outputs */
-    SOL_PTR_VECTOR_FOREACH_IDX (&ann_engine->pending_add, var, i) {
+    while ((var = sml_ann_variables_list_index(ann_engine->pending_add, 0))) {
         if (sml_ann_variable_is_input(var)) {
             inputs++;
             list = ann_engine->inputs;
@@ -400,7 +1138,10 @@ _sml_ann_change_ann_layout_if_needed(struct sml_ann_engine *ann_engine)
             sml_debug("Adding output variable");
         }
         changed = true;
-        sml_ann_variable_list_add_variable(list, var);
+        if ((error = sml_ann_variables_list_move_variable(list, var))) {
+            sml_critical("Could not move the pending variable");
+            return error;
+        }
     }
 
     SOL_PTR_VECTOR_FOREACH_IDX (&ann_engine->pending_remove, var, i) {
@@ -418,19 +1159,29 @@ _sml_ann_change_ann_layout_if_needed(struct sml_ann_engine *ann_engine)
     }
 
     sol_ptr_vector_clear(&ann_engine->pending_remove);
-    sol_ptr_vector_clear(&ann_engine->pending_add);
 
     if (changed) {
+        _sml_ann_discard_training(ann_engine);
         sml_cache_clear(ann_engine->anns_cache);
-        iann = _sml_ann_new(ann_engine, &error);
-        if (!iann) {
-            sml_critical("Could not create a new ANN");
-            return error;
-        }
         ann_engine->max_neurons = 0;
-        if ((error = _sml_ann_train(ann_engine, iann,
-                ann_engine->required_observations)))
-            return error;
+        if (ann_engine->async_training) {
+            if ((error = _sml_ann_train_async(ann_engine))) {
+                sml_critical("Could not start the ANN training");
+                return error;
+            }
+        } else {
+            iann = _sml_ann_new(ann_engine, &error);
+            if (!iann) {
+                sml_critical("Could not create a new ANN");
+                return error;
+            }
+            error = _sml_ann_train(ann_engine, iann,
+                ann_engine->required_observations);
+            if (error == -EINPROGRESS)
+                return 0;
+            if (error)
+                return error;
+        }
         sml_ann_variables_list_reset_observations(ann_engine->inputs, false);
         sml_ann_variables_list_reset_observations(ann_engine->outputs, false);
     }
@@ -451,7 +1202,8 @@ _sml_ann_alloc_arrays_if_needed(struct sml_ann_engine *ann_engine)
     outputs = sml_ann_variables_list_get_length(ann_engine->outputs);
 
     while (!_sml_ann_can_alloc_memory_for_observations(inputs + outputs,
-        ann_engine->required_observations,
+        _sml_ann_observations_capacity(ann_engine,
+        ann_engine->required_observations),
         ann_engine->engine.obs_max_size))
         ann_engine->required_observations /= 2;
 
@@ -461,17 +1213,9 @@ _sml_ann_alloc_arrays_if_needed(struct sml_ann_engine *ann_engine)
         return -ENOMEM;
     }
 
-    error = sml_ann_variables_list_realloc_observations_array(
-        ann_engine->inputs, ann_engine->required_observations);
+    error = _sml_ann_reserve_observations(ann_engine);
     if (error) {
-        sml_critical("Could not alloc the input observation arrays");
-        return error;
-    }
-
-    error = sml_ann_variables_list_realloc_observations_array(
-        ann_engine->outputs, ann_engine->required_observations);
-    if (error) {
-        sml_critical("Could not alloc the output observation arrays");
+        sml_critical("Could not alloc the observation arrays");
         return error;
     }
 
@@ -479,22 +1223,23 @@ _sml_ann_alloc_arrays_if_needed(struct sml_ann_engine *ann_engine)
 }
 
 static struct sml_ann_bridge *
-_sml_ann_get_best_ann_for_latest_observations(struct sml_ann_engine *ann_engine)
+_sml_ann_get_best_ann_by_scan(struct sml_ann_engine *ann_engine)
 {
-    struct sol_ptr_vector *anns;
+    struct sml_cache_node *node;
     struct sml_ann_bridge *iann, *best_ann;
     unsigned int i;
     float sum_iann, sum_best, distance, min;
 
-    anns = sml_cache_get_elements(ann_engine->anns_cache);
     best_ann = NULL;
     min = FLT_MAX;
     sum_best = FLT_MAX;
 
-    sml_debug("Selecting best ANN. Neural networks size: %d",
-        sol_ptr_vector_get_len(anns));
+    sml_debug("Selecting best ANN. Neural networks size: %" PRIu32,
+        sml_cache_get_size(ann_engine->anns_cache));
 
-    SOL_PTR_VECTOR_FOREACH_IDX (anns, iann, i) {
+    for (node = sml_cache_get_first(ann_engine->anns_cache), i = 0; node;
+        node = sml_cache_node_get_next(node), i++) {
+        iann = sml_cache_node_get_data(node);
         sml_debug("Neural network:%d", i);
         if (!sml_ann_bridge_is_trained(iann)) {
             sml_debug("ANN is not trained, skip");
@@ -515,6 +1260,19 @@ _sml_ann_get_best_ann_for_latest_observations(struct sml_ann_engine *ann_engine)
             }
         }
     }
+    return best_ann;
+}
+
+static struct sml_ann_bridge *
+_sml_ann_get_best_ann_for_latest_observations(struct sml_ann_engine *ann_engine)
+{
+    struct sml_ann_bridge *best_ann;
+
+    if (!_sml_ann_ci_index_update(ann_engine))
+        best_ann = sml_ann_ci_index_nearest(ann_engine->ci_index,
+            _sml_ann_ci_index_point(ann_engine));
+    else
+        best_ann = _sml_ann_get_best_ann_by_scan(ann_engine);
 
     if (best_ann)
         sml_cache_hit(ann_engine->anns_cache, best_ann);
@@ -525,19 +1283,17 @@ static void
 _sml_ann_engine_free(struct sml_engine *engine)
 {
     struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
-    uint16_t i;
-    struct sml_variable *var;
 
-    sml_ann_variable_list_free(ann_engine->inputs, true);
-    sml_ann_variable_list_free(ann_engine->outputs, true);
+    _sml_ann_discard_training(ann_engine);
+    sml_ann_variable_list_free(ann_engine->inputs);
+    sml_ann_variable_list_free(ann_engine->outputs);
 
     sml_cache_free(ann_engine->anns_cache);
+    sml_ann_bridge_file_close(ann_engine->packed_file);
+    sml_ann_ci_index_free(ann_engine->ci_index);
+    free(ann_engine->ci_point);
     sol_ptr_vector_clear(&ann_engine->pending_remove);
-
-    SOL_PTR_VECTOR_FOREACH_IDX (&ann_engine->pending_add, var, i)
-        sml_ann_variable_free(var);
-
-    sol_ptr_vector_clear(&ann_engine->pending_add);
+    sml_ann_variable_list_free(ann_engine->pending_add);
     sol_vector_clear(&ann_engine->activation_functions);
     free(ann_engine);
 }
@@ -583,13 +1339,10 @@ _sml_ann_pseudorehearsal_train(struct sml_ann_engine *ann_engine,
 {
 
     int r;
-    unsigned int total_size, diff, i, j, len, old_size;
-    struct sml_variable *var;
+    unsigned int total_size, old_size;
 
-    len = sml_ann_variables_list_get_length(ann_engine->inputs);
     old_size = ann_engine->required_observations;
     total_size = ann_engine->required_observations * EXPAND_FACTOR;
-    diff = total_size - ann_engine->required_observations;
 
     if (!sml_ann_bridge_is_trained(iann)) {
         sml_debug("ANN is not trained yet, training with the usual way");
@@ -603,54 +1356,180 @@ _sml_ann_pseudorehearsal_train(struct sml_ann_engine *ann_engine,
         return 0;
     }
 
-    if ((r = sml_ann_variables_list_realloc_observations_array(
-            ann_engine->inputs, total_size))) {
-        sml_debug("Could not expand the input array");
-        return r;
-    }
+    if ((r = _sml_ann_fill_pseudo_observations(iann, ann_engine->inputs,
+            ann_engine->outputs, old_size, total_size)))
+        goto exit;
 
-    if ((r = sml_ann_variables_list_realloc_observations_array(
-            ann_engine->outputs, total_size))) {
-        sml_debug("Could not expand the output array");
-        return r;
+    //Now train!
+    if ((r = _sml_ann_train(ann_engine, iann, total_size))) {
+        if (r == -EINPROGRESS) {
+            /* The generated observations are dropped once resumed */
+            ann_engine->resume_length = old_size;
+            return r;
+        }
+        sml_debug("Could not retrain the ANN!");
     }
 
-    //Generate inputs
-    for (i = 0; i < len; i++) {
-        var = sml_ann_variables_list_index(ann_engine->inputs, i);
-        sml_ann_variable_fill_with_random_values(var, diff);
+exit:
+    /* Drop the generated observations, the storage is kept for the
+       next retraining */
+    _sml_ann_set_observations_length(ann_engine, old_size);
+    return r;
+}
+
+static int
+_sml_ann_retrain_async(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann)
+{
+    struct sml_ann_training_job *job;
+    int r;
+
+    job = calloc(1, sizeof(struct sml_ann_training_job));
+    if (!job) {
+        sml_critical("Could not alloc the training job");
+        return -ENOMEM;
     }
 
-    //Predict the outputs
-    for (i = 0, j = ann_engine->required_observations; i < diff; i++, j++) {
-        sml_ann_bridge_predict_output_by_index(iann, ann_engine->inputs,
-            ann_engine->outputs, j);
+    /* The cached network keeps predicting while its copy is trained */
+    job->iann = sml_ann_bridge_copy(iann);
+    if (!job->iann) {
+        r = -ENOMEM;
+        goto err_copy;
     }
 
-    //Now train!
-    if ((r = _sml_ann_train(ann_engine, iann, total_size))) {
-        sml_debug("Could not retrain the ANN!");
-        return r;
+    if ((r = pthread_mutex_init(&job->lock, NULL))) {
+        sml_critical("Could not create the training job lock");
+        r = -r;
+        goto err_lock;
     }
 
-    len = sml_ann_variables_list_get_length(ann_engine->inputs);
-    for (i = 0; i < len; i++) {
-        var = sml_ann_variables_list_index(ann_engine->inputs, i);
-        sml_ann_variable_set_observations_array_index(var, old_size);
+    job->retrain = true;
+    job->retrained = iann;
+    job->measure_time = ann_engine->engine.stats_enabled;
+
+    if ((r = pthread_create(&job->thread, NULL, _sml_ann_training_job_run,
+            job))) {
+        sml_critical("Could not create the training thread");
+        r = -r;
+        goto err_thread;
     }
+    pthread_detach(job->thread);
 
-    //reset values
-    sml_ann_variables_list_realloc_observations_array(ann_engine->inputs,
-        old_size);
-    sml_ann_variables_list_realloc_observations_array(ann_engine->outputs,
-        old_size);
+    sml_debug("Retraining ANN:%p in background", iann);
+    /* The copy took the observations, new ones are stored for the next
+       retraining */
+    sml_ann_bridge_reset_observations(iann);
+    ann_engine->training_job = job;
     return 0;
+
+err_thread:
+    pthread_mutex_destroy(&job->lock);
+err_lock:
+    sml_ann_bridge_free(job->iann);
+err_copy:
+    free(job);
+    return r;
+}
+
+/* Retrains a cached network once it stored the required observations */
+static void
+_sml_ann_retrain(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann)
+{
+    uint64_t start;
+    int r;
+
+    if (ann_engine->async_training) {
+        /* Started once the running job is collected */
+        if (ann_engine->training_job) {
+            ann_engine->retrain_pending = true;
+            return;
+        }
+        if ((r = _sml_ann_retrain_async(ann_engine, iann))) {
+            sml_warning("Could not retrain ANN:%p, dropping its" \
+                " observations: %d", iann, r);
+            sml_ann_bridge_reset_observations(iann);
+        }
+        return;
+    }
+
+    /* A single training is sliced by the time budget at a time */
+    if (ann_engine->training_time_budget &&
+        (ann_engine->resume_ann || ann_engine->retrain_ann)) {
+        ann_engine->retrain_pending = true;
+        return;
+    }
+
+    start = sml_stats_timer_start(&ann_engine->engine);
+    r = sml_ann_bridge_retrain(iann, ann_engine->training_time_budget);
+    sml_stats_timer_stop(&ann_engine->engine, SML_STATS_TIMER_ANN_TRAINING,
+        start);
+    if (r == -EINPROGRESS) {
+        sml_debug("Retraining of ANN:%p will continue in the next process",
+            iann);
+        ann_engine->retrain_ann = iann;
+    }
+}
+
+static void
+_sml_ann_retrain_resume(struct sml_ann_engine *ann_engine)
+{
+    struct sml_ann_bridge *iann = ann_engine->retrain_ann;
+    uint64_t start;
+
+    if (!iann)
+        return;
+
+    start = sml_stats_timer_start(&ann_engine->engine);
+    if (sml_ann_bridge_retrain(iann, ann_engine->training_time_budget) !=
+        -EINPROGRESS)
+        ann_engine->retrain_ann = NULL;
+    sml_stats_timer_stop(&ann_engine->engine, SML_STATS_TIMER_ANN_TRAINING,
+        start);
+}
+
+static void
+_sml_ann_retrain_pending(struct sml_ann_engine *ann_engine)
+{
+    struct sml_cache_node *node;
+    struct sml_ann_bridge *iann;
+
+    if (!ann_engine->retrain_pending || ann_engine->training_job ||
+        ann_engine->resume_ann || ann_engine->retrain_ann)
+        return;
+
+    /* The first network is retrained, the others are pending again */
+    ann_engine->retrain_pending = false;
+    for (node = sml_cache_get_first(ann_engine->anns_cache); node;
+        node = sml_cache_node_get_next(node)) {
+        iann = sml_cache_node_get_data(node);
+        if (!sml_ann_bridge_needs_retrain(iann))
+            continue;
+        _sml_ann_retrain(ann_engine, iann);
+        /* A single retraining per call if they are limited in time */
+        if (!ann_engine->async_training &&
+            ann_engine->training_time_budget) {
+            ann_engine->retrain_pending = true;
+            return;
+        }
+    }
+}
+
+static void
+_sml_ann_add_observation_cb(void *data, void *cb_data)
+{
+    struct sml_ann_engine *ann_engine = cb_data;
+
+    if (sml_ann_bridge_add_observation(data, ann_engine->inputs,
+        ann_engine->outputs))
+        _sml_ann_retrain(ann_engine, data);
+    sml_debug("Adding current observation to ANN:%p", data);
 }
 
 static int
 _sml_ann_store_observations(struct sml_ann_engine *ann_engine)
 {
-    struct sol_ptr_vector *anns;
+    struct sml_cache_node *node;
     struct sml_ann_bridge *iann, *to_train;
     unsigned int hits, i, input_len;
     int r;
@@ -663,11 +1542,20 @@ _sml_ann_store_observations(struct sml_ann_engine *ann_engine)
 
     use_common_pool = true;
     to_train = NULL;
-    if (!ann_engine->use_pseudorehearsal) {
-        anns = sml_cache_get_elements(ann_engine->anns_cache);
+    if (!ann_engine->use_pseudorehearsal &&
+        !_sml_ann_ci_index_update(ann_engine)) {
+        to_train = ann_engine->ci_index_untrained;
+        if (sml_ann_ci_index_foreach_containing(ann_engine->ci_index,
+            _sml_ann_ci_index_point(ann_engine), _sml_ann_add_observation_cb,
+            ann_engine))
+            use_common_pool = false;
+    } else if (!ann_engine->use_pseudorehearsal) {
         input_len = sml_ann_variables_list_get_length(ann_engine->inputs);
-        sml_debug("Total ANNS:%d", sol_ptr_vector_get_len(anns));
-        SOL_PTR_VECTOR_FOREACH_IDX (anns, iann, i) {
+        sml_debug("Total ANNS:%" PRIu32,
+            sml_cache_get_size(ann_engine->anns_cache));
+        for (node = sml_cache_get_first(ann_engine->anns_cache), i = 0; node;
+            node = sml_cache_node_get_next(node), i++) {
+            iann = sml_cache_node_get_data(node);
             if (!sml_ann_bridge_is_trained(iann)) {
                 sml_debug("ANN is not trained, skip");
                 to_train = iann;
@@ -677,14 +1565,33 @@ _sml_ann_store_observations(struct sml_ann_engine *ann_engine)
                 ann_engine->inputs);
             if (hits == input_len) {
                 use_common_pool = false;
-                sml_ann_bridge_add_observation(iann, ann_engine->inputs,
-                    ann_engine->outputs);
+                if (sml_ann_bridge_add_observation(iann, ann_engine->inputs,
+                    ann_engine->outputs))
+                    _sml_ann_retrain(ann_engine, iann);
                 sml_debug("Adding current observation to ANN:%d", i);
             }
         }
     }
 
     if (use_common_pool) {
+        /* The training resumed in the next calls uses the stored
+           observations */
+        if (ann_engine->resume_ann) {
+            sml_debug("Training in progress, not storing the observation in" \
+                " the common pool");
+            return 0;
+        }
+
+        /* A background training uses its own copy of the observations,
+           the most recent ones keep being stored meanwhile */
+        if (_sml_ann_get_observations_length(ann_engine) >=
+            ann_engine->required_observations)
+            _sml_ann_keep_last_observations(ann_engine,
+                ann_engine->required_observations - 1);
+        if (ann_engine->training_job &&
+            ann_engine->job_observations < ann_engine->required_observations)
+            ann_engine->job_observations++;
+
         sml_debug("Storing observation in the common pool %d",
             _sml_ann_get_observations_length(ann_engine));
         sml_ann_variables_list_add_last_value_to_observation(
@@ -692,8 +1599,15 @@ _sml_ann_store_observations(struct sml_ann_engine *ann_engine)
         sml_ann_variables_list_add_last_value_to_observation(
             ann_engine->outputs);
 
-        if (_sml_ann_get_observations_length(ann_engine) ==
+        if (!ann_engine->training_job &&
+            _sml_ann_get_observations_length(ann_engine) ==
             ann_engine->required_observations) {
+            if (ann_engine->async_training) {
+                if ((r = _sml_ann_train_async(ann_engine)))
+                    sml_critical("Could not start the ANN training");
+                return r;
+            }
+
             if (!to_train) {
                 iann = _sml_ann_new(ann_engine, &r);
                 if (!iann) {
@@ -706,14 +1620,20 @@ _sml_ann_store_observations(struct sml_ann_engine *ann_engine)
             }
 
             if (!ann_engine->use_pseudorehearsal) {
-                if ((r = _sml_ann_train(ann_engine, iann,
-                        ann_engine->required_observations))) {
+                r = _sml_ann_train(ann_engine, iann,
+                    ann_engine->required_observations);
+                if (r == -EINPROGRESS)
+                    return 0;
+                if (r) {
                     sml_critical("Could not train the neural network");
                     sml_cache_remove(ann_engine->anns_cache, iann);
                     return r;
                 }
             } else {
-                if ((r = _sml_ann_pseudorehearsal_train(ann_engine, iann))) {
+                r = _sml_ann_pseudorehearsal_train(ann_engine, iann);
+                if (r == -EINPROGRESS)
+                    return 0;
+                if (r) {
                     sml_critical("Could not train the neural network");
                     return r;
                 }
@@ -727,30 +1647,45 @@ _sml_ann_store_observations(struct sml_ann_engine *ann_engine)
         }
     }
     return 0;
-}
-
-static int
-_sml_ann_process(struct sml_engine *engine)
-{
-    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
-    bool r, significant_changes, should_act;
-    int error = 0;
-    struct sml_ann_bridge *iann;
-    struct sml_variables_list *changed;
+}
+
+static int
+_sml_ann_prepare_process(struct sml_ann_engine *ann_engine)
+{
+    int error;
 
     if ((error = _sml_ann_alloc_arrays_if_needed(ann_engine))) {
         sml_critical("Could not alloc observation arrays123! %d", error);
         return error;
     }
 
+    /* Publishes the ANN trained in background, if it is ready */
+    if ((error = _sml_ann_training_job_collect(ann_engine)))
+        sml_warning("Background training failed: %d", error);
+
+    /* Continues the trainings stopped by the time budget */
+    if ((error = _sml_ann_train_resume(ann_engine)))
+        sml_warning("Could not train the neural network: %d", error);
+    _sml_ann_retrain_resume(ann_engine);
+    _sml_ann_retrain_pending(ann_engine);
+
     /* Changes the ANN layout if variables were added/removed */
     if ((error = _sml_ann_change_ann_layout_if_needed(ann_engine))) {
         sml_critical("Could not change the ANN layout");
         return error;
     }
 
-    if ((error = sml_call_read_state_cb(&ann_engine->engine)))
-        return error;
+    return 0;
+}
+
+static int
+_sml_ann_process_observation(struct sml_ann_engine *ann_engine)
+{
+    bool r, significant_changes, should_act;
+    uint64_t start;
+    int error = 0;
+    struct sml_ann_bridge *iann;
+    struct sml_variables_list *changed;
 
     should_act = false;
     if (ann_engine->first_run) {
@@ -778,7 +1713,10 @@ _sml_ann_process(struct sml_engine *engine)
     if (ann_engine->engine.hits == ann_engine->engine.stabilization_hits) {
         ann_engine->engine.hits = 0;
         should_act = true;
+        start = sml_stats_timer_start(&ann_engine->engine);
         _sml_ann_store_observations(ann_engine);
+        sml_stats_timer_stop(&ann_engine->engine,
+            SML_STATS_TIMER_OBSERVATION_HIT, start);
         sml_debug("Reads are stabilized!");
     } else
         ann_engine->engine.hits++;
@@ -793,8 +1731,11 @@ _sml_ann_process(struct sml_engine *engine)
 
         if (iann && sml_ann_bridge_is_trained(iann)) {
             sml_debug("Trying to predict output");
+            start = sml_stats_timer_start(&ann_engine->engine);
             r = sml_ann_bridge_predict_output(iann, ann_engine->inputs,
                 ann_engine->outputs);
+            sml_stats_timer_stop(&ann_engine->engine, SML_STATS_TIMER_PREDICT,
+                start);
             if (r) {
                 changed = _sml_ann_output_has_significant_changes(
                     ann_engine->outputs);
@@ -806,7 +1747,7 @@ _sml_ann_process(struct sml_engine *engine)
                 } else
                     sml_debug("Not calling changed cb.");
                 if (changed)
-                    sml_ann_variable_list_free(changed, false);
+                    sml_ann_variable_list_free(changed);
             } else
                 sml_critical("Could not predict the output");
         } else
@@ -816,11 +1757,76 @@ _sml_ann_process(struct sml_engine *engine)
     return error;
 }
 
+static int
+_sml_ann_process(struct sml_engine *engine)
+{
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
+    int error;
+
+    if ((error = _sml_ann_prepare_process(ann_engine)))
+        return error;
+
+    if ((error = sml_call_read_state_cb(&ann_engine->engine)))
+        return error;
+
+    return _sml_ann_process_observation(ann_engine);
+}
+
+static int
+_sml_ann_process_batch(struct sml_engine *engine, const float *inputs,
+    const float *outputs, size_t rows, size_t stride)
+{
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
+    size_t row, in_stride, out_stride;
+    uint16_t in_len, out_len;
+    int error;
+
+    /* Variables added before the call are part of the rows */
+    if ((error = _sml_ann_prepare_process(ann_engine)))
+        return error;
+
+    in_len = sml_ann_variables_list_get_length(ann_engine->inputs);
+    out_len = sml_ann_variables_list_get_length(ann_engine->outputs);
+    if (stride && (stride < in_len || (outputs && stride < out_len))) {
+        sml_warning("Invalid stride %zu. Inputs: %d Outputs: %d", stride,
+            in_len, out_len);
+        return -EINVAL;
+    }
+    in_stride = stride ? stride : in_len;
+    out_stride = stride ? stride : out_len;
+
+    for (row = 0; row < rows; row++) {
+        if (row && (error = _sml_ann_prepare_process(ann_engine)))
+            return error;
+
+        if (sml_ann_variables_list_get_length(ann_engine->inputs) != in_len ||
+            (outputs &&
+            sml_ann_variables_list_get_length(ann_engine->outputs) !=
+            out_len)) {
+            sml_warning("Variables changed while processing a batch");
+            return -EINVAL;
+        }
+
+        sml_ann_variables_list_set_values(ann_engine->inputs,
+            inputs + row * in_stride);
+        if (outputs)
+            sml_ann_variables_list_set_values(ann_engine->outputs,
+                outputs + row * out_stride);
+
+        if ((error = _sml_ann_process_observation(ann_engine)))
+            return error;
+    }
+
+    return 0;
+}
+
 static bool
 _sml_ann_predict(struct sml_engine *engine)
 {
     struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
     struct sml_ann_bridge *iann;
+    uint64_t start;
+    bool r;
 
     if (!ann_engine->use_pseudorehearsal)
         iann = _sml_ann_get_best_ann_for_latest_observations(ann_engine);
@@ -832,8 +1838,11 @@ _sml_ann_predict(struct sml_engine *engine)
         return false;
     }
 
-    if (!sml_ann_bridge_predict_output(iann, ann_engine->inputs,
-        ann_engine->outputs)) {
+    start = sml_stats_timer_start(engine);
+    r = sml_ann_bridge_predict_output(iann, ann_engine->inputs,
+        ann_engine->outputs);
+    sml_stats_timer_stop(engine, SML_STATS_TIMER_PREDICT, start);
+    if (!r) {
         sml_critical("Could not predict the output");
         return false;
     }
@@ -841,12 +1850,28 @@ _sml_ann_predict(struct sml_engine *engine)
     return true;
 }
 
+static void
+_sml_ann_get_stats(struct sml_engine *engine, struct sml_stats *stats)
+{
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
+    struct sml_cache_node *node, *next;
+    struct sml_ann_bridge *iann;
+
+    SML_CACHE_FOREACH_SAFE (ann_engine->anns_cache, node, next, iann)
+        if (sml_ann_bridge_is_trained(iann))
+            stats->trained_anns++;
+    stats->cache_hits += sml_cache_get_hits(ann_engine->anns_cache);
+    stats->cache_evictions +=
+        sml_cache_get_evictions(ann_engine->anns_cache);
+}
+
 static bool
 _sml_ann_save(struct sml_engine *engine, const char *path)
 {
     struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
     struct sml_ann_bridge *iann;
     char ann_path[SML_PATH_MAX], cfg_path[SML_PATH_MAX];
+    char quantized_path[SML_PATH_MAX];
     struct sol_ptr_vector *anns;
     uint16_t i, ann_idx;
     bool exists;
@@ -875,16 +1900,32 @@ _sml_ann_save(struct sml_engine *engine, const char *path)
     if (ann_engine->use_pseudorehearsal) {
         snprintf(ann_path, sizeof(ann_path), "%s/%s.%s", path,
             ANN_PSEUDOREHEARSAL_PREFIX, ANN_FILE_EXTENSION);
+        snprintf(quantized_path, sizeof(quantized_path), "%s/%s.%s", path,
+            ANN_PSEUDOREHEARSAL_PREFIX, QUANTIZED_FILE_EXTENSION);
+        if (file_exists(quantized_path) && !delete_file(quantized_path)) {
+            sml_critical("Could not remove the old quantized ANN at:%s",
+                quantized_path);
+            return false;
+        }
         iann = sml_cache_get_element(ann_engine->anns_cache, 0);
         if (iann && sml_ann_bridge_is_trained(iann)) {
             if (!sml_ann_bridge_save_with_no_cfg(iann, ann_path)) {
                 sml_critical("Could not save the ANN at:%s", ann_path);
                 return false;
             }
+            if (!sml_ann_bridge_save_quantized(iann, quantized_path))
+                return false;
         } else
             sml_debug("Not saving ANN. Not trained or does not exist yet.");
     } else {
         anns = sml_cache_get_elements(ann_engine->anns_cache);
+        snprintf(ann_path, sizeof(ann_path), "%s/%s", path, PACKED_FILE);
+        if (sml_ann_bridge_file_save(ann_path, anns)) {
+            sml_debug("Neural networks saved at:%s", ann_path);
+            return true;
+        }
+
+        /* Networks that can not be packed are saved one by one */
         ann_idx = 0;
         SOL_PTR_VECTOR_FOREACH_IDX (anns, iann, i) {
             if (!sml_ann_bridge_is_trained(iann)) {
@@ -895,11 +1936,16 @@ _sml_ann_save(struct sml_engine *engine, const char *path)
                 path, ANN_FILE_PREFIX, ann_idx, ANN_FILE_EXTENSION);
             snprintf(cfg_path, sizeof(cfg_path), "%s/%s%d.%s",
                 path, CFG_FILE_PREFIX, ann_idx, CFG_FILE_EXTENSION);
+            snprintf(quantized_path, sizeof(quantized_path), "%s/%s%d.%s",
+                path, ANN_FILE_PREFIX, ann_idx, QUANTIZED_FILE_EXTENSION);
             ann_idx++;
             if (!sml_ann_bridge_save(iann, ann_path, cfg_path)) {
                 sml_critical("Could not save the neural network at:%s", path);
                 continue;
             }
+            if (!sml_ann_bridge_save_quantized(iann, quantized_path))
+                sml_critical("Could not save the quantized neural network" \
+                    " at:%s", quantized_path);
         }
     }
     sml_debug("Neural network saved at:%s", path);
@@ -951,24 +1997,73 @@ sml_ann_set_candidate_groups(struct sml_object *sml,
     return true;
 }
 
+static bool
+_sml_ann_load_packed(struct sml_ann_engine *ann_engine, const char *path)
+{
+    struct sml_ann_bridge *iann;
+    unsigned int i, count;
+
+    ann_engine->packed_file = sml_ann_bridge_file_open(path);
+    if (!ann_engine->packed_file)
+        return false;
+
+    count = sml_ann_bridge_file_get_count(ann_engine->packed_file);
+    for (i = 0; i < count; i++) {
+        iann = sml_ann_bridge_file_get(ann_engine->packed_file, i,
+            ann_engine->quantization_bits);
+        if (!iann)
+            goto err_exit;
+        if (!_sml_ann_cache_put(ann_engine, iann)) {
+            sml_ann_bridge_free(iann);
+            goto err_exit;
+        }
+    }
+    sml_debug("Neural networks loaded from:%s", path);
+    return true;
+
+err_exit:
+    sml_cache_clear(ann_engine->anns_cache);
+    sml_ann_bridge_file_close(ann_engine->packed_file);
+    ann_engine->packed_file = NULL;
+    return false;
+}
+
+static void
+_sml_ann_load_quantized(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge *iann, const char *path)
+{
+    if (!ann_engine->quantization_bits || !is_file(path))
+        return;
+    if (!sml_ann_bridge_load_quantized(iann, path))
+        sml_warning("Predicting with the float weights of the ANN");
+}
+
 static bool
 _sml_ann_load(struct sml_engine *engine, const char *path)
 {
     struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
     struct sml_ann_bridge *iann;
     char ann_path[SML_PATH_MAX], cfg_path[SML_PATH_MAX];
+    char quantized_path[SML_PATH_MAX];
     unsigned int i = 0;
 
+    _sml_ann_discard_training(ann_engine);
     if (sml_cache_get_size(ann_engine->anns_cache)) {
         sml_cache_clear(ann_engine->anns_cache);
         sml_warning("Destroying a previously created neural network");
     }
+    sml_ann_bridge_file_close(ann_engine->packed_file);
+    ann_engine->packed_file = NULL;
 
     if (!is_dir(path)) {
         sml_critical("Failed to load sml in directory %s\n", path);
         return false;
     }
 
+    snprintf(ann_path, sizeof(ann_path), "%s/%s", path, PACKED_FILE);
+    if (!ann_engine->use_pseudorehearsal && is_file(ann_path))
+        return _sml_ann_load_packed(ann_engine, ann_path);
+
     if (ann_engine->use_pseudorehearsal) {
         snprintf(ann_path, sizeof(ann_path), "%s/%s.%s", path,
             ANN_PSEUDOREHEARSAL_PREFIX, ANN_FILE_EXTENSION);
@@ -977,12 +2072,15 @@ _sml_ann_load(struct sml_engine *engine, const char *path)
             sml_critical("Could not load the ann at:%s", ann_path);
             return false;
         }
-        if (!sml_cache_put(ann_engine->anns_cache, iann)) {
+        if (!_sml_ann_cache_put(ann_engine, iann)) {
             sml_critical(
                 "Could not add the struct sml_ann_bridge to the cache");
             sml_ann_bridge_free(iann);
             return false;
         }
+        snprintf(quantized_path, sizeof(quantized_path), "%s/%s.%s", path,
+            ANN_PSEUDOREHEARSAL_PREFIX, QUANTIZED_FILE_EXTENSION);
+        _sml_ann_load_quantized(ann_engine, iann, quantized_path);
     } else {
         while (1) {
             snprintf(ann_path, sizeof(ann_path), "%s/%s%d.%s", path,
@@ -1001,11 +2099,14 @@ _sml_ann_load(struct sml_engine *engine, const char *path)
             iann = sml_ann_bridge_load_from_file(ann_path, cfg_path);
             if (!iann)
                 break;
-            if (!sml_cache_put(ann_engine->anns_cache, iann)) {
+            if (!_sml_ann_cache_put(ann_engine, iann)) {
                 sml_ann_bridge_free(iann);
                 sml_cache_clear(ann_engine->anns_cache);
                 return false;
             }
+            snprintf(quantized_path, sizeof(quantized_path), "%s/%s%d.%s",
+                path, ANN_FILE_PREFIX, i, QUANTIZED_FILE_EXTENSION);
+            _sml_ann_load_quantized(ann_engine, iann, quantized_path);
             i++;
         }
     }
@@ -1034,7 +2135,7 @@ _sml_ann_remove_variable(struct sml_engine *engine, struct sml_variable *var)
 {
     struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
 
-    if (sml_cache_get_size(ann_engine->anns_cache)) {
+    if (_sml_ann_has_networks(ann_engine)) {
         if (sol_ptr_vector_append(&ann_engine->pending_remove, var)) {
             sml_critical("Could not add the variable to the pending remove" \
                 " list");
@@ -1077,6 +2178,29 @@ _sml_ann_get_output_list(struct sml_engine *engine)
     return ann_engine->outputs;
 }
 
+static int
+_sml_ann_variables_list_set_values(struct sml_engine *engine,
+    struct sml_variables_list *list, const float *values)
+{
+    sml_ann_variables_list_set_values(list, values);
+    return 0;
+}
+
+static int
+_sml_ann_variables_list_get_values(struct sml_engine *engine,
+    struct sml_variables_list *list, float *values)
+{
+    sml_ann_variables_list_get_values(list, values);
+    return 0;
+}
+
+static int
+_sml_ann_variables_list_bind_values(struct sml_engine *engine,
+    struct sml_variables_list *list, float *values)
+{
+    return sml_ann_variables_list_bind_values(list, values);
+}
+
 static int
 _sml_ann_variable_set_enabled(struct sml_engine *engine,
     struct sml_variable *var, bool enabled)
@@ -1084,6 +2208,23 @@ _sml_ann_variable_set_enabled(struct sml_engine *engine,
     return sml_ann_variable_set_enabled(var, enabled);
 }
 
+static bool
+_sml_ann_variable_set_range(struct sml_engine *engine,
+    struct sml_variable *var, float min, float max)
+{
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
+
+    /* Recorded observations were clamped to the current range, so they
+       can not be brought to a wider one */
+    if (sml_ann_variable_range_widens(var, min, max)) {
+        sml_debug("Variable range widened, dropping recorded observations");
+        _sml_ann_discard_training(ann_engine);
+        sml_ann_variables_list_reset_observations(ann_engine->inputs, false);
+        sml_ann_variables_list_reset_observations(ann_engine->outputs, false);
+    }
+    return sml_ann_variable_set_range(engine, var, min, max);
+}
+
 static void
 _sml_ann_print_variables_list(struct sml_variables_list *list)
 {
@@ -1128,6 +2269,9 @@ _sml_ann_print_debug(struct sml_engine *engine, bool full)
         sml_debug("Candidate groups: %d", ann_engine->candidate_groups);
         sml_debug("Observations max size: %d",
             ann_engine->engine.obs_max_size);
+        sml_debug("Async training: %s%s",
+            ann_engine->async_training ? "true" : "false",
+            ann_engine->training_job ? " (training in progress)" : "");
 
         sml_debug("ANNs (%d) {",
             sml_cache_get_size(ann_engine->anns_cache));
@@ -1148,6 +2292,16 @@ _sml_ann_print_debug(struct sml_engine *engine, bool full)
 static void
 _sml_ann_cache_element_free(void *element, void *data)
 {
+    struct sml_ann_engine *ann_engine = data;
+
+    ann_engine->ci_index_valid = false;
+    if (ann_engine->resume_ann == element)
+        ann_engine->resume_ann = NULL;
+    if (ann_engine->retrain_ann == element)
+        ann_engine->retrain_ann = NULL;
+    if (ann_engine->training_job &&
+        ann_engine->training_job->retrained == element)
+        ann_engine->training_job->retrained = NULL;
     sml_ann_bridge_free(element);
 }
 
@@ -1156,6 +2310,7 @@ _sml_ann_erase_knowledge(struct sml_engine *engine)
 {
     struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)engine;
 
+    _sml_ann_discard_training(ann_engine);
     sml_cache_clear(ann_engine->anns_cache);
     sml_ann_variables_list_reset_observations(ann_engine->inputs, true);
     sml_ann_variables_list_reset_observations(ann_engine->outputs, true);
@@ -1185,9 +2340,14 @@ sml_ann_new(void)
         sml_critical("Could not create the output variable list");
         goto err_outputs;
     }
+    ann_engine->pending_add = sml_ann_variable_list_new();
+    if (!ann_engine->pending_add) {
+        sml_critical("Could not create the pending variable list");
+        goto err_pending;
+    }
 
     ann_engine->anns_cache = sml_cache_new(DEFAULT_CACHE_SIZE,
-        _sml_ann_cache_element_free, NULL);
+        _sml_ann_cache_element_free, ann_engine);
 
     if (!ann_engine->anns_cache) {
         sml_critical("Could not create the ANN cache");
@@ -1199,15 +2359,17 @@ sml_ann_new(void)
     ann_engine->train_error = DEFAULT_DESIRED_ERROR;
     ann_engine->candidate_groups = DEFAULT_CANDIDATE_GROUPS;
     ann_engine->required_observations = INITIAL_REQUIRED_OBSERVATIONS;
+    ann_engine->training_variants = 1;
+    ann_engine->training_threads = 1;
     ann_engine->first_run = true;
     ann_engine->use_pseudorehearsal = true;
     sol_vector_init(&ann_engine->activation_functions,
         sizeof(enum sml_ann_activation_function));
     sol_ptr_vector_init(&ann_engine->pending_remove);
-    sol_ptr_vector_init(&ann_engine->pending_add);
 
     ann_engine->engine.free = _sml_ann_engine_free;
     ann_engine->engine.process = _sml_ann_process;
+    ann_engine->engine.process_batch = _sml_ann_process_batch;
     ann_engine->engine.predict = _sml_ann_predict;
     ann_engine->engine.save = _sml_ann_save;
     ann_engine->engine.load = _sml_ann_load;
@@ -1226,17 +2388,26 @@ sml_ann_new(void)
     ann_engine->engine.variables_list_get_length =
         sml_ann_variables_list_get_length;
     ann_engine->engine.variables_list_index = sml_ann_variables_list_index;
-    ann_engine->engine.variable_set_range = sml_ann_variable_set_range;
+    ann_engine->engine.variables_list_set_values =
+        _sml_ann_variables_list_set_values;
+    ann_engine->engine.variables_list_get_values =
+        _sml_ann_variables_list_get_values;
+    ann_engine->engine.variables_list_bind_values =
+        _sml_ann_variables_list_bind_values;
+    ann_engine->engine.variable_set_range = _sml_ann_variable_set_range;
     ann_engine->engine.variable_get_range = sml_ann_variable_get_range;
     ann_engine->engine.print_debug = _sml_ann_print_debug;
+    ann_engine->engine.get_stats = _sml_ann_get_stats;
     ann_engine->engine.erase_knowledge = _sml_ann_erase_knowledge;
     ann_engine->engine.magic_number = ANN_MAGIC;
 
     return (struct sml_object *)&ann_engine->engine;
 err_cache:
-    sml_ann_variable_list_free(ann_engine->outputs, true);
+    sml_ann_variable_list_free(ann_engine->pending_add);
+err_pending:
+    sml_ann_variable_list_free(ann_engine->outputs);
 err_outputs:
-    sml_ann_variable_list_free(ann_engine->inputs, true);
+    sml_ann_variable_list_free(ann_engine->inputs);
 err_inputs:
     free(ann_engine);
     return NULL;
@@ -1300,3 +2471,326 @@ sml_ann_use_pseudorehearsal_strategy(struct sml_object *sml,
     ann_engine->use_pseudorehearsal = use_pseudorehearsal;
     return true;
 }
+
+API_EXPORT bool
+sml_ann_set_warm_start(struct sml_object *sml, bool warm_start)
+{
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    ann_engine->warm_start = warm_start;
+    return true;
+}
+
+API_EXPORT bool
+sml_ann_set_training_time_budget(struct sml_object *sml, unsigned int budget_ms)
+{
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    ann_engine->training_time_budget = budget_ms;
+    return true;
+}
+
+API_EXPORT bool
+sml_ann_set_training_variants(struct sml_object *sml, unsigned int variants)
+{
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    if (!variants) {
+        sml_warning("At least one neural network must be trained");
+        return false;
+    }
+    ann_engine->training_variants = variants;
+    return true;
+}
+
+API_EXPORT bool
+sml_ann_set_training_threads(struct sml_object *sml, unsigned int threads)
+{
+    struct sml_cache_node *node;
+
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    if (!threads) {
+        sml_warning("At least one training thread is required");
+        return false;
+    }
+#ifndef HAVE_PARALLEL_FANN
+    if (threads > 1) {
+        sml_warning("FANN was built without parallel training support");
+        return false;
+    }
+#endif
+
+    ann_engine->training_threads = threads;
+    for (node = sml_cache_get_first(ann_engine->anns_cache); node;
+        node = sml_cache_node_get_next(node))
+        sml_ann_bridge_set_training_threads(sml_cache_node_get_data(node),
+            threads);
+    if (ann_engine->untrained_ann)
+        sml_ann_bridge_set_training_threads(ann_engine->untrained_ann,
+            threads);
+    return true;
+}
+
+API_EXPORT bool
+sml_ann_set_quantization(struct sml_object *sml,
+    enum sml_ann_quantization quantization, float max_error)
+{
+    struct sml_cache_node *node;
+    unsigned int bits;
+
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    switch (quantization) {
+    case SML_ANN_QUANTIZATION_NONE:
+        bits = 0;
+        break;
+    case SML_ANN_QUANTIZATION_INT16:
+        bits = 16;
+        break;
+    case SML_ANN_QUANTIZATION_INT8:
+        bits = 8;
+        break;
+    default:
+        sml_warning("Unknown quantization:%d", quantization);
+        return false;
+    }
+    if (isnan(max_error) || max_error < 0) {
+        sml_warning("The quantization max error must be positive");
+        return false;
+    }
+
+    ann_engine->quantization_bits = bits;
+    ann_engine->quantization_max_error = max_error;
+    for (node = sml_cache_get_first(ann_engine->anns_cache); node;
+        node = sml_cache_node_get_next(node))
+        sml_ann_bridge_set_quantization(sml_cache_node_get_data(node), bits,
+            max_error);
+    if (ann_engine->untrained_ann)
+        sml_ann_bridge_set_quantization(ann_engine->untrained_ann, bits,
+            max_error);
+    return true;
+}
+
+API_EXPORT float
+sml_ann_get_quantization_error(struct sml_object *sml)
+{
+    struct sml_cache_node *node, *next;
+    struct sml_ann_bridge *iann;
+    float error, max = NAN;
+
+    if (!sml_is_ann(sml))
+        return NAN;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    SML_CACHE_FOREACH_SAFE (ann_engine->anns_cache, node, next, iann) {
+        error = sml_ann_bridge_get_quantization_error(iann);
+        if (!isnan(error) && (isnan(max) || error > max))
+            max = error;
+    }
+    return max;
+}
+
+API_EXPORT bool
+sml_ann_set_async_training(struct sml_object *sml, bool async_training)
+{
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    if (!ann_engine->first_run) {
+        sml_warning("Async training can only be set before the first call of" \
+            " sml_process");
+        return false;
+    }
+    ann_engine->async_training = async_training;
+    return true;
+}
+
+API_EXPORT bool
+sml_ann_set_training_finished_callback(struct sml_object *sml,
+    sml_ann_training_finished_cb training_finished_cb, void *data)
+{
+    if (!sml_is_ann(sml))
+        return false;
+
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    ann_engine->training_finished_cb = training_finished_cb;
+    ann_engine->training_finished_cb_data = data;
+    return true;
+}
+
+static unsigned int
+_sml_ann_select_best_for_values(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge **anns, unsigned int anns_len, const float *values)
+{
+    unsigned int i, best = 0;
+    float distance, min = FLT_MAX, sum_best = FLT_MAX, sum_iann;
+
+    for (i = 0; i < anns_len; i++) {
+        distance = sml_ann_bridge_confidence_intervals_distance_sum_values(
+            anns[i], ann_engine->inputs, values);
+        if (distance < min) {
+            min = distance;
+            best = i;
+            sum_best = sml_ann_bridge_get_confidence_interval_sum(anns[i]);
+        } else if (distance == min) {
+            sum_iann = sml_ann_bridge_get_confidence_interval_sum(anns[i]);
+            if (sum_iann < sum_best) {
+                best = i;
+                sum_best = sum_iann;
+            }
+        }
+    }
+    return best;
+}
+
+static int
+_sml_ann_bridge_ptr_cmp(const void *a, const void *b)
+{
+    uintptr_t pa = (uintptr_t)*(struct sml_ann_bridge *const *)a;
+    uintptr_t pb = (uintptr_t)*(struct sml_ann_bridge *const *)b;
+
+    if (pa < pb)
+        return -1;
+    return pa > pb;
+}
+
+/* anns must be sorted by address */
+static unsigned int
+_sml_ann_select_best_by_index(struct sml_ann_engine *ann_engine,
+    struct sml_ann_bridge **anns, unsigned int anns_len, const float *values)
+{
+    struct sml_ann_bridge *best, **found;
+    float *point = ann_engine->ci_point;
+    uint16_t i, len;
+
+    len = sml_ann_variables_list_get_length(ann_engine->inputs);
+    for (i = 0; i < len; i++) {
+        point[i] = values[i];
+        if (isnan(point[i]))
+            sml_ann_variable_get_range(
+                sml_ann_variables_list_index(ann_engine->inputs, i),
+                &point[i], NULL);
+    }
+
+    best = sml_ann_ci_index_nearest(ann_engine->ci_index, point);
+    found = best ? bsearch(&best, anns, anns_len, sizeof(*anns),
+        _sml_ann_bridge_ptr_cmp) : NULL;
+    /* Networks with confidence intervals that do not match the inputs
+       are not indexed */
+    if (!found)
+        return _sml_ann_select_best_for_values(ann_engine, anns, anns_len,
+            values);
+    return found - anns;
+}
+
+API_EXPORT int
+sml_ann_predict_batch(struct sml_object *sml, const float *inputs,
+    float *outputs, unsigned int rows)
+{
+    struct sml_ann_engine *ann_engine = (struct sml_ann_engine *)sml;
+    struct sml_cache_node *node;
+    struct sml_ann_bridge *iann, **anns = NULL;
+    unsigned int i, anns_len = 0, *route = NULL, *order = NULL,
+        *groups = NULL;
+    uint16_t in_len;
+    bool use_index = false;
+    int r = 0;
+
+    if (!sml_is_ann(sml))
+        return -EINVAL;
+    ON_NULL_RETURN_VAL(inputs, -EINVAL);
+    ON_NULL_RETURN_VAL(outputs, -EINVAL);
+    if (!rows)
+        return 0;
+
+    in_len = sml_ann_variables_list_get_length(ann_engine->inputs);
+    anns = malloc(sizeof(struct sml_ann_bridge *) *
+        (sml_cache_get_size(ann_engine->anns_cache) + 1));
+    route = malloc(sizeof(unsigned int) * rows);
+    order = malloc(sizeof(unsigned int) * rows);
+    if (!anns || !route || !order) {
+        sml_critical("Could not alloc the batch prediction data");
+        r = -ENOMEM;
+        goto exit;
+    }
+
+    if (ann_engine->use_pseudorehearsal) {
+        iann = sml_cache_get_element(ann_engine->anns_cache, 0);
+        if (iann && sml_ann_bridge_is_trained(iann))
+            anns[anns_len++] = iann;
+    } else {
+        for (node = sml_cache_get_first(ann_engine->anns_cache); node;
+            node = sml_cache_node_get_next(node)) {
+            iann = sml_cache_node_get_data(node);
+            if (sml_ann_bridge_is_trained(iann))
+                anns[anns_len++] = iann;
+        }
+        /* Rows are routed by the confidence intervals index, the
+           networks it returns are found by their address */
+        if (anns_len > 1 && !_sml_ann_ci_index_update(ann_engine)) {
+            qsort(anns, anns_len, sizeof(*anns), _sml_ann_bridge_ptr_cmp);
+            use_index = true;
+        }
+    }
+
+    if (!anns_len) {
+        sml_warning("There is no trained neural network to predict with");
+        r = -ENOENT;
+        goto exit;
+    }
+
+    groups = calloc(anns_len + 1, sizeof(unsigned int));
+    if (!groups) {
+        sml_critical("Could not alloc the batch prediction data");
+        r = -ENOMEM;
+        goto exit;
+    }
+
+    /* Route every row once, then sort the rows by network so each one
+       runs its rows back to back */
+    for (i = 0; i < rows; i++) {
+        if (use_index)
+            route[i] = _sml_ann_select_best_by_index(ann_engine, anns,
+                anns_len, inputs + (size_t)i * in_len);
+        else
+            route[i] = _sml_ann_select_best_for_values(ann_engine, anns,
+                anns_len, inputs + (size_t)i * in_len);
+        groups[route[i] + 1]++;
+    }
+    for (i = 0; i < anns_len; i++)
+        groups[i + 1] += groups[i];
+    for (i = 0; i < rows; i++)
+        order[groups[route[i]]++] = i;
+
+    /* groups[i] is now the end of the rows of network i */
+    for (i = 0; i < anns_len && !r; i++) {
+        unsigned int start = i ? groups[i - 1] : 0;
+
+        if (groups[i] == start)
+            continue;
+        sml_debug("Predicting %u rows with neural network %p",
+            groups[i] - start, anns[i]);
+        r = sml_ann_bridge_predict_rows(anns[i], ann_engine->inputs,
+            ann_engine->outputs, inputs, outputs, order + start,
+            groups[i] - start);
+    }
+
+exit:
+    free(groups);
+    free(order);
+    free(route);
+    free(anns);
+    return r;
+}
@@ -18,21 +18,52 @@
 
 #include "sml_ann_bridge.h"
 #include "sml_ann_variable_list.h"
+#include "sml_ann_kernel.h"
 #include <sml_log.h>
 #include <sml_util.h>
+#include <sml_engine.h>
 #include <stdlib.h>
 #include <float.h>
 #include <stdio.h>
 #include <math.h>
 #include <floatfann.h>
 #include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <config.h>
+
+#ifdef HAVE_PARALLEL_FANN
+#include <parallel_fann.h>
+#endif
 
 #define REPORTS_BETWEEN_EPOCHS (100)
 #define MAX_NEURONS_MULTIPLIER (5)
 #define MAX_EPOCHS (500)
+/* Reports while training with a time budget, the deadline and the error
+   plateau are checked on each report */
+#define BUDGET_REPORTS_BETWEEN_EPOCHS (10)
+#define BUDGET_REPORTS_BETWEEN_NEURONS (1)
+#define PLATEAU_REPORTS (5)
+#define PLATEAU_MIN_IMPROVEMENT (0.01)
+/* Largest output difference accepted between the kernel and fann_run() */
+#define KERNEL_TOLERANCE (1e-4)
+/* Inputs the kernel is checked against fann_run() on before it is used */
+#define KERNEL_SAMPLES (8)
+#define PACKED_MAGIC (0x4e4e4153)
+#define PACKED_VERSION (1)
+/* Sections of a packed file start at multiples of this, the kernel images
+   inside it require at least 8 */
+#define PACKED_ALIGN (8)
+#define PACKED_PAD(_size) (((_size) + PACKED_ALIGN - 1) & ~(uint64_t)(PACKED_ALIGN - 1))
 
 struct sml_ann_bridge {
     bool trained;
+    /* The weights come from a previous training or a saved network */
+    bool has_weights;
     float last_train_error;
     struct fann *ann;
     struct sol_vector confidence_intervals;
@@ -42,6 +73,45 @@ struct sml_ann_bridge {
     unsigned int max_neurons;
 
     float ci_length_sum;
+
+    /* Scratch used to hand the observations to FANN, kept across calls */
+    fann_type **train_rows;
+    unsigned int train_rows_size;
+    fann_type *train_copy;
+    size_t train_copy_size;
+
+    /* Input vector handed to fann_run(), sized for the network layout */
+    fann_type *input;
+    unsigned int input_size;
+
+    /* Threads sharing the observations of each batch training epoch */
+    unsigned int training_threads;
+
+    /* Compiled form of ann used to predict, created on first use after
+       the weights change */
+    struct sml_ann_kernel *kernel;
+    bool kernel_unsupported;
+    /* Inputs of the last training, KERNEL_SAMPLES rows of input_size */
+    fann_type *kernel_samples;
+    unsigned int kernel_samples_len;
+
+    /* Quantized kernel used to predict instead, if it is accurate enough.
+       The error is the MSE increase measured when it was quantized. */
+    struct sml_ann_kernel *quantized;
+    unsigned int quantization_bits;
+    float quantization_max_error;
+    float quantization_error;
+
+    /* Training split in slices by a time budget. The session keeps the
+       epochs (or neurons, for cascade training) done by previous slices. */
+    bool training;
+    bool training_cascade;
+    bool out_of_time;
+    unsigned int session_progress;
+    unsigned int slice_progress;
+    unsigned int plateau_reports;
+    float best_error;
+    uint64_t deadline;
 };
 
 typedef struct _Confidence_Interval {
@@ -49,6 +119,70 @@ typedef struct _Confidence_Interval {
     float upper_limit;
 } Confidence_Interval;
 
+/* Layout of the packed networks file, in the byte order of the machine.
+   The header is followed by one entry per network, pointing to its block.
+   A block starts with a Packed_Ann and is followed by the size of each
+   layer without bias neurons, the activation function and steepness of
+   each neuron, the weights, the confidence intervals and the images of
+   the float and quantized kernels, each section starting at a PACKED_ALIGN
+   boundary. */
+typedef struct _Packed_Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t entries;
+    uint64_t size;
+} Packed_Header;
+
+typedef struct _Packed_Entry {
+    uint64_t offset;
+    uint64_t size;
+} Packed_Entry;
+
+typedef struct _Packed_Ann {
+    uint32_t num_layers;
+    uint32_t total_neurons;
+    uint32_t total_connections;
+    uint32_t confidence_intervals_len;
+    uint32_t max_neurons;
+    uint32_t required_observations;
+    uint32_t train_error_function;
+    uint32_t reserved;
+    float learning_rate;
+    float learning_momentum;
+    float last_train_error;
+    float quantization_error;
+    uint64_t kernel_size;
+    uint64_t quantized_size;
+} Packed_Ann;
+
+struct sml_ann_bridge_file {
+    void *data;
+    size_t size;
+    unsigned int count;
+    const Packed_Entry *entries;
+};
+
+#ifdef HAVE_PARALLEL_FANN
+typedef float (*Parallel_Epoch)(struct fann *ann, struct fann_train_data *data,
+    const unsigned int threads);
+#endif
+
+/* One of the networks trained in parallel by sml_ann_bridge_train_variants() */
+typedef struct _Train_Variant {
+    pthread_t thread;
+    struct sml_ann_bridge *iann;
+    struct sml_variables_list *inputs;
+    struct sml_variables_list *outputs;
+    unsigned int required_observations;
+    unsigned int max_neurons;
+    float desired_train_error;
+    bool warm_start;
+    float train_error;
+    int error;
+} Train_Variant;
+
 static struct sml_ann_bridge *
 _sml_ann_bridge_new(struct fann *ann, bool trained)
 {
@@ -58,9 +192,20 @@ _sml_ann_bridge_new(struct fann *ann, bool trained)
         sml_critical("Could not create an struct sml_ann_bridge");
         return NULL;
     }
+    iann->input_size = fann_get_num_input(ann);
+    iann->input = calloc(iann->input_size ? iann->input_size : 1,
+        sizeof(fann_type));
+    if (!iann->input) {
+        sml_critical("Could not alloc fann input vector");
+        free(iann);
+        return NULL;
+    }
     sol_vector_init(&iann->confidence_intervals, sizeof(Confidence_Interval));
     iann->ann = ann;
     iann->trained = trained;
+    iann->has_weights = trained;
+    iann->training_threads = 1;
+    iann->quantization_error = NAN;
     iann->last_train_error = NAN;
     if (iann->trained)
         fann_set_training_algorithm(iann->ann, FANN_TRAIN_INCREMENTAL);
@@ -86,8 +231,8 @@ _sml_ann_bridge_calculate_confidence_interval(struct sml_ann_bridge *iann,
     struct sml_variables_list *inputs,
     unsigned int observations)
 {
-    unsigned int i, j, inputs_len;
-    float mean, sd, value;
+    unsigned int i, inputs_len;
+    float mean, sd;
     struct sml_variable *var;
     Confidence_Interval *ci;
     char var_name[SML_VARIABLE_NAME_MAX_LEN + 1];
@@ -95,7 +240,6 @@ _sml_ann_bridge_calculate_confidence_interval(struct sml_ann_bridge *iann,
     sml_debug("Calculating confidence interval");
     inputs_len = sml_ann_variables_list_get_length(inputs);
     for (i = 0; i < inputs_len; i++) {
-        mean = sd = 0.0;
         var = sml_ann_variables_list_index(inputs, i);
         ci = sol_vector_append(&iann->confidence_intervals);
         if (!ci) {
@@ -103,23 +247,10 @@ _sml_ann_bridge_calculate_confidence_interval(struct sml_ann_bridge *iann,
             goto err_exit;
         }
 
-        for (j = 0; j < observations; j++) {
-            value = sml_ann_variable_get_value_by_index(var, j);
-            if (isnan(value))
-                sml_ann_variable_get_range(var, &value, NULL);
-            mean += value;
-        }
-        mean /= observations;
-
-        //Now the standard deviation
-        for (j = 0; j < observations; j++) {
-            value = sml_ann_variable_get_value_by_index(var, j);
-            if (isnan(value))
-                sml_ann_variable_get_range(var, &value, NULL);
-            sd += pow(value - mean, 2.0);
-        }
-        sd /= observations;
-        sd = sqrt(sd);
+        /* Kept up to date by the list as observations are recorded */
+        if (!sml_ann_variable_get_observations_stats(var, observations,
+            &mean, &sd))
+            mean = sd = NAN;
 
         //Confidence interval of 95%
         ci->lower_limit = mean - (1.96 * (sd / sqrt(observations)));
@@ -200,43 +331,330 @@ _sml_ann_bridge_translate_to_fann_activation_vector(
     return true;
 }
 
-static void
-_sml_ann_bridge_fill_train_data_array(struct sml_variables_list *inputs,
+static int
+_sml_ann_bridge_reserve_train_copy(struct sml_ann_bridge *iann, size_t size)
+{
+    fann_type *copy;
+
+    if (size <= iann->train_copy_size)
+        return 0;
+    copy = realloc(iann->train_copy, sizeof(fann_type) * size);
+    if (!copy) {
+        sml_critical("Could not alloc the train data copy");
+        return -ENOMEM;
+    }
+    iann->train_copy = copy;
+    iann->train_copy_size = size;
+    return 0;
+}
+
+/*
+ * Points the rows of the train data at the observation matrices of the
+ * lists, which are kept scaled. Only lists with columns that can not be
+ * used as is (disabled variables or variables without a range) are
+ * copied, into a scratch buffer owned by the bridge.
+ */
+static int
+_sml_ann_bridge_setup_train_data(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs,
     struct sml_variables_list *outputs,
     struct fann_train_data *train_data,
     unsigned int observations)
 {
-    uint16_t i, j, size;
-    struct sml_variable *var;
-    float value, min;
+    struct sml_variables_list *lists[] = { inputs, outputs };
+    fann_type **rows[2];
+    uint16_t lens[2];
+    fann_type **train_rows;
+    size_t copy_size = 0, offset = 0;
+    unsigned int i, j;
+    int r;
+
+    lens[0] = sml_ann_variables_list_get_length(inputs);
+    lens[1] = sml_ann_variables_list_get_length(outputs);
+
+    if (observations > iann->train_rows_size) {
+        train_rows = realloc(iann->train_rows,
+            sizeof(fann_type *) * observations * 2);
+        if (!train_rows) {
+            sml_critical("Could not alloc the train data rows");
+            return -ENOMEM;
+        }
+        iann->train_rows = train_rows;
+        iann->train_rows_size = observations;
+    }
+    rows[0] = iann->train_rows;
+    rows[1] = iann->train_rows + observations;
 
-    size = sml_ann_variables_list_get_length(inputs);
-    for (i = 0; i < size; i++) {
-        var = sml_ann_variables_list_index(inputs, i);
-        for (j = 0; j < observations; j++) {
-            value = sml_ann_variable_get_value_by_index(var, j);
-            if (isnan(value) || !sml_ann_variable_is_enabled(var)) {
-                sml_ann_variable_get_range(var, &min, NULL);
-                value = min;
-            }
-            train_data->input[j][i] =
-                sml_ann_variable_scale_value(var, value);
+    for (i = 0; i < 2; i++) {
+        if (!sml_ann_variables_list_observations_are_scaled(lists[i]))
+            copy_size += (size_t)lens[i] * observations;
+    }
+    if ((r = _sml_ann_bridge_reserve_train_copy(iann, copy_size)))
+        return r;
+
+    for (i = 0; i < 2; i++) {
+        if (sml_ann_variables_list_observations_are_scaled(lists[i])) {
+            for (j = 0; j < observations; j++)
+                rows[i][j] = (fann_type *)
+                    sml_ann_variables_list_get_observation_row(lists[i], j);
+            continue;
+        }
+        for (j = 0; j < observations; j++, offset += lens[i]) {
+            rows[i][j] = iann->train_copy + offset;
+            sml_ann_variables_list_fill_scaled_row(lists[i], j, rows[i][j]);
         }
     }
 
-    size = sml_ann_variables_list_get_length(outputs);
-    for (i = 0; i < size; i++) {
-        var = sml_ann_variables_list_index(outputs, i);
-        for (j = 0; j < observations; j++) {
-            value = sml_ann_variable_get_value_by_index(var, j);
-            if (isnan(value) || !sml_ann_variable_is_enabled(var)) {
-                sml_ann_variable_get_range(var, &min, NULL);
-                value = min;
-            }
-            train_data->output[j][i] =
-                sml_ann_variable_scale_value(var, value);
+    memset(train_data, 0, sizeof(struct fann_train_data));
+    train_data->num_data = observations;
+    train_data->num_input = lens[0];
+    train_data->num_output = lens[1];
+    train_data->input = rows[0];
+    train_data->output = rows[1];
+    return 0;
+}
+
+/* Unlike fann_shuffle_train_data() this only swaps the row pointers, so
+   the observation matrices are left untouched. */
+static void
+_sml_ann_bridge_shuffle_train_data(struct fann_train_data *train_data)
+{
+    unsigned int i, j;
+    fann_type *tmp;
+
+    for (i = train_data->num_data; i > 1; i--) {
+        j = rand() % i;
+        tmp = train_data->input[i - 1];
+        train_data->input[i - 1] = train_data->input[j];
+        train_data->input[j] = tmp;
+        tmp = train_data->output[i - 1];
+        train_data->output[i - 1] = train_data->output[j];
+        train_data->output[j] = tmp;
+    }
+}
+
+#ifdef HAVE_PARALLEL_FANN
+static Parallel_Epoch
+_sml_ann_bridge_get_parallel_epoch(struct fann *ann)
+{
+    switch (fann_get_training_algorithm(ann)) {
+    case FANN_TRAIN_BATCH:
+        return fann_train_epoch_batch_parallel;
+    case FANN_TRAIN_RPROP:
+        return fann_train_epoch_irpropm_parallel;
+    case FANN_TRAIN_QUICKPROP:
+        return fann_train_epoch_quickprop_parallel;
+    case FANN_TRAIN_SARPROP:
+        return fann_train_epoch_sarprop_parallel;
+    default:
+        /* Incremental training updates the weights after each observation */
+        return NULL;
+    }
+}
+#endif
+
+/* Same as fann_train_on_data(), but the epochs of batch algorithms are split
+   between the training threads. Each thread computes the slopes of a fixed
+   range of observations and they are merged in order, so the result does
+   not depend on the thread scheduling. */
+static void
+_sml_ann_bridge_train_on_data(struct sml_ann_bridge *iann,
+    struct fann_train_data *data, unsigned int max_epochs,
+    unsigned int epochs_between_reports, float desired_error,
+    fann_callback_type callback)
+{
+#ifdef HAVE_PARALLEL_FANN
+    Parallel_Epoch train_epoch;
+    unsigned int i;
+    float error;
+
+    train_epoch = _sml_ann_bridge_get_parallel_epoch(iann->ann);
+    if (iann->training_threads > 1 && train_epoch) {
+        for (i = 1; i <= max_epochs; i++) {
+            error = train_epoch(iann->ann, data, iann->training_threads);
+            if (callback && (i % epochs_between_reports == 0 ||
+                i == 1 || i == max_epochs || error <= desired_error) &&
+                callback(iann->ann, data, max_epochs, epochs_between_reports,
+                desired_error, i) == -1)
+                break;
+            if (error <= desired_error)
+                break;
+        }
+        return;
+    }
+#endif
+
+    fann_set_callback(iann->ann, callback);
+    fann_train_on_data(iann->ann, data, max_epochs, epochs_between_reports,
+        desired_error);
+    fann_set_callback(iann->ann, NULL);
+}
+
+static void
+_sml_ann_bridge_weights_changed(struct sml_ann_bridge *iann)
+{
+    sml_ann_kernel_free(iann->kernel);
+    iann->kernel = NULL;
+    iann->kernel_unsupported = false;
+    sml_ann_kernel_free(iann->quantized);
+    iann->quantized = NULL;
+    iann->quantization_error = NAN;
+}
+
+/* Quantizes the network and measures how much it increases the MSE over
+   data. The quantized kernel is dropped if the increase is too large. */
+static void
+_sml_ann_bridge_quantize(struct sml_ann_bridge *iann,
+    struct fann_train_data *data)
+{
+    struct sml_ann_kernel *kernel;
+    const float *quantized_out;
+    fann_type *out;
+    double float_error = 0, quantized_error = 0, d;
+    unsigned int row, i, len;
+
+    sml_ann_kernel_free(iann->quantized);
+    iann->quantized = NULL;
+    iann->quantization_error = NAN;
+    if (!iann->quantization_bits || !data->num_data)
+        return;
+
+    kernel = sml_ann_kernel_new(iann->ann);
+    if (!kernel) {
+        sml_debug("ANN:%p can not be compiled, not quantizing it", iann);
+        return;
+    }
+    iann->quantized = sml_ann_kernel_quantize(kernel,
+        iann->quantization_bits);
+    sml_ann_kernel_free(kernel);
+    if (!iann->quantized)
+        return;
+
+    len = fann_get_num_output(iann->ann);
+    for (row = 0; row < data->num_data; row++) {
+        out = fann_run(iann->ann, data->input[row]);
+        if (!out) {
+            sml_critical("fann_run() returned NULL!");
+            goto err_exit;
+        }
+        quantized_out = sml_ann_kernel_run(iann->quantized,
+            data->input[row]);
+        for (i = 0; i < len; i++) {
+            d = out[i] - data->output[row][i];
+            float_error += d * d;
+            d = quantized_out[i] - data->output[row][i];
+            quantized_error += d * d;
+        }
+    }
+
+    iann->quantization_error = (quantized_error - float_error) /
+        ((double)data->num_data * len);
+    sml_debug("ANN:%p quantized to %u bits, MSE increase:%f", iann,
+        iann->quantization_bits, iann->quantization_error);
+    if (iann->quantization_error <= iann->quantization_max_error) {
+        /* The float kernel is compiled again if quantization is disabled */
+        sml_ann_kernel_free(iann->kernel);
+        iann->kernel = NULL;
+        return;
+    }
+
+    sml_warning("Quantized ANN:%p MSE increase %f is above %f, keeping the" \
+        " float network", iann, iann->quantization_error,
+        iann->quantization_max_error);
+err_exit:
+    sml_ann_kernel_free(iann->quantized);
+    iann->quantized = NULL;
+}
+
+static int
+_sml_ann_bridge_train_cb(struct fann *ann, struct fann_train_data *train,
+    unsigned int max_epochs, unsigned int epochs_between_reports,
+    float desired_error, unsigned int epochs)
+{
+    struct sml_ann_bridge *iann = fann_get_user_data(ann);
+    float error = fann_get_MSE(ann);
+
+    /* The cascade training reports its total epochs, the neurons it
+       installed are counted by the slice */
+    if (!iann->training_cascade)
+        iann->slice_progress = epochs;
+    if (error < iann->best_error * (1 - PLATEAU_MIN_IMPROVEMENT)) {
+        iann->best_error = error;
+        iann->plateau_reports = 0;
+    } else if (++iann->plateau_reports >= PLATEAU_REPORTS) {
+        sml_debug("Training error is not improving anymore:%f", error);
+        return -1;
+    }
+
+    if (sml_stats_now() >= iann->deadline) {
+        iann->out_of_time = true;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+_sml_ann_bridge_train_slice(struct sml_ann_bridge *iann,
+    struct fann_train_data *train_data, unsigned int max_neurons,
+    float desired_train_error, unsigned int time_budget)
+{
+    unsigned int limit, neurons;
+
+    limit = iann->training_cascade ? max_neurons : MAX_EPOCHS;
+    if (iann->session_progress >= limit)
+        return;
+
+    iann->out_of_time = false;
+    iann->slice_progress = 0;
+    iann->deadline = sml_stats_now() + (uint64_t)time_budget * 1000;
+    fann_set_user_data(iann->ann, iann);
+
+    if (iann->training_cascade) {
+        neurons = fann_get_total_neurons(iann->ann);
+        fann_set_callback(iann->ann, _sml_ann_bridge_train_cb);
+        fann_cascadetrain_on_data(iann->ann, train_data,
+            limit - iann->session_progress,
+            BUDGET_REPORTS_BETWEEN_NEURONS, desired_train_error);
+        fann_set_callback(iann->ann, NULL);
+        iann->slice_progress = fann_get_total_neurons(iann->ann) - neurons;
+    } else
+        _sml_ann_bridge_train_on_data(iann, train_data,
+            limit - iann->session_progress,
+            BUDGET_REPORTS_BETWEEN_EPOCHS, desired_train_error,
+            _sml_ann_bridge_train_cb);
+    iann->session_progress += iann->slice_progress;
+    if (iann->session_progress >= limit ||
+        fann_get_MSE(iann->ann) <= desired_train_error)
+        iann->out_of_time = false;
+}
+
+/* Keeps inputs spread over the train data to validate the kernel compiled
+   after training */
+static void
+_sml_ann_bridge_keep_kernel_samples(struct sml_ann_bridge *iann,
+    struct fann_train_data *data)
+{
+    unsigned int i, step;
+
+    iann->kernel_samples_len = 0;
+    if (!data->num_data || data->num_input != iann->input_size)
+        return;
+    if (!iann->kernel_samples) {
+        iann->kernel_samples = malloc(sizeof(fann_type) * KERNEL_SAMPLES *
+            (iann->input_size ? iann->input_size : 1));
+        if (!iann->kernel_samples) {
+            sml_warning("Could not alloc the kernel samples");
+            return;
         }
     }
+
+    step = data->num_data > KERNEL_SAMPLES ? data->num_data / KERNEL_SAMPLES :
+        1;
+    for (i = 0; i < data->num_data &&
+        iann->kernel_samples_len < KERNEL_SAMPLES; i += step)
+        memcpy(iann->kernel_samples +
+            iann->kernel_samples_len++ * iann->input_size,
+            data->input[i], sizeof(fann_type) * iann->input_size);
 }
 
 static int
@@ -245,47 +663,70 @@ _sml_really_train(struct sml_ann_bridge *iann,
     struct sml_variables_list *outputs,
     float *err, unsigned int required_observations,
     unsigned int max_neurons,
-    float desired_train_error)
+    float desired_train_error, bool warm_start,
+    unsigned int time_budget)
 {
 
-    struct fann_train_data *train_data;
+    struct fann_train_data train_data;
     unsigned int in_size, out_size;
     float train_error;
+    int r;
 
-    fann_randomize_weights(iann->ann, -0.2, 0.2);
+    _sml_ann_bridge_weights_changed(iann);
+    if (iann->training)
+        sml_debug("Resuming the training of ANN:%p", iann);
+    else if (!warm_start || !iann->has_weights)
+        fann_randomize_weights(iann->ann, -0.2, 0.2);
+    else
+        sml_debug("Retraining ANN:%p from its current weights", iann);
 
     in_size = sml_ann_variables_list_get_length(inputs);
     out_size = sml_ann_variables_list_get_length(outputs);
 
-    train_data = fann_create_train(required_observations, in_size,
-        out_size);
-    if (!train_data) {
+    if ((r = _sml_ann_bridge_setup_train_data(iann, inputs, outputs,
+            &train_data, required_observations))) {
         sml_critical("Could not create the train data");
-        return -ENOMEM;
+        iann->training = false;
+        return r;
     }
 
-    _sml_ann_bridge_fill_train_data_array(inputs, outputs, train_data,
-        required_observations);
-
     sml_debug("Observations size: %d", required_observations);
+    _sml_ann_bridge_keep_kernel_samples(iann, &train_data);
 
     if (!max_neurons)
         max_neurons = (in_size + out_size) +
             ((in_size + out_size) * MAX_NEURONS_MULTIPLIER);
     iann->max_neurons = max_neurons;
-    fann_shuffle_train_data(train_data);
-    if (!iann->trained) {
-        fann_cascadetrain_on_data(iann->ann, train_data,
+    _sml_ann_bridge_shuffle_train_data(&train_data);
+    if (time_budget) {
+        if (!iann->training) {
+            iann->training = true;
+            iann->training_cascade = !iann->trained;
+            iann->session_progress = 0;
+            iann->plateau_reports = 0;
+            iann->best_error = FLT_MAX;
+        }
+        _sml_ann_bridge_train_slice(iann, &train_data, max_neurons,
+            desired_train_error, time_budget);
+        if (iann->out_of_time) {
+            iann->has_weights = true;
+            sml_debug("Training time budget is over, %u epochs done",
+                iann->session_progress);
+            return -EINPROGRESS;
+        }
+    } else if (!iann->trained) {
+        fann_cascadetrain_on_data(iann->ann, &train_data,
             max_neurons,
             REPORTS_BETWEEN_EPOCHS, desired_train_error);
     } else {
-        fann_train_on_data(iann->ann, train_data, MAX_EPOCHS,
-            REPORTS_BETWEEN_EPOCHS, desired_train_error);
+        _sml_ann_bridge_train_on_data(iann, &train_data, MAX_EPOCHS,
+            REPORTS_BETWEEN_EPOCHS, desired_train_error, NULL);
     }
 
+    iann->training = false;
+    iann->has_weights = true;
     train_error = fann_get_MSE(iann->ann);
     sml_debug("MSE error on test data: %f\n", train_error);
-    fann_destroy_train(train_data);
     *err = train_error;
     return 0;
 }
@@ -316,22 +757,18 @@ _sml_ann_bridge_setup_ci_and_observations(struct sml_ann_bridge *iann,
     return 0;
 }
 
-int
-sml_ann_bridge_train(struct sml_ann_bridge *iann,
+static int
+_sml_ann_bridge_evaluate_training(struct sml_ann_bridge *iann,
     struct sml_variables_list *inputs,
-    struct sml_variables_list *outputs, float desired_train_error,
+    struct sml_variables_list *outputs, float train_error,
+    float desired_train_error,
     unsigned int required_observations,
-    unsigned int max_neurons,
     unsigned int *required_observations_suggestion,
     bool use_pseudorehearsal)
 {
-    float train_error;
-    int error;
-
-    if ((error = _sml_really_train(iann, inputs, outputs, &train_error,
-            required_observations, max_neurons,
-            desired_train_error)))
-        return error;
+    struct fann_train_data train_data;
+    unsigned int observations = required_observations;
+    int error = 0;
 
     if (train_error <= desired_train_error) {
         iann->trained = true;
@@ -362,6 +799,128 @@ sml_ann_bridge_train(struct sml_ann_bridge *iann,
             required_observations,
             use_pseudorehearsal);
     }
+
+    if (!error && iann->trained && iann->quantization_bits &&
+        !_sml_ann_bridge_setup_train_data(iann, inputs, outputs, &train_data,
+        observations))
+        _sml_ann_bridge_quantize(iann, &train_data);
+    return error;
+}
+
+int
+sml_ann_bridge_train(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs, float desired_train_error,
+    unsigned int required_observations,
+    unsigned int max_neurons,
+    unsigned int *required_observations_suggestion,
+    bool use_pseudorehearsal, bool warm_start,
+    unsigned int time_budget)
+{
+    float train_error;
+    int error;
+
+    if ((error = _sml_really_train(iann, inputs, outputs, &train_error,
+            required_observations, max_neurons,
+            desired_train_error, warm_start, time_budget)))
+        return error;
+
+    return _sml_ann_bridge_evaluate_training(iann, inputs, outputs,
+        train_error,
+        desired_train_error, required_observations,
+        required_observations_suggestion, use_pseudorehearsal);
+}
+
+static void *
+_sml_ann_bridge_train_variant_run(void *data)
+{
+    Train_Variant *variant = data;
+
+    variant->error = _sml_really_train(variant->iann, variant->inputs,
+        variant->outputs, &variant->train_error,
+        variant->required_observations, variant->max_neurons,
+        variant->desired_train_error, variant->warm_start, 0);
+    return NULL;
+}
+
+int
+sml_ann_bridge_train_variants(struct sml_ann_bridge *iann,
+    struct sml_ann_bridge **variants, unsigned int variants_len,
+    struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs, float desired_train_error,
+    unsigned int required_observations,
+    unsigned int max_neurons,
+    unsigned int *required_observations_suggestion,
+    bool use_pseudorehearsal, bool warm_start)
+{
+    Train_Variant *runs, *best;
+    struct fann *ann;
+    unsigned int i, started;
+    int error;
+
+    runs = calloc(variants_len + 1, sizeof(Train_Variant));
+    if (!runs) {
+        sml_critical("Could not alloc the training variants");
+        return -ENOMEM;
+    }
+
+    for (i = 0; i <= variants_len; i++) {
+        runs[i].iann = i ? variants[i - 1] : iann;
+        runs[i].inputs = inputs;
+        runs[i].outputs = outputs;
+        runs[i].required_observations = required_observations;
+        runs[i].max_neurons = max_neurons;
+        runs[i].desired_train_error = desired_train_error;
+        runs[i].warm_start = warm_start;
+    }
+
+    /* The observations are only read while the variants are trained. The
+       network of iann is trained by the calling thread. */
+    for (started = 1; started <= variants_len; started++) {
+        if ((error = pthread_create(&runs[started].thread, NULL,
+                _sml_ann_bridge_train_variant_run, &runs[started]))) {
+            sml_warning("Could not start the training thread of variant %u:" \
+                " %d", started, error);
+            break;
+        }
+    }
+    _sml_ann_bridge_train_variant_run(&runs[0]);
+    for (i = 1; i < started; i++)
+        pthread_join(runs[i].thread, NULL);
+
+    best = NULL;
+    for (i = 0; i < started; i++) {
+        sml_debug("Variant:%u error:%d MSE:%f", i, runs[i].error,
+            runs[i].train_error);
+        if (runs[i].error)
+            continue;
+        if (!best || runs[i].train_error < best->train_error)
+            best = &runs[i];
+    }
+
+    if (!best) {
+        error = runs[0].error;
+        goto end;
+    }
+
+    /* Keeps the best network in iann, the variant gets the replaced one */
+    if (best->iann != iann) {
+        sml_debug("Using the network of variant:%u", (unsigned int)
+            (best - runs));
+        ann = iann->ann;
+        iann->ann = best->iann->ann;
+        best->iann->ann = ann;
+        _sml_ann_bridge_weights_changed(iann);
+        iann->max_neurons = best->iann->max_neurons;
+        iann->has_weights = true;
+    }
+
+    error = _sml_ann_bridge_evaluate_training(iann, inputs, outputs,
+        best->train_error, desired_train_error, required_observations,
+        required_observations_suggestion, use_pseudorehearsal);
+
+end:
+    free(runs);
     return error;
 }
 
@@ -430,7 +989,33 @@ sml_ann_bridge_confidence_intervals_distance_sum(struct sml_ann_bridge *iann,
     return distance;
 }
 
-void
+float
+sml_ann_bridge_confidence_intervals_distance_sum_values(
+    struct sml_ann_bridge *iann, struct sml_variables_list *inputs,
+    const float *values)
+{
+    Confidence_Interval *ci;
+    uint16_t i, len;
+    float v, distance = 0.0;
+
+    len = sml_ann_variables_list_get_length(inputs);
+    for (i = 0; i < len; i++) {
+        v = values[i];
+        if (isnan(v))
+            sml_ann_variable_get_range(sml_ann_variables_list_index(inputs, i),
+                &v, NULL);
+        ci = sol_vector_get(&iann->confidence_intervals, i);
+        if (!ci)
+            continue;
+        if (v < ci->lower_limit)
+            distance += fabsf(ci->lower_limit - v);
+        else if (v > ci->upper_limit)
+            distance += fabsf(ci->upper_limit - v);
+    }
+    return distance;
+}
+
+bool
 sml_ann_bridge_add_observation(struct sml_ann_bridge *iann,
     struct sml_variables_list *inputs,
     struct sml_variables_list *outputs)
@@ -439,9 +1024,13 @@ sml_ann_bridge_add_observation(struct sml_ann_bridge *iann,
 
     if (!iann->observations) {
         sml_warning("The bridge observation vector is not created");
-        return;
+        return false;
     }
 
+    /* Full, waiting to be retrained */
+    if (iann->observation_idx == iann->required_observations)
+        return false;
+
     len = sml_ann_variables_list_get_length(inputs);
     for (i = 0; i < len; i++)
         iann->observations->input[iann->observation_idx][i] =
@@ -454,88 +1043,334 @@ sml_ann_bridge_add_observation(struct sml_ann_bridge *iann,
 
     iann->observation_idx++;
     sml_debug("ANN:%p observation_idx:%d", iann, iann->observation_idx);
-    if (iann->observation_idx == iann->required_observations) {
-        sml_debug("Retraining the ANN !");
-        fann_train_on_data(iann->ann, iann->observations, MAX_EPOCHS,
-            REPORTS_BETWEEN_EPOCHS, iann->last_train_error);
-        iann->observation_idx = 0;
-    }
+    return iann->observation_idx == iann->required_observations;
 }
 
-float
-sml_ann_bridge_get_confidence_interval_sum(struct sml_ann_bridge *iann)
+bool
+sml_ann_bridge_needs_retrain(struct sml_ann_bridge *iann)
 {
-    return iann->ci_length_sum;
+    return iann->observations &&
+           iann->observation_idx == iann->required_observations;
 }
 
-int
-sml_ann_bridge_consider_trained(struct sml_ann_bridge *iann,
-    struct sml_variables_list *inputs,
-    unsigned int observations,
-    bool use_pseudorehearsal)
+void
+sml_ann_bridge_reset_observations(struct sml_ann_bridge *iann)
 {
-    int error = _sml_ann_bridge_setup_ci_and_observations(iann, inputs,
-        observations,
-        use_pseudorehearsal);
+    iann->observation_idx = 0;
+}
 
-    if (error != 0)
-        return error;
-    iann->trained = true;
-    fann_set_training_algorithm(iann->ann, FANN_TRAIN_INCREMENTAL);
+int
+sml_ann_bridge_retrain(struct sml_ann_bridge *iann, unsigned int time_budget)
+{
+    _sml_ann_bridge_weights_changed(iann);
+    _sml_ann_bridge_keep_kernel_samples(iann, iann->observations);
+    if (time_budget) {
+        if (!iann->training) {
+            sml_debug("Retraining the ANN in slices !");
+            iann->training = true;
+            iann->training_cascade = false;
+            iann->session_progress = 0;
+            iann->plateau_reports = 0;
+            iann->best_error = FLT_MAX;
+        }
+        _sml_ann_bridge_train_slice(iann, iann->observations,
+            iann->max_neurons, iann->last_train_error, time_budget);
+        if (iann->out_of_time) {
+            sml_debug("Retraining time budget is over, %u epochs done",
+                iann->session_progress);
+            return -EINPROGRESS;
+        }
+    } else {
+        sml_debug("Retraining the ANN !");
+        _sml_ann_bridge_train_on_data(iann, iann->observations, MAX_EPOCHS,
+            REPORTS_BETWEEN_EPOCHS, iann->last_train_error, NULL);
+    }
+    iann->training = false;
+    _sml_ann_bridge_quantize(iann, iann->observations);
+    iann->observation_idx = 0;
     return 0;
 }
 
-static bool
-_sml_ann_bridge_really_predict_output(struct sml_ann_bridge *iann,
-    struct sml_variables_list *inputs,
-    struct sml_variables_list *outputs,
-    unsigned int idx,
-    bool set_current_value)
+/* Moves the weights of retrained, a copy of iann, to iann and frees it */
+void
+sml_ann_bridge_take_weights(struct sml_ann_bridge *iann,
+    struct sml_ann_bridge *retrained)
 {
-    uint16_t size, i;
-    fann_type *out, *in;
-    struct sml_variable *var;
-    float value;
-    bool r = false;
+    struct fann *ann = iann->ann;
+    struct sml_ann_kernel *kernel = iann->kernel;
+    struct sml_ann_kernel *quantized = iann->quantized;
+    fann_type *kernel_samples = iann->kernel_samples;
+    unsigned int kernel_samples_len = iann->kernel_samples_len;
+
+    iann->ann = retrained->ann;
+    iann->kernel = retrained->kernel;
+    iann->kernel_unsupported = retrained->kernel_unsupported;
+    iann->quantized = retrained->quantized;
+    iann->quantization_error = retrained->quantization_error;
+    iann->kernel_samples = retrained->kernel_samples;
+    iann->kernel_samples_len = retrained->kernel_samples_len;
+    iann->has_weights = true;
+
+    retrained->ann = ann;
+    retrained->kernel = kernel;
+    retrained->quantized = quantized;
+    retrained->kernel_samples = kernel_samples;
+    retrained->kernel_samples_len = kernel_samples_len;
+    sml_ann_bridge_free(retrained);
+}
 
-    size = sml_ann_variables_list_get_length(inputs);
-    in = malloc(sizeof(fann_type) * size);
+void
+sml_ann_bridge_set_training_threads(struct sml_ann_bridge *iann,
+    unsigned int threads)
+{
+    iann->training_threads = threads ? threads : 1;
+}
 
-    if (!in) {
-        sml_critical("Could not alloc fann input vector");
-        return r;
+void
+sml_ann_bridge_set_quantization(struct sml_ann_bridge *iann,
+    unsigned int bits, float max_error)
+{
+    if (bits != iann->quantization_bits) {
+        sml_ann_kernel_free(iann->quantized);
+        iann->quantized = NULL;
+        iann->quantization_error = NAN;
     }
+    iann->quantization_bits = bits;
+    iann->quantization_max_error = max_error;
+}
 
-    for (i = 0; i < size; i++) {
-        var = sml_ann_variables_list_index(inputs, i);
-        if (!set_current_value)
-            value = sml_ann_variable_get_value_by_index(var, idx);
-        else //the last observation
-            value = sml_ann_variable_get_value(var);
-        if (isnan(value))
-            sml_ann_variable_get_range(var, &value, NULL);
-        in[i] = sml_ann_variable_scale_value(var, value);
-    }
+float
+sml_ann_bridge_get_quantization_error(struct sml_ann_bridge *iann)
+{
+    return iann->quantization_error;
+}
 
-    out = fann_run(iann->ann, in);
+bool
+sml_ann_bridge_save_quantized(struct sml_ann_bridge *iann, const char *path)
+{
+    FILE *f;
+    bool r;
 
-    if (out) {
+    if (!iann->quantized)
+        return true;
+
+    sml_debug("Saving quantized ann at:%s", path);
+    f = fopen(path, "wb");
+    if (!f) {
+        sml_critical("Could not create the quantized ANN file");
+        return false;
+    }
+
+    r = sml_ann_kernel_save(iann->quantized, iann->quantization_error, f);
+    if (fclose(f) == EOF)
+        r = false;
+    if (!r) {
+        sml_critical("Could not save the quantized ANN at:%s", path);
+        delete_file(path);
+    }
+    return r;
+}
+
+bool
+sml_ann_bridge_load_quantized(struct sml_ann_bridge *iann, const char *path)
+{
+    struct sml_ann_kernel *quantized;
+    float error;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        sml_critical("Could not open the quantized ANN file:%s", path);
+        return false;
+    }
+    quantized = sml_ann_kernel_load(f, &error);
+    fclose(f);
+    if (!quantized)
+        return false;
+
+    if (sml_ann_kernel_get_num_input(quantized) != iann->input_size ||
+        sml_ann_kernel_get_num_output(quantized) !=
+        fann_get_num_output(iann->ann)) {
+        sml_critical("The quantized ANN does not match the network layout");
+        sml_ann_kernel_free(quantized);
+        return false;
+    }
+    if (sml_ann_kernel_get_bits(quantized) != iann->quantization_bits) {
+        sml_warning("The ANN was quantized to %u bits instead of %u",
+            sml_ann_kernel_get_bits(quantized), iann->quantization_bits);
+        sml_ann_kernel_free(quantized);
+        return false;
+    }
+
+    sml_ann_kernel_free(iann->quantized);
+    iann->quantized = quantized;
+    iann->quantization_bits = sml_ann_kernel_get_bits(quantized);
+    sml_ann_kernel_free(iann->kernel);
+    iann->kernel = NULL;
+    iann->quantization_error = error;
+    return true;
+}
+
+float
+sml_ann_bridge_get_confidence_interval_sum(struct sml_ann_bridge *iann)
+{
+    return iann->ci_length_sum;
+}
+
+bool
+sml_ann_bridge_get_confidence_intervals(struct sml_ann_bridge *iann,
+    float *lower, float *upper, uint16_t len)
+{
+    Confidence_Interval *ci;
+    uint16_t i;
+
+    if (iann->confidence_intervals.len != len)
+        return false;
+    SOL_VECTOR_FOREACH_IDX (&iann->confidence_intervals, ci, i) {
+        lower[i] = ci->lower_limit;
+        upper[i] = ci->upper_limit;
+    }
+    return true;
+}
+
+int
+sml_ann_bridge_consider_trained(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs,
+    unsigned int observations,
+    bool use_pseudorehearsal)
+{
+    int error = _sml_ann_bridge_setup_ci_and_observations(iann, inputs,
+        observations,
+        use_pseudorehearsal);
+
+    if (error != 0)
+        return error;
+    iann->trained = true;
+    fann_set_training_algorithm(iann->ann, FANN_TRAIN_INCREMENTAL);
+    return 0;
+}
+
+static bool
+_sml_ann_bridge_kernel_matches(struct sml_ann_bridge *iann,
+    struct sml_ann_kernel *kernel, fann_type *input)
+{
+    const float *compiled;
+    const fann_type *out;
+    unsigned int i, len;
+
+    out = fann_run(iann->ann, input);
+    if (!out)
+        return false;
+    compiled = sml_ann_kernel_run(kernel, input);
+    len = fann_get_num_output(iann->ann);
+    for (i = 0; i < len; i++) {
+        if (fabsf(compiled[i] - out[i]) > KERNEL_TOLERANCE) {
+            sml_warning("Compiled ANN output %f differs from %f, using" \
+                " fann_run()", compiled[i], out[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Compiles the network. The kernel is kept only if its outputs match the
+   fann_run() ones for iann->input, the inputs kept from the last training
+   and the observations stored so far. */
+static void
+_sml_ann_bridge_compile(struct sml_ann_bridge *iann)
+{
+    struct sml_ann_kernel *kernel;
+    unsigned int i, len;
+
+    kernel = sml_ann_kernel_new(iann->ann);
+    if (!kernel) {
+        sml_debug("ANN:%p can not be compiled, using fann_run()", iann);
+        iann->kernel_unsupported = true;
+        return;
+    }
+
+    if (!_sml_ann_bridge_kernel_matches(iann, kernel, iann->input))
+        goto unsupported;
+    for (i = 0; i < iann->kernel_samples_len; i++) {
+        if (!_sml_ann_bridge_kernel_matches(iann, kernel,
+            iann->kernel_samples + i * iann->input_size))
+            goto unsupported;
+    }
+    len = iann->observations ? iann->observation_idx : 0;
+    if (len > KERNEL_SAMPLES)
+        len = KERNEL_SAMPLES;
+    for (i = 0; i < len; i++) {
+        if (!_sml_ann_bridge_kernel_matches(iann, kernel,
+            iann->observations->input[i]))
+            goto unsupported;
+    }
+
+    iann->kernel = kernel;
+    return;
+
+unsupported:
+    sml_ann_kernel_free(kernel);
+    iann->kernel_unsupported = true;
+}
+
+/* Runs the network over iann->input. The network is compiled on the first
+   run after its weights change. */
+static const fann_type *
+_sml_ann_bridge_run(struct sml_ann_bridge *iann)
+{
+    if (iann->quantized)
+        return sml_ann_kernel_run(iann->quantized, iann->input);
+    if (!iann->kernel && !iann->kernel_unsupported)
+        _sml_ann_bridge_compile(iann);
+    if (iann->kernel)
+        return sml_ann_kernel_run(iann->kernel, iann->input);
+    return fann_run(iann->ann, iann->input);
+}
+
+static bool
+_sml_ann_bridge_really_predict_output(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs,
+    unsigned int idx,
+    bool set_current_value)
+{
+    const fann_type *out;
+
+    if (sml_ann_variables_list_get_length(inputs) != iann->input_size) {
+        sml_critical("The inputs do not match the neural network layout");
+        return false;
+    }
+
+    if (!set_current_value)
+        sml_ann_variables_list_get_scaled_row(inputs, idx, iann->input);
+    else //the last observation
+        sml_ann_variables_list_get_scaled_values(inputs, iann->input);
+
+    out = _sml_ann_bridge_run(iann);
+    if (!out) {
+        sml_critical("fann_run() returned NULL!");
+        return false;
+    }
+
+    if (!set_current_value)
+        sml_ann_variables_list_set_scaled_row(outputs, idx, out);
+    else
+        sml_ann_variables_list_set_scaled_values(outputs, out);
+
+#ifdef Debug
+    {
         char var_name[SML_VARIABLE_NAME_MAX_LEN + 1];
+        struct sml_variable *var;
+        uint16_t i, size;
+        float value;
 
         size = sml_ann_variables_list_get_length(outputs);
-
         for (i = 0; i < size; i++) {
             var = sml_ann_variables_list_index(outputs, i);
-
-            if (isnan(out[i]))
-                sml_ann_variable_get_range(var, &value, NULL);
-            else
-                value = sml_ann_variable_descale_value(var, out[i]);
-
             if (!set_current_value)
-                sml_ann_variable_set_value_by_index(var, value, idx);
+                value = sml_ann_variable_get_value_by_index(var, idx);
             else
-                sml_ann_variable_set_value(var, value);
+                value = sml_ann_variable_get_value(var);
 
             if (sml_ann_variable_get_name(var, var_name, sizeof(var_name))) {
                 sml_warning("Failed to get variable name for %p", var);
@@ -545,11 +1380,42 @@ _sml_ann_bridge_really_predict_output(struct sml_ann_bridge *iann,
             sml_debug("Predicted value:%f current value:%f variable:%s", value,
                 sml_ann_variable_get_previous_value(var), var_name);
         }
-        r = true;
-    } else
-        sml_critical("fann_run() returned NULL!");
-    free(in);
-    return r;
+    }
+#endif
+    return true;
+}
+
+int
+sml_ann_bridge_predict_rows(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs,
+    const float *in, float *out,
+    const unsigned int *rows, unsigned int count)
+{
+    uint16_t in_len, out_len;
+    const fann_type *result;
+    unsigned int i;
+
+    in_len = sml_ann_variables_list_get_length(inputs);
+    out_len = sml_ann_variables_list_get_length(outputs);
+    if (in_len != iann->input_size ||
+        out_len != fann_get_num_output(iann->ann)) {
+        sml_critical("The variables do not match the neural network layout");
+        return -EINVAL;
+    }
+
+    for (i = 0; i < count; i++) {
+        sml_ann_variables_list_scale_values(inputs,
+            in + (size_t)rows[i] * in_len, iann->input);
+        result = _sml_ann_bridge_run(iann);
+        if (!result) {
+            sml_critical("fann_run() returned NULL!");
+            return -EIO;
+        }
+        sml_ann_variables_list_descale_values(outputs, result,
+            out + (size_t)rows[i] * out_len);
+    }
+    return 0;
 }
 
 bool
@@ -575,7 +1441,13 @@ sml_ann_bridge_free(struct sml_ann_bridge *iann)
 {
     fann_destroy_train(iann->observations);
     fann_destroy(iann->ann);
+    sml_ann_kernel_free(iann->kernel);
+    sml_ann_kernel_free(iann->quantized);
     sol_vector_clear(&iann->confidence_intervals);
+    free(iann->train_rows);
+    free(iann->train_copy);
+    free(iann->kernel_samples);
+    free(iann->input);
     free(iann);
 }
 
@@ -585,6 +1457,59 @@ sml_ann_bridge_is_trained(struct sml_ann_bridge *iann)
     return iann->trained;
 }
 
+struct sml_ann_bridge *
+sml_ann_bridge_copy(struct sml_ann_bridge *iann)
+{
+    struct fann *ann;
+    struct sml_ann_bridge *copy;
+    Confidence_Interval *ci, *ci_copy;
+    uint16_t i;
+
+    ann = fann_copy(iann->ann);
+    if (!ann) {
+        sml_critical("Could not copy the neural network");
+        return NULL;
+    }
+
+    copy = _sml_ann_bridge_new(ann, iann->trained);
+    if (!copy) {
+        fann_destroy(ann);
+        return NULL;
+    }
+
+    SOL_VECTOR_FOREACH_IDX (&iann->confidence_intervals, ci, i) {
+        ci_copy = sol_vector_append(&copy->confidence_intervals);
+        if (!ci_copy) {
+            sml_critical("Could not copy the confidence intervals");
+            goto err_exit;
+        }
+        *ci_copy = *ci;
+    }
+
+    if (iann->observations) {
+        copy->observations = fann_duplicate_train_data(iann->observations);
+        if (!copy->observations) {
+            sml_critical("Could not copy the observations array");
+            goto err_exit;
+        }
+    }
+
+    copy->has_weights = iann->has_weights;
+    copy->training_threads = iann->training_threads;
+    copy->quantization_bits = iann->quantization_bits;
+    copy->quantization_max_error = iann->quantization_max_error;
+    copy->last_train_error = iann->last_train_error;
+    copy->required_observations = iann->required_observations;
+    copy->observation_idx = iann->observation_idx;
+    copy->max_neurons = iann->max_neurons;
+    copy->ci_length_sum = iann->ci_length_sum;
+    return copy;
+
+err_exit:
+    sml_ann_bridge_free(copy);
+    return NULL;
+}
+
 struct sml_ann_bridge *
 sml_ann_bridge_new(unsigned int inputs, unsigned int outputs,
     unsigned int candidate_groups, unsigned int epochs,
@@ -823,6 +1748,431 @@ err_exit:
     return NULL;
 }
 
+/* Only networks with the layout fann_create_shortcut_array() creates, as
+   the cascade training keeps it, can be packed */
+static bool
+_sml_ann_bridge_is_packable(struct fann *ann)
+{
+    struct fann_neuron *first = ann->first_layer->first_neuron;
+    struct fann_neuron *neuron;
+    struct fann_layer *layer;
+    unsigned int i, count;
+
+    if (ann->network_type != FANN_NETTYPE_SHORTCUT)
+        return false;
+    for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++) {
+        count = layer->first_neuron - first;
+        for (neuron = layer->first_neuron; neuron != layer->last_neuron;
+            neuron++) {
+            if (neuron->last_con - neuron->first_con != count)
+                return false;
+            for (i = 0; i < count; i++) {
+                if (ann->connections[neuron->first_con + i] != first + i)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool
+_sml_ann_bridge_write_section(const void *data, size_t size, FILE *f)
+{
+    static const char padding[PACKED_ALIGN] = { 0 };
+
+    if (size && fwrite(data, size, 1, f) != 1)
+        return false;
+    if (PACKED_PAD(size) != size &&
+        fwrite(padding, PACKED_PAD(size) - size, 1, f) != 1)
+        return false;
+    return true;
+}
+
+static bool
+_sml_ann_bridge_write_packed(struct sml_ann_bridge *iann, FILE *f)
+{
+    struct fann *ann = iann->ann;
+    struct fann_neuron *first = ann->first_layer->first_neuron;
+    struct fann_layer *layer;
+    Packed_Ann packed = { 0 };
+    uint32_t *layers;
+    int32_t *activations;
+    float *steepnesses;
+    unsigned int i;
+    bool r = false;
+
+    /* Networks are only compiled once used, so the ones that were not
+       used yet are compiled to be saved with their kernel. Quantized
+       networks are saved without it. */
+    if (!iann->kernel && !iann->kernel_unsupported && !iann->quantized)
+        _sml_ann_bridge_compile(iann);
+
+    packed.num_layers = ann->last_layer - ann->first_layer;
+    packed.total_neurons = ann->total_neurons;
+    packed.total_connections = ann->total_connections;
+    packed.confidence_intervals_len = iann->confidence_intervals.len;
+    packed.max_neurons = iann->max_neurons;
+    packed.required_observations = iann->required_observations;
+    packed.train_error_function = fann_get_train_error_function(ann);
+    packed.learning_rate = fann_get_learning_rate(ann);
+    packed.learning_momentum = fann_get_learning_momentum(ann);
+    packed.last_train_error = iann->last_train_error;
+    packed.quantization_error = iann->quantization_error;
+    packed.kernel_size = iann->kernel ?
+        sml_ann_kernel_get_image_size(iann->kernel) : 0;
+    packed.quantized_size = iann->quantized ?
+        sml_ann_kernel_get_image_size(iann->quantized) : 0;
+
+    layers = calloc(packed.num_layers, sizeof(uint32_t));
+    activations = calloc(packed.total_neurons, sizeof(int32_t));
+    steepnesses = calloc(packed.total_neurons, sizeof(float));
+    if (!layers || !activations || !steepnesses) {
+        sml_critical("Could not alloc the packed ANN arrays");
+        goto exit;
+    }
+
+    for (layer = ann->first_layer; layer != ann->last_layer; layer++)
+        layers[layer - ann->first_layer] = layer->last_neuron -
+            layer->first_neuron;
+    /* The bias neuron is added back by fann_create_shortcut_array() */
+    layers[0]--;
+    for (i = 0; i < packed.total_neurons; i++) {
+        activations[i] = first[i].activation_function;
+        steepnesses[i] = first[i].activation_steepness;
+    }
+
+    r = _sml_ann_bridge_write_section(&packed, sizeof(packed), f) &&
+        _sml_ann_bridge_write_section(layers,
+        packed.num_layers * sizeof(uint32_t), f) &&
+        _sml_ann_bridge_write_section(activations,
+        packed.total_neurons * sizeof(int32_t), f) &&
+        _sml_ann_bridge_write_section(steepnesses,
+        packed.total_neurons * sizeof(float), f) &&
+        _sml_ann_bridge_write_section(ann->weights,
+        packed.total_connections * sizeof(fann_type), f) &&
+        _sml_ann_bridge_write_section(iann->confidence_intervals.data,
+        packed.confidence_intervals_len * sizeof(Confidence_Interval), f) &&
+        (!iann->kernel || sml_ann_kernel_write(iann->kernel, 0, f)) &&
+        (!iann->quantized || sml_ann_kernel_write(iann->quantized,
+        iann->quantization_error, f));
+
+exit:
+    free(layers);
+    free(activations);
+    free(steepnesses);
+    return r;
+}
+
+bool
+sml_ann_bridge_file_save(const char *path, struct sol_ptr_vector *anns)
+{
+    Packed_Header header = { 0 };
+    Packed_Entry *entries;
+    struct sml_ann_bridge *iann;
+    long offset;
+    uint16_t i;
+    FILE *f;
+    bool r = false;
+
+    SOL_PTR_VECTOR_FOREACH_IDX (anns, iann, i) {
+        if (!sml_ann_bridge_is_trained(iann))
+            continue;
+        if (!_sml_ann_bridge_is_packable(iann->ann)) {
+            sml_debug("ANN:%p layout can not be packed", iann);
+            return false;
+        }
+        header.count++;
+    }
+
+    entries = calloc(header.count ? header.count : 1, sizeof(Packed_Entry));
+    if (!entries) {
+        sml_critical("Could not alloc the packed ANN entries");
+        return false;
+    }
+
+    sml_debug("Saving packed anns at:%s", path);
+    f = fopen(path, "wb");
+    if (!f) {
+        sml_critical("Could not create the packed ANN file");
+        free(entries);
+        return false;
+    }
+
+    header.magic = PACKED_MAGIC;
+    header.version = PACKED_VERSION;
+    header.entries = PACKED_PAD(sizeof(header));
+    /* The entries are written again once the blocks offsets are known */
+    if (!_sml_ann_bridge_write_section(&header, sizeof(header), f) ||
+        !_sml_ann_bridge_write_section(entries,
+        header.count * sizeof(Packed_Entry), f))
+        goto exit;
+
+    header.count = 0;
+    SOL_PTR_VECTOR_FOREACH_IDX (anns, iann, i) {
+        if (!sml_ann_bridge_is_trained(iann))
+            continue;
+        offset = ftell(f);
+        if (offset < 0 || !_sml_ann_bridge_write_packed(iann, f))
+            goto exit;
+        entries[header.count].offset = offset;
+        entries[header.count].size = ftell(f) - offset;
+        header.count++;
+    }
+
+    offset = ftell(f);
+    if (offset < 0)
+        goto exit;
+    header.size = offset;
+    if (fseek(f, 0, SEEK_SET) ||
+        !_sml_ann_bridge_write_section(&header, sizeof(header), f) ||
+        !_sml_ann_bridge_write_section(entries,
+        header.count * sizeof(Packed_Entry), f))
+        goto exit;
+
+    r = true;
+exit:
+    if (fclose(f) == EOF) {
+        sml_critical("Could not correctly close the packed ANN file");
+        r = false;
+    }
+    if (!r) {
+        sml_critical("Could not save the packed anns at:%s", path);
+        delete_file(path);
+    }
+    free(entries);
+    return r;
+}
+
+struct sml_ann_bridge_file *
+sml_ann_bridge_file_open(const char *path)
+{
+    struct sml_ann_bridge_file *file;
+    const Packed_Header *header;
+    struct stat st;
+    unsigned int i;
+    int fd;
+
+    sml_debug("Mapping packed anns:%s", path);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        sml_critical("Could not open file:%s", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) || (uint64_t)st.st_size < sizeof(Packed_Header) ||
+        (uint64_t)st.st_size > SIZE_MAX) {
+        sml_critical("Invalid packed ANN file:%s", path);
+        close(fd);
+        return NULL;
+    }
+
+    file = calloc(1, sizeof(struct sml_ann_bridge_file));
+    if (!file) {
+        sml_critical("Could not alloc the packed ANN file");
+        close(fd);
+        return NULL;
+    }
+
+    /* The networks are only read, so the pages are shared with the page
+       cache and other processes using the same file */
+    file->size = st.st_size;
+    file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->data == MAP_FAILED) {
+        sml_critical("Could not map the packed ANN file:%s", path);
+        free(file);
+        return NULL;
+    }
+
+    header = file->data;
+    if (header->magic != PACKED_MAGIC || header->version != PACKED_VERSION ||
+        header->size != file->size || header->entries % PACKED_ALIGN ||
+        header->entries > file->size ||
+        header->count > (file->size - header->entries) / sizeof(Packed_Entry))
+        goto err_invalid;
+
+    file->count = header->count;
+    file->entries = (const Packed_Entry *)((const char *)file->data +
+        header->entries);
+    for (i = 0; i < file->count; i++) {
+        if (file->entries[i].offset % PACKED_ALIGN ||
+            file->entries[i].offset > file->size ||
+            file->entries[i].size > file->size - file->entries[i].offset ||
+            file->entries[i].size < sizeof(Packed_Ann))
+            goto err_invalid;
+    }
+    return file;
+
+err_invalid:
+    sml_critical("Invalid packed ANN file:%s", path);
+    sml_ann_bridge_file_close(file);
+    return NULL;
+}
+
+void
+sml_ann_bridge_file_close(struct sml_ann_bridge_file *file)
+{
+    if (!file)
+        return;
+    munmap(file->data, file->size);
+    free(file);
+}
+
+unsigned int
+sml_ann_bridge_file_get_count(struct sml_ann_bridge_file *file)
+{
+    return file->count;
+}
+
+/* Returns the next section of a packed block, NULL if it does not fit */
+static const void *
+_sml_ann_bridge_read_section(const char **pos, const char *end,
+    uint64_t size)
+{
+    const char *section = *pos;
+    uint64_t left = end - section;
+
+    if (size > left)
+        return NULL;
+    *pos += PACKED_PAD(size) <= left ? PACKED_PAD(size) : size;
+    return section;
+}
+
+struct sml_ann_bridge *
+sml_ann_bridge_file_get(struct sml_ann_bridge_file *file, unsigned int idx,
+    unsigned int quantization_bits)
+{
+    const Packed_Ann *packed;
+    const uint32_t *layers;
+    const int32_t *activations;
+    const float *steepnesses;
+    const fann_type *weights;
+    const Confidence_Interval *cis;
+    const void *kernel, *quantized;
+    const char *pos, *end;
+    struct fann_neuron *neuron;
+    struct sml_ann_bridge *iann;
+    Confidence_Interval *ci;
+    struct fann *ann;
+    unsigned int i;
+
+    if (idx >= file->count)
+        return NULL;
+
+    pos = (const char *)file->data + file->entries[idx].offset;
+    end = pos + file->entries[idx].size;
+    packed = _sml_ann_bridge_read_section(&pos, end, sizeof(Packed_Ann));
+    if (!packed || packed->num_layers < 2)
+        goto err_invalid;
+    layers = _sml_ann_bridge_read_section(&pos, end,
+        (uint64_t)packed->num_layers * sizeof(uint32_t));
+    activations = _sml_ann_bridge_read_section(&pos, end,
+        (uint64_t)packed->total_neurons * sizeof(int32_t));
+    steepnesses = _sml_ann_bridge_read_section(&pos, end,
+        (uint64_t)packed->total_neurons * sizeof(float));
+    weights = _sml_ann_bridge_read_section(&pos, end,
+        (uint64_t)packed->total_connections * sizeof(fann_type));
+    cis = _sml_ann_bridge_read_section(&pos, end,
+        (uint64_t)packed->confidence_intervals_len *
+        sizeof(Confidence_Interval));
+    kernel = _sml_ann_bridge_read_section(&pos, end, packed->kernel_size);
+    quantized = _sml_ann_bridge_read_section(&pos, end,
+        packed->quantized_size);
+    if (!layers || !activations || !steepnesses || !weights || !cis ||
+        !kernel || !quantized)
+        goto err_invalid;
+
+    ann = fann_create_shortcut_array(packed->num_layers, layers);
+    if (!ann) {
+        sml_critical("Could not create the packed neural network");
+        return NULL;
+    }
+    if (ann->total_neurons != packed->total_neurons ||
+        ann->total_connections != packed->total_connections) {
+        fann_destroy(ann);
+        goto err_invalid;
+    }
+
+    memcpy(ann->weights, weights,
+        packed->total_connections * sizeof(fann_type));
+    neuron = ann->first_layer->first_neuron;
+    for (i = 0; i < packed->total_neurons; i++) {
+        neuron[i].activation_function = activations[i];
+        neuron[i].activation_steepness = steepnesses[i];
+    }
+    fann_set_train_error_function(ann, packed->train_error_function);
+    fann_set_learning_rate(ann, packed->learning_rate);
+    fann_set_learning_momentum(ann, packed->learning_momentum);
+
+    iann = _sml_ann_bridge_new(ann, true);
+    if (!iann) {
+        fann_destroy(ann);
+        return NULL;
+    }
+
+    for (i = 0; i < packed->confidence_intervals_len; i++) {
+        ci = sol_vector_append(&iann->confidence_intervals);
+        if (!ci) {
+            sml_critical("Could not alloc the confidence interval");
+            goto err_exit;
+        }
+        *ci = cis[i];
+        iann->ci_length_sum += (ci->upper_limit - ci->lower_limit);
+    }
+    iann->max_neurons = packed->max_neurons;
+    iann->required_observations = packed->required_observations;
+    iann->last_train_error = packed->last_train_error;
+
+    iann->observations = fann_create_train(iann->required_observations,
+        fann_get_num_input(iann->ann),
+        fann_get_num_output(iann->ann));
+    if (!iann->observations) {
+        sml_critical("Could not alloc observations array");
+        goto err_exit;
+    }
+
+    /* The kernels use the weights in the mapped file, which is kept until
+       the networks are freed. The float kernel is not needed while the
+       quantized one is used. */
+    if (packed->quantized_size && quantization_bits) {
+        iann->quantized = sml_ann_kernel_map(quantized,
+            packed->quantized_size, NULL);
+        if (!iann->quantized)
+            goto err_exit;
+        /* Only used if the weights have the bits predictions are done
+           with, like the quantized files of sml_ann_bridge_load_quantized() */
+        if (sml_ann_kernel_get_bits(iann->quantized) == quantization_bits) {
+            iann->quantization_bits = quantization_bits;
+            iann->quantization_error = packed->quantization_error;
+        } else {
+            sml_ann_kernel_free(iann->quantized);
+            iann->quantized = NULL;
+        }
+    }
+    if (packed->kernel_size && !iann->quantized) {
+        iann->kernel = sml_ann_kernel_map(kernel, packed->kernel_size, NULL);
+        if (!iann->kernel)
+            goto err_exit;
+    }
+
+    if ((iann->kernel && (sml_ann_kernel_get_num_input(iann->kernel) !=
+        iann->input_size || sml_ann_kernel_get_num_output(iann->kernel) !=
+        fann_get_num_output(ann))) ||
+        (iann->quantized && (sml_ann_kernel_get_num_input(iann->quantized) !=
+        iann->input_size || sml_ann_kernel_get_num_output(iann->quantized) !=
+        fann_get_num_output(ann)))) {
+        sml_critical("The packed ANN kernels do not match the network");
+        goto err_exit;
+    }
+    return iann;
+
+err_invalid:
+    sml_critical("Invalid packed ANN %u", idx);
+    return NULL;
+err_exit:
+    sml_ann_bridge_free(iann);
+    return NULL;
+}
+
 void
 sml_ann_bridge_print_debug(struct sml_ann_bridge *ann)
 {
@@ -844,21 +2194,16 @@ sml_ann_bridge_get_error(struct sml_ann_bridge *iann,
     struct sml_variables_list *input, struct sml_variables_list *output,
     unsigned int observations)
 {
-    struct fann_train_data *test_data;
+    struct fann_train_data test_data;
     float err = NAN;
 
-    test_data = fann_create_train(observations,
-        sml_ann_variables_list_get_length(input),
-        sml_ann_variables_list_get_length(output));
-    if (!test_data) {
+    if (_sml_ann_bridge_setup_train_data(iann, input, output, &test_data,
+            observations)) {
         sml_critical("Could not create the test data");
         return err;
     }
 
-    _sml_ann_bridge_fill_train_data_array(input, output, test_data,
-        observations);
-    err = fann_test_data(iann->ann, test_data);
+    err = fann_test_data(iann->ann, &test_data);
     sml_debug("ANN current error:%f", err);
-    fann_destroy_train(test_data);
     return err;
 }
@@ -25,6 +25,7 @@
 extern "C" {
 #endif
 struct sml_ann_bridge;
+struct sml_ann_bridge_file;
 
 struct sml_ann_bridge *sml_ann_bridge_new(unsigned int inputs,
     unsigned int outputs,
@@ -43,18 +44,32 @@ int sml_ann_bridge_train(struct sml_ann_bridge *iann, struct sml_variables_list
     unsigned int required_observations,
     unsigned int max_neurons,
     unsigned int *required_observations_suggestion,
-    bool use_pseudorehearsal);
+    bool use_pseudorehearsal, bool warm_start,
+    unsigned int time_budget);
+int sml_ann_bridge_train_variants(struct sml_ann_bridge *iann,
+    struct sml_ann_bridge **variants, unsigned int variants_len,
+    struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs, float desired_train_error,
+    unsigned int required_observations,
+    unsigned int max_neurons,
+    unsigned int *required_observations_suggestion,
+    bool use_pseudorehearsal, bool warm_start);
 bool sml_ann_bridge_save(struct sml_ann_bridge *iann, const char *ann_path, const char *cfg_path);
 struct sml_ann_bridge *sml_ann_bridge_load_from_file(const char *ann_path, const char *cfg_path);
 int sml_ann_bridge_consider_trained(struct sml_ann_bridge *iann, struct sml_variables_list *inputs,
     unsigned int observations, bool use_pseudorehearsal);
 unsigned int sml_ann_bridge_inputs_in_confidence_interval_hits(struct sml_ann_bridge *iann,
     struct sml_variables_list *inputs);
-void sml_ann_bridge_add_observation(struct sml_ann_bridge *iann,
+bool sml_ann_bridge_add_observation(struct sml_ann_bridge *iann,
     struct sml_variables_list *inputs,
     struct sml_variables_list *outputs);
+bool sml_ann_bridge_needs_retrain(struct sml_ann_bridge *iann);
+void sml_ann_bridge_reset_observations(struct sml_ann_bridge *iann);
+int sml_ann_bridge_retrain(struct sml_ann_bridge *iann, unsigned int time_budget);
+void sml_ann_bridge_take_weights(struct sml_ann_bridge *iann, struct sml_ann_bridge *retrained);
 void sml_ann_bridge_print_debug(struct sml_ann_bridge *ann);
 float sml_ann_bridge_get_confidence_interval_sum(struct sml_ann_bridge *iann);
+bool sml_ann_bridge_get_confidence_intervals(struct sml_ann_bridge *iann, float *lower, float *upper, uint16_t len);
 float sml_ann_bridge_confidence_intervals_distance_sum(struct sml_ann_bridge *iann,
     struct sml_variables_list *inputs);
 bool sml_ann_bridge_predict_output_by_index(struct sml_ann_bridge *iann,
@@ -66,6 +81,24 @@ float sml_ann_bridge_get_error(struct sml_ann_bridge *iann, struct sml_variables
     unsigned int observations);
 bool sml_ann_bridge_save_with_no_cfg(struct sml_ann_bridge *iann, const char *ann_path);
 struct sml_ann_bridge *sml_ann_bridge_load_from_file_with_no_cfg(const char *ann_path);
+struct sml_ann_bridge *sml_ann_bridge_copy(struct sml_ann_bridge *iann);
+void sml_ann_bridge_set_training_threads(struct sml_ann_bridge *iann, unsigned int threads);
+void sml_ann_bridge_set_quantization(struct sml_ann_bridge *iann, unsigned int bits, float max_error);
+float sml_ann_bridge_get_quantization_error(struct sml_ann_bridge *iann);
+bool sml_ann_bridge_save_quantized(struct sml_ann_bridge *iann, const char *path);
+bool sml_ann_bridge_load_quantized(struct sml_ann_bridge *iann, const char *path);
+bool sml_ann_bridge_file_save(const char *path, struct sol_ptr_vector *anns);
+struct sml_ann_bridge_file *sml_ann_bridge_file_open(const char *path);
+void sml_ann_bridge_file_close(struct sml_ann_bridge_file *file);
+unsigned int sml_ann_bridge_file_get_count(struct sml_ann_bridge_file *file);
+struct sml_ann_bridge *sml_ann_bridge_file_get(struct sml_ann_bridge_file *file, unsigned int idx, unsigned int quantization_bits);
+float sml_ann_bridge_confidence_intervals_distance_sum_values(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs, const float *values);
+int sml_ann_bridge_predict_rows(struct sml_ann_bridge *iann,
+    struct sml_variables_list *inputs,
+    struct sml_variables_list *outputs,
+    const float *in, float *out,
+    const unsigned int *rows, unsigned int count);
 #ifdef __cplusplus
 }
 #endif
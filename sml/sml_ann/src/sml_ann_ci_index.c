@@ -0,0 +1,458 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sml_ann_ci_index.h"
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sml_log.h>
+
+#define LEAF_SIZE (4)
+#define MIN_CAPACITY (8)
+
+struct sml_ann_ci_index_entry {
+    void *data;
+    float length_sum;
+};
+
+struct sml_ann_ci_index_node {
+    /* Children are only set for inner nodes, the root is never a child */
+    unsigned int left;
+    unsigned int right;
+    unsigned int first;
+    unsigned int count;
+};
+
+struct sml_ann_ci_index {
+    uint16_t dimensions;
+
+    struct sml_ann_ci_index_entry *entries;
+    /* lower and upper limits of each entry, 2 * dimensions per entry */
+    float *bounds;
+    unsigned int len;
+    unsigned int capacity;
+
+    /* Entry positions sorted by the build, nodes refer to ranges of it */
+    unsigned int *order;
+    struct sml_ann_ci_index_node *nodes;
+    /* Bounding box of each node, laid out as the entry bounds */
+    float *node_bounds;
+    unsigned int nodes_len;
+    bool built;
+};
+
+struct sml_ann_ci_index_query {
+    struct sml_ann_ci_index *index;
+    const float *point;
+    unsigned int best;
+    float best_distance;
+};
+
+static inline float *
+_lower(float *bounds, uint16_t dimensions, unsigned int i)
+{
+    return bounds + (size_t)i * dimensions * 2;
+}
+
+static inline float *
+_upper(float *bounds, uint16_t dimensions, unsigned int i)
+{
+    return bounds + (size_t)i * dimensions * 2 + dimensions;
+}
+
+/* Same sum as sml_ann_bridge_confidence_intervals_distance_sum(), which
+   keeps the distances of the boxes exactly comparable with it. A box
+   enclosing other boxes is never farther than them, so node distances can
+   be used as lower bounds. */
+static float
+_distance(const float *lower, const float *upper, const float *point,
+    uint16_t dimensions)
+{
+    float distance = 0.0;
+    uint16_t i;
+
+    for (i = 0; i < dimensions; i++) {
+        if (point[i] < lower[i])
+            distance += fabsf(lower[i] - point[i]);
+        else if (point[i] > upper[i])
+            distance += fabsf(upper[i] - point[i]);
+    }
+    return distance;
+}
+
+static bool
+_contains(const float *lower, const float *upper, const float *point,
+    uint16_t dimensions)
+{
+    uint16_t i;
+
+    for (i = 0; i < dimensions; i++) {
+        if (!(point[i] >= lower[i] && point[i] <= upper[i]))
+            return false;
+    }
+    return true;
+}
+
+struct sml_ann_ci_index *
+sml_ann_ci_index_new(uint16_t dimensions)
+{
+    struct sml_ann_ci_index *index = calloc(1,
+        sizeof(struct sml_ann_ci_index));
+
+    if (!index) {
+        sml_critical("Could not alloc the confidence interval index");
+        return NULL;
+    }
+    index->dimensions = dimensions;
+    return index;
+}
+
+void
+sml_ann_ci_index_clear(struct sml_ann_ci_index *index)
+{
+    index->len = 0;
+    index->nodes_len = 0;
+    index->built = false;
+}
+
+void
+sml_ann_ci_index_free(struct sml_ann_ci_index *index)
+{
+    if (!index)
+        return;
+    free(index->entries);
+    free(index->bounds);
+    free(index->order);
+    free(index->nodes);
+    free(index->node_bounds);
+    free(index);
+}
+
+uint16_t
+sml_ann_ci_index_get_dimensions(struct sml_ann_ci_index *index)
+{
+    return index->dimensions;
+}
+
+static int
+_sml_ann_ci_index_reserve(struct sml_ann_ci_index *index,
+    unsigned int capacity)
+{
+    struct sml_ann_ci_index_entry *entries;
+    struct sml_ann_ci_index_node *nodes;
+    unsigned int *order;
+    float *bounds;
+    size_t box_size = sizeof(float) * index->dimensions * 2;
+
+    if (capacity <= index->capacity)
+        return 0;
+    if (capacity < MIN_CAPACITY)
+        capacity = MIN_CAPACITY;
+    if (capacity < index->capacity * 2)
+        capacity = index->capacity * 2;
+
+    entries = realloc(index->entries,
+        sizeof(struct sml_ann_ci_index_entry) * capacity);
+    if (!entries)
+        return -ENOMEM;
+    index->entries = entries;
+
+    bounds = realloc(index->bounds, box_size * capacity);
+    if (!bounds)
+        return -ENOMEM;
+    index->bounds = bounds;
+
+    order = realloc(index->order, sizeof(unsigned int) * capacity);
+    if (!order)
+        return -ENOMEM;
+    index->order = order;
+
+    /* A binary tree with leaves of at least one entry */
+    nodes = realloc(index->nodes,
+        sizeof(struct sml_ann_ci_index_node) * capacity * 2);
+    if (!nodes)
+        return -ENOMEM;
+    index->nodes = nodes;
+
+    bounds = realloc(index->node_bounds, box_size * capacity * 2);
+    if (!bounds)
+        return -ENOMEM;
+    index->node_bounds = bounds;
+
+    index->capacity = capacity;
+    return 0;
+}
+
+int
+sml_ann_ci_index_add(struct sml_ann_ci_index *index, void *data,
+    const float *lower, const float *upper, float length_sum)
+{
+    uint16_t i;
+    int r;
+
+    /* Such boxes are never near to or contain anything */
+    for (i = 0; i < index->dimensions; i++) {
+        if (isnan(lower[i]) || isnan(upper[i]))
+            return 0;
+    }
+    if (isnan(length_sum))
+        return 0;
+
+    if ((r = _sml_ann_ci_index_reserve(index, index->len + 1))) {
+        sml_critical("Could not add an entry to the confidence interval index");
+        return r;
+    }
+
+    index->entries[index->len].data = data;
+    index->entries[index->len].length_sum = length_sum;
+    memcpy(_lower(index->bounds, index->dimensions, index->len), lower,
+        sizeof(float) * index->dimensions);
+    memcpy(_upper(index->bounds, index->dimensions, index->len), upper,
+        sizeof(float) * index->dimensions);
+    index->len++;
+    index->built = false;
+    return 0;
+}
+
+static inline float
+_center(struct sml_ann_ci_index *index, unsigned int entry, uint16_t dim)
+{
+    return (_lower(index->bounds, index->dimensions, entry)[dim] +
+           _upper(index->bounds, index->dimensions, entry)[dim]) / 2.0;
+}
+
+/* Partially sorts order[first, first + count) so the element at nth is
+   the one a full sort by the center on dim would put there. */
+static void
+_select(struct sml_ann_ci_index *index, unsigned int first,
+    unsigned int count, unsigned int nth, uint16_t dim)
+{
+    unsigned int *order = index->order;
+    unsigned int lo = first, hi = first + count - 1, i, store, tmp;
+    float pivot;
+
+    while (lo < hi) {
+        tmp = order[(lo + hi) / 2];
+        order[(lo + hi) / 2] = order[hi];
+        order[hi] = tmp;
+        pivot = _center(index, order[hi], dim);
+
+        for (i = store = lo; i < hi; i++) {
+            if (_center(index, order[i], dim) < pivot) {
+                tmp = order[i];
+                order[i] = order[store];
+                order[store++] = tmp;
+            }
+        }
+        tmp = order[store];
+        order[store] = order[hi];
+        order[hi] = tmp;
+
+        if (store == nth)
+            return;
+        if (nth < store)
+            hi = store - 1;
+        else
+            lo = store + 1;
+    }
+}
+
+static unsigned int
+_sml_ann_ci_index_build_node(struct sml_ann_ci_index *index,
+    unsigned int first, unsigned int count)
+{
+    uint16_t dims = index->dimensions, i, split_dim = 0;
+    unsigned int n = index->nodes_len++, j, half;
+    struct sml_ann_ci_index_node *node = index->nodes + n;
+    float *lower = _lower(index->node_bounds, dims, n);
+    float *upper = _upper(index->node_bounds, dims, n);
+    float *entry_lower, *entry_upper, c, min_c, max_c, spread = -1;
+
+    node->first = first;
+    node->count = count;
+    node->left = node->right = 0;
+
+    for (j = 0; j < count; j++) {
+        entry_lower = _lower(index->bounds, dims, index->order[first + j]);
+        entry_upper = _upper(index->bounds, dims, index->order[first + j]);
+        for (i = 0; i < dims; i++) {
+            if (!j || entry_lower[i] < lower[i])
+                lower[i] = entry_lower[i];
+            if (!j || entry_upper[i] > upper[i])
+                upper[i] = entry_upper[i];
+        }
+    }
+
+    if (count <= LEAF_SIZE)
+        return n;
+
+    /* Split at the median center of the dimension where the centers are
+       the most spread */
+    for (i = 0; i < dims; i++) {
+        min_c = max_c = _center(index, index->order[first], i);
+        for (j = 1; j < count; j++) {
+            c = _center(index, index->order[first + j], i);
+            if (c < min_c)
+                min_c = c;
+            else if (c > max_c)
+                max_c = c;
+        }
+        if (max_c - min_c > spread) {
+            spread = max_c - min_c;
+            split_dim = i;
+        }
+    }
+
+    half = count / 2;
+    _select(index, first, count, first + half, split_dim);
+    node->left = _sml_ann_ci_index_build_node(index, first, half);
+    node->right = _sml_ann_ci_index_build_node(index, first + half,
+        count - half);
+    return n;
+}
+
+int
+sml_ann_ci_index_build(struct sml_ann_ci_index *index)
+{
+    unsigned int i;
+
+    index->nodes_len = 0;
+    for (i = 0; i < index->len; i++)
+        index->order[i] = i;
+    if (index->len)
+        _sml_ann_ci_index_build_node(index, 0, index->len);
+    index->built = true;
+    return 0;
+}
+
+static inline bool
+_is_better(struct sml_ann_ci_index *index, unsigned int entry,
+    float distance, unsigned int best, float best_distance)
+{
+    if (distance != best_distance)
+        return distance < best_distance;
+    if (index->entries[entry].length_sum != index->entries[best].length_sum)
+        return index->entries[entry].length_sum <
+               index->entries[best].length_sum;
+    /* Entries are added in cache order, the first one wins ties */
+    return entry < best;
+}
+
+static void
+_sml_ann_ci_index_nearest_node(struct sml_ann_ci_index_query *query,
+    unsigned int n)
+{
+    struct sml_ann_ci_index *index = query->index;
+    struct sml_ann_ci_index_node *node = index->nodes + n;
+    uint16_t dims = index->dimensions;
+    unsigned int j, entry, first, second;
+    float distance, d_left, d_right;
+
+    if (!node->left) {
+        for (j = 0; j < node->count; j++) {
+            entry = index->order[node->first + j];
+            distance = _distance(_lower(index->bounds, dims, entry),
+                _upper(index->bounds, dims, entry), query->point, dims);
+            if (query->best == UINT32_MAX ||
+                _is_better(index, entry, distance, query->best,
+                query->best_distance)) {
+                query->best = entry;
+                query->best_distance = distance;
+            }
+        }
+        return;
+    }
+
+    d_left = _distance(_lower(index->node_bounds, dims, node->left),
+        _upper(index->node_bounds, dims, node->left), query->point, dims);
+    d_right = _distance(_lower(index->node_bounds, dims, node->right),
+        _upper(index->node_bounds, dims, node->right), query->point, dims);
+    first = node->left;
+    second = node->right;
+    if (d_right < d_left) {
+        first = node->right;
+        second = node->left;
+        distance = d_left;
+        d_left = d_right;
+        d_right = distance;
+    }
+
+    /* Boxes at the same distance may still win the tie break */
+    if (query->best == UINT32_MAX || d_left <= query->best_distance)
+        _sml_ann_ci_index_nearest_node(query, first);
+    if (query->best == UINT32_MAX || d_right <= query->best_distance)
+        _sml_ann_ci_index_nearest_node(query, second);
+}
+
+void *
+sml_ann_ci_index_nearest(struct sml_ann_ci_index *index, const float *point)
+{
+    struct sml_ann_ci_index_query query = {
+        .index = index,
+        .point = point,
+        .best = UINT32_MAX,
+    };
+
+    if (!index->built || !index->len)
+        return NULL;
+
+    _sml_ann_ci_index_nearest_node(&query, 0);
+    return index->entries[query.best].data;
+}
+
+static unsigned int
+_sml_ann_ci_index_containing_node(struct sml_ann_ci_index *index,
+    unsigned int n, const float *point, sml_ann_ci_index_cb cb, void *cb_data)
+{
+    struct sml_ann_ci_index_node *node = index->nodes + n;
+    uint16_t dims = index->dimensions;
+    unsigned int j, entry, found = 0;
+
+    if (!_contains(_lower(index->node_bounds, dims, n),
+        _upper(index->node_bounds, dims, n), point, dims))
+        return 0;
+
+    if (node->left) {
+        found += _sml_ann_ci_index_containing_node(index, node->left, point,
+            cb, cb_data);
+        found += _sml_ann_ci_index_containing_node(index, node->right, point,
+            cb, cb_data);
+        return found;
+    }
+
+    for (j = 0; j < node->count; j++) {
+        entry = index->order[node->first + j];
+        if (_contains(_lower(index->bounds, dims, entry),
+            _upper(index->bounds, dims, entry), point, dims)) {
+            if (cb)
+                cb(index->entries[entry].data, cb_data);
+            found++;
+        }
+    }
+    return found;
+}
+
+unsigned int
+sml_ann_ci_index_foreach_containing(struct sml_ann_ci_index *index,
+    const float *point, sml_ann_ci_index_cb cb, void *cb_data)
+{
+    if (!index->built || !index->len)
+        return 0;
+    return _sml_ann_ci_index_containing_node(index, 0, point, cb, cb_data);
+}
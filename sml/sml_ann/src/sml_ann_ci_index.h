@@ -0,0 +1,47 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * Bounding volume hierarchy over the confidence interval boxes of the
+ * trained networks, one dimension per input variable. Entries are added
+ * and then the tree is built once; any change requires a clear and a new
+ * build.
+ */
+struct sml_ann_ci_index;
+typedef void (*sml_ann_ci_index_cb)(void *data, void *cb_data);
+
+struct sml_ann_ci_index *sml_ann_ci_index_new(uint16_t dimensions);
+void sml_ann_ci_index_free(struct sml_ann_ci_index *index);
+void sml_ann_ci_index_clear(struct sml_ann_ci_index *index);
+uint16_t sml_ann_ci_index_get_dimensions(struct sml_ann_ci_index *index);
+int sml_ann_ci_index_add(struct sml_ann_ci_index *index, void *data, const float *lower, const float *upper, float length_sum);
+int sml_ann_ci_index_build(struct sml_ann_ci_index *index);
+void *sml_ann_ci_index_nearest(struct sml_ann_ci_index *index, const float *point);
+unsigned int sml_ann_ci_index_foreach_containing(struct sml_ann_ci_index *index, const float *point, sml_ann_ci_index_cb cb, void *cb_data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,855 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sml_ann_kernel.h"
+#include <floatfann.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sml_log.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* Same limit fann_run() applies to the neuron sums */
+#define MAX_SUM (150.0f)
+#define LOG2E (1.44269504f)
+/* Fractional bits of the fixed point neuron values of quantized kernels */
+#define VALUE_SHIFT (12)
+#define VALUE_ONE (1 << VALUE_SHIFT)
+/* Largest sum of the absolute 16 bits weights of a neuron, so its sums
+   fit in 32 bits */
+#define MAX_Q16_WEIGHTS_SUM (INT32_MAX / -INT16_MIN)
+#define KERNEL_MAGIC (0x514c4d53)
+#define KERNEL_VERSION (2)
+/* Sections of a kernel image start at multiples of this */
+#define IMAGE_ALIGN (8)
+#define IMAGE_PAD(_size) (((_size) + IMAGE_ALIGN - 1) & ~(uint64_t)(IMAGE_ALIGN - 1))
+
+/* Fixed size fields, so the neurons can be used from an image as they
+   are */
+struct sml_ann_kernel_neuron {
+    /* Position of the first weight and of the first source neuron. The
+       sources of a neuron are always consecutive neurons. */
+    uint32_t weights;
+    uint32_t sources;
+    uint32_t count;
+    /* Position of the neuron itself */
+    uint32_t value;
+    uint32_t layer;
+    int32_t activation;
+    float steepness;
+    float max_sum;
+    /* Converts the fixed point sums of quantized kernels, steepness
+       included */
+    float scale;
+    uint32_t reserved;
+};
+
+/* A kernel image starts with the header and is followed by the neurons,
+   the layer scales, the initial neuron values and the weights, each one
+   starting at an IMAGE_ALIGN boundary */
+struct sml_ann_kernel_image_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t bits;
+    uint32_t num_input;
+    uint32_t num_output;
+    uint32_t outputs;
+    uint32_t values_len;
+    uint32_t weights_len;
+    uint32_t layers_len;
+    uint32_t neurons_len;
+    float error;
+    uint64_t size;
+};
+
+struct sml_ann_kernel {
+    unsigned int num_input;
+    unsigned int num_output;
+    /* Position of the first output neuron */
+    unsigned int outputs;
+    unsigned int values_len;
+    unsigned int weights_len;
+    unsigned int layers_len;
+    /* 0 for float kernels, 8 or 16 for quantized ones */
+    unsigned int bits;
+    /* Value of every neuron, in the FANN order. Bias neurons are set to 1
+       when the kernel is created and never change. Quantized kernels only
+       keep the output values here. */
+    float *values;
+    /* Weights of the computed neurons, each one with its weights
+       consecutive and in the order they are computed */
+    float *weights;
+    /* Quantized kernels keep the neuron values in fixed point, and the
+       weights of each layer as integers multiplied by the layer scale */
+    int16_t *qvalues;
+    void *qweights;
+    float *scales;
+    struct sml_ann_kernel_neuron *neurons;
+    unsigned int neurons_len;
+    /* Weights, scales and neurons point into an image instead of being
+       allocated. The image is freed with the kernel if it is set. */
+    bool mapped;
+    void *image;
+};
+
+static bool
+_sml_ann_kernel_activation_supported(enum fann_activationfunc_enum activation)
+{
+    switch (activation) {
+    case FANN_LINEAR:
+    case FANN_THRESHOLD:
+    case FANN_THRESHOLD_SYMMETRIC:
+    case FANN_SIGMOID:
+    case FANN_SIGMOID_SYMMETRIC:
+    case FANN_GAUSSIAN:
+    case FANN_GAUSSIAN_SYMMETRIC:
+    case FANN_ELLIOT:
+    case FANN_ELLIOT_SYMMETRIC:
+    case FANN_LINEAR_PIECE:
+    case FANN_LINEAR_PIECE_SYMMETRIC:
+    case FANN_SIN_SYMMETRIC:
+    case FANN_COS_SYMMETRIC:
+    case FANN_SIN:
+    case FANN_COS:
+        return true;
+    default:
+        /* The stepwise approximations are not compiled */
+        return false;
+    }
+}
+
+/* exp() with a relative error below 3e-6. The power of two of the rounded
+   exponent is built in the float bits and the remaining fraction, within
+   [-0.5, 0.5], is given by a polynomial. */
+static inline float
+_sml_ann_kernel_exp(float x)
+{
+    union {
+        float f;
+        int32_t i;
+    } pow2;
+    float t, f;
+    int32_t i;
+
+    if (x > 88.0f)
+        x = 88.0f;
+    else if (x < -87.0f)
+        x = -87.0f;
+
+    t = x * LOG2E;
+    i = (int32_t)(t >= 0 ? t + 0.5f : t - 0.5f);
+    f = (t - i) * (float)M_LN2;
+    pow2.i = (i + 127) << 23;
+    return pow2.f * (1.0f + f * (1.0f + f * (0.5f + f * (1.0f / 6 +
+           f * (1.0f / 24 + f * (1.0f / 120))))));
+}
+
+/* Same functions as fann_activation_switch() */
+static inline float
+_sml_ann_kernel_activation(enum fann_activationfunc_enum activation,
+    float sum)
+{
+    switch (activation) {
+    case FANN_LINEAR:
+        return sum;
+    case FANN_THRESHOLD:
+        return sum < 0 ? 0 : 1;
+    case FANN_THRESHOLD_SYMMETRIC:
+        return sum < 0 ? -1 : 1;
+    case FANN_SIGMOID:
+        return 1.0f / (1.0f + _sml_ann_kernel_exp(-2.0f * sum));
+    case FANN_SIGMOID_SYMMETRIC:
+        return 2.0f / (1.0f + _sml_ann_kernel_exp(-2.0f * sum)) - 1.0f;
+    case FANN_GAUSSIAN:
+        return _sml_ann_kernel_exp(-sum * sum);
+    case FANN_GAUSSIAN_SYMMETRIC:
+        return _sml_ann_kernel_exp(-sum * sum) * 2.0f - 1.0f;
+    case FANN_ELLIOT:
+        return (sum * 0.5f) / (1.0f + fabsf(sum)) + 0.5f;
+    case FANN_ELLIOT_SYMMETRIC:
+        return sum / (1.0f + fabsf(sum));
+    case FANN_LINEAR_PIECE:
+        return sum < 0 ? 0 : (sum > 1 ? 1 : sum);
+    case FANN_LINEAR_PIECE_SYMMETRIC:
+        return sum < -1 ? -1 : (sum > 1 ? 1 : sum);
+    case FANN_SIN_SYMMETRIC:
+        return sinf(sum);
+    case FANN_COS_SYMMETRIC:
+        return cosf(sum);
+    case FANN_SIN:
+        return sinf(sum) / 2.0f + 0.5f;
+    case FANN_COS:
+        return cosf(sum) / 2.0f + 0.5f;
+    default:
+        return 0;
+    }
+}
+
+static inline float
+_sml_ann_kernel_dot(const float *weights, const float *values,
+    unsigned int count)
+{
+    unsigned int i = 0;
+    float sum;
+
+#ifdef __SSE__
+    __m128 acc = _mm_setzero_ps();
+    float partial[4];
+
+    for (; i + 4 <= count; i += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(weights + i),
+            _mm_loadu_ps(values + i)));
+    _mm_storeu_ps(partial, acc);
+    sum = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#else
+    /* Independent sums, so the compiler is free to vectorize them */
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        s0 += weights[i] * values[i];
+        s1 += weights[i + 1] * values[i + 1];
+        s2 += weights[i + 2] * values[i + 2];
+        s3 += weights[i + 3] * values[i + 3];
+    }
+    sum = (s0 + s1) + (s2 + s3);
+#endif
+
+    for (; i < count; i++)
+        sum += weights[i] * values[i];
+    return sum;
+}
+
+static inline int32_t
+_sml_ann_kernel_dot_q8(const int8_t *weights, const int16_t *values,
+    unsigned int count)
+{
+    unsigned int i;
+    int32_t sum = 0;
+
+    for (i = 0; i < count; i++)
+        sum += (int32_t)weights[i] * values[i];
+    return sum;
+}
+
+static inline int32_t
+_sml_ann_kernel_dot_q16(const int16_t *weights, const int16_t *values,
+    unsigned int count)
+{
+    unsigned int i;
+    int32_t sum = 0;
+
+    for (i = 0; i < count; i++)
+        sum += (int32_t)weights[i] * values[i];
+    return sum;
+}
+
+static inline int16_t
+_sml_ann_kernel_to_fixed(float value)
+{
+    value *= VALUE_ONE;
+    if (isnan(value))
+        return 0;
+    if (value >= INT16_MAX)
+        return INT16_MAX;
+    if (value <= INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)(value >= 0 ? value + 0.5f : value - 0.5f);
+}
+
+static struct sml_ann_kernel *
+_sml_ann_kernel_alloc(unsigned int values_len, unsigned int weights_len,
+    unsigned int neurons_len, unsigned int num_output, unsigned int bits)
+{
+    struct sml_ann_kernel *kernel;
+
+    kernel = calloc(1, sizeof(struct sml_ann_kernel));
+    if (!kernel) {
+        sml_critical("Could not alloc the ANN kernel");
+        return NULL;
+    }
+
+    kernel->bits = bits;
+    kernel->values_len = values_len;
+    kernel->neurons = calloc(neurons_len ? neurons_len : 1,
+        sizeof(struct sml_ann_kernel_neuron));
+    if (!bits) {
+        kernel->values = calloc(values_len ? values_len : 1, sizeof(float));
+        kernel->weights = calloc(weights_len ? weights_len : 1,
+            sizeof(float));
+    } else {
+        kernel->values = calloc(num_output ? num_output : 1, sizeof(float));
+        kernel->qvalues = calloc(values_len ? values_len : 1,
+            sizeof(int16_t));
+        kernel->qweights = calloc(weights_len ? weights_len : 1, bits / 8);
+    }
+
+    if (!kernel->neurons || !kernel->values ||
+        (!bits && !kernel->weights) ||
+        (bits && (!kernel->qvalues || !kernel->qweights))) {
+        sml_critical("Could not alloc the ANN kernel arrays");
+        sml_ann_kernel_free(kernel);
+        return NULL;
+    }
+    return kernel;
+}
+
+static bool
+_sml_ann_kernel_add_neuron(struct sml_ann_kernel *kernel, struct fann *ann,
+    struct fann_layer *layer, struct fann_neuron *neuron,
+    unsigned int *weights_len)
+{
+    struct sml_ann_kernel_neuron *compiled;
+    struct fann_neuron *first = ann->first_layer->first_neuron;
+    struct fann_neuron **sources = ann->connections + neuron->first_con;
+    unsigned int i, count, value;
+
+    value = neuron - first;
+    if (neuron->first_con == neuron->last_con) {
+        kernel->values[value] = 1;
+        return true;
+    }
+
+    if (!_sml_ann_kernel_activation_supported(neuron->activation_function)) {
+        sml_debug("Activation function %d can not be compiled",
+            neuron->activation_function);
+        return false;
+    }
+
+    count = neuron->last_con - neuron->first_con;
+    for (i = 1; i < count; i++) {
+        if (sources[i] != sources[0] + i) {
+            sml_debug("Neuron %u is not connected to consecutive neurons",
+                value);
+            return false;
+        }
+    }
+    /* Sources must be computed before the neuron */
+    if (sources[0] < first || (unsigned int)(sources[0] - first) + count >
+        value)
+        return false;
+
+    compiled = &kernel->neurons[kernel->neurons_len++];
+    compiled->weights = *weights_len;
+    compiled->sources = sources[0] - first;
+    compiled->count = count;
+    compiled->value = value;
+    compiled->layer = layer - ann->first_layer;
+    compiled->steepness = neuron->activation_steepness;
+    compiled->max_sum = MAX_SUM / neuron->activation_steepness;
+    compiled->activation = neuron->activation_function;
+    memcpy(kernel->weights + *weights_len, ann->weights + neuron->first_con,
+        count * sizeof(float));
+    *weights_len += count;
+    return true;
+}
+
+struct sml_ann_kernel *
+sml_ann_kernel_new(struct fann *ann)
+{
+    struct sml_ann_kernel *kernel;
+    struct fann_layer *layer, *output_layer;
+    struct fann_neuron *first, *neuron;
+    unsigned int total, i, weights_len = 0;
+
+    if (ann->first_layer + 1 >= ann->last_layer)
+        return NULL;
+
+    first = ann->first_layer->first_neuron;
+    output_layer = ann->last_layer - 1;
+    total = output_layer->last_neuron - first;
+    if ((unsigned int)(output_layer->first_neuron - first) + ann->num_output >
+        total)
+        return NULL;
+
+    kernel = _sml_ann_kernel_alloc(total, ann->total_connections, total,
+        ann->num_output, 0);
+    if (!kernel)
+        return NULL;
+
+    kernel->num_input = ann->num_input;
+    kernel->num_output = ann->num_output;
+    kernel->outputs = output_layer->first_neuron - first;
+    kernel->layers_len = ann->last_layer - ann->first_layer;
+
+    /* The input layer ends with its bias neuron */
+    for (i = kernel->num_input;
+        i < (unsigned int)(ann->first_layer->last_neuron - first); i++)
+        kernel->values[i] = 1;
+
+    for (layer = ann->first_layer + 1; layer != ann->last_layer; layer++) {
+        for (neuron = layer->first_neuron; neuron != layer->last_neuron;
+            neuron++) {
+            if (!_sml_ann_kernel_add_neuron(kernel, ann, layer, neuron,
+                &weights_len))
+                goto err_exit;
+        }
+    }
+
+    kernel->weights_len = weights_len;
+    return kernel;
+
+err_exit:
+    sml_ann_kernel_free(kernel);
+    return NULL;
+}
+
+void
+sml_ann_kernel_free(struct sml_ann_kernel *kernel)
+{
+    if (!kernel)
+        return;
+    free(kernel->values);
+    free(kernel->qvalues);
+    if (!kernel->mapped) {
+        free(kernel->weights);
+        free(kernel->qweights);
+        free(kernel->scales);
+        free(kernel->neurons);
+    }
+    free(kernel->image);
+    free(kernel);
+}
+
+/* Checks that running the kernel stays inside its arrays */
+static bool
+_sml_ann_kernel_validate(const struct sml_ann_kernel *kernel)
+{
+    const struct sml_ann_kernel_neuron *neuron;
+    const int16_t *w16;
+    unsigned int i, j;
+    int32_t sum;
+
+    for (i = 0; i < kernel->neurons_len; i++) {
+        neuron = &kernel->neurons[i];
+        if (neuron->layer >= kernel->layers_len ||
+            neuron->value >= kernel->values_len ||
+            neuron->count > neuron->value ||
+            neuron->sources > neuron->value - neuron->count ||
+            neuron->count > kernel->weights_len ||
+            neuron->weights > kernel->weights_len - neuron->count ||
+            !_sml_ann_kernel_activation_supported(neuron->activation))
+            return false;
+        /* Quantized weights are summed in 32 bits */
+        if (kernel->bits == 8 &&
+            neuron->count > INT32_MAX / (INT8_MAX * -INT16_MIN))
+            return false;
+        if (kernel->bits == 16) {
+            w16 = (const int16_t *)kernel->qweights + neuron->weights;
+            for (j = 0, sum = 0; j < neuron->count; j++) {
+                sum += abs(w16[j]);
+                if (sum > MAX_Q16_WEIGHTS_SUM)
+                    return false;
+            }
+        }
+    }
+    return kernel->num_output <= kernel->values_len &&
+           kernel->outputs <= kernel->values_len - kernel->num_output &&
+           kernel->num_input <= kernel->values_len;
+}
+
+static bool
+_sml_ann_kernel_setup_scales(struct sml_ann_kernel *kernel)
+{
+    struct sml_ann_kernel_neuron *neuron;
+    unsigned int i;
+
+    if (!_sml_ann_kernel_validate(kernel))
+        return false;
+    for (i = 0; i < kernel->neurons_len; i++) {
+        neuron = &kernel->neurons[i];
+        neuron->scale = kernel->scales[neuron->layer] * neuron->steepness /
+            VALUE_ONE;
+    }
+    return true;
+}
+
+struct sml_ann_kernel *
+sml_ann_kernel_quantize(const struct sml_ann_kernel *kernel,
+    unsigned int bits)
+{
+    struct sml_ann_kernel *quantized;
+    struct sml_ann_kernel_neuron *neuron;
+    unsigned int i, j;
+    float max, w, q, sum;
+    int8_t *w8;
+    int16_t *w16;
+
+    if (kernel->bits || (bits != 8 && bits != 16))
+        return NULL;
+
+    quantized = _sml_ann_kernel_alloc(kernel->values_len,
+        kernel->weights_len, kernel->neurons_len, kernel->num_output, bits);
+    if (!quantized)
+        return NULL;
+
+    quantized->scales = calloc(kernel->layers_len, sizeof(float));
+    if (!quantized->scales) {
+        sml_critical("Could not alloc the quantization scales");
+        goto err_exit;
+    }
+
+    quantized->num_input = kernel->num_input;
+    quantized->num_output = kernel->num_output;
+    quantized->outputs = kernel->outputs;
+    quantized->weights_len = kernel->weights_len;
+    quantized->layers_len = kernel->layers_len;
+    quantized->neurons_len = kernel->neurons_len;
+    memcpy(quantized->neurons, kernel->neurons,
+        kernel->neurons_len * sizeof(struct sml_ann_kernel_neuron));
+
+    /* Each layer is scaled by its largest weight. The 16 bits weights of
+       a neuron must also add up to MAX_Q16_WEIGHTS_SUM at most, rounding
+       included. */
+    max = bits == 8 ? INT8_MAX : INT16_MAX;
+    for (i = 0; i < kernel->neurons_len; i++) {
+        neuron = &kernel->neurons[i];
+        sum = 0;
+        for (j = 0; j < neuron->count; j++) {
+            w = fabsf(kernel->weights[neuron->weights + j]);
+            sum += w;
+            if (w / max > quantized->scales[neuron->layer])
+                quantized->scales[neuron->layer] = w / max;
+        }
+        if (bits != 16)
+            continue;
+        if (neuron->count >= MAX_Q16_WEIGHTS_SUM)
+            goto err_exit;
+        w = sum / (MAX_Q16_WEIGHTS_SUM - neuron->count);
+        if (w > quantized->scales[neuron->layer])
+            quantized->scales[neuron->layer] = w;
+    }
+    for (i = 0; i < kernel->layers_len; i++) {
+        if (!quantized->scales[i])
+            quantized->scales[i] = 1;
+    }
+
+    w8 = quantized->qweights;
+    w16 = quantized->qweights;
+    for (i = 0; i < kernel->neurons_len; i++) {
+        neuron = &kernel->neurons[i];
+        for (j = neuron->weights; j < neuron->weights + neuron->count; j++) {
+            q = kernel->weights[j] / quantized->scales[neuron->layer];
+            q = q >= 0 ? q + 0.5f : q - 0.5f;
+            if (q > max)
+                q = max;
+            else if (q < -max)
+                q = -max;
+            if (bits == 8)
+                w8[j] = (int8_t)q;
+            else
+                w16[j] = (int16_t)q;
+        }
+    }
+
+    /* Everything but the inputs and the computed neurons is a bias */
+    for (i = 0; i < quantized->values_len; i++)
+        quantized->qvalues[i] = i < kernel->num_input ? 0 : VALUE_ONE;
+    for (i = 0; i < kernel->neurons_len; i++)
+        quantized->qvalues[kernel->neurons[i].value] = 0;
+
+    if (!_sml_ann_kernel_setup_scales(quantized)) {
+        sml_debug("The ANN kernel can not be quantized to %u bits", bits);
+        goto err_exit;
+    }
+    return quantized;
+
+err_exit:
+    sml_ann_kernel_free(quantized);
+    return NULL;
+}
+
+static const float *
+_sml_ann_kernel_run_quantized(struct sml_ann_kernel *kernel,
+    const float *input)
+{
+    struct sml_ann_kernel_neuron *neuron, *end;
+    int16_t *values = kernel->qvalues;
+    unsigned int i;
+    float sum, value;
+
+    for (i = 0; i < kernel->num_input; i++)
+        values[i] = _sml_ann_kernel_to_fixed(input[i]);
+
+    end = kernel->neurons + kernel->neurons_len;
+    for (neuron = kernel->neurons; neuron < end; neuron++) {
+        if (kernel->bits == 8)
+            sum = _sml_ann_kernel_dot_q8(
+                (int8_t *)kernel->qweights + neuron->weights,
+                values + neuron->sources, neuron->count) * neuron->scale;
+        else
+            sum = _sml_ann_kernel_dot_q16(
+                (int16_t *)kernel->qweights + neuron->weights,
+                values + neuron->sources, neuron->count) * neuron->scale;
+        if (sum > neuron->max_sum)
+            sum = neuron->max_sum;
+        else if (sum < -neuron->max_sum)
+            sum = -neuron->max_sum;
+        value = _sml_ann_kernel_activation(neuron->activation, sum);
+        values[neuron->value] = _sml_ann_kernel_to_fixed(value);
+        /* Outputs are given without the fixed point rounding */
+        if (neuron->value >= kernel->outputs &&
+            neuron->value - kernel->outputs < kernel->num_output)
+            kernel->values[neuron->value - kernel->outputs] = value;
+    }
+    return kernel->values;
+}
+
+const float *
+sml_ann_kernel_run(struct sml_ann_kernel *kernel, const float *input)
+{
+    struct sml_ann_kernel_neuron *neuron, *end;
+    float *values = kernel->values;
+    float sum;
+
+    if (kernel->bits)
+        return _sml_ann_kernel_run_quantized(kernel, input);
+
+    memcpy(values, input, kernel->num_input * sizeof(float));
+    end = kernel->neurons + kernel->neurons_len;
+    for (neuron = kernel->neurons; neuron < end; neuron++) {
+        sum = _sml_ann_kernel_dot(kernel->weights + neuron->weights,
+            values + neuron->sources, neuron->count) * neuron->steepness;
+        if (sum > neuron->max_sum)
+            sum = neuron->max_sum;
+        else if (sum < -neuron->max_sum)
+            sum = -neuron->max_sum;
+        values[neuron->value] = _sml_ann_kernel_activation(
+            neuron->activation, sum);
+    }
+    return values + kernel->outputs;
+}
+
+unsigned int
+sml_ann_kernel_get_num_input(const struct sml_ann_kernel *kernel)
+{
+    return kernel->num_input;
+}
+
+unsigned int
+sml_ann_kernel_get_num_output(const struct sml_ann_kernel *kernel)
+{
+    return kernel->num_output;
+}
+
+unsigned int
+sml_ann_kernel_get_bits(const struct sml_ann_kernel *kernel)
+{
+    return kernel->bits;
+}
+
+/* Sizes of the image sections, in the order they are written. They are
+   computed in 64 bits, so the lengths read from an image can not wrap
+   them where size_t is 32 bits. */
+static void
+_sml_ann_kernel_image_sections(const struct sml_ann_kernel *kernel,
+    uint64_t sections[5])
+{
+    sections[0] = sizeof(struct sml_ann_kernel_image_header);
+    sections[1] = (uint64_t)kernel->neurons_len *
+        sizeof(struct sml_ann_kernel_neuron);
+    sections[2] = kernel->bits ?
+        (uint64_t)kernel->layers_len * sizeof(float) : 0;
+    sections[3] = (uint64_t)kernel->values_len *
+        (kernel->bits ? sizeof(int16_t) : sizeof(float));
+    sections[4] = (uint64_t)kernel->weights_len *
+        (kernel->bits ? kernel->bits / 8 : sizeof(float));
+}
+
+static uint64_t
+_sml_ann_kernel_image_size(const struct sml_ann_kernel *kernel)
+{
+    uint64_t sections[5], size = 0;
+    unsigned int i;
+
+    _sml_ann_kernel_image_sections(kernel, sections);
+    for (i = 0; i < sizeof(sections) / sizeof(*sections); i++)
+        size += IMAGE_PAD(sections[i]);
+    return size;
+}
+
+size_t
+sml_ann_kernel_get_image_size(const struct sml_ann_kernel *kernel)
+{
+    return _sml_ann_kernel_image_size(kernel);
+}
+
+bool
+sml_ann_kernel_write(const struct sml_ann_kernel *kernel, float error,
+    FILE *f)
+{
+    static const char padding[IMAGE_ALIGN] = { 0 };
+    struct sml_ann_kernel_image_header header = { 0 };
+    const void *data[5];
+    uint64_t sections[5];
+    unsigned int i;
+
+    header.magic = KERNEL_MAGIC;
+    header.version = KERNEL_VERSION;
+    header.bits = kernel->bits;
+    header.num_input = kernel->num_input;
+    header.num_output = kernel->num_output;
+    header.outputs = kernel->outputs;
+    header.values_len = kernel->values_len;
+    header.weights_len = kernel->weights_len;
+    header.layers_len = kernel->layers_len;
+    header.neurons_len = kernel->neurons_len;
+    header.error = error;
+    header.size = _sml_ann_kernel_image_size(kernel);
+
+    _sml_ann_kernel_image_sections(kernel, sections);
+    data[0] = &header;
+    data[1] = kernel->neurons;
+    data[2] = kernel->scales;
+    data[3] = kernel->bits ? (const void *)kernel->qvalues : kernel->values;
+    data[4] = kernel->bits ? kernel->qweights : kernel->weights;
+    for (i = 0; i < 5; i++) {
+        if (!sections[i])
+            continue;
+        if (fwrite(data[i], sections[i], 1, f) != 1 ||
+            (IMAGE_PAD(sections[i]) != sections[i] &&
+            fwrite(padding, IMAGE_PAD(sections[i]) - sections[i], 1, f) != 1))
+            return false;
+    }
+    return true;
+}
+
+struct sml_ann_kernel *
+sml_ann_kernel_map(const void *image, size_t size, float *error)
+{
+    const struct sml_ann_kernel_image_header *header = image;
+    const char *section;
+    struct sml_ann_kernel *kernel;
+    uint64_t sections[5];
+
+    if (((uintptr_t)image % IMAGE_ALIGN) || size < sizeof(*header) ||
+        header->magic != KERNEL_MAGIC || header->version != KERNEL_VERSION ||
+        (header->bits && header->bits != 8 && header->bits != 16) ||
+        header->size > size) {
+        sml_critical("Invalid ANN kernel image");
+        return NULL;
+    }
+
+    kernel = calloc(1, sizeof(struct sml_ann_kernel));
+    if (!kernel) {
+        sml_critical("Could not alloc the ANN kernel");
+        return NULL;
+    }
+    kernel->mapped = true;
+    kernel->bits = header->bits;
+    kernel->num_input = header->num_input;
+    kernel->num_output = header->num_output;
+    kernel->outputs = header->outputs;
+    kernel->values_len = header->values_len;
+    kernel->weights_len = header->weights_len;
+    kernel->layers_len = header->layers_len;
+    kernel->neurons_len = header->neurons_len;
+
+    /* Every section fits in size, so they can be used as size_t from
+       here on */
+    if (_sml_ann_kernel_image_size(kernel) != header->size)
+        goto err_invalid;
+
+    _sml_ann_kernel_image_sections(kernel, sections);
+    section = (const char *)image + IMAGE_PAD(sections[0]);
+    kernel->neurons = (struct sml_ann_kernel_neuron *)section;
+    section += IMAGE_PAD(sections[1]);
+    kernel->scales = (float *)section;
+    section += IMAGE_PAD(sections[2]);
+
+    /* Only the neuron values are written while running */
+    if (kernel->bits) {
+        kernel->values = calloc(kernel->num_output ? kernel->num_output : 1,
+            sizeof(float));
+        kernel->qvalues = malloc(sections[3] ? sections[3] : 1);
+        if (!kernel->values || !kernel->qvalues)
+            goto err_alloc;
+        memcpy(kernel->qvalues, section, sections[3]);
+        kernel->qweights = (void *)(section + IMAGE_PAD(sections[3]));
+    } else {
+        kernel->values = malloc(sections[3] ? sections[3] : 1);
+        if (!kernel->values)
+            goto err_alloc;
+        memcpy(kernel->values, section, sections[3]);
+        kernel->weights = (float *)(section + IMAGE_PAD(sections[3]));
+    }
+
+    if (!_sml_ann_kernel_validate(kernel))
+        goto err_invalid;
+    if (error)
+        *error = header->error;
+    return kernel;
+
+err_alloc:
+    sml_critical("Could not alloc the ANN kernel values");
+    sml_ann_kernel_free(kernel);
+    return NULL;
+err_invalid:
+    sml_critical("Invalid ANN kernel image");
+    sml_ann_kernel_free(kernel);
+    return NULL;
+}
+
+bool
+sml_ann_kernel_save(const struct sml_ann_kernel *kernel, float error,
+    FILE *f)
+{
+    if (!kernel->bits)
+        return false;
+    return sml_ann_kernel_write(kernel, error, f);
+}
+
+struct sml_ann_kernel *
+sml_ann_kernel_load(FILE *f, float *error)
+{
+    struct sml_ann_kernel_image_header header;
+    struct sml_ann_kernel *kernel;
+    void *image;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != KERNEL_MAGIC || header.version != KERNEL_VERSION ||
+        (header.bits != 8 && header.bits != 16) ||
+        header.size < sizeof(header) || header.size > SIZE_MAX) {
+        sml_critical("Invalid quantized ANN file");
+        return NULL;
+    }
+
+    image = malloc(header.size);
+    if (!image) {
+        sml_critical("Could not alloc the quantized ANN");
+        return NULL;
+    }
+    memcpy(image, &header, sizeof(header));
+    if (fread((char *)image + sizeof(header), header.size - sizeof(header),
+        1, f) != 1) {
+        sml_critical("Could not read the quantized ANN");
+        free(image);
+        return NULL;
+    }
+
+    kernel = sml_ann_kernel_map(image, header.size, error);
+    if (!kernel) {
+        free(image);
+        return NULL;
+    }
+    kernel->image = image;
+    return kernel;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the Soletta Project
+ *
+ * Copyright (C) 2015 Intel Corporation. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * Compiled form of a trained FANN network, used to predict without going
+ * through fann_run(). The weights and the activation parameters are copied
+ * into dense arrays when the kernel is created, so it must be created again
+ * once the network changes. Networks using activation functions or
+ * connections the kernel does not know are not compiled.
+ *
+ * A kernel can be quantized to 8 or 16 bits weights, with one scale per
+ * layer. Quantized kernels keep the neuron values in fixed point and only
+ * use floats to apply the activation functions.
+ *
+ * Kernels are serialized as images in the byte order of the machine. An
+ * image in memory, like a mapped file, can be used by a kernel without
+ * copying its weights, as long as it outlives the kernel.
+ */
+struct fann;
+struct sml_ann_kernel;
+
+struct sml_ann_kernel *sml_ann_kernel_new(struct fann *ann);
+struct sml_ann_kernel *sml_ann_kernel_quantize(const struct sml_ann_kernel *kernel, unsigned int bits);
+void sml_ann_kernel_free(struct sml_ann_kernel *kernel);
+const float *sml_ann_kernel_run(struct sml_ann_kernel *kernel, const float *input);
+unsigned int sml_ann_kernel_get_num_input(const struct sml_ann_kernel *kernel);
+unsigned int sml_ann_kernel_get_num_output(const struct sml_ann_kernel *kernel);
+unsigned int sml_ann_kernel_get_bits(const struct sml_ann_kernel *kernel);
+size_t sml_ann_kernel_get_image_size(const struct sml_ann_kernel *kernel);
+bool sml_ann_kernel_write(const struct sml_ann_kernel *kernel, float error, FILE *f);
+struct sml_ann_kernel *sml_ann_kernel_map(const void *image, size_t size, float *error);
+bool sml_ann_kernel_save(const struct sml_ann_kernel *kernel, float error, FILE *f);
+struct sml_ann_kernel *sml_ann_kernel_load(FILE *f, float *error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,7 +17,9 @@
  */
 
 #include <sml_ann.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <math.h>
 #include "macros.h"
 #include "sml_log.h"
 
@@ -100,9 +102,66 @@ sml_ann_use_pseudorehearsal_strategy(struct sml_object *sml,
     return false;
 }
 
+API_EXPORT bool
+sml_ann_set_warm_start(struct sml_object *sml, bool warm_start)
+{
+    return false;
+}
+
+API_EXPORT bool
+sml_ann_set_training_time_budget(struct sml_object *sml, unsigned int budget_ms)
+{
+    return false;
+}
+
+API_EXPORT bool
+sml_ann_set_training_variants(struct sml_object *sml, unsigned int variants)
+{
+    return false;
+}
+
+API_EXPORT bool
+sml_ann_set_training_threads(struct sml_object *sml, unsigned int threads)
+{
+    return false;
+}
+
+API_EXPORT bool
+sml_ann_set_quantization(struct sml_object *sml,
+    enum sml_ann_quantization quantization, float max_error)
+{
+    return false;
+}
+
+API_EXPORT float
+sml_ann_get_quantization_error(struct sml_object *sml)
+{
+    return NAN;
+}
+
 API_EXPORT bool
 sml_ann_set_initial_required_observations(struct sml_object *sml,
     unsigned int required_observations)
 {
     return false;
 }
+
+API_EXPORT bool
+sml_ann_set_async_training(struct sml_object *sml, bool async_training)
+{
+    return false;
+}
+
+API_EXPORT bool
+sml_ann_set_training_finished_callback(struct sml_object *sml,
+    sml_ann_training_finished_cb training_finished_cb, void *data)
+{
+    return false;
+}
+
+API_EXPORT int
+sml_ann_predict_batch(struct sml_object *sml, const float *inputs,
+    float *outputs, unsigned int rows)
+{
+    return -ENOTSUP;
+}
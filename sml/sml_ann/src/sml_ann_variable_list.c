@@ -15,7 +15,6 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-
 #include <stdlib.h>
 #include "sml_ann_variable_list.h"
 #include <macros.h>
@@ -26,290 +25,1120 @@
 #include <string.h>
 #include <sml_log.h>
 
+#define MIN_CAPACITY (8)
+
+/*
+ * Variable data is stored per list, as a structure of arrays: slot i of
+ * every array belongs to the i-th variable of the list. Observations are
+ * kept as a row-major matrix, one row per observation and one column per
+ * variable, so a row can be handed to FANN as is. The matrix is used as a
+ * ring: once it is full, recording an observation replaces the oldest one,
+ * so its storage only changes when more rows are reserved or the columns
+ * change.
+ *
+ * Observation columns are stored already scaled to [-1, 1], with missing
+ * values mapped to -1 (the scaled minimum), which is what FANN is trained
+ * with. Columns whose variable has no usable range yet (the default
+ * [-FLT_MAX, FLT_MAX]) keep the raw values instead, and are scaled when
+ * the range is set. Scaled values are clamped to the range, so they can
+ * only be rescaled to a narrower one: the engine drops the recorded
+ * observations before a range is widened.
+ *
+ * A variable belongs to the list that created it (or the one it was
+ * moved to). Views only reference variables owned by other lists and do
+ * not hold any data.
+ */
 struct sml_variable_impl {
     char *name;
-    unsigned int observations_idx;
-    /* Keep this as plain C-Array, it's easier to resize
-       and preallocate the data */
-    float *observations;
-
-    float current_value;
-    float previous_value;
-    float last_stable_value;
-    float min_value;
-    float max_value;
-
+    struct sml_variables_list_impl *list;
+    uint16_t idx;
     bool enabled;
     bool input;
 };
 
 struct sml_variables_list_impl {
     struct sol_ptr_vector variables;
+    bool view;
+    uint16_t capacity;
+
+    /* Points to values, or to the caller buffer when bound */
+    float *current;
+    float *values;
+    float *previous;
+    float *stable;
+    float *min;
+    float *max;
+    /* Whether the observation column holds scaled values */
+    bool *scaled;
+
+    float *observations;
+    /* Allocated rows */
+    unsigned int observations_size;
+    /* Ring position of the oldest observation */
+    unsigned int observations_start;
+    /* Number of recorded observations */
+    unsigned int observations_idx;
+
+    /* Running mean and sum of squared deviations of each observation
+       column (Welford), over the first observations_idx rows. Only kept
+       while observations are appended in order, see stats_valid. */
+    double *mean;
+    double *m2;
+    bool stats_valid;
 };
 
-void
-sml_ann_variable_fill_with_random_values(struct sml_variable *var,
-    unsigned int total)
+static inline uint16_t
+_len(struct sml_variables_list_impl *impl)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    return sol_ptr_vector_get_len(&impl->variables);
+}
+
+static inline struct sml_variables_list_impl *
+_owner(struct sml_variable *var)
+{
+    return ((struct sml_variable_impl *)var)->list;
+}
+
+static inline uint16_t
+_idx(struct sml_variable *var)
+{
+    return ((struct sml_variable_impl *)var)->idx;
+}
+
+static void
+_sml_ann_variables_list_unbind(struct sml_variables_list_impl *impl)
+{
+    if (impl->current == impl->values)
+        return;
+
+    memcpy(impl->values, impl->current, sizeof(float) * _len(impl));
+    impl->current = impl->values;
+}
+
+static int
+_sml_ann_variables_list_reserve(struct sml_variables_list_impl *impl,
+    uint16_t capacity)
+{
+    float **arrays[] = { &impl->values, &impl->previous, &impl->stable,
+                         &impl->min, &impl->max };
     unsigned int i;
+    float *array;
+    bool *scaled;
+    double *stats;
+
+    if (capacity <= impl->capacity)
+        return 0;
+
+    if (capacity < MIN_CAPACITY)
+        capacity = MIN_CAPACITY;
+    if (capacity < impl->capacity * 2 && impl->capacity * 2 <= UINT16_MAX)
+        capacity = impl->capacity * 2;
+
+    _sml_ann_variables_list_unbind(impl);
+    for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        array = realloc(*arrays[i], sizeof(float) * capacity);
+        if (!array) {
+            impl->current = impl->values;
+            return -ENOMEM;
+        }
+        *arrays[i] = array;
+    }
+    impl->current = impl->values;
+    scaled = realloc(impl->scaled, sizeof(bool) * capacity);
+    if (!scaled)
+        return -ENOMEM;
+    impl->scaled = scaled;
+    stats = realloc(impl->mean, sizeof(double) * capacity);
+    if (!stats)
+        return -ENOMEM;
+    impl->mean = stats;
+    stats = realloc(impl->m2, sizeof(double) * capacity);
+    if (!stats)
+        return -ENOMEM;
+    impl->m2 = stats;
+    impl->capacity = capacity;
+    return 0;
+}
+
+static inline bool
+_range_is_usable(float min, float max)
+{
+    return max > min && isfinite(max - min);
+}
+
+static inline float
+_scale_with_range(float min, float max, float value)
+{
+    float midrange = (max + min) / 2.0;
+
+    if (value > max)
+        value = max;
+    else if (value < min)
+        value = min;
+    return (value - midrange) / ((max - min) / 2.0);
+}
+
+static inline float
+_descale_with_range(float min, float max, float value)
+{
+    float midrange = (max + min) / 2.0;
+
+    if (value > 1.0)
+        value = 1.0;
+    else if (value < -1.0)
+        value = -1.0;
+    return (((max - min) / 2.0) * value) + midrange;
+}
+
+static inline float
+_scale(struct sml_variables_list_impl *impl, uint16_t i, float value)
+{
+    return _scale_with_range(impl->min[i], impl->max[i], value);
+}
+
+/* Converts a raw value to its representation in the observation column */
+static inline float
+_observation_store(struct sml_variables_list_impl *impl, uint16_t i,
+    float value)
+{
+    if (!impl->scaled[i])
+        return value;
+    if (isnan(value))
+        return -1.0;
+    return _scale(impl, i, value);
+}
+
+static inline float
+_observation_load(struct sml_variables_list_impl *impl, uint16_t i,
+    float stored)
+{
+    if (!impl->scaled[i])
+        return stored;
+    return _descale_with_range(impl->min[i], impl->max[i], stored);
+}
+
+static inline float
+_observation_empty(struct sml_variables_list_impl *impl, uint16_t i)
+{
+    return impl->scaled[i] ? -1.0 : NAN;
+}
+
+/* The row-th oldest observation */
+static inline float *
+_row(struct sml_variables_list_impl *impl, unsigned int row)
+{
+    return impl->observations + (size_t)_len(impl) *
+           ((impl->observations_start + row) % impl->observations_size);
+}
 
-    for (i = 0; i < total; i++) {
-        impl->observations[impl->observations_idx++] =
-            impl->min_value + rand() /
-            (RAND_MAX / (impl->max_value - impl->min_value));
+/* The value statistics are computed over: what reading the observation
+   back gives, with the range minimum for missing values */
+static inline float
+_stats_value(struct sml_variables_list_impl *impl, uint16_t i, float stored)
+{
+    float value = _observation_load(impl, i, stored);
+
+    if (isnan(value))
+        return impl->min[i];
+    return value;
+}
+
+static void
+_stats_reset(struct sml_variables_list_impl *impl)
+{
+    uint16_t i, len = _len(impl);
+
+    for (i = 0; i < len; i++)
+        impl->mean[i] = impl->m2[i] = 0.0;
+    impl->stats_valid = true;
+}
+
+/* Resets every observation of the column col to the empty value */
+static void
+_sml_ann_variables_list_fill_column(struct sml_variables_list_impl *impl,
+    uint16_t col)
+{
+    uint16_t len = _len(impl);
+    float empty = _observation_empty(impl, col);
+    unsigned int row;
+
+    if (!impl->observations)
+        return;
+    for (row = 0; row < impl->observations_size; row++)
+        impl->observations[row * len + col] = empty;
+}
+
+/* Changes the number of columns of the observation matrix. The column col
+   is inserted (grow) or dropped (shrink). */
+static int
+_sml_ann_variables_list_relayout(struct sml_variables_list_impl *impl,
+    uint16_t old_len, uint16_t new_len, uint16_t col)
+{
+    float *observations;
+    unsigned int row;
+    uint16_t c;
+
+    if (!impl->observations_size)
+        return 0;
+
+    if (!new_len) {
+        free(impl->observations);
+        impl->observations = NULL;
+        return 0;
+    }
+
+    if (new_len < old_len) {
+        /* The new stride is smaller, moving forward is safe in place */
+        for (row = 0; row < impl->observations_size; row++) {
+            for (c = 0; c < new_len; c++)
+                impl->observations[row * new_len + c] =
+                    impl->observations[row * old_len + (c < col ? c : c + 1)];
+        }
+        observations = realloc(impl->observations,
+            sizeof(float) * impl->observations_size * new_len);
+        if (observations)
+            impl->observations = observations;
+        return 0;
+    }
+
+    observations = malloc(sizeof(float) * impl->observations_size * new_len);
+    if (!observations) {
+        sml_critical("Could not alloc the observation matrix");
+        return -ENOMEM;
     }
+    for (row = 0; row < impl->observations_size; row++) {
+        for (c = 0; c < new_len; c++) {
+            if (c == col)
+                observations[row * new_len + c] = NAN;
+            else if (impl->observations)
+                observations[row * new_len + c] =
+                    impl->observations[row * old_len + (c < col ? c : c - 1)];
+        }
+    }
+    free(impl->observations);
+    impl->observations = observations;
+    return 0;
 }
 
-void
-sml_ann_variable_set_value_by_index(struct sml_variable *var, float value,
-    unsigned int idx)
+static struct sml_variables_list_impl *
+_sml_ann_variable_list_alloc(bool view)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *list =
+        calloc(1, sizeof(struct sml_variables_list_impl));
+
+    ON_NULL_RETURN_VAL(list, NULL);
+    sol_ptr_vector_init(&list->variables);
+    list->view = view;
+    list->stats_valid = true;
+    return list;
+}
+
+struct sml_variables_list *
+sml_ann_variable_list_new()
+{
+    return (struct sml_variables_list *)_sml_ann_variable_list_alloc(false);
+}
+
+struct sml_variables_list *
+sml_ann_variable_list_new_view()
+{
+    return (struct sml_variables_list *)_sml_ann_variable_list_alloc(true);
+}
 
-    impl->observations[idx] = value;
+static void
+_sml_ann_variable_free(struct sml_variable_impl *var)
+{
+    free(var->name);
+    free(var);
 }
 
 void
-sml_ann_variables_list_add_last_value_to_observation(
-    struct sml_variables_list *list)
+sml_ann_variable_list_free(struct sml_variables_list *list)
 {
     struct sml_variables_list_impl *impl =
         (struct sml_variables_list_impl *)list;
     struct sml_variable_impl *var;
     uint16_t i;
 
-    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
-        var->observations[var->observations_idx++] = var->current_value;
+    if (!impl->view) {
+        SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
+            _sml_ann_variable_free(var);
+    }
+    sol_ptr_vector_clear(&impl->variables);
+    free(impl->values);
+    free(impl->previous);
+    free(impl->stable);
+    free(impl->min);
+    free(impl->max);
+    free(impl->scaled);
+    free(impl->mean);
+    free(impl->m2);
+    free(impl->observations);
+    free(impl);
 }
 
-void
-sml_ann_variables_list_reset_observations(struct sml_variables_list *list,
-    bool reset_control_varaibles)
+/* Appends a slot for var, initialized as a fresh variable. */
+static int
+_sml_ann_variables_list_append(struct sml_variables_list_impl *impl,
+    struct sml_variable_impl *var)
+{
+    uint16_t len = _len(impl);
+    int r;
+
+    if (len == UINT16_MAX)
+        return -ENOSPC;
+    if ((r = _sml_ann_variables_list_reserve(impl, len + 1)))
+        return r;
+    _sml_ann_variables_list_unbind(impl);
+    if ((r = _sml_ann_variables_list_relayout(impl, len, len + 1, len)))
+        return r;
+    if ((r = sol_ptr_vector_append(&impl->variables, var))) {
+        _sml_ann_variables_list_relayout(impl, len + 1, len, len);
+        return r;
+    }
+
+    impl->values[len] = NAN;
+    impl->previous[len] = NAN;
+    impl->stable[len] = NAN;
+    impl->min[len] = -FLT_MAX;
+    impl->max[len] = FLT_MAX;
+    impl->scaled[len] = false;
+    impl->mean[len] = impl->m2[len] = 0.0;
+    if (impl->observations_idx)
+        impl->stats_valid = false;
+    var->list = impl;
+    var->idx = len;
+    return 0;
+}
+
+/* Drops the slot of the variable at index, without freeing it */
+static struct sml_variable_impl *
+_sml_ann_variables_list_steal(struct sml_variables_list_impl *impl,
+    uint16_t index)
+{
+    struct sml_variable_impl *var;
+    uint16_t i, len = _len(impl);
+    size_t tail;
+
+    var = sol_ptr_vector_steal(&impl->variables, index);
+    if (!var || impl->view)
+        return var;
+
+    _sml_ann_variables_list_unbind(impl);
+    _sml_ann_variables_list_relayout(impl, len, len - 1, index);
+    tail = sizeof(float) * (len - index - 1);
+    memmove(impl->values + index, impl->values + index + 1, tail);
+    memmove(impl->previous + index, impl->previous + index + 1, tail);
+    memmove(impl->stable + index, impl->stable + index + 1, tail);
+    memmove(impl->min + index, impl->min + index + 1, tail);
+    memmove(impl->max + index, impl->max + index + 1, tail);
+    memmove(impl->scaled + index, impl->scaled + index + 1,
+        sizeof(bool) * (len - index - 1));
+    memmove(impl->mean + index, impl->mean + index + 1,
+        sizeof(double) * (len - index - 1));
+    memmove(impl->m2 + index, impl->m2 + index + 1,
+        sizeof(double) * (len - index - 1));
+    for (i = index; i < len - 1; i++) {
+        struct sml_variable_impl *v = sol_ptr_vector_get(&impl->variables, i);
+        v->idx = i;
+    }
+    var->list = NULL;
+    return var;
+}
+
+struct sml_variable *
+sml_ann_variables_list_new_variable(struct sml_variables_list *list,
+    const char *name, bool input)
 {
     struct sml_variables_list_impl *impl =
         (struct sml_variables_list_impl *)list;
     struct sml_variable_impl *var;
-    uint16_t i;
 
-    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i) {
-        var->observations_idx = 0;
-        if (reset_control_varaibles) {
-            var->current_value = var->previous_value =
-                    var->last_stable_value = NAN;
-        }
+    if (impl->view) {
+        sml_critical("Variables can not be created in a view");
+        return NULL;
     }
+
+    var = calloc(1, sizeof(struct sml_variable_impl));
+    ON_NULL_RETURN_VAL(var, NULL);
+    var->name = strdup(name);
+    if (!var->name)
+        goto err_name;
+    var->enabled = true;
+    var->input = input;
+
+    if (_sml_ann_variables_list_append(impl, var))
+        goto err_append;
+    return (struct sml_variable *)var;
+
+err_append:
+    free(var->name);
+err_name:
+    free(var);
+    return NULL;
 }
 
-void
-sml_ann_variables_list_set_current_value_as_stable(
-    struct sml_variables_list *list)
+int
+sml_ann_variables_list_move_variable(struct sml_variables_list *list,
+    struct sml_variable *var)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable_impl *var_impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *from = var_impl->list;
+    uint16_t src = var_impl->idx, dst;
+    int r;
+
+    if (impl->view || from == impl)
+        return -EINVAL;
+
+    if ((r = _sml_ann_variables_list_append(impl, var_impl)))
+        return r;
+
+    dst = var_impl->idx;
+    impl->values[dst] = from->current[src];
+    impl->previous[dst] = from->previous[src];
+    impl->stable[dst] = from->stable[src];
+    impl->min[dst] = from->min[src];
+    impl->max[dst] = from->max[src];
+    impl->scaled[dst] = from->scaled[src];
+    _sml_ann_variables_list_fill_column(impl, dst);
+    if (impl->observations_idx)
+        impl->stats_valid = false;
+
+    /* The steal resets the owner, restore it */
+    _sml_ann_variables_list_steal(from, src);
+    var_impl->list = impl;
+    var_impl->idx = dst;
+    return 0;
+}
+
+int
+sml_ann_variable_list_add_variable(struct sml_variables_list *list,
+    struct sml_variable *var)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+
+    if (!impl->view) {
+        sml_critical("Only views can reference variables of other lists");
+        return -EINVAL;
+    }
+    return sol_ptr_vector_append(&impl->variables, var);
+}
+
+bool
+sml_ann_variable_list_remove(struct sml_variables_list *list, uint16_t index)
 {
     struct sml_variables_list_impl *impl =
         (struct sml_variables_list_impl *)list;
     struct sml_variable_impl *var;
-    uint16_t i;
 
-    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
-        var->last_stable_value = var->current_value;
+    var = _sml_ann_variables_list_steal(impl, index);
+    if (!var) {
+        sml_critical("Could not remove the index %d", index);
+        return false;
+    }
+    if (!impl->view)
+        _sml_ann_variable_free(var);
+    return true;
+}
+
+struct sml_variables_list *
+sml_ann_variable_list_dup(struct sml_variables_list *list,
+    unsigned int observations)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variables_list_impl *copy;
+    struct sml_variable_impl *var;
+    struct sml_variable *var_copy;
+    uint16_t i, len = _len(impl);
+    unsigned int j;
+
+    copy = (struct sml_variables_list_impl *)sml_ann_variable_list_new();
+    ON_NULL_RETURN_VAL(copy, NULL);
+
+    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i) {
+        var_copy = sml_ann_variables_list_new_variable(
+            (struct sml_variables_list *)copy, var->name, var->input);
+        if (!var_copy) {
+            sml_critical("Could not copy the variable %s", var->name);
+            goto err_exit;
+        }
+        ((struct sml_variable_impl *)var_copy)->enabled = var->enabled;
+    }
+
+    if (len) {
+        memcpy(copy->values, impl->current, sizeof(float) * len);
+        memcpy(copy->previous, impl->previous, sizeof(float) * len);
+        memcpy(copy->stable, impl->stable, sizeof(float) * len);
+        memcpy(copy->min, impl->min, sizeof(float) * len);
+        memcpy(copy->max, impl->max, sizeof(float) * len);
+        memcpy(copy->scaled, impl->scaled, sizeof(bool) * len);
+        memcpy(copy->mean, impl->mean, sizeof(double) * len);
+        memcpy(copy->m2, impl->m2, sizeof(double) * len);
+    }
+
+    if (observations) {
+        if (sml_ann_variables_list_reserve_observations(
+            (struct sml_variables_list *)copy, observations))
+            goto err_exit;
+        for (j = 0; len && j < observations; j++)
+            memcpy(copy->observations + (size_t)j * len, _row(impl, j),
+                sizeof(float) * len);
+    }
+    copy->observations_idx = observations;
+    copy->stats_valid = impl->stats_valid &&
+        observations == impl->observations_idx;
+    return (struct sml_variables_list *)copy;
+
+err_exit:
+    sml_ann_variable_list_free((struct sml_variables_list *)copy);
+    return NULL;
 }
 
 int
-sml_ann_variable_realloc_observation_array(struct sml_variable *var,
+sml_ann_variables_list_reserve_observations(struct sml_variables_list *list,
     unsigned int size)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t len = _len(impl);
     float *observations;
-    unsigned int i;
+    unsigned int row;
+    size_t i;
 
-    observations = realloc(impl->observations, sizeof(float) * size);
-    if (!observations) {
-        sml_critical("Could not realloc the variable %s observations array" \
-            " to %d", impl->name, size);
-        return -errno;
+    if (impl->view)
+        return -EINVAL;
+    if (size <= impl->observations_size)
+        return 0;
+
+    if (len) {
+        observations = malloc(sizeof(float) * size * len);
+        if (!observations) {
+            sml_critical("Could not alloc the observation matrix for %d" \
+                " rows", size);
+            return -ENOMEM;
+        }
+        /* Unwrap the ring, oldest observation first */
+        for (row = 0; row < impl->observations_size; row++)
+            memcpy(observations + (size_t)row * len, _row(impl, row),
+                sizeof(float) * len);
+        for (i = (size_t)impl->observations_size * len; i < (size_t)size * len;
+            i++)
+            observations[i] = _observation_empty(impl, i % len);
+        free(impl->observations);
+        impl->observations = observations;
     }
 
-    impl->observations = observations;
+    impl->observations_size = size;
+    impl->observations_start = 0;
+    return 0;
+}
+
+unsigned int
+sml_ann_variables_list_get_observations_capacity(
+    struct sml_variables_list *list)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
 
-    if (size < impl->observations_idx)
-        impl->observations_idx = size;
-    else {
-        for (i = impl->observations_idx; i < size; i++)
-            impl->observations[i] = NAN;
+    return impl->observations_size;
+}
+
+/* Returns the row for a new observation, dropping the oldest one if the
+   ring is full. NULL if there is no room or no columns. */
+static float *
+_sml_ann_variables_list_push_row(struct sml_variables_list_impl *impl)
+{
+    uint16_t i, len = _len(impl);
+    unsigned int n = impl->observations_idx;
+    double value, mean;
+    float *oldest;
+
+    if (!impl->observations_size)
+        return NULL;
+
+    if (n == impl->observations_size) {
+        oldest = len ? _row(impl, 0) : NULL;
+        for (i = 0; impl->stats_valid && i < len; i++) {
+            if (n == 1) {
+                impl->mean[i] = impl->m2[i] = 0.0;
+                continue;
+            }
+            value = _stats_value(impl, i, oldest[i]);
+            mean = (n * impl->mean[i] - value) / (n - 1);
+            impl->m2[i] -= (value - impl->mean[i]) * (value - mean);
+            if (impl->m2[i] < 0.0)
+                impl->m2[i] = 0.0;
+            impl->mean[i] = mean;
+        }
+        impl->observations_start =
+            (impl->observations_start + 1) % impl->observations_size;
+        impl->observations_idx--;
     }
-    return 0;
+
+    if (!len) {
+        impl->observations_idx++;
+        return NULL;
+    }
+    return _row(impl, impl->observations_idx++);
 }
 
-int
-sml_ann_variables_list_realloc_observations_array(
-    struct sml_variables_list *list, unsigned int size)
+unsigned int
+sml_ann_variables_list_get_observations_length(struct sml_variables_list *list)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+
+    return impl->observations_idx;
+}
+
+void
+sml_ann_variables_list_set_observations_length(struct sml_variables_list *list,
+    unsigned int length)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+
+    if (length != impl->observations_idx)
+        impl->stats_valid = false;
+    impl->observations_idx = length;
+}
+
+void
+sml_ann_variables_list_keep_last_observations(struct sml_variables_list *list,
+    unsigned int length)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+
+    if (length >= impl->observations_idx)
+        return;
+
+    impl->observations_start = (impl->observations_start +
+        impl->observations_idx - length) % impl->observations_size;
+    impl->observations_idx = length;
+    impl->stats_valid = false;
+}
+
+void
+sml_ann_variables_list_fill_with_random_values(struct sml_variables_list *list,
+    unsigned int total)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t i, len = _len(impl);
+    float *row;
+
+    impl->stats_valid = false;
+    for (; total > 0; total--) {
+        row = _sml_ann_variables_list_push_row(impl);
+        if (!row) {
+            if (!len && impl->observations_size)
+                continue;
+            return;
+        }
+        for (i = 0; i < len; i++) {
+            if (impl->scaled[i])
+                row[i] = -1.0 + rand() / (RAND_MAX / 2.0);
+            else
+                row[i] = impl->min[i] +
+                    rand() / (RAND_MAX / (impl->max[i] - impl->min[i]));
+        }
+    }
+}
+
+void
+sml_ann_variables_list_add_last_value_to_observation(
+    struct sml_variables_list *list)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t i, len = _len(impl);
+    double delta, value;
+    float *row;
+
+    row = _sml_ann_variables_list_push_row(impl);
+    if (!row) {
+        if (!impl->observations_size)
+            sml_warning("There is no room to record the observation");
+        return;
+    }
+
+    for (i = 0; i < len; i++)
+        row[i] = _observation_store(impl, i, impl->current[i]);
+
+    if (!impl->stats_valid)
+        return;
+    for (i = 0; i < len; i++) {
+        value = _stats_value(impl, i, row[i]);
+        delta = value - impl->mean[i];
+        impl->mean[i] += delta / impl->observations_idx;
+        impl->m2[i] += delta * (value - impl->mean[i]);
+    }
+}
+
+const float *
+sml_ann_variables_list_get_observation_row(struct sml_variables_list *list,
+    unsigned int row)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+
+    if (impl->view || row >= impl->observations_size)
+        return NULL;
+    return _row(impl, row);
+}
+
+bool
+sml_ann_variables_list_observations_are_scaled(struct sml_variables_list *list)
 {
     struct sml_variables_list_impl *impl =
         (struct sml_variables_list_impl *)list;
     struct sml_variable_impl *var;
     uint16_t i;
-    int r;
 
+    if (impl->view)
+        return false;
     SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i) {
-        r = sml_ann_variable_realloc_observation_array(
-            (struct sml_variable *)var, size);
-        if (r < 0)
-            return r;
+        if (!var->enabled || !impl->scaled[i])
+            return false;
     }
-    return 0;
+    return true;
 }
 
 void
-sml_ann_variable_free(struct sml_variable *var)
+sml_ann_variables_list_fill_scaled_row(struct sml_variables_list *list,
+    unsigned int row, float *dst)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable_impl *var;
+    uint16_t i;
+    const float *src = _row(impl, row);
+    float value;
 
-    free(impl->observations);
-    free(impl->name);
-    free(impl);
+    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i) {
+        if (!var->enabled)
+            dst[i] = -1.0;
+        else if (impl->scaled[i])
+            dst[i] = src[i];
+        else {
+            value = src[i];
+            if (isnan(value))
+                value = impl->min[i];
+            dst[i] = _scale(impl, i, value);
+        }
+    }
 }
 
-struct sml_variable *
-sml_ann_variable_new(const char *name, bool input)
+/* Scales value, using the minimum of the range for missing values */
+static inline float
+_scale_or_min(struct sml_variables_list_impl *impl, uint16_t i, float value)
 {
-    struct sml_variable_impl *var = calloc(1, sizeof(struct sml_variable_impl));
+    if (isnan(value))
+        value = impl->min[i];
+    return _scale(impl, i, value);
+}
 
-    ON_NULL_RETURN_VAL(var, NULL);
-    var->name = strdup(name);
-    if (!var->name) {
-        free(var);
-        return NULL;
-    }
+static inline float
+_descale_or_min(struct sml_variables_list_impl *impl, uint16_t i, float value)
+{
+    if (isnan(value))
+        return impl->min[i];
+    return _descale_with_range(impl->min[i], impl->max[i], value);
+}
 
-    var->current_value = NAN;
-    var->previous_value = NAN;
-    var->last_stable_value = NAN;
-    var->min_value = -FLT_MAX;
-    var->max_value = FLT_MAX;
-    var->enabled = true;
-    var->input = input;
+void
+sml_ann_variables_list_get_scaled_values(struct sml_variables_list *list,
+    float *dst)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable *var;
+    struct sml_variables_list_impl *owner;
+    uint16_t i;
 
-    return (struct sml_variable *)var;
+    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i) {
+        owner = _owner(var);
+        dst[i] = _scale_or_min(owner, _idx(var), owner->current[_idx(var)]);
+    }
 }
 
 void
-sml_ann_variable_set_observations_array_index(struct sml_variable *var,
-    unsigned int idx)
+sml_ann_variables_list_set_scaled_values(struct sml_variables_list *list,
+    const float *src)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable *var;
+    struct sml_variables_list_impl *owner;
+    uint16_t i, idx;
 
-    impl->observations_idx = idx;
+    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i) {
+        owner = _owner(var);
+        idx = _idx(var);
+        owner->previous[idx] = owner->current[idx];
+        owner->current[idx] = _descale_or_min(owner, idx, src[i]);
+    }
 }
 
-float
-sml_ann_variable_get_last_stable_value(struct sml_variable *var)
+void
+sml_ann_variables_list_scale_values(struct sml_variables_list *list,
+    const float *src, float *dst)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable *var;
+    uint16_t i;
 
-    return impl->last_stable_value;
+    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
+        dst[i] = _scale_or_min(_owner(var), _idx(var), src[i]);
 }
 
-struct sml_variables_list *
-sml_ann_variable_list_new()
+void
+sml_ann_variables_list_descale_values(struct sml_variables_list *list,
+    const float *src, float *dst)
 {
-    struct sml_variables_list_impl *list =
-        malloc(sizeof(struct sml_variables_list_impl));
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable *var;
+    uint16_t i;
 
-    ON_NULL_RETURN_VAL(list, NULL);
-    sol_ptr_vector_init(&list->variables);
-    return (struct sml_variables_list *)list;
+    SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
+        dst[i] = _descale_or_min(_owner(var), _idx(var), src[i]);
 }
 
-float
-sml_ann_variable_scale_value(struct sml_variable *var, float value)
+void
+sml_ann_variables_list_get_scaled_row(struct sml_variables_list *list,
+    unsigned int row, float *dst)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
-    float midrange = (impl->max_value + impl->min_value) / 2.0;
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t i, len = _len(impl);
+    const float *src = _row(impl, row);
+
+    for (i = 0; i < len; i++) {
+        if (impl->scaled[i])
+            dst[i] = src[i];
+        else
+            dst[i] = _scale_or_min(impl, i, src[i]);
+    }
+}
 
-    if (value > impl->max_value)
-        value = impl->max_value;
-    else if (value < impl->min_value)
-        value = impl->min_value;
-    return (value - midrange) / ((impl->max_value - impl->min_value) / 2.0);
+void
+sml_ann_variables_list_set_scaled_row(struct sml_variables_list *list,
+    unsigned int row, const float *src)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t i, len = _len(impl);
+    float *dst = _row(impl, row);
+
+    if (row < impl->observations_idx)
+        impl->stats_valid = false;
+    for (i = 0; i < len; i++) {
+        if (!impl->scaled[i])
+            dst[i] = _descale_or_min(impl, i, src[i]);
+        else if (isnan(src[i]))
+            dst[i] = -1.0;
+        else
+            dst[i] = src[i] > 1.0 ? 1.0 : (src[i] < -1.0 ? -1.0 : src[i]);
+    }
 }
 
-float
-sml_ann_variable_descale_value(struct sml_variable *var, float value)
+bool
+sml_ann_variables_list_has_changes_since_stable(struct sml_variables_list *list,
+    float threshold)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
-    float midrange = (impl->max_value + impl->min_value) / 2.0;
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t i, len = _len(impl);
+    float last, stable;
+
+    for (i = 0; i < len; i++) {
+        last = impl->current[i];
+        stable = impl->stable[i];
+        if (!isnan(stable) && !isnan(last)) {
+            if (fabs(last - stable) >= threshold)
+                return true;
+        } else if (!(isnan(stable) && isnan(last)))
+            return true;
+    }
+    return false;
+}
 
-    if (value > 1.0)
-        value = 1.0;
-    else if (value < -1.0)
-        value = -1.0;
-    return (((impl->max_value - impl->min_value) / 2.0) * value) + midrange;
+void
+sml_ann_variables_list_set_values(struct sml_variables_list *list,
+    const float *values)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    struct sml_variable *var;
+    uint16_t i, len = _len(impl);
+
+    if (impl->view) {
+        SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
+            sml_ann_variable_set_value(var, values[i]);
+        return;
+    }
+
+    memcpy(impl->previous, impl->current, sizeof(float) * len);
+    if (values != impl->current)
+        memcpy(impl->current, values, sizeof(float) * len);
 }
 
 void
-sml_ann_variable_list_free(struct sml_variables_list *list, bool free_var)
+sml_ann_variables_list_get_values(struct sml_variables_list *list,
+    float *values)
 {
     struct sml_variables_list_impl *impl =
         (struct sml_variables_list_impl *)list;
     struct sml_variable *var;
     uint16_t i;
 
-    if (free_var) {
+    if (impl->view) {
         SOL_PTR_VECTOR_FOREACH_IDX (&impl->variables, var, i)
-            sml_ann_variable_free(var);
+            values[i] = sml_ann_variable_get_value(var);
+        return;
     }
-    sol_ptr_vector_clear(&impl->variables);
-    free(impl);
+
+    if (values != impl->current)
+        memcpy(values, impl->current, sizeof(float) * _len(impl));
 }
 
 int
-sml_ann_variable_list_add_variable(struct sml_variables_list *list,
-    struct sml_variable *var)
+sml_ann_variables_list_bind_values(struct sml_variables_list *list,
+    float *values)
 {
     struct sml_variables_list_impl *impl =
         (struct sml_variables_list_impl *)list;
 
-    return sol_ptr_vector_append(&impl->variables, var);
+    if (impl->view) {
+        sml_warning("Only the engine input and output lists can be bound");
+        return -EINVAL;
+    }
+
+    _sml_ann_variables_list_unbind(impl);
+    if (!values)
+        return 0;
+
+    memcpy(values, impl->current, sizeof(float) * _len(impl));
+    impl->current = values;
+    return 0;
+}
+
+void
+sml_ann_variables_list_reset_observations(struct sml_variables_list *list,
+    bool reset_control_variables)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+    uint16_t i, len = _len(impl);
+
+    impl->observations_idx = 0;
+    impl->observations_start = 0;
+    _stats_reset(impl);
+    if (!reset_control_variables)
+        return;
+
+    for (i = 0; i < len; i++)
+        impl->current[i] = impl->previous[i] = impl->stable[i] = NAN;
+}
+
+void
+sml_ann_variables_list_set_current_value_as_stable(
+    struct sml_variables_list *list)
+{
+    struct sml_variables_list_impl *impl =
+        (struct sml_variables_list_impl *)list;
+
+    memcpy(impl->stable, impl->current, sizeof(float) * _len(impl));
 }
 
 float
 sml_ann_variable_get_value_by_index(struct sml_variable *var,
     unsigned int index)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl = _owner(var);
 
-    return impl->observations[index];
+    return _observation_load(impl, _idx(var),
+        _row(impl, index)[_idx(var)]);
 }
 
-unsigned int
-sml_ann_variable_get_observations_length(struct sml_variable *var)
+void
+sml_ann_variable_set_value_by_index(struct sml_variable *var, float value,
+    unsigned int index)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl = _owner(var);
 
-    return impl->observations_idx;
+    if (index < impl->observations_idx)
+        impl->stats_valid = false;
+    _row(impl, index)[_idx(var)] = _observation_store(impl, _idx(var), value);
 }
 
 bool
-sml_ann_variable_list_remove(struct sml_variables_list *list, uint16_t index)
+sml_ann_variable_get_observations_stats(struct sml_variable *var,
+    unsigned int observations, float *mean, float *sd)
 {
-    struct sml_variables_list_impl *impl =
-        (struct sml_variables_list_impl *)list;
-    struct sml_variable *var = sol_ptr_vector_steal(&impl->variables, index);
+    struct sml_variables_list_impl *impl = _owner(var);
+    uint16_t i = _idx(var);
+    double delta, value, m = 0.0, m2 = 0.0;
+    unsigned int row;
 
-    if (!var) {
-        sml_critical("Could not remove the index %d", index);
+    if (!observations || observations > impl->observations_size)
         return false;
+
+    if (impl->stats_valid && observations == impl->observations_idx) {
+        m = impl->mean[i];
+        m2 = impl->m2[i];
+    } else {
+        for (row = 0; row < observations; row++) {
+            value = _stats_value(impl, i, _row(impl, row)[i]);
+            delta = value - m;
+            m += delta / (row + 1);
+            m2 += delta * (value - m);
+        }
     }
-    sml_ann_variable_free(var);
+
+    *mean = m;
+    *sd = sqrt(m2 / observations);
     return true;
 }
 
+float
+sml_ann_variable_get_last_stable_value(struct sml_variable *var)
+{
+    return _owner(var)->stable[_idx(var)];
+}
+
+void
+sml_ann_variable_set_last_stable_value(struct sml_variable *var, float value)
+{
+    _owner(var)->stable[_idx(var)] = value;
+}
+
 float
 sml_ann_variable_get_previous_value(struct sml_variable *var)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    return _owner(var)->previous[_idx(var)];
+}
+
+float
+sml_ann_variable_scale_value(struct sml_variable *var, float value)
+{
+    return _scale(_owner(var), _idx(var), value);
+}
+
+float
+sml_ann_variable_descale_value(struct sml_variable *var, float value)
+{
+    struct sml_variables_list_impl *impl = _owner(var);
 
-    return impl->previous_value;
+    return _descale_with_range(impl->min[_idx(var)], impl->max[_idx(var)],
+        value);
 }
 
 bool
@@ -323,20 +1152,19 @@ sml_ann_variable_is_input(struct sml_variable *var)
 float
 sml_ann_variable_get_value(struct sml_variable *var)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
-
     ON_NULL_RETURN_VAL(var, NAN);
-    return impl->current_value;
+    return _owner(var)->current[_idx(var)];
 }
 
 bool
 sml_ann_variable_set_value(struct sml_variable *var, float value)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl;
 
     ON_NULL_RETURN_VAL(var, false);
-    impl->previous_value = impl->current_value;
-    impl->current_value  = value;
+    impl = _owner(var);
+    impl->previous[_idx(var)] = impl->current[_idx(var)];
+    impl->current[_idx(var)] = value;
     return true;
 }
 
@@ -358,7 +1186,7 @@ sml_ann_variables_list_get_length(struct sml_variables_list *list)
         (struct sml_variables_list_impl *)list;
 
     ON_NULL_RETURN_VAL(list, 0);
-    return sol_ptr_vector_get_len(&impl->variables);
+    return _len(impl);
 }
 
 int
@@ -390,24 +1218,59 @@ bool
 sml_ann_variable_set_range(struct sml_engine *engine, struct sml_variable *var,
     float min, float max)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl;
+    uint16_t i, len;
+    unsigned int row;
+    float *value;
 
     ON_NULL_RETURN_VAL(var, false);
-    impl->min_value = min;
-    impl->max_value = max;
+    impl = _owner(var);
+    i = _idx(var);
+    len = _len(impl);
+
+    /* Bring the recorded observations to the new scale */
+    for (row = 0; impl->observations && row < impl->observations_size;
+        row++) {
+        value = impl->observations + row * len + i;
+        if (impl->scaled[i])
+            *value = _descale_with_range(impl->min[i], impl->max[i], *value);
+        if (_range_is_usable(min, max))
+            *value = isnan(*value) ? -1.0 :
+                _scale_with_range(min, max, *value);
+    }
+
+    impl->min[i] = min;
+    impl->max[i] = max;
+    impl->scaled[i] = _range_is_usable(min, max);
+    if (impl->observations_idx)
+        impl->stats_valid = false;
     return true;
 }
 
 bool
-sml_ann_variable_get_range(struct sml_variable *var, float *min, float *max)
+sml_ann_variable_range_widens(struct sml_variable *var, float min, float max)
 {
-    struct sml_variable_impl *impl = (struct sml_variable_impl *)var;
+    struct sml_variables_list_impl *impl;
+    uint16_t i;
+
+    ON_NULL_RETURN_VAL(var, false);
+    impl = _owner(var);
+    i = _idx(var);
+
+    if (!impl->observations_idx || !impl->scaled[i])
+        return false;
+    return !_range_is_usable(min, max) || min < impl->min[i] ||
+           max > impl->max[i];
+}
 
+bool
+sml_ann_variable_get_range(struct sml_variable *var, float *min, float *max)
+{
     ON_NULL_RETURN_VAL(var, false);
     if (min)
-        *min = impl->min_value;
+        *min = _owner(var)->min[_idx(var)];
     if (max)
-        *max = impl->max_value;
+        *max = _owner(var)->max[_idx(var)];
     return true;
 }
 
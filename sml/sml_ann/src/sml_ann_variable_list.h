@@ -27,45 +27,61 @@ struct sml_engine;
 #ifdef __cplusplus
 extern "C" {
 #endif
-int sml_ann_variable_list_add_variable(struct sml_variables_list *list, struct sml_variable *var);
-float sml_ann_variable_get_value_by_index(struct sml_variable *var, unsigned int index);
-
-struct sml_variable *sml_ann_variable_new(const char *name, bool input);
-void sml_ann_variable_set_observations_array_index(struct sml_variable *var, unsigned int idx);
-bool sml_ann_variable_is_input(struct sml_variable *var);
-void sml_ann_variable_free(struct sml_variable *var);
 struct sml_variables_list *sml_ann_variable_list_new();
-void sml_ann_variable_list_free(struct sml_variables_list *list, bool free_var);
+struct sml_variables_list *sml_ann_variable_list_new_view();
+void sml_ann_variable_list_free(struct sml_variables_list *list);
+struct sml_variables_list *sml_ann_variable_list_dup(struct sml_variables_list *list, unsigned int observations);
+struct sml_variable *sml_ann_variables_list_new_variable(struct sml_variables_list *list, const char *name, bool input);
+int sml_ann_variables_list_move_variable(struct sml_variables_list *list, struct sml_variable *var);
+int sml_ann_variable_list_add_variable(struct sml_variables_list *list, struct sml_variable *var);
 bool sml_ann_variable_list_remove(struct sml_variables_list *list, uint16_t index);
 
-unsigned int sml_ann_variable_get_observations_length(struct sml_variable *var);
+bool sml_ann_variable_is_input(struct sml_variable *var);
+float sml_ann_variable_get_value_by_index(struct sml_variable *var, unsigned int index);
+void sml_ann_variable_set_value_by_index(struct sml_variable *var, float value, unsigned int index);
 
 float sml_ann_variable_scale_value(struct sml_variable *var, float value);
 float sml_ann_variable_descale_value(struct sml_variable *var, float value);
 
-int sml_ann_variable_realloc_observation_array(struct sml_variable *var, unsigned int size);
 float sml_ann_variable_get_previous_value(struct sml_variable *var);
-
+bool sml_ann_variable_get_observations_stats(struct sml_variable *var, unsigned int observations, float *mean, float *sd);
 float sml_ann_variable_get_last_stable_value(struct sml_variable *var);
 void sml_ann_variable_set_last_stable_value(struct sml_variable *var, float value);
 
 float sml_ann_variable_get_value(struct sml_variable *var);
 bool sml_ann_variable_set_value(struct sml_variable *var, float value);
-void sml_ann_variable_set_value_by_index(struct sml_variable *var, float value, unsigned int idx);
 
 struct sml_variable *sml_ann_variables_list_index(struct sml_variables_list *list, unsigned int index);
 uint16_t sml_ann_variables_list_get_length(struct sml_variables_list *list);
 int sml_ann_variable_get_name(struct sml_variable *var, char *var_name, size_t var_name_size);
 bool sml_ann_variable_set_range(struct sml_engine *engine, struct sml_variable *var, float min, float max);
+bool sml_ann_variable_range_widens(struct sml_variable *var, float min, float max);
 bool sml_ann_variable_get_range(struct sml_variable *var, float *min, float *max);
 int sml_ann_variable_set_enabled(struct sml_variable *var, bool enabled);
 bool sml_ann_variable_is_enabled(struct sml_variable *var);
 
 void sml_ann_variables_list_add_last_value_to_observation(struct sml_variables_list *list);
+void sml_ann_variables_list_set_values(struct sml_variables_list *list, const float *values);
+void sml_ann_variables_list_get_values(struct sml_variables_list *list, float *values);
+int sml_ann_variables_list_bind_values(struct sml_variables_list *list, float *values);
 void sml_ann_variables_list_reset_observations(struct sml_variables_list *list, bool reset_control_variables);
 void sml_ann_variables_list_set_current_value_as_stable(struct sml_variables_list *list);
-int sml_ann_variables_list_realloc_observations_array(struct sml_variables_list *list, unsigned int size);
-void sml_ann_variable_fill_with_random_values(struct sml_variable *var, unsigned int total);
+bool sml_ann_variables_list_has_changes_since_stable(struct sml_variables_list *list, float threshold);
+int sml_ann_variables_list_reserve_observations(struct sml_variables_list *list, unsigned int size);
+unsigned int sml_ann_variables_list_get_observations_capacity(struct sml_variables_list *list);
+unsigned int sml_ann_variables_list_get_observations_length(struct sml_variables_list *list);
+void sml_ann_variables_list_set_observations_length(struct sml_variables_list *list, unsigned int length);
+void sml_ann_variables_list_keep_last_observations(struct sml_variables_list *list, unsigned int length);
+void sml_ann_variables_list_fill_with_random_values(struct sml_variables_list *list, unsigned int total);
+const float *sml_ann_variables_list_get_observation_row(struct sml_variables_list *list, unsigned int row);
+bool sml_ann_variables_list_observations_are_scaled(struct sml_variables_list *list);
+void sml_ann_variables_list_fill_scaled_row(struct sml_variables_list *list, unsigned int row, float *dst);
+void sml_ann_variables_list_get_scaled_values(struct sml_variables_list *list, float *dst);
+void sml_ann_variables_list_set_scaled_values(struct sml_variables_list *list, const float *src);
+void sml_ann_variables_list_scale_values(struct sml_variables_list *list, const float *src, float *dst);
+void sml_ann_variables_list_descale_values(struct sml_variables_list *list, const float *src, float *dst);
+void sml_ann_variables_list_get_scaled_row(struct sml_variables_list *list, unsigned int row, float *dst);
+void sml_ann_variables_list_set_scaled_row(struct sml_variables_list *list, unsigned int row, const float *src);
 
 #ifdef __cplusplus
 }
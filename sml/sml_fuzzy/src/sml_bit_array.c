@@ -23,19 +23,23 @@
 #include "sml_bit_array.h"
 #include "sml.h"
 
-//Change this constants to change the size of the bit array element.
-#define BITS 1
-#define ITEMS_IN_BYTE 8 //(8/BITS)
-#define MASK 1 //(11b)
+#define WORD_BITS 64
+#define ALL_ONES UINT64_MAX
 
-static uint16_t
-_calc_data_size(uint16_t size)
+static inline uint16_t
+_calc_words(uint16_t size)
 {
-    uint16_t input_data_size = size / ITEMS_IN_BYTE;
+    return (size + WORD_BITS - 1) / WORD_BITS;
+}
 
-    if (size % ITEMS_IN_BYTE)
-        input_data_size++;
-    return input_data_size;
+//Bits after size in the last word are always kept unset, so words can be
+//compared and counted directly.
+static inline uint64_t
+_last_word_mask(uint16_t size)
+{
+    if (!(size % WORD_BITS))
+        return ALL_ONES;
+    return (UINT64_C(1) << (size % WORD_BITS)) - 1;
 }
 
 void
@@ -48,17 +52,16 @@ sml_bit_array_init(struct sml_bit_array *array)
 bool
 sml_bit_array_set(struct sml_bit_array *array, uint16_t pos, uint8_t value)
 {
-    uint16_t real_pos;
-    uint8_t mask, shift;
+    uint64_t mask;
 
-    real_pos = pos / ITEMS_IN_BYTE;
-    if (real_pos >= array->size)
+    if (pos >= array->size)
         return false;
 
-    shift = (pos % ITEMS_IN_BYTE) * BITS;
-    mask = MASK << shift;
-    value = value << shift;
-    array->data[real_pos] = (array->data[real_pos] & ~mask) | value;
+    mask = UINT64_C(1) << (pos % WORD_BITS);
+    if (value)
+        array->data[pos / WORD_BITS] |= mask;
+    else
+        array->data[pos / WORD_BITS] &= ~mask;
 
     return true;
 }
@@ -66,17 +69,10 @@ sml_bit_array_set(struct sml_bit_array *array, uint16_t pos, uint8_t value)
 uint8_t
 sml_bit_array_get(struct sml_bit_array *array, uint16_t pos)
 {
-    uint16_t real_pos;
-    uint8_t input_terms_membership, shift;
-
     if (pos >= array->size)
         return 0;
 
-    real_pos = pos / ITEMS_IN_BYTE;
-    shift = (pos % ITEMS_IN_BYTE) * BITS;
-    input_terms_membership = array->data[real_pos];
-    input_terms_membership = input_terms_membership & (MASK << shift);
-    return input_terms_membership >> shift;
+    return (array->data[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
 }
 
 void
@@ -91,27 +87,33 @@ int
 sml_bit_array_size_set(struct sml_bit_array *array, uint16_t new_size,
     uint8_t initial_value)
 {
-    uint8_t *tmp_output;
-    uint16_t new_real_size, old_size;
+    uint64_t *tmp_output;
+    uint16_t old_words, new_words, old_size;
 
     if (new_size == 0) {
         sml_bit_array_clear(array);
         return 0;
     }
 
-    new_real_size = _calc_data_size(new_size);
-    tmp_output = realloc(array->data, new_real_size);
-    if (tmp_output == NULL)
-        return -errno;
-    array->data = tmp_output;
     old_size = array->size;
+    old_words = _calc_words(old_size);
+    new_words = _calc_words(new_size);
+    if (old_words != new_words) {
+        tmp_output = realloc(array->data, new_words * sizeof(uint64_t));
+        if (tmp_output == NULL)
+            return -errno;
+        array->data = tmp_output;
+    }
     array->size = new_size;
 
     if (new_size > old_size) {
-        uint16_t i;
-        for (i = old_size; i < new_size; i++)
-            sml_bit_array_set(array, i, initial_value);
+        if (old_words && initial_value)
+            array->data[old_words - 1] |= ~_last_word_mask(old_size);
+        if (new_words > old_words)
+            memset(array->data + old_words, initial_value ? 0xff : 0,
+                (new_words - old_words) * sizeof(uint64_t));
     }
+    array->data[new_words - 1] &= _last_word_mask(new_size);
 
     return 0;
 }
@@ -125,18 +127,167 @@ sml_bit_array_size_get(struct sml_bit_array *array)
 unsigned int
 sml_bit_array_byte_size_get(struct sml_bit_array *array)
 {
-    return _calc_data_size(array->size);
+    return _calc_words(array->size) * sizeof(uint64_t);
 }
 
 int
 sml_bit_array_remove(struct sml_bit_array *array, uint16_t pos)
 {
-    uint16_t i;
+    uint16_t i, word, words;
+    uint64_t low_mask;
 
     if (pos >= array->size)
         return -EINVAL;
-    for (i = pos; i < array->size - 1; i++)
-        sml_bit_array_set(array, i, sml_bit_array_get(array, i + 1));
+
+    word = pos / WORD_BITS;
+    words = _calc_words(array->size);
+    low_mask = (UINT64_C(1) << (pos % WORD_BITS)) - 1;
+
+    //Bits before pos are kept, the remaining ones are shifted one position
+    array->data[word] = (array->data[word] & low_mask) |
+        ((array->data[word] >> 1) & ~low_mask);
+    for (i = word + 1; i < words; i++) {
+        array->data[i - 1] |= array->data[i] << (WORD_BITS - 1);
+        array->data[i] >>= 1;
+    }
 
     return sml_bit_array_size_set(array, array->size - 1, 0);
 }
+
+void
+sml_bit_array_and(struct sml_bit_array *dst, struct sml_bit_array *src)
+{
+    uint16_t i, words, src_words;
+
+    words = _calc_words(dst->size);
+    src_words = _calc_words(src->size);
+    for (i = 0; i < words; i++)
+        dst->data[i] &= i < src_words ? src->data[i] : 0;
+}
+
+void
+sml_bit_array_and_not(struct sml_bit_array *dst, struct sml_bit_array *src)
+{
+    uint16_t i, words;
+
+    words = _calc_words(dst->size);
+    if (words > _calc_words(src->size))
+        words = _calc_words(src->size);
+    for (i = 0; i < words; i++)
+        dst->data[i] &= ~src->data[i];
+}
+
+void
+sml_bit_array_or(struct sml_bit_array *dst, struct sml_bit_array *src)
+{
+    uint16_t i, words;
+
+    words = _calc_words(dst->size);
+    if (words > _calc_words(src->size))
+        words = _calc_words(src->size);
+    for (i = 0; i < words; i++)
+        dst->data[i] |= src->data[i];
+    if (words)
+        dst->data[words - 1] &= _last_word_mask(dst->size);
+}
+
+void
+sml_bit_array_xor(struct sml_bit_array *dst, struct sml_bit_array *src)
+{
+    uint16_t i, words;
+
+    words = _calc_words(dst->size);
+    if (words > _calc_words(src->size))
+        words = _calc_words(src->size);
+    for (i = 0; i < words; i++)
+        dst->data[i] ^= src->data[i];
+    if (words)
+        dst->data[words - 1] &= _last_word_mask(dst->size);
+}
+
+bool
+sml_bit_array_equals(struct sml_bit_array *array1,
+    struct sml_bit_array *array2, struct sml_bit_array *mask)
+{
+    uint16_t i, words, words1, words2, mask_words;
+    uint64_t word1, word2;
+
+    words1 = _calc_words(array1->size);
+    words2 = _calc_words(array2->size);
+    mask_words = mask ? _calc_words(mask->size) : UINT16_MAX;
+    words = words1 > words2 ? words1 : words2;
+    if (words > mask_words)
+        words = mask_words;
+
+    for (i = 0; i < words; i++) {
+        word1 = i < words1 ? array1->data[i] : 0;
+        word2 = i < words2 ? array2->data[i] : 0;
+        if (mask)
+            word1 = (word1 ^ word2) & mask->data[i];
+        else
+            word1 ^= word2;
+        if (word1)
+            return false;
+    }
+
+    return true;
+}
+
+uint16_t
+sml_bit_array_popcount(struct sml_bit_array *array)
+{
+    uint16_t i, words, count = 0;
+
+    words = _calc_words(array->size);
+    for (i = 0; i < words; i++)
+        count += __builtin_popcountll(array->data[i]);
+    return count;
+}
+
+static int32_t
+_find_first(struct sml_bit_array *array1, struct sml_bit_array *array2,
+    uint16_t from, uint16_t to)
+{
+    uint16_t i, last, size, words1, words2;
+    uint64_t word;
+
+    size = array1->size;
+    if (array2 && array2->size > size)
+        size = array2->size;
+    if (to > size)
+        to = size;
+    if (from >= to)
+        return -1;
+
+    words1 = _calc_words(array1->size);
+    words2 = array2 ? _calc_words(array2->size) : 0;
+    last = (to - 1) / WORD_BITS;
+
+    for (i = from / WORD_BITS; i <= last; i++) {
+        word = i < words1 ? array1->data[i] : 0;
+        if (array2)
+            word ^= i < words2 ? array2->data[i] : 0;
+        if (i == from / WORD_BITS)
+            word &= ALL_ONES << (from % WORD_BITS);
+        if (i == last)
+            word &= _last_word_mask(to);
+        if (word)
+            return i * WORD_BITS + __builtin_ctzll(word);
+    }
+
+    return -1;
+}
+
+int32_t
+sml_bit_array_find_first_set(struct sml_bit_array *array, uint16_t from,
+    uint16_t to)
+{
+    return _find_first(array, NULL, from, to);
+}
+
+int32_t
+sml_bit_array_find_first_diff(struct sml_bit_array *array1,
+    struct sml_bit_array *array2, uint16_t from, uint16_t to)
+{
+    return _find_first(array1, array2, from, to);
+}
@@ -30,7 +30,7 @@ extern "C" {
 
 struct sml_bit_array {
     uint16_t size;
-    uint8_t *data;
+    uint64_t *data;
 };
 
 bool sml_bit_array_set(struct sml_bit_array *array, uint16_t pos, uint8_t value);
@@ -41,6 +41,14 @@ uint16_t sml_bit_array_size_get(struct sml_bit_array *array);
 void sml_bit_array_init(struct sml_bit_array *array);
 unsigned int sml_bit_array_byte_size_get(struct sml_bit_array *array);
 int sml_bit_array_remove(struct sml_bit_array *array, uint16_t pos);
+void sml_bit_array_and(struct sml_bit_array *dst, struct sml_bit_array *src);
+void sml_bit_array_and_not(struct sml_bit_array *dst, struct sml_bit_array *src);
+void sml_bit_array_or(struct sml_bit_array *dst, struct sml_bit_array *src);
+void sml_bit_array_xor(struct sml_bit_array *dst, struct sml_bit_array *src);
+bool sml_bit_array_equals(struct sml_bit_array *array1, struct sml_bit_array *array2, struct sml_bit_array *mask);
+uint16_t sml_bit_array_popcount(struct sml_bit_array *array);
+int32_t sml_bit_array_find_first_set(struct sml_bit_array *array, uint16_t from, uint16_t to);
+int32_t sml_bit_array_find_first_diff(struct sml_bit_array *array1, struct sml_bit_array *array2, uint16_t from, uint16_t to);
 
 #ifdef __cplusplus
 }
@@ -347,6 +347,7 @@ _pre_process(struct sml_fuzzy_engine *fuzzy_engine, bool *should_act,
 {
     struct sml_measure *new_measure;
     bool input_changed;
+    uint64_t start;
     int error;
 
     if ((error = _fuzzy_initialize_terms(fuzzy_engine))) {
@@ -358,7 +359,10 @@ _pre_process(struct sml_fuzzy_engine *fuzzy_engine, bool *should_act,
         !fuzzy_engine->fuzzy->output_terms_count)
         return 0;
 
+    start = sml_stats_timer_start(&fuzzy_engine->engine);
     new_measure = sml_fuzzy_get_membership_values(fuzzy_engine->fuzzy);
+    sml_stats_timer_stop(&fuzzy_engine->engine, SML_STATS_TIMER_MEMBERSHIP,
+        start);
     if (!new_measure)
         return -ENOMEM;
 
@@ -405,6 +409,7 @@ _act(struct sml_fuzzy_engine *fuzzy_engine, bool *should_learn)
     struct sml_matrix output_membership;
     struct sol_vector changed_idx = SOL_VECTOR_INIT(uint16_t);
     struct sml_variables_list *changed;
+    uint64_t start;
     int error;
 
 #ifdef Debug
@@ -412,7 +417,11 @@ _act(struct sml_fuzzy_engine *fuzzy_engine, bool *should_learn)
 #endif
 
     //predict outputs
-    if ((error = sml_fuzzy_process_output(fuzzy_engine->fuzzy)))
+    start = sml_stats_timer_start(&fuzzy_engine->engine);
+    error = sml_fuzzy_process_output(fuzzy_engine->fuzzy);
+    sml_stats_timer_stop(&fuzzy_engine->engine, SML_STATS_TIMER_PREDICT,
+        start);
+    if (error)
         return error;
 
 #ifdef Debug
@@ -630,10 +639,8 @@ _initialize_terms_list(struct sml_fuzzy *fuzzy, struct sml_variables_list *list)
 }
 
 static int
-_sml_process(struct sml_engine *engine)
+_prepare_process(struct sml_fuzzy_engine *fuzzy_engine)
 {
-    struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
-    bool should_learn = false, should_act = false;
     int error;
 
     if (!sml_observation_controller_update_cache_size(
@@ -664,10 +671,15 @@ _sml_process(struct sml_engine *engine)
         }
     }
 
-    if ((error = sml_call_read_state_cb(&fuzzy_engine->engine))) {
-        sml_error("Failed to read variables.");
-        return error;
-    }
+    return 0;
+}
+
+static int
+_process_observation(struct sml_fuzzy_engine *fuzzy_engine)
+{
+    bool should_learn = false, should_act = false;
+    uint64_t start;
+    int error;
 
     if ((error = _pre_process(fuzzy_engine, &should_act, &should_learn))) {
         sml_error("Failed to pre process.");
@@ -679,12 +691,17 @@ _sml_process(struct sml_engine *engine)
         return error;
     }
 
-    if (should_learn && !fuzzy_engine->engine.learn_disabled &&
-        (error = sml_observation_controller_observation_hit(
+    if (should_learn && !fuzzy_engine->engine.learn_disabled) {
+        start = sml_stats_timer_start(&fuzzy_engine->engine);
+        error = sml_observation_controller_observation_hit(
             fuzzy_engine->observation_controller,
-            fuzzy_engine->last_stable_measure))) {
-        sml_error("Failed to log observation.");
-        return error;
+            fuzzy_engine->last_stable_measure);
+        sml_stats_timer_stop(&fuzzy_engine->engine,
+            SML_STATS_TIMER_OBSERVATION_HIT, start);
+        if (error) {
+            sml_error("Failed to log observation.");
+            return error;
+        }
     }
 
     if (fuzzy_engine->variable_terms_auto_balance &&
@@ -699,16 +716,88 @@ _sml_process(struct sml_engine *engine)
     return 0;
 }
 
+static int
+_sml_process(struct sml_engine *engine)
+{
+    struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
+    int error;
+
+    if ((error = _prepare_process(fuzzy_engine)))
+        return error;
+
+    if ((error = sml_call_read_state_cb(&fuzzy_engine->engine))) {
+        sml_error("Failed to read variables.");
+        return error;
+    }
+
+    return _process_observation(fuzzy_engine);
+}
+
+static int
+_sml_process_batch(struct sml_engine *engine, const float *inputs,
+    const float *outputs, size_t rows, size_t stride)
+{
+    struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
+    size_t row, in_stride, out_stride;
+    uint16_t in_len, out_len;
+    int error;
+
+    /* Variables removed before the call are not part of the rows */
+    if ((error = _prepare_process(fuzzy_engine)))
+        return error;
+
+    in_len = sml_fuzzy_variables_list_get_length(
+        fuzzy_engine->fuzzy->input_list);
+    out_len = sml_fuzzy_variables_list_get_length(
+        fuzzy_engine->fuzzy->output_list);
+    if (stride && (stride < in_len || (outputs && stride < out_len))) {
+        sml_warning("Invalid stride %zu. Inputs: %d Outputs: %d", stride,
+            in_len, out_len);
+        return -EINVAL;
+    }
+    in_stride = stride ? stride : in_len;
+    out_stride = stride ? stride : out_len;
+
+    for (row = 0; row < rows; row++) {
+        if (row && (error = _prepare_process(fuzzy_engine)))
+            return error;
+
+        if (sml_fuzzy_variables_list_get_length(
+            fuzzy_engine->fuzzy->input_list) != in_len ||
+            (outputs && sml_fuzzy_variables_list_get_length(
+            fuzzy_engine->fuzzy->output_list) != out_len)) {
+            sml_warning("Variables changed while processing a batch");
+            return -EINVAL;
+        }
+
+        sml_fuzzy_inputs_set_values(fuzzy_engine->fuzzy,
+            inputs + row * in_stride);
+        if (outputs)
+            sml_fuzzy_outputs_set_values(fuzzy_engine->fuzzy,
+                outputs + row * out_stride);
+
+        if ((error = _process_observation(fuzzy_engine)))
+            return error;
+    }
+
+    return 0;
+}
+
 static bool
 _sml_predict(struct sml_engine *engine)
 {
     struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
+    uint64_t start;
+    int error;
 
     if (!fuzzy_engine->fuzzy->input_terms_count ||
         !fuzzy_engine->fuzzy->output_terms_count)
         return false;
 
-    return sml_fuzzy_process_output(fuzzy_engine->fuzzy) == 0;
+    start = sml_stats_timer_start(engine);
+    error = sml_fuzzy_process_output(fuzzy_engine->fuzzy);
+    sml_stats_timer_stop(engine, SML_STATS_TIMER_PREDICT, start);
+    return error == 0;
 }
 
 static bool
@@ -758,6 +847,16 @@ _sml_load(struct sml_engine *engine, const char *path)
         fuzzy_engine->observation_controller, path);
 }
 
+static void
+_sml_get_stats(struct sml_engine *engine, struct sml_stats *stats)
+{
+    struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
+
+    stats->rules = sml_fuzzy_get_rules_count(fuzzy_engine->fuzzy);
+    sml_observation_controller_fill_stats(
+        fuzzy_engine->observation_controller, stats);
+}
+
 static void
 _sml_free(struct sml_engine *engine)
 {
@@ -843,6 +942,46 @@ _sml_get_output_list(struct sml_engine *engine)
     return (struct sml_variables_list *)fuzzy_engine->fuzzy->output_list;
 }
 
+static int
+_sml_variables_list_set_values(struct sml_engine *engine,
+    struct sml_variables_list *list, const float *values)
+{
+    struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
+    uint16_t i, len;
+
+    if (list == fuzzy_engine->fuzzy->input_list)
+        sml_fuzzy_inputs_set_values(fuzzy_engine->fuzzy, values);
+    else if (list == fuzzy_engine->fuzzy->output_list)
+        sml_fuzzy_outputs_set_values(fuzzy_engine->fuzzy, values);
+    else {
+        len = sml_fuzzy_variables_list_get_length(list);
+        for (i = 0; i < len; i++)
+            sml_fuzzy_variable_set_value(
+                sml_fuzzy_variables_list_index(list, i), values[i]);
+    }
+    return 0;
+}
+
+static int
+_sml_variables_list_get_values(struct sml_engine *engine,
+    struct sml_variables_list *list, float *values)
+{
+    struct sml_fuzzy_engine *fuzzy_engine = (struct sml_fuzzy_engine *)engine;
+    uint16_t i, len;
+
+    if (list == fuzzy_engine->fuzzy->input_list)
+        sml_fuzzy_inputs_get_values(fuzzy_engine->fuzzy, values);
+    else if (list == fuzzy_engine->fuzzy->output_list)
+        sml_fuzzy_outputs_get_values(fuzzy_engine->fuzzy, values);
+    else {
+        len = sml_fuzzy_variables_list_get_length(list);
+        for (i = 0; i < len; i++)
+            values[i] = sml_fuzzy_variable_get_value(
+                sml_fuzzy_variables_list_index(list, i));
+    }
+    return 0;
+}
+
 static bool
 _sml_remove_variable(struct sml_engine *engine, struct sml_variable *variable)
 {
@@ -1182,7 +1321,8 @@ sml_fuzzy_new(void)
         goto error_fuzzy;
 
     fuzzy_engine->observation_controller =
-        sml_observation_controller_new(fuzzy_engine->fuzzy);
+        sml_observation_controller_new(&fuzzy_engine->engine,
+        fuzzy_engine->fuzzy);
     if (!fuzzy_engine->observation_controller)
         goto error_observation_controller;
 
@@ -1196,6 +1336,7 @@ sml_fuzzy_new(void)
     fuzzy_engine->engine.load_file = _sml_load_fll_file;
     fuzzy_engine->engine.free = _sml_free;
     fuzzy_engine->engine.process = _sml_process;
+    fuzzy_engine->engine.process_batch = _sml_process_batch;
     fuzzy_engine->engine.predict = _sml_predict;
     fuzzy_engine->engine.save = _sml_save;
     fuzzy_engine->engine.load = _sml_load;
@@ -1214,9 +1355,14 @@ sml_fuzzy_new(void)
     fuzzy_engine->engine.variables_list_get_length =
         sml_fuzzy_variables_list_get_length;
     fuzzy_engine->engine.variables_list_index = _fuzzy_variables_list_index;
+    fuzzy_engine->engine.variables_list_set_values =
+        _sml_variables_list_set_values;
+    fuzzy_engine->engine.variables_list_get_values =
+        _sml_variables_list_get_values;
     fuzzy_engine->engine.variable_set_range = _fuzzy_variable_set_range;
     fuzzy_engine->engine.variable_get_range = sml_fuzzy_variable_get_range;
     fuzzy_engine->engine.print_debug = _sml_print_debug;
+    fuzzy_engine->engine.get_stats = _sml_get_stats;
     fuzzy_engine->engine.erase_knowledge = _sml_fuzzy_erase_knowledge;
     fuzzy_engine->engine.magic_number = FUZZY_MAGIC;
 
@@ -579,6 +579,52 @@ sml_fuzzy_variable_set_value(struct sml_variable *variable, float value)
     sml_warning("Trying to use unknown class of variable");
 }
 
+void
+sml_fuzzy_inputs_set_values(struct sml_fuzzy *fuzzy, const float *values)
+{
+    fl::Engine *engine = (fl::Engine*)fuzzy->engine;
+    int i, len = engine->numberOfInputVariables();
+
+    for (i = 0; i < len; i++)
+        engine->getInputVariable(i)->setInputValue(values[i]);
+}
+
+void
+sml_fuzzy_outputs_set_values(struct sml_fuzzy *fuzzy, const float *values)
+{
+    fl::Engine *engine = (fl::Engine*)fuzzy->engine;
+    int i, len = engine->numberOfOutputVariables();
+
+    for (i = 0; i < len; i++)
+        engine->getOutputVariable(i)->setOutputValue(values[i]);
+}
+
+void
+sml_fuzzy_inputs_get_values(struct sml_fuzzy *fuzzy, float *values)
+{
+    fl::Engine *engine = (fl::Engine*)fuzzy->engine;
+    int i, len = engine->numberOfInputVariables();
+    fl::InputVariable *var;
+
+    for (i = 0; i < len; i++) {
+        var = engine->getInputVariable(i);
+        values[i] = _var_get_val_in_range(var, var->getInputValue());
+    }
+}
+
+void
+sml_fuzzy_outputs_get_values(struct sml_fuzzy *fuzzy, float *values)
+{
+    fl::Engine *engine = (fl::Engine*)fuzzy->engine;
+    int i, len = engine->numberOfOutputVariables();
+    fl::OutputVariable *var;
+
+    for (i = 0; i < len; i++) {
+        var = engine->getOutputVariable(i);
+        values[i] = _var_get_val_in_range(var, var->getOutputValue());
+    }
+}
+
 struct sml_variable *
 sml_fuzzy_new_input(struct sml_fuzzy *fuzzy, const char *name)
 {
@@ -1091,6 +1137,17 @@ sml_fuzzy_is_rule_block_empty(struct sml_fuzzy *fuzzy)
     return engine->getRuleBlock(0)->numberOfRules() == 0;
 }
 
+uint32_t
+sml_fuzzy_get_rules_count(struct sml_fuzzy *fuzzy)
+{
+    fl::Engine *engine = (fl::Engine*)fuzzy->engine;
+
+    if (engine->numberOfRuleBlocks() == 0)
+        return 0;
+
+    return engine->getRuleBlock(0)->numberOfRules();
+}
+
 struct sml_fuzzy_rule *
 sml_fuzzy_rule_add(struct sml_fuzzy *fuzzy, const char *rule)
 {
@@ -1109,6 +1166,92 @@ sml_fuzzy_rule_add(struct sml_fuzzy *fuzzy, const char *rule)
     return (struct sml_fuzzy_rule *) rule_obj;
 }
 
+//fuzzylite only builds antecedents and consequents by parsing the rule text.
+//These classes allow the expression trees to be set directly.
+class SmlAntecedent : public fl::Antecedent {
+public:
+    void setExpression(fl::Expression *expression) {
+        unload();
+        _expression = expression;
+    }
+};
+
+class SmlConsequent : public fl::Consequent {
+public:
+    void addConclusion(fl::Proposition *proposition) {
+        _conclusions.push_back(proposition);
+    }
+};
+
+static fl::Proposition *
+_proposition_new(struct sml_variable *var, struct sml_fuzzy_term *term)
+{
+    fl::Proposition *proposition = new fl::Proposition();
+
+    proposition->variable = (fl::Variable *)var;
+    proposition->term = (fl::Term *)term;
+    return proposition;
+}
+
+struct sml_fuzzy_rule *
+sml_fuzzy_rule_add_terms(struct sml_fuzzy *fuzzy,
+    struct sml_variable **input_vars, struct sml_fuzzy_term **input_terms,
+    uint16_t inputs_len, struct sml_variable *output_var,
+    struct sml_fuzzy_term *output_term, float weight)
+{
+    fl::Engine *engine = (fl::Engine*)fuzzy->engine;
+    fl::RuleBlock *block = engine->getRuleBlock(0);
+    fl::Expression *expression = NULL;
+    fl::Operator *op;
+    SmlAntecedent *antecedent = NULL;
+    SmlConsequent *consequent = NULL;
+    fl::Rule *rule_obj = NULL;
+    uint16_t i;
+
+    if (!inputs_len)
+        return NULL;
+
+    try {
+        //Same left associative tree built by the parser for
+        //"if A is a and B is b and C is c"
+        for (i = 0; i < inputs_len; i++) {
+            if (!expression) {
+                expression = _proposition_new(input_vars[i], input_terms[i]);
+                continue;
+            }
+            op = new fl::Operator();
+            op->name = fl::Rule::andKeyword();
+            op->left = expression;
+            op->right = _proposition_new(input_vars[i], input_terms[i]);
+            expression = op;
+        }
+
+        antecedent = new SmlAntecedent();
+        antecedent->setExpression(expression);
+        expression = NULL;
+
+        consequent = new SmlConsequent();
+        consequent->addConclusion(_proposition_new(output_var, output_term));
+
+        rule_obj = new fl::Rule("", weight);
+        rule_obj->setAntecedent(antecedent);
+        rule_obj->setConsequent(consequent);
+        block->addRule(rule_obj);
+    } catch (std::bad_alloc &e) {
+        sml_critical("Could not alloc the rule");
+        if (rule_obj)
+            delete rule_obj;
+        else {
+            delete antecedent;
+            delete consequent;
+        }
+        delete expression;
+        return NULL;
+    }
+
+    return (struct sml_fuzzy_rule *) rule_obj;
+}
+
 bool
 sml_fuzzy_rule_free(struct sml_fuzzy *fuzzy, struct sml_fuzzy_rule *rule)
 {
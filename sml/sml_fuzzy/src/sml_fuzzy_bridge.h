@@ -64,6 +64,10 @@ struct sml_variable *sml_fuzzy_get_output(struct sml_fuzzy *fuzzy, const char *n
 int sml_fuzzy_variable_get_name(struct sml_variable *variable, char *var_name, size_t var_name_size);
 float sml_fuzzy_variable_get_value(struct sml_variable *variable);
 void sml_fuzzy_variable_set_value(struct sml_variable *variable, float value);
+void sml_fuzzy_inputs_set_values(struct sml_fuzzy *fuzzy, const float *values);
+void sml_fuzzy_outputs_set_values(struct sml_fuzzy *fuzzy, const float *values);
+void sml_fuzzy_inputs_get_values(struct sml_fuzzy *fuzzy, float *values);
+void sml_fuzzy_outputs_get_values(struct sml_fuzzy *fuzzy, float *values);
 uint16_t sml_fuzzy_variable_terms_count(struct sml_variable *variable);
 void sml_fuzzy_variable_set_enabled(struct sml_variable *variable, bool enabled);
 bool sml_fuzzy_variable_is_enabled(struct sml_variable *variable);
@@ -89,7 +93,9 @@ bool sml_fuzzy_term_set_range(struct sml_fuzzy_term *term, float min, float max)
 bool sml_fuzzy_is_input(struct sml_fuzzy *fuzzy, struct sml_variable *variable, uint16_t *index);
 bool sml_fuzzy_is_output(struct sml_fuzzy *fuzzy, struct sml_variable *variable, uint16_t *index);
 bool sml_fuzzy_is_rule_block_empty(struct sml_fuzzy *fuzzy);
+uint32_t sml_fuzzy_get_rules_count(struct sml_fuzzy *fuzzy);
 struct sml_fuzzy_rule *sml_fuzzy_rule_add(struct sml_fuzzy *fuzzy, const char *rule);
+struct sml_fuzzy_rule *sml_fuzzy_rule_add_terms(struct sml_fuzzy *fuzzy, struct sml_variable **input_vars, struct sml_fuzzy_term **input_terms, uint16_t inputs_len, struct sml_variable *output_var, struct sml_fuzzy_term *output_term, float weight);
 bool sml_fuzzy_rule_free(struct sml_fuzzy *fuzzy, struct sml_fuzzy_rule *rule);
 bool sml_fuzzy_find_variable(struct sml_variables_list *list, struct sml_variable *var, uint16_t *index);
 void sml_fuzzy_update_terms_count(struct sml_fuzzy *fuzzy);
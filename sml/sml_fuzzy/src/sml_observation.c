@@ -24,6 +24,7 @@
 #include <sml_string.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <math.h>
 #include <errno.h>
@@ -31,173 +32,351 @@
 #define RULE_WEIGHT 1
 #define WEIGHT_THRESHOLD (0.1)
 #define FLOAT_THRESHOLD (0.01)
-
+#define HASH_OFFSET_BASIS (2166136261u)
+#define HASH_PRIME (16777619u)
+
+//All data of an observation is kept in a single block:
+//  uint16_t input_offsets[inputs_len + 1]
+//  uint16_t output_offsets[outputs_len + 1]
+//  padding up to a multiple of 8 bytes
+//  uint64_t input_bits[] - one bit per input term, all inputs packed together
+//  uint8_t output_weights[] - one byte per output term
+//Offsets are the index of the first term of each variable in input_bits and
+//output_weights. The last offset is the total number of terms.
+//Input bits are stored in words so they can be handled as a sml_bit_array.
 struct sml_observation {
-    //Replace this structure with a struct sml_matrix
-    struct sol_vector output_weights;
-    struct sol_vector input_membership;
+    uint16_t inputs_len;
+    uint16_t outputs_len;
+    uint8_t *data;
 };
 
+static inline size_t
+_offsets_size(uint16_t inputs_len, uint16_t outputs_len)
+{
+    size_t size = (inputs_len + outputs_len + 2) * sizeof(uint16_t);
+
+    return (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+static inline uint16_t *
+_input_offsets(struct sml_observation *obs)
+{
+    return (uint16_t *)obs->data;
+}
+
+static inline uint16_t *
+_output_offsets(struct sml_observation *obs)
+{
+    return _input_offsets(obs) + obs->inputs_len + 1;
+}
+
+static inline uint16_t
+_input_words(struct sml_observation *obs)
+{
+    return (_input_offsets(obs)[obs->inputs_len] + 63) / 64;
+}
+
+static inline uint64_t *
+_input_bits(struct sml_observation *obs)
+{
+    return (uint64_t *)(obs->data +
+        _offsets_size(obs->inputs_len, obs->outputs_len));
+}
+
+static inline uint8_t *
+_output_weights(struct sml_observation *obs)
+{
+    return (uint8_t *)(_input_bits(obs) + _input_words(obs));
+}
+
+//The returned array does not own its data, it must not be cleared
+static inline void
+_input_bits_view(struct sml_observation *obs, struct sml_bit_array *view)
+{
+    view->size = _input_offsets(obs)[obs->inputs_len];
+    view->data = _input_bits(obs);
+}
+
+static inline bool
+_input_layout_equals(struct sml_observation *obs1,
+    struct sml_observation *obs2)
+{
+    return obs1->inputs_len == obs2->inputs_len &&
+           !memcmp(_input_offsets(obs1), _input_offsets(obs2),
+               (obs1->inputs_len + 1) * sizeof(uint16_t));
+}
+
+static inline uint16_t
+_input_terms_len(struct sml_observation *obs, uint16_t input)
+{
+    uint16_t *offsets = _input_offsets(obs);
+
+    return offsets[input + 1] - offsets[input];
+}
+
+static inline uint16_t
+_output_terms_len(struct sml_observation *obs, uint16_t output)
+{
+    uint16_t *offsets = _output_offsets(obs);
+
+    return offsets[output + 1] - offsets[output];
+}
+
+static uint8_t
+_input_get(struct sml_observation *obs, uint16_t input, uint16_t term)
+{
+    struct sml_bit_array bits;
+
+    if (input >= obs->inputs_len || term >= _input_terms_len(obs, input))
+        return 0;
+
+    _input_bits_view(obs, &bits);
+    return sml_bit_array_get(&bits, _input_offsets(obs)[input] + term);
+}
+
 static void
-_input_set(struct sml_observation *observation, uint16_t input, uint16_t term,
+_input_set(struct sml_observation *obs, uint16_t input, uint16_t term,
     uint8_t value)
 {
-    struct sml_bit_array *array;
+    struct sml_bit_array bits;
 
-    array = sol_vector_get(&observation->input_membership, input);
-    if (!array)
+    if (input >= obs->inputs_len || term >= _input_terms_len(obs, input))
         return;
 
-    sml_bit_array_set(array, term, value);
+    _input_bits_view(obs, &bits);
+    sml_bit_array_set(&bits, _input_offsets(obs)[input] + term,
+        value == SET);
 }
 
-
-static int
-_input_membership_initialize(struct sml_fuzzy *fuzzy,
-    struct sml_observation *obs)
+static uint8_t
+_output_get(struct sml_observation *obs, uint16_t output, uint16_t term)
 {
-    uint16_t len, i, terms_len;
-    struct sml_bit_array *array;
-    struct sml_variable *var;
-    int error;
+    if (output >= obs->outputs_len || term >= _output_terms_len(obs, output))
+        return 0;
 
-    len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
-    for (i = 0; i < len; i++) {
-        if (i >= obs->input_membership.len) {
-            array = sol_vector_append(&obs->input_membership);
-            if (!array)
-                return -ENOMEM;
-            sml_bit_array_init(array);
-        } else
-            array = sol_vector_get(&obs->input_membership, i);
+    return _output_weights(obs)[_output_offsets(obs)[output] + term];
+}
 
-        var = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
-        terms_len = sml_fuzzy_variable_terms_count(var);
-        error = sml_bit_array_size_set(array, terms_len, 0);
-        if (error != 0)
-            return error;
-    }
+static void
+_output_set(struct sml_observation *obs, uint16_t output, uint16_t term,
+    uint8_t data)
+{
+    if (output >= obs->outputs_len || term >= _output_terms_len(obs, output))
+        return;
 
-    return 0;
+    _output_weights(obs)[_output_offsets(obs)[output] + term] = data;
 }
 
+//Allocates a zeroed data block for the given number of terms of each
+//variable. Observation is only changed on success.
 static int
-_output_weights_initialize(struct sml_fuzzy *fuzzy, struct sml_observation *obs)
+_data_alloc(struct sml_observation *obs, uint16_t inputs_len,
+    const uint16_t *input_terms, uint16_t outputs_len,
+    const uint16_t *output_terms)
 {
-    uint16_t len, i, j, terms_len;
-    uint8_t *val;
-    struct sol_vector *vector;
-    struct sml_variable *var;
+    uint32_t input_total = 0, output_total = 0;
+    uint16_t *offsets, i;
+    size_t size;
+    uint8_t *data;
+
+    for (i = 0; i < inputs_len; i++)
+        input_total += input_terms[i];
+    for (i = 0; i < outputs_len; i++)
+        output_total += output_terms[i];
+    if (input_total > UINT16_MAX || output_total > UINT16_MAX)
+        return -EINVAL;
 
-    len = sml_fuzzy_variables_list_get_length(fuzzy->output_list);
-    for (i = 0; i < len; i++) {
-        if (i >= obs->output_weights.len) {
-            vector = sol_vector_append(&obs->output_weights);
-            if (!vector)
-                return -ENOMEM;
-            sol_vector_init(vector, sizeof(uint8_t));
-        } else
-            vector = sol_vector_get(&obs->output_weights, i);
-
-        var = sml_fuzzy_variables_list_index(fuzzy->output_list, i);
-        terms_len = sml_fuzzy_variable_terms_count(var);
-        for (j = vector->len; j < terms_len; j++) {
-            val = sol_vector_append(vector);
-            *val = 0;
-        }
-    }
+    size = _offsets_size(inputs_len, outputs_len) +
+        (input_total + 63) / 64 * sizeof(uint64_t) + output_total;
+    data = calloc(1, size);
+    if (!data)
+        return -ENOMEM;
+
+    offsets = (uint16_t *)data;
+    for (i = 0; i < inputs_len; i++)
+        offsets[i + 1] = offsets[i] + input_terms[i];
+    offsets += inputs_len + 1;
+    for (i = 0; i < outputs_len; i++)
+        offsets[i + 1] = offsets[i] + output_terms[i];
+
+    obs->inputs_len = inputs_len;
+    obs->outputs_len = outputs_len;
+    obs->data = data;
     return 0;
 }
 
+//Copies terms of a variable from src to dst. If skip_term is a valid term,
+//it is not copied and the following terms are shifted.
 static void
-_input_membership_free(struct sml_observation *observation)
+_var_copy(struct sml_observation *dst, uint16_t dst_var,
+    struct sml_observation *src, uint16_t src_var, bool input,
+    uint16_t skip_term)
 {
-    uint16_t i;
-
-    for (i = 0; i < observation->input_membership.len; i++)
-        sml_bit_array_clear(sol_vector_get(&observation->input_membership, i));
-    sol_vector_clear(&observation->input_membership);
+    uint16_t j, terms_len, src_term;
+
+    terms_len = input ? _input_terms_len(dst, dst_var) :
+        _output_terms_len(dst, dst_var);
+    for (j = 0; j < terms_len; j++) {
+        src_term = j >= skip_term ? j + 1 : j;
+        if (input)
+            _input_set(dst, dst_var, j, _input_get(src, src_var, src_term));
+        else
+            _output_set(dst, dst_var, j, _output_get(src, src_var, src_term));
+    }
 }
 
 static void
-_output_weights_free(struct sml_observation *observation)
+_data_replace(struct sml_observation *obs, struct sml_observation *new_obs)
 {
-    uint16_t i;
-
-    for (i = 0; i < observation->output_weights.len; i++)
-        sol_vector_clear(sol_vector_get(&observation->output_weights, i));
-    sol_vector_clear(&observation->output_weights);
+    free(obs->data);
+    *obs = *new_obs;
 }
 
+//Compacts the terms of a variable to new_terms_len terms, removing
+//skip_term. Used when terms are removed, merged or split.
 static int
-_output_set(struct sml_fuzzy *fuzzy, struct sml_observation *obs, uint16_t
-    output,
-    uint16_t term, uint8_t data)
+_var_terms_reshape(struct sml_observation *obs, bool input, uint16_t var_num,
+    uint16_t new_terms_len, uint16_t skip_term)
 {
-    struct sol_vector *vector;
-    uint8_t *val;
+    struct sml_observation new_obs;
+    uint16_t *input_terms, *output_terms, i;
     int error;
 
-    if (output >= obs->output_weights.len ||
-        term >= *((uint8_t *)sol_vector_get(&obs->output_weights, output))) {
-        if ((error = _output_weights_initialize(fuzzy, obs)))
-            return error;
-    }
+    if (var_num >= (input ? obs->inputs_len : obs->outputs_len))
+        return -EINVAL;
 
-    vector = sol_vector_get(&obs->output_weights, output);
-    if (!vector)
-        return -ENODATA;
+    input_terms = malloc(sizeof(uint16_t) * (obs->inputs_len +
+        obs->outputs_len));
+    if (!input_terms)
+        return -ENOMEM;
+    output_terms = input_terms + obs->inputs_len;
+
+    for (i = 0; i < obs->inputs_len; i++)
+        input_terms[i] = _input_terms_len(obs, i);
+    for (i = 0; i < obs->outputs_len; i++)
+        output_terms[i] = _output_terms_len(obs, i);
+    if (input)
+        input_terms[var_num] = new_terms_len;
+    else
+        output_terms[var_num] = new_terms_len;
+
+    error = _data_alloc(&new_obs, obs->inputs_len, input_terms,
+        obs->outputs_len, output_terms);
+    free(input_terms);
+    if (error)
+        return error;
 
-    val = sol_vector_get(vector, term);
-    if (!val)
-        return -ENODATA;
+    for (i = 0; i < obs->inputs_len; i++)
+        _var_copy(&new_obs, i, obs, i, true,
+            input && i == var_num ? skip_term : UINT16_MAX);
+    for (i = 0; i < obs->outputs_len; i++)
+        _var_copy(&new_obs, i, obs, i, false,
+            !input && i == var_num ? skip_term : UINT16_MAX);
 
-    *val = data;
+    _data_replace(obs, &new_obs);
     return 0;
 }
 
-static uint8_t
-_output_get(struct sml_observation *observation, uint16_t output, uint16_t term)
+static void
+_terms_len_fill(struct sml_variables_list *list, uint16_t *terms)
 {
-    struct sol_vector *terms;
-    uint8_t *val;
+    uint16_t i, len;
 
-    if (output >= observation->output_weights.len)
-        return 0;
+    len = sml_fuzzy_variables_list_get_length(list);
+    for (i = 0; i < len; i++)
+        terms[i] = sml_fuzzy_variable_terms_count(
+            sml_fuzzy_variables_list_index(list, i));
+}
 
-    terms = sol_vector_get(&observation->output_weights, output);
-    if (term >= terms->len)
-        return 0;
+static bool
+_observation_fits(struct sml_fuzzy *fuzzy, struct sml_observation *obs)
+{
+    return obs->inputs_len ==
+           sml_fuzzy_variables_list_get_length(fuzzy->input_list) &&
+           obs->outputs_len ==
+           sml_fuzzy_variables_list_get_length(fuzzy->output_list) &&
+           _input_offsets(obs)[obs->inputs_len] == fuzzy->input_terms_count &&
+           _output_offsets(obs)[obs->outputs_len] == fuzzy->output_terms_count;
+}
 
-    val = sol_vector_get(terms, term);
-    if (!val)
+//Grows the observation to hold all variables and terms of fuzzy
+static int
+_observation_fit(struct sml_fuzzy *fuzzy, struct sml_observation *obs)
+{
+    struct sml_observation new_obs;
+    uint16_t *input_terms, *output_terms, inputs_len, outputs_len, i;
+    int error;
+
+    if (_observation_fits(fuzzy, obs))
         return 0;
-    return *val;
+
+    inputs_len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
+    outputs_len = sml_fuzzy_variables_list_get_length(fuzzy->output_list);
+    if (inputs_len < obs->inputs_len)
+        inputs_len = obs->inputs_len;
+    if (outputs_len < obs->outputs_len)
+        outputs_len = obs->outputs_len;
+
+    input_terms = calloc(inputs_len + outputs_len, sizeof(uint16_t));
+    if (!input_terms)
+        return -ENOMEM;
+    output_terms = input_terms + inputs_len;
+
+    _terms_len_fill(fuzzy->input_list, input_terms);
+    _terms_len_fill(fuzzy->output_list, output_terms);
+    for (i = 0; i < obs->inputs_len; i++)
+        if (input_terms[i] < _input_terms_len(obs, i))
+            input_terms[i] = _input_terms_len(obs, i);
+    for (i = 0; i < obs->outputs_len; i++)
+        if (output_terms[i] < _output_terms_len(obs, i))
+            output_terms[i] = _output_terms_len(obs, i);
+
+    error = _data_alloc(&new_obs, inputs_len, input_terms, outputs_len,
+        output_terms);
+    free(input_terms);
+    if (error)
+        return error;
+
+    for (i = 0; i < obs->inputs_len; i++)
+        _var_copy(&new_obs, i, obs, i, true, UINT16_MAX);
+    for (i = 0; i < obs->outputs_len; i++)
+        _var_copy(&new_obs, i, obs, i, false, UINT16_MAX);
+
+    _data_replace(obs, &new_obs);
+    return 0;
 }
 
 static struct sml_observation *
 _observation_alloc(struct sml_fuzzy *fuzzy)
 {
-    struct sml_observation *observation = malloc(
-        sizeof(struct sml_observation));
+    struct sml_observation *observation;
+    uint16_t *input_terms, *output_terms, inputs_len, outputs_len;
+    int error;
 
+    observation = malloc(sizeof(struct sml_observation));
     if (!observation)
         return NULL;
 
-    sol_vector_init(&observation->output_weights, sizeof(struct sol_vector));
-    if (_output_weights_initialize(fuzzy, observation))
+    inputs_len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
+    outputs_len = sml_fuzzy_variables_list_get_length(fuzzy->output_list);
+    input_terms = malloc(sizeof(uint16_t) * (inputs_len + outputs_len));
+    if (!input_terms)
         goto alloc_error;
-
-    sol_vector_init(&observation->input_membership,
-        sizeof(struct sml_bit_array));
-    if (_input_membership_initialize(fuzzy, observation) != 0)
+    output_terms = input_terms + inputs_len;
+
+    _terms_len_fill(fuzzy->input_list, input_terms);
+    _terms_len_fill(fuzzy->output_list, output_terms);
+    error = _data_alloc(observation, inputs_len, input_terms, outputs_len,
+        output_terms);
+    free(input_terms);
+    if (error) {
+        errno = -error;
         goto alloc_error;
+    }
 
     return observation;
 
 alloc_error:
-    _output_weights_free(observation);
-    _input_membership_free(observation);
     free(observation);
     return NULL;
 }
@@ -233,20 +412,13 @@ uint8_t
 sml_observation_input_term_get(struct sml_observation *obs, uint16_t input,
     uint16_t term)
 {
-    struct sml_bit_array *array;
-
-    array = sol_vector_get(&obs->input_membership, input);
-    if (!array)
-        return 0;
-
-    return sml_bit_array_get(array, term);
+    return _input_get(obs, input, term);
 }
 
 void
 sml_observation_free(struct sml_observation *observation)
 {
-    _output_weights_free(observation);
-    _input_membership_free(observation);
+    free(observation->data);
     free(observation);
 }
 
@@ -307,12 +479,21 @@ sml_observation_enabled_input_values_equals(struct sml_fuzzy *fuzzy,
     return true;
 }
 
-bool
-sml_observation_enabled_input_equals(struct sml_fuzzy *fuzzy,
-    struct sml_observation *obs1,
-    struct sml_observation *obs2)
+//Only set terms are hashed, so observations created before new terms were
+//added to a variable keep the same hash.
+static inline uint32_t
+_hash_set_term(uint32_t hash, uint16_t input, uint16_t term)
+{
+    hash = (hash ^ input) * HASH_PRIME;
+    return (hash ^ term) * HASH_PRIME;
+}
+
+uint32_t
+sml_observation_enabled_input_hash(struct sml_fuzzy *fuzzy,
+    struct sml_observation *observation)
 {
     uint16_t i, j, len;
+    uint32_t hash = HASH_OFFSET_BASIS;
     struct sml_variable *var;
 
     len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
@@ -321,13 +502,83 @@ sml_observation_enabled_input_equals(struct sml_fuzzy *fuzzy,
         uint16_t terms_len = sml_fuzzy_variable_terms_count(var);
         if (sml_fuzzy_variable_is_enabled(var)) {
             for (j = 0; j < terms_len; j++) {
-                if (sml_observation_input_term_get(obs1, i, j) !=
-                    sml_observation_input_term_get(obs2, i, j))
-                    return false;
+                if (sml_observation_input_term_get(observation, i, j))
+                    hash = _hash_set_term(hash, i, j);
             }
         }
     }
 
+    return hash;
+}
+
+uint32_t
+sml_observation_enabled_input_values_hash(struct sml_fuzzy *fuzzy,
+    struct sml_measure *measure)
+{
+    uint16_t i, j, len;
+    uint32_t hash = HASH_OFFSET_BASIS;
+    float val, *tmp;
+    struct sml_variable *var;
+
+    len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
+    for (i = 0; i < len; i++) {
+        var = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
+        uint16_t terms_len = sml_fuzzy_variable_terms_count(var);
+        if (sml_fuzzy_variable_is_enabled(var)) {
+            for (j = 0; j < terms_len; j++) {
+                val = sml_matrix_cast_get(&measure->inputs, i, j, tmp, float);
+                if (val > VARIABLE_MEMBERSHIP_THRESHOLD)
+                    hash = _hash_set_term(hash, i, j);
+            }
+        }
+    }
+
+    return hash;
+}
+
+bool
+sml_observation_input_var_equals(struct sml_observation *obs1,
+    struct sml_observation *obs2, uint16_t input)
+{
+    struct sml_bit_array bits1, bits2;
+    uint16_t j, terms_len, start;
+
+    if (input < obs1->inputs_len && input < obs2->inputs_len &&
+        _input_offsets(obs1)[input] == _input_offsets(obs2)[input] &&
+        _input_terms_len(obs1, input) == _input_terms_len(obs2, input)) {
+        start = _input_offsets(obs1)[input];
+        _input_bits_view(obs1, &bits1);
+        _input_bits_view(obs2, &bits2);
+        return sml_bit_array_find_first_diff(&bits1, &bits2, start,
+            start + _input_terms_len(obs1, input)) < 0;
+    }
+
+    terms_len = input < obs1->inputs_len ? _input_terms_len(obs1, input) : 0;
+    if (input < obs2->inputs_len && _input_terms_len(obs2, input) > terms_len)
+        terms_len = _input_terms_len(obs2, input);
+    for (j = 0; j < terms_len; j++)
+        if (_input_get(obs1, input, j) != _input_get(obs2, input, j))
+            return false;
+
+    return true;
+}
+
+bool
+sml_observation_enabled_input_equals(struct sml_fuzzy *fuzzy,
+    struct sml_observation *obs1,
+    struct sml_observation *obs2)
+{
+    uint16_t i, len;
+    struct sml_variable *var;
+
+    len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
+    for (i = 0; i < len; i++) {
+        var = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
+        if (sml_fuzzy_variable_is_enabled(var) &&
+            !sml_observation_input_var_equals(obs1, obs2, i))
+            return false;
+    }
+
     return true;
 }
 
@@ -367,6 +618,15 @@ sml_observation_input_equals(struct sml_fuzzy *fuzzy,
     uint16_t i, j, len;
     struct sml_variable *var;
 
+    //Same layout, unused bits are always zero
+    if (_input_layout_equals(obs1, obs2)) {
+        struct sml_bit_array bits1, bits2;
+
+        _input_bits_view(obs1, &bits1);
+        _input_bits_view(obs2, &bits2);
+        return sml_bit_array_equals(&bits1, &bits2, NULL);
+    }
+
     len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
     for (i = 0; i < len; i++) {
         var = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
@@ -391,6 +651,9 @@ sml_observation_hit(struct sml_fuzzy *fuzzy,
     bool tmp_hit = false;
     struct sml_variable *variable;
 
+    if ((error = _observation_fit(fuzzy, observation)))
+        return error;
+
     len = sml_fuzzy_variables_list_get_length(fuzzy->output_list);
     for (i = 0; i < len; i++) {
         variable = sml_fuzzy_variables_list_index(fuzzy->output_list, i);
@@ -407,27 +670,20 @@ sml_observation_hit(struct sml_fuzzy *fuzzy,
                     reduce_weight = true;
                 } else
                     output_weight += RULE_WEIGHT;
-                if ((error = _output_set(fuzzy, observation, i, j,
-                        output_weight)))
-                    return error;
+                _output_set(observation, i, j, output_weight);
                 tmp_hit = true;
             } else if (output_weight > 0 &&
                 val < VARIABLE_MEMBERSHIP_THRESHOLD) {
                 output_weight -= RULE_WEIGHT;
-                if ((error = _output_set(fuzzy, observation, i, j,
-                        output_weight)))
-                    return error;
+                _output_set(observation, i, j, output_weight);
                 tmp_hit = true;
             }
             index++;
         }
 
         if (reduce_weight)
-            for (j = 0; j < terms_len; j++) {
-                if ((error = _output_set(fuzzy, observation, i, j,
-                        _output_get(observation, i, j))))
-                    return error;
-            }
+            for (j = 0; j < terms_len; j++)
+                _output_set(observation, i, j, _output_get(observation, i, j));
     }
 
     if (hit)
@@ -613,44 +869,122 @@ error:
     sml_string_free(str);
 }
 
+int
+sml_observation_rule_add(struct sml_fuzzy *fuzzy,
+    struct sol_ptr_vector *observation_list,
+    float weight_threshold,
+    struct sml_bit_array *relevant_inputs,
+    float *output_weights,
+    uint16_t output_number,
+    struct sol_ptr_vector *rules)
+{
+    struct sml_observation *first_observation =
+        sol_ptr_vector_get(observation_list, 0);
+    struct sml_variable **input_vars, *var;
+    struct sml_fuzzy_term **input_terms;
+    struct sml_fuzzy_rule *rule;
+    uint16_t i, j, len, terms_len, inputs_len = 0, index = 0;
+    float weight;
+    int error = 0;
+
+    input_vars = malloc(sizeof(struct sml_variable *) *
+        fuzzy->input_terms_count);
+    input_terms = malloc(sizeof(struct sml_fuzzy_term *) *
+        fuzzy->input_terms_count);
+    if (!input_vars || !input_terms) {
+        error = -ENOMEM;
+        goto end;
+    }
+
+    len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
+    for (i = 0; i < len; i++) {
+        var = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
+        if (!sml_fuzzy_variable_is_enabled(var) ||
+            !_is_input_relevant(relevant_inputs, i))
+            continue;
+
+        terms_len = sml_fuzzy_variable_terms_count(var);
+        for (j = 0; j < terms_len; j++) {
+            if (sml_observation_input_term_get(first_observation, i, j) !=
+                SET)
+                continue;
+            input_vars[inputs_len] = var;
+            input_terms[inputs_len] = sml_fuzzy_variable_get_term(var, j);
+            inputs_len++;
+        }
+    }
+
+    if (!inputs_len) {
+        sml_critical("Generating observation rule failed");
+        goto end;
+    }
+
+    for (i = 0; i < output_number; i++)
+        index += sml_fuzzy_variable_terms_count(
+            sml_fuzzy_variables_list_index(fuzzy->output_list, i));
+
+    var = sml_fuzzy_variables_list_index(fuzzy->output_list, output_number);
+    terms_len = sml_fuzzy_variable_terms_count(var);
+    for (j = 0; j < terms_len; j++, index++) {
+        weight = output_weights[index];
+        if (weight <= weight_threshold)
+            continue;
+        if (weight >= (1 - FLOAT_THRESHOLD))
+            weight = 1;
+
+        rule = sml_fuzzy_rule_add_terms(fuzzy, input_vars, input_terms,
+            inputs_len, var, sml_fuzzy_variable_get_term(var, j), weight);
+        if (!rule) {
+            error = SML_INTERNAL_ERROR;
+            goto end;
+        }
+        if (sol_ptr_vector_append(rules, rule)) {
+            sml_fuzzy_rule_free(fuzzy, rule);
+            error = -ENOMEM;
+            goto end;
+        }
+    }
+
+end:
+    free(input_vars);
+    free(input_terms);
+    return error;
+}
+
 void
 sml_observation_debug(struct sml_observation *observation)
 {
     uint16_t i, j;
     struct sml_string *str = sml_string_new("\t");
-    struct sol_vector *term_weights;
-    struct sml_bit_array *term_membership;
-    uint8_t *val;
 
     sml_string_append_printf(str, "Observation {");
-    sml_string_append_printf(str, "Inputs (%d) {",
-        observation->input_membership.len);
-    SOL_VECTOR_FOREACH_IDX (&observation->input_membership, term_membership,
-        i) {
+    sml_string_append_printf(str, "Inputs (%d) {", observation->inputs_len);
+    for (i = 0; i < observation->inputs_len; i++) {
         if (i > 0)
             sml_string_append(str, ", ");
         sml_string_append_printf(str, "{");
-        for (j = 0; j < term_membership->size; j++) {
+        for (j = 0; j < _input_terms_len(observation, i); j++) {
             if ( j > 0)
                 sml_string_append(str, ", ");
             sml_string_append_printf(str, "%d",
-                sml_bit_array_get(term_membership, j));
+                _input_get(observation, i, j));
         }
         sml_string_append(str, "}");
     }
     sml_string_append(str, "}");
 
     sml_string_append_printf(str, ", Outputs (%d) {",
-        observation->output_weights.len);
+        observation->outputs_len);
 
-    SOL_VECTOR_FOREACH_IDX (&observation->output_weights, term_weights, i) {
+    for (i = 0; i < observation->outputs_len; i++) {
         if (i > 0)
             sml_string_append(str, ", ");
         sml_string_append_printf(str, "{");
-        SOL_VECTOR_FOREACH_IDX (term_weights, val, j) {
+        for (j = 0; j < _output_terms_len(observation, i); j++) {
             if ( j > 0)
                 sml_string_append(str, ", ");
-            sml_string_append_printf(str, "%d", *val);
+            sml_string_append_printf(str, "%d",
+                _output_get(observation, i, j));
         }
         sml_string_append(str, "}");
     }
@@ -667,42 +1001,46 @@ sml_observation_remove_variables(struct sml_observation *observation,
     bool *inputs_to_remove,
     bool *outputs_to_remove)
 {
-    uint16_t i, removed, len;
-
-    if (inputs_to_remove) {
-        removed = 0;
-        len = observation->input_membership.len;
-        for (i = 0; i < len; i++) {
-            if (inputs_to_remove[i]) {
-                sml_bit_array_clear(sol_vector_get(
-                    &observation->input_membership, i - removed));
-                sol_vector_del(&observation->input_membership, i - removed);
-                removed++;
-            }
-        }
-    }
+    struct sml_observation new_obs;
+    uint16_t *input_terms, *output_terms, inputs_len = 0, outputs_len = 0, i;
+    int error;
 
-    if (outputs_to_remove) {
-        removed = 0;
-        len = observation->output_weights.len;
-        for (i = 0; i < len; i++) {
-            if (outputs_to_remove[i]) {
-                sol_vector_clear(sol_vector_get(&observation->output_weights,
-                    i - removed));
-                sol_vector_del(&observation->output_weights, i - removed);
-                removed++;
-            }
-        }
-    }
+    input_terms = malloc(sizeof(uint16_t) * (observation->inputs_len +
+        observation->outputs_len));
+    if (!input_terms)
+        return -ENOMEM;
+    output_terms = input_terms + observation->inputs_len;
+
+    for (i = 0; i < observation->inputs_len; i++)
+        if (!inputs_to_remove || !inputs_to_remove[i])
+            input_terms[inputs_len++] = _input_terms_len(observation, i);
+    for (i = 0; i < observation->outputs_len; i++)
+        if (!outputs_to_remove || !outputs_to_remove[i])
+            output_terms[outputs_len++] = _output_terms_len(observation, i);
+
+    error = _data_alloc(&new_obs, inputs_len, input_terms, outputs_len,
+        output_terms);
+    free(input_terms);
+    if (error)
+        return error;
+
+    for (i = 0, inputs_len = 0; i < observation->inputs_len; i++)
+        if (!inputs_to_remove || !inputs_to_remove[i])
+            _var_copy(&new_obs, inputs_len++, observation, i, true,
+                UINT16_MAX);
+    for (i = 0, outputs_len = 0; i < observation->outputs_len; i++)
+        if (!outputs_to_remove || !outputs_to_remove[i])
+            _var_copy(&new_obs, outputs_len++, observation, i, false,
+                UINT16_MAX);
 
+    _data_replace(observation, &new_obs);
     return 0;
 }
 
 bool
 sml_observation_is_empty(struct sml_observation *observation)
 {
-    return !observation->output_weights.len ||
-           !observation->input_membership.len;
+    return !observation->outputs_len || !observation->inputs_len;
 }
 
 int
@@ -710,17 +1048,15 @@ sml_observation_merge_output(struct sml_fuzzy *fuzzy,
     struct sml_observation *observation1, struct sml_observation *observation2)
 {
     uint16_t i, j;
-    struct sol_vector *term_weights;
-    uint8_t *val;
     int error;
 
-    if ((error = _output_weights_initialize(fuzzy, observation1)))
+    if ((error = _observation_fit(fuzzy, observation1)))
         return error;
 
-    SOL_VECTOR_FOREACH_IDX (&observation1->output_weights, term_weights, i) {
-        SOL_VECTOR_FOREACH_IDX (term_weights, val, j)
-            *val = *val + _output_get(observation2, i, j);
-    }
+    for (i = 0; i < observation1->outputs_len; i++)
+        for (j = 0; j < _output_terms_len(observation1, i); j++)
+            _output_set(observation1, i, j, _output_get(observation1, i, j) +
+                _output_get(observation2, i, j));
 
     return 0;
 }
@@ -729,19 +1065,21 @@ bool
 sml_observation_is_base(struct sml_fuzzy *fuzzy,
     struct sml_observation *observation)
 {
-    uint16_t i, j, len;
+    uint16_t i, len, *offsets;
     struct sml_variable *var;
+    struct sml_bit_array bits;
 
+    _input_bits_view(observation, &bits);
+    offsets = _input_offsets(observation);
     len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
+    if (len > observation->inputs_len)
+        len = observation->inputs_len;
     for (i = 0; i < len; i++) {
         var = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
-        uint16_t terms_len = sml_fuzzy_variable_terms_count(var);
-        if (!sml_fuzzy_variable_is_enabled(var)) {
-            for (j = 0; j < terms_len; j++) {
-                if (sml_observation_input_term_get(observation, i, j))
-                    return false;
-            }
-        }
+        if (!sml_fuzzy_variable_is_enabled(var) &&
+            sml_bit_array_find_first_set(&bits, offsets[i],
+            offsets[i + 1]) >= 0)
+            return false;
     }
 
     return true;
@@ -765,91 +1103,134 @@ sml_observation_fill_output_weights(struct sml_fuzzy *fuzzy,
     }
 }
 
+//File format keeps each variable in its own vector, as it was before the
+//observation data was packed.
 bool
 sml_observation_save(struct sml_observation *obs, FILE *f)
 {
-    uint16_t input_byte_size, i;
-    struct sol_vector *vector;
-    struct sml_bit_array *array;
+    uint16_t i, j, terms_len, bytes;
+    uint8_t byte;
 
-    if (fwrite(&obs->output_weights.len, sizeof(uint16_t), 1, f) < 1)
+    if (fwrite(&obs->outputs_len, sizeof(uint16_t), 1, f) < 1)
         return false;
 
-    SOL_VECTOR_FOREACH_IDX (&obs->output_weights, vector, i) {
-        if (fwrite(&vector->len, sizeof(uint16_t), 1, f) < 1)
+    for (i = 0; i < obs->outputs_len; i++) {
+        terms_len = _output_terms_len(obs, i);
+        if (fwrite(&terms_len, sizeof(uint16_t), 1, f) < 1)
             return false;
 
-        if (fwrite(vector->data, sizeof(uint8_t), vector->len, f) < vector->len)
+        if (fwrite(_output_weights(obs) + _output_offsets(obs)[i],
+            sizeof(uint8_t), terms_len, f) < terms_len)
             return false;
     }
 
-    if (fwrite(&obs->input_membership.len, sizeof(uint16_t), 1, f) < 1)
+    if (fwrite(&obs->inputs_len, sizeof(uint16_t), 1, f) < 1)
         return false;
 
-    SOL_VECTOR_FOREACH_IDX (&obs->input_membership, array, i) {
-        if (fwrite(&array->size, sizeof(uint16_t), 1, f) < 1)
-            return false;
-
-        input_byte_size = sml_bit_array_byte_size_get(array);
-        if (fwrite(array->data, sizeof(uint8_t), input_byte_size, f)
-            < input_byte_size)
+    for (i = 0; i < obs->inputs_len; i++) {
+        terms_len = _input_terms_len(obs, i);
+        if (fwrite(&terms_len, sizeof(uint16_t), 1, f) < 1)
             return false;
 
+        bytes = (terms_len + 7) / 8;
+        for (j = 0; j < bytes * 8; j++) {
+            if (j % 8 == 0)
+                byte = 0;
+            byte |= _input_get(obs, i, j) << (j % 8);
+            if (j % 8 == 7 && fwrite(&byte, sizeof(uint8_t), 1, f) < 1)
+                return false;
+        }
     }
 
     return true;
 }
 
+static uint8_t *
+_load_vectors(FILE *f, uint16_t *len, uint16_t **terms, bool bits)
+{
+    uint8_t *values = NULL, *tmp;
+    uint16_t i;
+    size_t size = 0, bytes;
+
+    *terms = NULL;
+    if (fread(len, sizeof(uint16_t), 1, f) < 1)
+        return NULL;
+
+    *terms = malloc(sizeof(uint16_t) * (*len + 1));
+    if (!*terms)
+        return NULL;
+
+    for (i = 0; i < *len; i++) {
+        if (fread(&(*terms)[i], sizeof(uint16_t), 1, f) < 1)
+            goto error;
+
+        bytes = bits ? ((*terms)[i] + 7) / 8 : (*terms)[i];
+        tmp = realloc(values, size + bytes + 1);
+        if (!tmp)
+            goto error;
+        values = tmp;
+        if (fread(values + size, sizeof(uint8_t), bytes, f) < bytes)
+            goto error;
+        size += bytes;
+    }
+
+    if (!values)
+        values = malloc(1);
+    return values;
+
+error:
+    free(values);
+    free(*terms);
+    *terms = NULL;
+    return NULL;
+}
+
 struct sml_observation *
 sml_observation_load(FILE *f)
 {
     struct sml_observation *obs;
-    uint16_t i, j, input_size, output_size;
+    uint16_t i, j, inputs_len, outputs_len, *input_terms, *output_terms;
+    uint8_t *inputs = NULL, *outputs, *itr;
 
     obs = malloc(sizeof(struct sml_observation));
+    if (!obs)
+        return NULL;
 
-    if (fread(&output_size, sizeof(uint16_t), 1, f) < 1)
+    outputs = _load_vectors(f, &outputs_len, &output_terms, false);
+    if (!outputs)
         goto error;
-    sol_vector_init(&obs->output_weights, sizeof(struct sol_vector));
-    for (i = 0; i < output_size; i++) {
-        struct sol_vector *vector;
-        uint16_t terms_size;
-
-        vector = sol_vector_append(&obs->output_weights);
-        sol_vector_init(vector, sizeof(uint8_t));
 
-        if (fread(&terms_size, sizeof(uint16_t), 1, f) < 1)
-            goto error;
-        for (j = 0; j < terms_size; j++) {
-            uint8_t *val = sol_vector_append(vector);
-            if (fread(val, sizeof(uint8_t), 1, f) < 1)
-                goto error;
-        }
-    }
-
-    if (fread(&input_size, sizeof(uint16_t), 1, f) < 1)
+    inputs = _load_vectors(f, &inputs_len, &input_terms, true);
+    if (!inputs)
         goto error;
-    sol_vector_init(&obs->input_membership, sizeof(struct sml_bit_array));
-    for (i = 0; i < input_size; i++) {
-        struct sml_bit_array *array;
-        uint16_t terms_size, input_byte_size;
 
-        array = sol_vector_append(&obs->input_membership);
-        sml_bit_array_init(array);
+    if (_data_alloc(obs, inputs_len, input_terms, outputs_len, output_terms))
+        goto error;
 
-        if (fread(&terms_size, sizeof(uint16_t), 1, f) < 1)
-            goto error;
-        if (sml_bit_array_size_set(array, terms_size, 0) != 0)
-            goto error;
-        input_byte_size = sml_bit_array_byte_size_get(array);
-        if (fread(array->data, sizeof(uint8_t), input_byte_size, f)
-            < input_byte_size)
-            goto error;
+    memcpy(_output_weights(obs), outputs,
+        _output_offsets(obs)[obs->outputs_len]);
+    for (i = 0, itr = inputs; i < inputs_len; i++) {
+        for (j = 0; j < input_terms[i]; j++)
+            _input_set(obs, i, j, (itr[j / 8] >> (j % 8)) & 1);
+        itr += (input_terms[i] + 7) / 8;
     }
+
+    free(inputs);
+    free(input_terms);
+    free(outputs);
+    free(output_terms);
     return obs;
 
 error:
-    sml_observation_free(obs);
+    if (inputs) {
+        free(inputs);
+        free(input_terms);
+    }
+    if (outputs) {
+        free(outputs);
+        free(output_terms);
+    }
+    free(obs);
     return NULL;
 }
 
@@ -857,40 +1238,35 @@ int
 sml_observation_remove_term(struct sml_observation *obs, uint16_t var_num,
     uint16_t term_num, bool input)
 {
-    struct sol_vector *vector;
-    struct sml_bit_array *array;
+    uint16_t terms_len;
 
-    if (input) {
-        array = sol_vector_get(&obs->input_membership, var_num);
-        return sml_bit_array_remove(array, term_num);
-    }
+    if (var_num >= (input ? obs->inputs_len : obs->outputs_len))
+        return -EINVAL;
 
-    vector = sol_vector_get(&obs->output_weights, var_num);
-    return sol_vector_del(vector, term_num);
+    terms_len = input ? _input_terms_len(obs, var_num) :
+        _output_terms_len(obs, var_num);
+    if (term_num >= terms_len)
+        return -EINVAL;
+
+    return _var_terms_reshape(obs, input, var_num, terms_len - 1, term_num);
 }
 
 int
 sml_observation_merge_terms(struct sml_observation *obs, uint16_t var_num,
     uint16_t term1, uint16_t term2, bool input)
 {
-    struct sol_vector *vector;
-    struct sml_bit_array *array;
-    uint8_t val;
-    uint16_t *weight1, *weight2;
+    if (var_num >= (input ? obs->inputs_len : obs->outputs_len))
+        return -EINVAL;
 
-    if (input) {
-        array = sol_vector_get(&obs->input_membership, var_num);
-        val = sml_bit_array_get(array, term1) == SET ||
-            sml_bit_array_get(array, term2) == SET ? SET : UNSET;
-        sml_bit_array_set(array, term1, val);
-        return sml_bit_array_remove(array, term2);
-    }
+    if (input)
+        _input_set(obs, var_num, term1,
+            _input_get(obs, var_num, term1) == SET ||
+            _input_get(obs, var_num, term2) == SET ? SET : UNSET);
+    else
+        _output_set(obs, var_num, term1, _output_get(obs, var_num, term1) +
+            _output_get(obs, var_num, term2));
 
-    vector = sol_vector_get(&obs->output_weights, var_num);
-    weight1 = sol_vector_get(vector, term1);
-    weight2 = sol_vector_get(vector, term2);
-    *weight1 = *weight1 + *weight2;
-    return sol_vector_del(vector, term2);
+    return sml_observation_remove_term(obs, var_num, term2, input);
 }
 
 int
@@ -898,36 +1274,35 @@ sml_observation_split_terms(struct sml_fuzzy *fuzzy,
     struct sml_observation *obs, uint16_t var_num, uint16_t term_num,
     uint16_t term1, uint16_t term2, bool input)
 {
-    struct sol_vector *vector;
-    struct sml_bit_array *array;
     struct sml_variable *var;
+    uint16_t terms_len;
     uint8_t val;
-    uint16_t weight, terms_len;
     int error;
 
-    if (input) {
-        array = sol_vector_get(&obs->input_membership, var_num);
-        var = sml_fuzzy_variables_list_index(fuzzy->input_list, var_num);
-        terms_len = sml_fuzzy_variable_terms_count(var);
-        if ((error = sml_bit_array_size_set(array, terms_len, 0)))
-            return error;
-
-        val = sml_bit_array_get(array, term_num) == SET;
-        sml_bit_array_set(array, term1, val);
-        sml_bit_array_set(array, term2, val);
-        return sml_bit_array_remove(array, term_num);
-    }
-
-    weight = _output_get(obs, var_num, term_num);
+    if (var_num >= (input ? obs->inputs_len : obs->outputs_len))
+        return -EINVAL;
 
-    if ((error = _output_set(fuzzy, obs, var_num, term1, weight)))
+    //Make room for the new terms
+    var = sml_fuzzy_variables_list_index(
+        input ? fuzzy->input_list : fuzzy->output_list, var_num);
+    terms_len = sml_fuzzy_variable_terms_count(var);
+    if (terms_len != (input ? _input_terms_len(obs, var_num) :
+        _output_terms_len(obs, var_num)) &&
+        (error = _var_terms_reshape(obs, input, var_num, terms_len,
+            UINT16_MAX)))
         return error;
 
-    if ((error = _output_set(fuzzy, obs, var_num, term2, weight)))
-        return error;
+    if (input) {
+        val = _input_get(obs, var_num, term_num);
+        _input_set(obs, var_num, term1, val);
+        _input_set(obs, var_num, term2, val);
+    } else {
+        val = _output_get(obs, var_num, term_num);
+        _output_set(obs, var_num, term1, val);
+        _output_set(obs, var_num, term2, val);
+    }
 
-    vector = sol_vector_get(&obs->output_weights, var_num);
-    return sol_vector_del(vector, term_num);
+    return sml_observation_remove_term(obs, var_num, term_num, input);
 }
 
 unsigned int
@@ -935,11 +1310,10 @@ sml_observation_estimate_size(struct sml_fuzzy *fuzzy)
 {
     unsigned int size = sizeof(struct sml_observation);
 
-    size += (sml_fuzzy_variables_list_get_length(fuzzy->input_list) +
-        sml_fuzzy_variables_list_get_length(fuzzy->output_list)) *
-        sizeof(struct sol_vector);
+    size += _offsets_size(
+        sml_fuzzy_variables_list_get_length(fuzzy->input_list),
+        sml_fuzzy_variables_list_get_length(fuzzy->output_list));
     size += (fuzzy->output_terms_count * sizeof(uint8_t)) +
-        (fuzzy->input_terms_count / 8 + 1);
+        (fuzzy->input_terms_count + 63) / 64 * sizeof(uint64_t);
     return size;
 }
-
@@ -34,8 +34,12 @@ int sml_observation_new(struct sml_fuzzy *fuzzy, struct sml_measure *measure, st
 void sml_observation_free(struct sml_observation *observation);
 bool sml_observation_enabled_input_equals(struct sml_fuzzy *fuzzy, struct sml_observation *obs1, struct sml_observation *obs2);
 bool sml_observation_input_equals(struct sml_fuzzy *fuzzy, struct sml_observation *obs1, struct sml_observation *obs2);
+bool sml_observation_input_var_equals(struct sml_observation *obs1, struct sml_observation *obs2, uint16_t input);
 bool sml_observation_enabled_input_values_equals(struct sml_fuzzy *fuzzy, struct sml_observation *observation, struct sml_measure *measure);
+uint32_t sml_observation_enabled_input_hash(struct sml_fuzzy *fuzzy, struct sml_observation *observation);
+uint32_t sml_observation_enabled_input_values_hash(struct sml_fuzzy *fuzzy, struct sml_measure *measure);
 void sml_observation_rule_generate(struct sml_fuzzy *fuzzy, struct sol_ptr_vector *observation_list, float weight_threshold, struct sml_bit_array *relevant_inputs, float *output_weights, uint16_t output_number, sml_process_str_cb process_cb, void *data);
+int sml_observation_rule_add(struct sml_fuzzy *fuzzy, struct sol_ptr_vector *observation_list, float weight_threshold, struct sml_bit_array *relevant_inputs, float *output_weights, uint16_t output_number, struct sol_ptr_vector *rules);
 int sml_observation_hit(struct sml_fuzzy *fuzzy, struct sml_observation *observation, struct sml_measure *measure, bool *hit);
 void sml_observation_debug(struct sml_observation *observation);
 int sml_observation_remove_variables(struct sml_observation *observation, bool *inputs_to_remove, bool *outputs_to_remove);
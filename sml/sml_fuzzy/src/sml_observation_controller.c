@@ -20,6 +20,7 @@
 #include "sml_observation_group.h"
 #include <sml_log.h>
 #include <sml_cache.h>
+#include <sml_engine.h>
 #include "sml_rule_group.h"
 #include "sml_util.h"
 #include <macros.h>
@@ -27,54 +28,207 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 #define DEFAULT_CACHE_SIZE (0)
 #define WEIGHT_THRESHOLD (0.05)
 #define DEFAULT_OBS_CONTROLLER_FILE "controller.dat"
 #define VERSION 0x1
+#define MIN_INDEX_SIZE (16)
+
+//Index entry of an observation group. Key is the hash of the enabled input
+//terms of the first observation of the group.
+struct obs_group_index_entry {
+    uint32_t key;
+    struct sml_observation_group *obs_group;
+    struct obs_group_index_entry *next;
+};
 
 struct sml_observation_controller {
     struct sml_cache *obs_group_cache;
+    struct obs_group_index_entry **index;
+    uint32_t index_size;
+    uint32_t index_count;
+    //Set when groups may have changed their keys. Index is rebuilt on demand.
+    bool index_dirty;
     //vector of ptr_vector of struct sml_rule_group
     //The index of this vector indicates which output the rules are related to
     struct sol_vector rule_group_map; //TODO: User Matrix
     struct sml_fuzzy *fuzzy;
+    struct sml_engine *engine;
     float weight_threshold;
     bool simplification_disabled;
 };
 
-static int
-_merge_obs_groups(struct sml_observation_controller *obs_controller)
+static uint32_t
+_index_key(struct sml_observation_controller *obs_controller,
+    struct sml_observation_group *obs_group)
+{
+    struct sml_observation *first =
+        sml_observation_group_get_first_observation(obs_group);
+
+    if (!first)
+        return 0;
+    return sml_observation_enabled_input_hash(obs_controller->fuzzy, first);
+}
 
+static inline struct obs_group_index_entry **
+_index_bucket(struct sml_observation_controller *obs_controller, uint32_t key)
 {
-    int error;
-    uint16_t i, j;
-    uint16_t len;
-    struct sml_observation_group *item_i, *item_j;
-    struct sol_ptr_vector *obs_group_list;
+    return &obs_controller->index[key & (obs_controller->index_size - 1)];
+}
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    len  = sol_ptr_vector_get_len(obs_group_list);
-    for (i = 0; i < len; i++)
-        for (j = i + 1; j < len; j++) {
-            item_i = sol_ptr_vector_get(obs_group_list, i);
-            item_j = sol_ptr_vector_get(obs_group_list, j);
-
-            if (sml_observation_group_enabled_input_equals(
-                obs_controller->fuzzy, item_i, item_j)) {
-                if ((error = sml_observation_group_merge(obs_controller->fuzzy,
-                        item_i, item_j)))
-                    return error;
-                sml_observation_group_free(item_j);
-                sol_ptr_vector_del(obs_group_list, j);
-                len--;
-                j--;
+static void
+_index_clear(struct sml_observation_controller *obs_controller)
+{
+    struct obs_group_index_entry *entry, *next;
+    uint32_t i;
+
+    for (i = 0; i < obs_controller->index_size; i++) {
+        for (entry = obs_controller->index[i]; entry; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+        obs_controller->index[i] = NULL;
+    }
+    obs_controller->index_count = 0;
+}
+
+static bool
+_index_grow_if_needed(struct sml_observation_controller *obs_controller)
+{
+    struct obs_group_index_entry **index, **bucket, *entry, *next;
+    uint32_t size, i;
+
+    if (obs_controller->index &&
+        obs_controller->index_count < obs_controller->index_size)
+        return true;
+
+    size = obs_controller->index_size ? obs_controller->index_size * 2 :
+        MIN_INDEX_SIZE;
+    index = calloc(size, sizeof(struct obs_group_index_entry *));
+    if (!index)
+        return false;
+
+    for (i = 0; i < obs_controller->index_size; i++) {
+        for (entry = obs_controller->index[i]; entry; entry = next) {
+            next = entry->next;
+            bucket = &index[entry->key & (size - 1)];
+            entry->next = *bucket;
+            *bucket = entry;
+        }
+    }
+
+    free(obs_controller->index);
+    obs_controller->index = index;
+    obs_controller->index_size = size;
+    return true;
+}
+
+static void
+_index_add(struct sml_observation_controller *obs_controller,
+    struct sml_observation_group *obs_group, uint32_t key)
+{
+    struct obs_group_index_entry **bucket, *entry;
+
+    if (obs_controller->index_dirty)
+        return;
+
+    entry = malloc(sizeof(struct obs_group_index_entry));
+    if (!entry || !_index_grow_if_needed(obs_controller)) {
+        //Index will be rebuilt on next lookup
+        sml_warning("Could not index the observation group");
+        free(entry);
+        obs_controller->index_dirty = true;
+        return;
+    }
+
+    entry->key = key;
+    entry->obs_group = obs_group;
+    bucket = _index_bucket(obs_controller, key);
+    entry->next = *bucket;
+    *bucket = entry;
+    obs_controller->index_count++;
+}
+
+static void
+_index_del(struct sml_observation_controller *obs_controller,
+    struct sml_observation_group *obs_group)
+{
+    struct obs_group_index_entry **itr, *entry;
+
+    if (obs_controller->index_dirty || !obs_controller->index_count)
+        return;
+
+    for (itr = _index_bucket(obs_controller,
+        _index_key(obs_controller, obs_group)); *itr; itr = &(*itr)->next) {
+        if ((*itr)->obs_group == obs_group) {
+            entry = *itr;
+            *itr = entry->next;
+            free(entry);
+            obs_controller->index_count--;
+            return;
+        }
+    }
+}
+
+//Indexes all observation groups, merging groups that have the same enabled
+//inputs.
+static int
+_index_rebuild(struct sml_observation_controller *obs_controller, bool merge)
+{
+    int error;
+    uint32_t key;
+    struct sml_observation_group *obs_group;
+    struct obs_group_index_entry *entry = NULL;
+    struct sml_cache_node *node, *next;
+
+    _index_clear(obs_controller);
+    obs_controller->index_dirty = false;
+    SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+        obs_group) {
+        key = _index_key(obs_controller, obs_group);
+        if (merge && obs_controller->index_count) {
+            for (entry = *_index_bucket(obs_controller, key); entry;
+                entry = entry->next) {
+                if (entry->key == key &&
+                    sml_observation_group_enabled_input_equals(
+                    obs_controller->fuzzy, entry->obs_group, obs_group))
+                    break;
             }
         }
 
+        if (!entry) {
+            _index_add(obs_controller, obs_group, key);
+            continue;
+        }
+
+        if ((error = sml_observation_group_merge(obs_controller->fuzzy,
+                entry->obs_group, obs_group))) {
+            obs_controller->index_dirty = true;
+            return error;
+        }
+        sml_cache_steal(obs_controller->obs_group_cache, obs_group);
+        sml_observation_group_free(obs_group);
+        entry = NULL;
+    }
+
     return 0;
 }
 
+static void
+_index_update_if_needed(struct sml_observation_controller *obs_controller)
+{
+    if (obs_controller->index_dirty)
+        _index_rebuild(obs_controller, false);
+}
+
+static int
+_merge_obs_groups(struct sml_observation_controller *obs_controller)
+{
+    return _index_rebuild(obs_controller, true);
+}
+
 static void
 _initialize_rule_group_map(struct sml_observation_controller *obs_controller)
 {
@@ -108,15 +262,20 @@ _controller_append_observation(
     struct sml_observation *obs)
 {
     int error;
-    uint16_t i;
+    uint32_t key;
     struct sml_observation_group *obs_group;
-    struct sol_ptr_vector *obs_group_list;
+    struct obs_group_index_entry *entry;
     bool appended = false;
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i) {
+    _index_update_if_needed(obs_controller);
+    key = sml_observation_enabled_input_hash(obs_controller->fuzzy, obs);
+    for (entry = obs_controller->index_count ?
+        *_index_bucket(obs_controller, key) : NULL; entry;
+        entry = entry->next) {
+        if (entry->key != key)
+            continue;
         error = sml_observation_group_observation_append(obs_controller->fuzzy,
-            obs_group, obs,
+            entry->obs_group, obs,
             &appended);
         if (error || appended)
             return error;
@@ -132,7 +291,8 @@ _controller_append_observation(
     if (error || !appended)
         goto append_error;
 
-    sml_cache_put(obs_controller->obs_group_cache, obs_group);
+    if (sml_cache_put(obs_controller->obs_group_cache, obs_group))
+        _index_add(obs_controller, obs_group, key);
     return 0;
 
 append_error:
@@ -152,20 +312,23 @@ _cache_element_free(void *element, void *data)
         sml_rule_group_list_observation_remove(obs_controller->fuzzy,
             rule_group_list, element, obs_controller->weight_threshold, i);
 
+    _index_del(obs_controller, element);
     sml_observation_group_free(element);
 }
 
 struct sml_observation_controller *
-sml_observation_controller_new(struct sml_fuzzy *fuzzy)
+sml_observation_controller_new(struct sml_engine *engine,
+    struct sml_fuzzy *fuzzy)
 {
     struct sml_observation_controller *obs_controller =
-        malloc(sizeof(struct sml_observation_controller));
+        calloc(1, sizeof(struct sml_observation_controller));
 
     obs_controller->obs_group_cache = sml_cache_new(DEFAULT_CACHE_SIZE,
         _cache_element_free, obs_controller);
     sol_vector_init(&obs_controller->rule_group_map,
         sizeof(struct sol_ptr_vector));
     obs_controller->fuzzy = fuzzy;
+    obs_controller->engine = engine;
     obs_controller->weight_threshold = WEIGHT_THRESHOLD;
     obs_controller->simplification_disabled = false;
     _initialize_rule_group_map(obs_controller);
@@ -176,7 +339,10 @@ void
 sml_observation_controller_clear(
     struct sml_observation_controller *obs_controller)
 {
+    obs_controller->index_dirty = true;
     sml_cache_clear(obs_controller->obs_group_cache);
+    _index_clear(obs_controller);
+    obs_controller->index_dirty = false;
     _rule_group_map_clear(obs_controller);
 }
 
@@ -186,6 +352,7 @@ sml_observation_controller_free(
 {
     sml_observation_controller_clear(obs_controller);
     sml_cache_free(obs_controller->obs_group_cache);
+    free(obs_controller->index);
     free(obs_controller);
 }
 
@@ -194,31 +361,46 @@ sml_observation_controller_observation_hit(struct sml_observation_controller *
     obs_controller, struct sml_measure *measure)
 {
     int error;
-    uint16_t i, j;
+    uint16_t j;
+    uint32_t key;
+    uint64_t start;
     struct sml_observation_group *obs_group;
     struct sol_ptr_vector *rule_group_list;
-    struct sol_ptr_vector *obs_group_list;
+    struct obs_group_index_entry *entry;
     bool found;
 
     _initialize_rule_group_map(obs_controller);
-
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i) {
+    _index_update_if_needed(obs_controller);
+
+    key = sml_observation_enabled_input_values_hash(obs_controller->fuzzy,
+        measure);
+    for (entry = obs_controller->index_count ?
+        *_index_bucket(obs_controller, key) : NULL; entry;
+        entry = entry->next) {
+        if (entry->key != key)
+            continue;
+        obs_group = entry->obs_group;
         error = sml_observation_group_observation_hit(obs_controller->fuzzy,
             obs_group, measure, &found);
         if (error)
             return error;
 
         if (found) {
-            if (!obs_controller->simplification_disabled)
+            if (!obs_controller->simplification_disabled) {
+                start = sml_stats_timer_start(obs_controller->engine);
                 SOL_VECTOR_FOREACH_IDX (&obs_controller->rule_group_map,
                     rule_group_list, j) {
                     error = sml_rule_group_list_rebalance(obs_controller->fuzzy,
                         rule_group_list, obs_group,
                         obs_controller->weight_threshold, j);
                     if (error)
-                        return error;
+                        break;
                 }
+                sml_stats_timer_stop(obs_controller->engine,
+                    SML_STATS_TIMER_RULE_REBUILD, start);
+                if (error)
+                    return error;
+            }
             sml_cache_hit(obs_controller->obs_group_cache, obs_group);
             return 0;
         }
@@ -234,16 +416,22 @@ sml_observation_controller_observation_hit(struct sml_observation_controller *
         goto error_end;
 
     if (found) {
+        start = sml_stats_timer_start(obs_controller->engine);
         SOL_VECTOR_FOREACH_IDX (&obs_controller->rule_group_map,
             rule_group_list, j) {
             if ((error = sml_rule_group_list_observation_append(
                     obs_controller->fuzzy, rule_group_list,
                     obs_group, obs_controller->weight_threshold,
                     obs_controller->simplification_disabled, j)))
-                goto error_end;
+                break;
         }
+        sml_stats_timer_stop(obs_controller->engine,
+            SML_STATS_TIMER_RULE_REBUILD, start);
+        if (error)
+            goto error_end;
 
-        sml_cache_put(obs_controller->obs_group_cache, obs_group);
+        if (sml_cache_put(obs_controller->obs_group_cache, obs_group))
+            _index_add(obs_controller, obs_group, key);
     } else
         sml_observation_group_free(obs_group);
     return 0;
@@ -285,14 +473,13 @@ void
 sml_observation_controller_debug(
     struct sml_observation_controller *obs_controller)
 {
-    uint16_t i;
     struct sml_observation_group *obs_group;
-    struct sol_ptr_vector *obs_group_list;
+    struct sml_cache_node *node, *next;
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    sml_debug("Observation Controller (%d) {",
-        sol_ptr_vector_get_len(obs_group_list));
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i)
+    sml_debug("Observation Controller (%" PRIu32 ") {",
+        sml_cache_get_size(obs_controller->obs_group_cache));
+    SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+        obs_group)
         sml_observation_group_debug(obs_group);
     sml_debug("}");
 }
@@ -302,19 +489,20 @@ sml_observation_controller_variable_set_enabled(
     struct sml_observation_controller *obs_controller, bool enabled)
 {
     int error;
-    struct sol_ptr_vector *obs_group_list;
 
     _initialize_rule_group_map(obs_controller);
+    //Enabled inputs are part of the index key
+    obs_controller->index_dirty = true;
 
     if (enabled) {
         uint16_t i;
         struct sml_observation_group *item;
+        struct sml_cache_node *node, *next;
         struct sol_ptr_vector split = SOL_PTR_VECTOR_INIT;
 
         //Split groups
-        obs_group_list =
-            sml_cache_get_elements(obs_controller->obs_group_cache);
-        SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, item, i)
+        SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+            item)
             sml_observation_group_split(obs_controller->fuzzy, item, &split);
         sml_cache_clear(obs_controller->obs_group_cache);
         SOL_PTR_VECTOR_FOREACH_IDX (&split, item, i)
@@ -338,22 +526,22 @@ sml_observation_controller_remove_variables(struct sml_observation_controller
     bool *outputs_to_remove)
 {
     struct sml_observation_group *obs_group;
-    uint16_t i;
+    struct sml_cache_node *node, *next;
     int error = 0;
-    struct sol_ptr_vector *obs_group_list;
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i) {
+    obs_controller->index_dirty = true;
+    SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+        obs_group) {
         if ((error = sml_observation_group_remove_variables(obs_group,
                 inputs_to_remove, outputs_to_remove)))
             goto exit;
 
         if (sml_observation_group_is_empty(obs_group)) {
-            if (!sml_cache_remove_by_id(obs_controller->obs_group_cache, i)) {
+            if (!sml_cache_remove(obs_controller->obs_group_cache,
+                    obs_group)) {
                 sml_critical("Could not remove the observation group");
                 goto exit;
             }
-            i--;
         }
     }
 
@@ -469,9 +657,8 @@ load_state_false_end:
     return false;
 }
 
-int
-sml_observation_controller_rules_rebuild(struct sml_observation_controller
-    *obs_controller)
+static int
+_rules_rebuild(struct sml_observation_controller *obs_controller)
 {
     int error;
     struct sol_ptr_vector *rule_group_list;
@@ -493,6 +680,31 @@ sml_observation_controller_rules_rebuild(struct sml_observation_controller
     return 0;
 }
 
+int
+sml_observation_controller_rules_rebuild(struct sml_observation_controller
+    *obs_controller)
+{
+    int error;
+    uint64_t start;
+
+    start = sml_stats_timer_start(obs_controller->engine);
+    error = _rules_rebuild(obs_controller);
+    sml_stats_timer_stop(obs_controller->engine, SML_STATS_TIMER_RULE_REBUILD,
+        start);
+    return error;
+}
+
+void
+sml_observation_controller_fill_stats(
+    struct sml_observation_controller *obs_controller, struct sml_stats *stats)
+{
+    stats->observation_groups =
+        sml_cache_get_size(obs_controller->obs_group_cache);
+    stats->cache_hits += sml_cache_get_hits(obs_controller->obs_group_cache);
+    stats->cache_evictions +=
+        sml_cache_get_evictions(obs_controller->obs_group_cache);
+}
+
 void
 sml_observation_controller_set_simplification_disabled(
     struct sml_observation_controller *obs_controller, bool disabled)
@@ -510,22 +722,22 @@ sml_observation_controller_remove_term(struct sml_observation_controller
     uint16_t term_num, bool input)
 {
     struct sml_observation_group *obs_group;
-    uint16_t i;
+    struct sml_cache_node *node, *next;
     int error = 0;
-    struct sol_ptr_vector *obs_group_list;
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i) {
+    obs_controller->index_dirty = true;
+    SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+        obs_group) {
         if ((error = sml_observation_group_remove_terms(obs_group, var_num,
                 term_num, input)))
             return error;
 
         if (sml_observation_group_is_empty(obs_group)) {
-            if (!sml_cache_remove_by_id(obs_controller->obs_group_cache, i)) {
+            if (!sml_cache_remove(obs_controller->obs_group_cache,
+                    obs_group)) {
                 sml_critical("Could not remove the observation group");
                 return error;
             }
-            i--;
         }
     }
 
@@ -539,22 +751,22 @@ sml_observation_controller_merge_terms(struct sml_observation_controller
     bool input)
 {
     struct sml_observation_group *obs_group;
-    uint16_t i;
+    struct sml_cache_node *node, *next;
     int error = 0;
-    struct sol_ptr_vector *obs_group_list;
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i) {
+    obs_controller->index_dirty = true;
+    SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+        obs_group) {
         if ((error = sml_observation_group_merge_terms(obs_group, var_num,
                 term1, term2, input)))
             return error;
 
         if (sml_observation_group_is_empty(obs_group)) {
-            if (!sml_cache_remove_by_id(obs_controller->obs_group_cache, i)) {
+            if (!sml_cache_remove(obs_controller->obs_group_cache,
+                    obs_group)) {
                 sml_critical("Could not remove the observation group");
                 return error;
             }
-            i--;
         }
     }
 
@@ -569,22 +781,22 @@ sml_observation_controller_split_terms(struct sml_fuzzy *fuzzy,
     uint16_t term2, bool input)
 {
     struct sml_observation_group *obs_group;
-    uint16_t i;
+    struct sml_cache_node *node, *next;
     int error = 0;
-    struct sol_ptr_vector *obs_group_list;
 
-    obs_group_list = sml_cache_get_elements(obs_controller->obs_group_cache);
-    SOL_PTR_VECTOR_FOREACH_IDX (obs_group_list, obs_group, i) {
+    obs_controller->index_dirty = true;
+    SML_CACHE_FOREACH_SAFE (obs_controller->obs_group_cache, node, next,
+        obs_group) {
         if ((error = sml_observation_group_split_terms(fuzzy, obs_group,
                 var_num, term_num, term1, term2, input)))
             return error;
 
         if (sml_observation_group_is_empty(obs_group)) {
-            if (!sml_cache_remove_by_id(obs_controller->obs_group_cache, i)) {
+            if (!sml_cache_remove(obs_controller->obs_group_cache,
+                    obs_group)) {
                 sml_critical("Could not remove the observation group");
                 return error;
             }
-            i--;
         }
     }
 
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "sml_observation.h"
+#include <sml_engine.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,7 +27,7 @@ extern "C" {
 
 struct sml_observation_controller;
 
-struct sml_observation_controller *sml_observation_controller_new(struct sml_fuzzy *fuzzy);
+struct sml_observation_controller *sml_observation_controller_new(struct sml_engine *engine, struct sml_fuzzy *fuzzy);
 void sml_observation_controller_free(struct sml_observation_controller *observation);
 void sml_observation_controller_clear(struct sml_observation_controller *observation);
 int sml_observation_controller_observation_hit(struct sml_observation_controller *obs_controller, struct sml_measure *measure);
@@ -44,6 +45,7 @@ int sml_observation_controller_remove_term(struct sml_observation_controller *ob
 int sml_observation_controller_merge_terms(struct sml_observation_controller *obs_controller, uint16_t var_num, uint16_t term1, uint16_t term2, bool input);
 int sml_observation_controller_split_terms(struct sml_fuzzy *fuzzy, struct sml_observation_controller *obs_controller, uint16_t var_num, uint16_t term_num, uint16_t term1, uint16_t term2, bool input);
 bool sml_observation_controller_update_cache_size(struct sml_observation_controller *obs_controller, unsigned int max_memory_for_observation);
+void sml_observation_controller_fill_stats(struct sml_observation_controller *obs_controller, struct sml_stats *stats);
 
 #ifdef __cplusplus
 }
@@ -196,6 +196,20 @@ sml_observation_group_rule_generate(struct sml_fuzzy *fuzzy,
         output_number, process_cb, data);
 }
 
+int
+sml_observation_group_rule_add(struct sml_fuzzy *fuzzy,
+    struct sml_observation_group *obs_group,
+    float weight_threshold,
+    struct sml_bit_array *relevant_inputs,
+    float *output_weights,
+    uint16_t output_number,
+    struct sol_ptr_vector *rules)
+{
+    return sml_observation_rule_add(fuzzy, (struct sol_ptr_vector *)obs_group,
+        weight_threshold, relevant_inputs, output_weights,
+        output_number, rules);
+}
+
 void
 sml_observation_group_debug(struct sml_observation_group *obs_group)
 {
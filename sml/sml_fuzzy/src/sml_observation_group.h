@@ -31,6 +31,7 @@ struct sml_observation_group *sml_observation_group_new();
 int sml_observation_group_observation_hit(struct sml_fuzzy *fuzzy, struct sml_observation_group *obs_group, struct sml_measure *measure, bool *hit);
 void sml_observation_group_free(struct sml_observation_group *obs_group);
 void sml_observation_group_rule_generate(struct sml_fuzzy *fuzzy, struct sml_observation_group *obs_group, float weight_threshold, struct sml_bit_array *relevant_inputs, float *output_weights, uint16_t output_number, sml_process_str_cb process_cb, void *data);
+int sml_observation_group_rule_add(struct sml_fuzzy *fuzzy, struct sml_observation_group *obs_group, float weight_threshold, struct sml_bit_array *relevant_inputs, float *output_weights, uint16_t output_number, struct sol_ptr_vector *rules);
 void sml_observation_group_debug(struct sml_observation_group *obs_group);
 int sml_observation_group_merge(struct sml_fuzzy *fuzzy, struct sml_observation_group *obs_group1, struct sml_observation_group *obs_group2);
 bool sml_observation_group_enabled_input_equals(struct sml_fuzzy *fuzzy, struct sml_observation_group *obs_group1, struct sml_observation_group *obs_group2);
@@ -36,12 +36,6 @@ struct sml_rule_group {
     struct sml_bit_array relevant_inputs;
 };
 
-typedef struct _Tmp_Rule_Fuzzy {
-    struct sml_rule_group *rule_group;
-    struct sml_fuzzy *fuzzy;
-    bool error;
-} Tmp_Rule_Fuzzy;
-
 static int _rule_group_list_observation_append(struct sml_fuzzy *fuzzy,
     struct sol_ptr_vector *rule_group_list,
     struct sml_observation_group *obs_group,
@@ -60,26 +54,12 @@ _ptr_vector_del_obj(struct sol_ptr_vector *pv, void *ptr)
     return -ENODATA;
 }
 
-static void
-_rule_append(const char *str, void *data)
-{
-    Tmp_Rule_Fuzzy *tmp = data;
-    void *rule = sml_fuzzy_rule_add(tmp->fuzzy, str);
-
-    if (!rule) {
-        tmp->error = true;
-        return;
-    }
-
-    sol_ptr_vector_append(&tmp->rule_group->rules, rule);
-}
-
 static uint16_t
 _observation_belong_in_group(struct sml_fuzzy *fuzzy,
     struct sml_rule_group *rule_group, struct sml_observation_group *obs_group)
 {
     uint16_t level = 0;
-    uint16_t i, len, j;
+    uint16_t i, len;
     struct sml_variable *v;
 
     if (sol_ptr_vector_get_len(&rule_group->observations) == 0)
@@ -99,19 +79,11 @@ _observation_belong_in_group(struct sml_fuzzy *fuzzy,
     len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
     for (i = 0; i < len; i++) {
         v = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
-        uint16_t terms_len = sml_fuzzy_variable_terms_count(v);
-        uint16_t found = 0;
         if (sml_fuzzy_variable_is_enabled(v) &&
-            sml_bit_array_get(&rule_group->relevant_inputs, i)) {
-            for (j = 0; j < terms_len; j++) {
-                if (sml_observation_input_term_get(first_observation1, i, j) ==
-                    sml_observation_input_term_get(first_observation2, i, j))
-                    found++;
-            }
-
-            if (found == terms_len)
-                level++;
-        }
+            sml_bit_array_get(&rule_group->relevant_inputs, i) &&
+            sml_observation_input_var_equals(first_observation1,
+            first_observation2, i))
+            level++;
     }
 
     return level;
@@ -121,7 +93,7 @@ static void
 _insert_in_rule_group(struct sml_fuzzy *fuzzy,
     struct sml_rule_group *rule_group, struct sml_observation_group *obs_group)
 {
-    uint16_t i, len, j;
+    uint16_t i, len;
     struct sml_variable *v;
 
     struct sml_observation_group *first_group =
@@ -135,20 +107,11 @@ _insert_in_rule_group(struct sml_fuzzy *fuzzy,
     len = sml_fuzzy_variables_list_get_length(fuzzy->input_list);
     for (i = 0; i < len; i++) {
         v = sml_fuzzy_variables_list_index(fuzzy->input_list, i);
-        uint16_t terms_len = sml_fuzzy_variable_terms_count(v);
-        uint16_t found = 0;
-
         if (sml_fuzzy_variable_is_enabled(v) &&
-            sml_bit_array_get(&rule_group->relevant_inputs, i)) {
-            for (j = 0; j < terms_len; j++) {
-                if (sml_observation_input_term_get(first_observation1, i, j) ==
-                    sml_observation_input_term_get(first_observation2, i, j))
-                    found++;
-            }
-
-            if (found != terms_len)
-                sml_bit_array_set(&rule_group->relevant_inputs, i, UNSET);
-        }
+            sml_bit_array_get(&rule_group->relevant_inputs, i) &&
+            !sml_observation_input_var_equals(first_observation1,
+            first_observation2, i))
+            sml_bit_array_set(&rule_group->relevant_inputs, i, UNSET);
     }
 
     sol_ptr_vector_append(&rule_group->observations, obs_group);
@@ -178,6 +141,56 @@ _observation_conflicts_in_group(struct sml_fuzzy *fuzzy,
         output_number);
 }
 
+//Normalized weight of each output term, considering all observations of the
+//rule group.
+static int
+_rule_group_output_weights_get(struct sml_fuzzy *fuzzy,
+    struct sml_rule_group *rule_group, float **output_weights_float)
+{
+    struct sml_observation_group *obs_group;
+    struct sml_variable *var;
+    uint16_t *output_weights, len;
+    uint16_t c;
+    uint16_t i, j, index;
+    float *weights;
+    int error = 0;
+
+    output_weights = calloc(fuzzy->output_terms_count, sizeof(uint16_t));
+    if (!output_weights)
+        return -errno;
+
+    SOL_PTR_VECTOR_FOREACH_IDX (&rule_group->observations, obs_group, c)
+        sml_observation_group_fill_output_weights(fuzzy, obs_group,
+            output_weights);
+
+    weights = calloc(fuzzy->output_terms_count, sizeof(float));
+    if (!weights) {
+        error = -errno;
+        goto weights_end;
+    }
+
+    index = 0;
+    len = sml_fuzzy_variables_list_get_length(fuzzy->output_list);
+    for (i = 0; i < len; i++) {
+        var = sml_fuzzy_variables_list_index(fuzzy->output_list, i);
+        uint16_t terms_len = sml_fuzzy_variable_terms_count(var);
+        uint16_t total_weight = 0;
+        for (j = 0; j < terms_len; j++)
+            total_weight += output_weights[index + j];
+
+        for (j = 0; j < terms_len; j++) {
+            weights[index] = output_weights[index] / (float)total_weight;
+            index++;
+        }
+    }
+
+    *output_weights_float = weights;
+
+weights_end:
+    free(output_weights);
+    return error;
+}
+
 static int
 _rule_group_rule_refresh(struct sml_fuzzy *fuzzy,
     struct sml_rule_group *rule_group, float weight_threshold,
@@ -185,24 +198,24 @@ _rule_group_rule_refresh(struct sml_fuzzy *fuzzy,
 {
     uint16_t i;
     void *rule;
-    Tmp_Rule_Fuzzy tmp;
+    float *output_weights;
+    struct sml_observation_group *obs_group;
     int error;
 
     SOL_PTR_VECTOR_FOREACH_IDX (&rule_group->rules, rule, i)
         sml_fuzzy_rule_free(fuzzy, rule);
     sol_ptr_vector_clear(&rule_group->rules);
 
-    tmp.rule_group = rule_group;
-    tmp.fuzzy = fuzzy;
-    tmp.error = false;
-
-    if ((error = sml_rule_group_rule_generate(fuzzy, rule_group,
-            weight_threshold, output_number, _rule_append, &tmp)))
+    if ((error = _rule_group_output_weights_get(fuzzy, rule_group,
+            &output_weights)))
         return error;
 
-    if (tmp.error)
-        return SML_INTERNAL_ERROR;
-    return 0;
+    obs_group = sol_ptr_vector_get(&rule_group->observations, 0);
+    error = sml_observation_group_rule_add(fuzzy, obs_group, weight_threshold,
+        &rule_group->relevant_inputs, output_weights, output_number,
+        &rule_group->rules);
+    free(output_weights);
+    return error;
 }
 
 static int
@@ -447,54 +460,21 @@ sml_rule_group_rule_generate(struct sml_fuzzy *fuzzy,
     sml_process_str_cb process_cb, void *data)
 {
     struct sml_observation_group *obs_group;
-    struct sml_variable *var;
-    uint16_t *output_weights, len;
-    float *output_weights_float;
-    uint16_t c;
-    uint16_t i, j, index;
-    int error = 0;
-
-    output_weights = calloc(fuzzy->output_terms_count, sizeof(uint16_t));
-    if (!output_weights)
-        return -errno;
-
-    SOL_PTR_VECTOR_FOREACH_IDX (&rule_group->observations, obs_group, c)
-        sml_observation_group_fill_output_weights(fuzzy, obs_group,
-            output_weights);
-
-    output_weights_float = calloc(fuzzy->output_terms_count, sizeof(float));
-    if (!output_weights_float) {
-        error = -errno;
-        goto rule_generate_end;
-    }
-
-    index = 0;
-    len = sml_fuzzy_variables_list_get_length(fuzzy->output_list);
-    for (i = 0; i < len; i++) {
-        var = sml_fuzzy_variables_list_index(fuzzy->output_list, i);
-        uint16_t terms_len = sml_fuzzy_variable_terms_count(var);
-        uint16_t total_weight = 0;
-        for (j = 0; j < terms_len; j++)
-            total_weight += output_weights[index + j];
+    float *output_weights;
+    int error;
 
-        for (j = 0; j < terms_len; j++) {
-            output_weights_float[index] = output_weights[index] /
-                (float)total_weight;
-            index++;
-        }
-    }
+    if ((error = _rule_group_output_weights_get(fuzzy, rule_group,
+            &output_weights)))
+        return error;
 
     obs_group = sol_ptr_vector_get(&rule_group->observations, 0);
     sml_observation_group_rule_generate(fuzzy, obs_group, weight_threshold,
         &rule_group->relevant_inputs,
-        output_weights_float,
+        output_weights,
         output_number,
         process_cb, data);
-    free(output_weights_float);
-
-rule_generate_end:
     free(output_weights);
-    return error;
+    return 0;
 }
 
 int
@@ -32,28 +32,130 @@
 typedef struct _Variable {
     char *name;
     bool enabled;
-    float min, max, val;
+    float min, max;
+    /* Points to val_storage, or into the buffer bound to its list */
+    float *val;
+    float val_storage;
 } Variable;
 
 struct sml_naive_engine {
     struct sml_engine engine;
     struct sol_ptr_vector input_list;
     struct sol_ptr_vector output_list;
+    float *input_values;
+    float *output_values;
 };
 
 static int
 _sml_process(struct sml_engine *engine)
 {
-    if (!engine->read_state_cb) {
-        sml_critical("There is not read callback registered");
+    /* Timed like the other engines, so their stats can be compared */
+    return sml_call_read_state_cb(engine);
+}
+
+static void
+_set_values(struct sol_ptr_vector *list, const float *values)
+{
+    Variable *var;
+    uint16_t i;
+
+    SOL_PTR_VECTOR_FOREACH_IDX (list, var, i)
+        *var->val = values[i];
+}
+
+static float **
+_bound_values(struct sml_naive_engine *naive_engine,
+    struct sml_variables_list *list)
+{
+    if (list == (struct sml_variables_list *)&naive_engine->input_list)
+        return &naive_engine->input_values;
+    if (list == (struct sml_variables_list *)&naive_engine->output_list)
+        return &naive_engine->output_values;
+    return NULL;
+}
+
+static void
+_unbind_values(struct sml_naive_engine *naive_engine,
+    struct sol_ptr_vector *list)
+{
+    float **bound = _bound_values(naive_engine,
+        (struct sml_variables_list *)list);
+    Variable *var;
+    uint16_t i;
+
+    if (!bound || !*bound)
+        return;
+
+    SOL_PTR_VECTOR_FOREACH_IDX (list, var, i) {
+        var->val_storage = *var->val;
+        var->val = &var->val_storage;
+    }
+    *bound = NULL;
+}
+
+static int
+_sml_variables_list_set_values(struct sml_engine *engine,
+    struct sml_variables_list *list, const float *values)
+{
+    _set_values((struct sol_ptr_vector *)list, values);
+    return 0;
+}
+
+static int
+_sml_variables_list_get_values(struct sml_engine *engine,
+    struct sml_variables_list *list, float *values)
+{
+    Variable *var;
+    uint16_t i;
+
+    SOL_PTR_VECTOR_FOREACH_IDX ((struct sol_ptr_vector *)list, var, i)
+        values[i] = *var->val;
+    return 0;
+}
+
+static int
+_sml_variables_list_bind_values(struct sml_engine *engine,
+    struct sml_variables_list *list, float *values)
+{
+    struct sml_naive_engine *naive_engine = (struct sml_naive_engine *)engine;
+    float **bound = _bound_values(naive_engine, list);
+    Variable *var;
+    uint16_t i;
+
+    if (!bound) {
+        sml_warning("Only the engine input and output lists can be bound");
         return -EINVAL;
     }
 
-    if (!engine->read_state_cb((struct sml_object *)engine,
-        engine->read_state_cb_data)) {
-        sml_debug("Read cb returned false");
-        return -EAGAIN;
+    _unbind_values(naive_engine, (struct sol_ptr_vector *)list);
+    if (!values)
+        return 0;
+
+    SOL_PTR_VECTOR_FOREACH_IDX ((struct sol_ptr_vector *)list, var, i) {
+        values[i] = *var->val;
+        var->val = &values[i];
     }
+    *bound = values;
+    return 0;
+}
+
+static int
+_sml_process_batch(struct sml_engine *engine, const float *inputs,
+    const float *outputs, size_t rows, size_t stride)
+{
+    struct sml_naive_engine *naive_engine = (struct sml_naive_engine *)engine;
+    size_t in_stride, out_stride;
+
+    /* Naive engine doesn't learn, only the last row is kept */
+    in_stride = stride ? stride :
+        sol_ptr_vector_get_len(&naive_engine->input_list);
+    out_stride = stride ? stride :
+        sol_ptr_vector_get_len(&naive_engine->output_list);
+
+    _set_values(&naive_engine->input_list, inputs + (rows - 1) * in_stride);
+    if (outputs)
+        _set_values(&naive_engine->output_list,
+            outputs + (rows - 1) * out_stride);
     return 0;
 }
 
@@ -105,7 +207,7 @@ _print_list(struct sol_ptr_vector *list)
     Variable *var;
 
     SOL_PTR_VECTOR_FOREACH_IDX (list, var, i)
-        sml_debug("\t%s: %f (%f - %f)", var->name, var->val, var->min,
+        sml_debug("\t%s: %f (%f - %f)", var->name, *var->val, var->min,
             var->max);
 }
 
@@ -149,6 +251,7 @@ _sml_remove_variable(struct sml_engine *engine, struct sml_variable *variable)
 
     SOL_PTR_VECTOR_FOREACH_IDX (&naive_engine->input_list, var, i)
         if ((struct sml_variable *)var == variable) {
+            _unbind_values(naive_engine, &naive_engine->input_list);
             if (sol_ptr_vector_del(&naive_engine->input_list, i)) {
                 sml_critical("Could not remove input variable");
                 return false;
@@ -158,6 +261,7 @@ _sml_remove_variable(struct sml_engine *engine, struct sml_variable *variable)
 
     SOL_PTR_VECTOR_FOREACH_IDX (&naive_engine->output_list, var, i)
         if ((struct sml_variable *)var == variable) {
+            _unbind_values(naive_engine, &naive_engine->output_list);
             if (sol_ptr_vector_del(&naive_engine->output_list, i)) {
                 sml_critical("Could not remove output variable");
                 return false;
@@ -222,7 +326,8 @@ _create_var(const char *name)
     var->enabled = true;
     var->min = NAN;
     var->max = NAN;
-    var->val = NAN;
+    var->val_storage = NAN;
+    var->val = &var->val_storage;
 
     return var;
 }
@@ -236,6 +341,7 @@ _sml_new_input(struct sml_engine *engine, const char *name)
     if (!var)
         return NULL;
 
+    _unbind_values(naive_engine, &naive_engine->input_list);
     if (sol_ptr_vector_append(&naive_engine->input_list, var)) {
         free(var);
         return NULL;
@@ -253,6 +359,7 @@ _sml_new_output(struct sml_engine *engine, const char *name)
     if (!var)
         return NULL;
 
+    _unbind_values(naive_engine, &naive_engine->output_list);
     if (sol_ptr_vector_append(&naive_engine->output_list, var)) {
         free(var);
         return NULL;
@@ -288,7 +395,7 @@ _sml_variable_get_value(struct sml_variable *sml_variable)
 {
     Variable *var = (Variable *)sml_variable;
 
-    return var->val;
+    return *var->val;
 }
 
 static bool
@@ -296,7 +403,7 @@ _sml_variable_set_value(struct sml_variable *sml_variable, float val)
 {
     Variable *var = (Variable *)sml_variable;
 
-    var->val = val;
+    *var->val = val;
     return true;
 }
 
@@ -362,6 +469,7 @@ sml_naive_new(void)
 
     naive_engine->engine.free = _sml_free;
     naive_engine->engine.process = _sml_process;
+    naive_engine->engine.process_batch = _sml_process_batch;
     naive_engine->engine.predict = _sml_predict;
     naive_engine->engine.save = _sml_save;
     naive_engine->engine.load = _sml_load;
@@ -380,6 +488,12 @@ sml_naive_new(void)
     naive_engine->engine.variables_list_get_length =
         _sml_variables_list_get_length;
     naive_engine->engine.variables_list_index = _variables_list_index;
+    naive_engine->engine.variables_list_set_values =
+        _sml_variables_list_set_values;
+    naive_engine->engine.variables_list_get_values =
+        _sml_variables_list_get_values;
+    naive_engine->engine.variables_list_bind_values =
+        _sml_variables_list_bind_values;
     naive_engine->engine.variable_set_range = _sml_variable_set_range;
     naive_engine->engine.variable_get_range = _sml_variable_get_range;
     naive_engine->engine.print_debug = _sml_print_debug;